@@ -0,0 +1,91 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_GRAPH_MAX_STAGES 12
+#define BOOT_GRAPH_DEFAULT_STACK 4096
+#define BOOT_GRAPH_STAGE_BIT(index) (1u << (index))  ///< Dependency on the stage at index
+
+typedef esp_err_t (*boot_stage_fn_t)(void *arg);
+
+/**
+ * @brief One init step and the stages it has to wait for
+ */
+typedef struct {
+    const char *name;
+    boot_stage_fn_t fn;
+    void *arg;
+    uint32_t deps;        ///< BOOT_GRAPH_STAGE_BIT() of earlier stages in the same array
+    uint32_t stack_size;  ///< Worker task stack, 0 for BOOT_GRAPH_DEFAULT_STACK
+    bool optional;        ///< A failure only skips dependents instead of failing the boot
+    bool ready;           ///< Completing this stage means the teapot is controllable
+} boot_stage_t;
+
+typedef enum {
+    BOOT_STAGE_PENDING = 0,
+    BOOT_STAGE_RUNNING,
+    BOOT_STAGE_DONE,
+    BOOT_STAGE_FAILED,
+    BOOT_STAGE_SKIPPED     ///< A dependency failed or was skipped
+} boot_stage_status_t;
+
+/**
+ * @brief Outcome of one stage; times are esp_timer_get_time(), i.e. microseconds since reset
+ */
+typedef struct {
+    const char *name;
+    boot_stage_status_t status;
+    esp_err_t result;
+    uint32_t deps;
+    int64_t start_us;
+    int64_t end_us;
+} boot_stage_record_t;
+
+/**
+ * @brief Run the stages, each in its own task as soon as its dependencies are done
+ *
+ * Stages without a path between them overlap, e.g. sensor enumeration with the WiFi
+ * start. Dependencies must point to earlier entries, which rules out cycles. Blocks
+ * until every stage has finished or been skipped; the records of the last run are kept
+ * for boot_graph_get_record() and boot_graph_render_json().
+ *
+ * @param stages Stage table, must stay valid until the call returns
+ * @param count Number of stages, up to BOOT_GRAPH_MAX_STAGES
+ * @return ESP_OK if every non-optional stage succeeded, otherwise the error of the first
+ *         failed non-optional stage (ESP_ERR_INVALID_STATE if it was skipped, or if
+ *         another run is in progress)
+ */
+esp_err_t boot_graph_run(const boot_stage_t *stages, size_t count);
+
+/**
+ * @brief Get the record of a stage of the last run
+ * @param index Stage index
+ * @param record Output record
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such stage
+ */
+esp_err_t boot_graph_get_record(size_t index, boot_stage_record_t *record);
+
+/**
+ * @brief Render the last run as JSON, as served by GET /api/boot
+ *
+ * {"app_start_us":..,"ready_us":..,"done_us":..,"stages":[{"name":"relay","status":"done",
+ * "result":"ESP_OK","deps":["state"],"start_us":..,"end_us":..},...]}
+ * ready_us is the end of the stage flagged ready, -1 until it is done.
+ *
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @param len Length written, without the terminating NUL
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if buf is too small
+ */
+esp_err_t boot_graph_render_json(char *buf, size_t size, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
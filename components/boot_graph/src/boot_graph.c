@@ -0,0 +1,208 @@
+#include "boot_graph.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "BOOT";
+
+#define BOOT_TASK_PRIORITY 5
+
+static const boot_stage_t *g_stages;
+static boot_stage_record_t g_records[BOOT_GRAPH_MAX_STAGES];
+static size_t g_count = 0;
+static int g_ready_index = -1;
+static int64_t g_app_start_us = 0;
+static bool g_running = false;
+// Bit i: stage i finished, whatever the outcome. Never deleted, so a worker still
+// returning from xEventGroupSetBits() cannot touch a freed group.
+static StaticEventGroup_t g_done_buf;
+static EventGroupHandle_t g_done = NULL;
+
+static void stage_task(void *arg) {
+    size_t index = (size_t)arg;
+    const boot_stage_t *stage = &g_stages[index];
+    boot_stage_record_t *rec = &g_records[index];
+
+    if (stage->deps != 0) {
+        xEventGroupWaitBits(g_done, stage->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    // Records of dependencies were written before their bits were set
+    bool deps_ok = true;
+    for (size_t i = 0; i < g_count; i++) {
+        if ((stage->deps & BOOT_GRAPH_STAGE_BIT(i)) && g_records[i].status != BOOT_STAGE_DONE) {
+            deps_ok = false;
+        }
+    }
+
+    rec->start_us = esp_timer_get_time();
+    if (deps_ok) {
+        rec->status = BOOT_STAGE_RUNNING;
+        rec->result = stage->fn(stage->arg);
+        rec->status = rec->result == ESP_OK ? BOOT_STAGE_DONE : BOOT_STAGE_FAILED;
+    } else {
+        rec->result = ESP_ERR_INVALID_STATE;
+        rec->status = BOOT_STAGE_SKIPPED;
+    }
+    rec->end_us = esp_timer_get_time();
+
+    if (rec->status == BOOT_STAGE_DONE) {
+        ESP_LOGI(TAG, "%s: %" PRId64 " ms (done at %" PRId64 " ms)", stage->name,
+                 (rec->end_us - rec->start_us) / 1000, rec->end_us / 1000);
+    } else if (rec->status == BOOT_STAGE_FAILED) {
+        ESP_LOGW(TAG, "%s failed: %s", stage->name, esp_err_to_name(rec->result));
+    } else {
+        ESP_LOGW(TAG, "%s skipped, a dependency did not complete", stage->name);
+    }
+
+    xEventGroupSetBits(g_done, BOOT_GRAPH_STAGE_BIT(index));
+    vTaskDelete(NULL);
+}
+
+esp_err_t boot_graph_run(const boot_stage_t *stages, size_t count) {
+    if (stages == NULL || count == 0 || count > BOOT_GRAPH_MAX_STAGES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (g_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (size_t i = 0; i < count; i++) {
+        // Only backward edges: the graph cannot contain a cycle
+        if (stages[i].fn == NULL || (stages[i].deps >> i) != 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (g_done == NULL) {
+        g_done = xEventGroupCreateStatic(&g_done_buf);
+    }
+    xEventGroupClearBits(g_done, (EventBits_t)((1ull << BOOT_GRAPH_MAX_STAGES) - 1));
+    g_running = true;
+
+    g_app_start_us = esp_timer_get_time();
+    g_stages = stages;
+    g_count = count;
+    g_ready_index = -1;
+    memset(g_records, 0, sizeof(g_records));
+    for (size_t i = 0; i < count; i++) {
+        g_records[i].name = stages[i].name;
+        g_records[i].deps = stages[i].deps;
+        if (stages[i].ready) {
+            g_ready_index = (int)i;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t stack = stages[i].stack_size != 0 ? stages[i].stack_size : BOOT_GRAPH_DEFAULT_STACK;
+        if (xTaskCreate(stage_task, stages[i].name, stack, (void *)i, BOOT_TASK_PRIORITY, NULL) != pdPASS) {
+            // Let the stages already waiting on this one finish as skipped
+            g_records[i].status = BOOT_STAGE_FAILED;
+            g_records[i].result = ESP_ERR_NO_MEM;
+            xEventGroupSetBits(g_done, BOOT_GRAPH_STAGE_BIT(i));
+        }
+    }
+
+    uint32_t all = (uint32_t)((1ull << count) - 1);
+    xEventGroupWaitBits(g_done, all, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < count && ret == ESP_OK; i++) {
+        if (!stages[i].optional && g_records[i].status != BOOT_STAGE_DONE) {
+            ret = g_records[i].result;
+        }
+    }
+    g_stages = NULL;
+    g_running = false;
+    return ret;
+}
+
+esp_err_t boot_graph_get_record(size_t index, boot_stage_record_t *record) {
+    if (record == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (index >= g_count) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *record = g_records[index];
+    return ESP_OK;
+}
+
+// snprintf into the remaining space; returns false once the output no longer fits
+__attribute__((format(printf, 4, 5)))
+static bool append(char *buf, size_t size, size_t *pos, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *pos, size - *pos, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size - *pos) {
+        return false;
+    }
+    *pos += (size_t)n;
+    return true;
+}
+
+static const char *status_name(boot_stage_status_t status) {
+    switch (status) {
+    case BOOT_STAGE_RUNNING: return "running";
+    case BOOT_STAGE_DONE: return "done";
+    case BOOT_STAGE_FAILED: return "failed";
+    case BOOT_STAGE_SKIPPED: return "skipped";
+    default: return "pending";
+    }
+}
+
+esp_err_t boot_graph_render_json(char *buf, size_t size, size_t *len) {
+    if (buf == NULL || len == NULL || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t ready_us = -1;
+    int64_t done_us = 0;
+    for (size_t i = 0; i < g_count; i++) {
+        if (g_records[i].end_us > done_us) {
+            done_us = g_records[i].end_us;
+        }
+    }
+    if (g_ready_index >= 0 && g_records[g_ready_index].status == BOOT_STAGE_DONE) {
+        ready_us = g_records[g_ready_index].end_us;
+    }
+
+    size_t pos = 0;
+    if (!append(buf, size, &pos, "{\"app_start_us\":%" PRId64 ",\"ready_us\":%" PRId64
+                ",\"done_us\":%" PRId64 ",\"stages\":[", g_app_start_us, ready_us, done_us)) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < g_count; i++) {
+        const boot_stage_record_t *rec = &g_records[i];
+        if (!append(buf, size, &pos, "%s{\"name\":\"%s\",\"status\":\"%s\",\"result\":\"%s\",\"deps\":[",
+                    i > 0 ? "," : "", rec->name, status_name(rec->status), esp_err_to_name(rec->result))) {
+            return ESP_ERR_NO_MEM;
+        }
+        bool first = true;
+        for (size_t d = 0; d < g_count; d++) {
+            if (rec->deps & BOOT_GRAPH_STAGE_BIT(d)) {
+                if (!append(buf, size, &pos, "%s\"%s\"", first ? "" : ",", g_records[d].name)) {
+                    return ESP_ERR_NO_MEM;
+                }
+                first = false;
+            }
+        }
+        if (!append(buf, size, &pos, "],\"start_us\":%" PRId64 ",\"end_us\":%" PRId64 "}",
+                    rec->start_us, rec->end_us)) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (!append(buf, size, &pos, "]}")) {
+        return ESP_ERR_NO_MEM;
+    }
+    *len = pos;
+    return ESP_OK;
+}
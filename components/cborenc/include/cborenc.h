@@ -0,0 +1,79 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Streaming CBOR encoder writing straight into a caller-provided buffer
+ *
+ * Items are appended in order; containers are written with a definite length
+ * up front, so no back-patching and no heap is needed. Running out of space
+ * sets a sticky overflow flag reported by cborenc_finish().
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} cborenc_t;
+
+/**
+ * @brief Start encoding into a buffer
+ * @param enc Encoder
+ * @param buf Output buffer
+ * @param size Size of the output buffer
+ */
+void cborenc_init(cborenc_t *enc, uint8_t *buf, size_t size);
+
+/**
+ * @brief Begin a map; must be followed by exactly pairs key/value items
+ */
+void cborenc_map(cborenc_t *enc, size_t pairs);
+
+/**
+ * @brief Begin an array; must be followed by exactly count items
+ */
+void cborenc_array(cborenc_t *enc, size_t count);
+
+void cborenc_uint(cborenc_t *enc, uint64_t value);
+void cborenc_int(cborenc_t *enc, int64_t value);
+void cborenc_bool(cborenc_t *enc, bool value);
+void cborenc_null(cborenc_t *enc);
+
+/**
+ * @brief Encode a single-precision float
+ */
+void cborenc_float(cborenc_t *enc, float value);
+
+/**
+ * @brief Encode a UTF-8 text string
+ */
+void cborenc_text(cborenc_t *enc, const char *str, size_t len);
+
+/**
+ * @brief Encode a NUL-terminated UTF-8 text string
+ */
+void cborenc_cstr(cborenc_t *enc, const char *str);
+
+/**
+ * @brief Encode a byte string
+ */
+void cborenc_bytes(cborenc_t *enc, const uint8_t *data, size_t len);
+
+/**
+ * @brief Finish encoding
+ * @param enc Encoder
+ * @param len Output: number of bytes written
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the buffer was too small
+ */
+esp_err_t cborenc_finish(const cborenc_t *enc, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,123 @@
+#include "cborenc.h"
+#include <string.h>
+
+#define CBOR_MAJOR_UINT   0
+#define CBOR_MAJOR_NINT   1
+#define CBOR_MAJOR_BYTES  2
+#define CBOR_MAJOR_TEXT   3
+#define CBOR_MAJOR_ARRAY  4
+#define CBOR_MAJOR_MAP    5
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_FALSE   0xF4
+#define CBOR_TRUE    0xF5
+#define CBOR_NULL    0xF6
+#define CBOR_FLOAT32 0xFA
+
+static void put(cborenc_t *enc, const void *data, size_t n) {
+    if (enc->overflow || enc->len + n > enc->size) {
+        enc->overflow = true;
+        return;
+    }
+    memcpy(enc->buf + enc->len, data, n);
+    enc->len += n;
+}
+
+// Initial byte plus the shortest big-endian argument that holds value
+static void put_head(cborenc_t *enc, uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    size_t n;
+    major <<= 5;
+
+    if (value < 24) {
+        head[0] = major | (uint8_t)value;
+        n = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = major | 24;
+        n = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = major | 25;
+        n = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = major | 26;
+        n = 5;
+    } else {
+        head[0] = major | 27;
+        n = 9;
+    }
+    for (size_t i = n - 1; i > 0; i--) {
+        head[i] = (uint8_t)value;
+        value >>= 8;
+    }
+    put(enc, head, n);
+}
+
+void cborenc_init(cborenc_t *enc, uint8_t *buf, size_t size) {
+    enc->buf = buf;
+    enc->size = size;
+    enc->len = 0;
+    enc->overflow = false;
+}
+
+void cborenc_map(cborenc_t *enc, size_t pairs) {
+    put_head(enc, CBOR_MAJOR_MAP, pairs);
+}
+
+void cborenc_array(cborenc_t *enc, size_t count) {
+    put_head(enc, CBOR_MAJOR_ARRAY, count);
+}
+
+void cborenc_uint(cborenc_t *enc, uint64_t value) {
+    put_head(enc, CBOR_MAJOR_UINT, value);
+}
+
+void cborenc_int(cborenc_t *enc, int64_t value) {
+    if (value >= 0) {
+        put_head(enc, CBOR_MAJOR_UINT, (uint64_t)value);
+    } else {
+        // Negative integers encode -1 - value, which cannot overflow
+        put_head(enc, CBOR_MAJOR_NINT, ~(uint64_t)value);
+    }
+}
+
+void cborenc_bool(cborenc_t *enc, bool value) {
+    uint8_t byte = value ? CBOR_TRUE : CBOR_FALSE;
+    put(enc, &byte, 1);
+}
+
+void cborenc_null(cborenc_t *enc) {
+    uint8_t byte = CBOR_NULL;
+    put(enc, &byte, 1);
+}
+
+void cborenc_float(cborenc_t *enc, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t out[5] = {
+        CBOR_FLOAT32,
+        (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits
+    };
+    put(enc, out, sizeof(out));
+}
+
+void cborenc_text(cborenc_t *enc, const char *str, size_t len) {
+    put_head(enc, CBOR_MAJOR_TEXT, len);
+    put(enc, str, len);
+}
+
+void cborenc_cstr(cborenc_t *enc, const char *str) {
+    cborenc_text(enc, str, strlen(str));
+}
+
+void cborenc_bytes(cborenc_t *enc, const uint8_t *data, size_t len) {
+    put_head(enc, CBOR_MAJOR_BYTES, len);
+    put(enc, data, len);
+}
+
+esp_err_t cborenc_finish(const cborenc_t *enc, size_t *len) {
+    if (enc->overflow) {
+        return ESP_ERR_NO_MEM;
+    }
+    *len = enc->len;
+    return ESP_OK;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define COAP_VERSION 1
+#define COAP_TOKEN_MAX_LEN 8
+#define COAP_MAX_OPTIONS 16
+
+/**
+ * @brief Message types (RFC 7252 section 3)
+ */
+typedef enum {
+    COAP_TYPE_CON = 0,
+    COAP_TYPE_NON = 1,
+    COAP_TYPE_ACK = 2,
+    COAP_TYPE_RST = 3
+} coap_type_t;
+
+/**
+ * @brief Build a code from its class and detail, e.g. COAP_CODE(2, 5) for 2.05 Content
+ */
+#define COAP_CODE(cls, detail) ((uint8_t)(((cls) << 5) | (detail)))
+#define COAP_CODE_CLASS(code) ((code) >> 5)
+
+#define COAP_CODE_EMPTY                  COAP_CODE(0, 0)
+#define COAP_METHOD_GET                  COAP_CODE(0, 1)
+#define COAP_METHOD_POST                 COAP_CODE(0, 2)
+#define COAP_METHOD_PUT                  COAP_CODE(0, 3)
+#define COAP_METHOD_PATCH                COAP_CODE(0, 6)
+#define COAP_CODE_CHANGED                COAP_CODE(2, 4)
+#define COAP_CODE_VALID                  COAP_CODE(2, 3)
+#define COAP_CODE_CONTENT                COAP_CODE(2, 5)
+#define COAP_CODE_BAD_REQUEST            COAP_CODE(4, 0)
+#define COAP_CODE_BAD_OPTION             COAP_CODE(4, 2)
+#define COAP_CODE_NOT_FOUND              COAP_CODE(4, 4)
+#define COAP_CODE_METHOD_NOT_ALLOWED     COAP_CODE(4, 5)
+#define COAP_CODE_NOT_ACCEPTABLE         COAP_CODE(4, 6)
+#define COAP_CODE_UNSUPPORTED_FORMAT     COAP_CODE(4, 15)
+#define COAP_CODE_INTERNAL_ERROR         COAP_CODE(5, 0)
+
+/**
+ * @brief Option numbers used by the server (RFC 7252, 7641, 7959)
+ */
+#define COAP_OPTION_URI_HOST       3
+#define COAP_OPTION_ETAG           4
+#define COAP_OPTION_OBSERVE        6
+#define COAP_OPTION_URI_PORT       7
+#define COAP_OPTION_URI_PATH       11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_URI_QUERY      15
+#define COAP_OPTION_ACCEPT         17
+#define COAP_OPTION_BLOCK2         23
+#define COAP_OPTION_SIZE2          28
+
+#define COAP_OPTION_IS_CRITICAL(number) (((number) & 1) != 0)
+
+/**
+ * @brief Content-Format identifiers
+ */
+#define COAP_FORMAT_TEXT       0
+#define COAP_FORMAT_LINK       40
+#define COAP_FORMAT_JSON       50
+#define COAP_FORMAT_CBOR       60
+
+/**
+ * @brief Option view pointing into the parsed datagram
+ */
+typedef struct {
+    uint16_t number;
+    uint16_t len;
+    const uint8_t *value;
+} coap_option_t;
+
+/**
+ * @brief Parsed message; all pointers refer to the original datagram
+ */
+typedef struct {
+    coap_type_t type;
+    uint8_t code;
+    uint16_t message_id;
+    uint8_t token_len;
+    uint8_t token[COAP_TOKEN_MAX_LEN];
+    size_t option_count;
+    coap_option_t options[COAP_MAX_OPTIONS];
+    const uint8_t *payload;
+    size_t payload_len;
+} coap_msg_t;
+
+/**
+ * @brief Parse a datagram
+ * @param buf Datagram
+ * @param len Length of the datagram
+ * @param msg Output message
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on a malformed message,
+ *         ESP_ERR_NO_MEM if it has more than COAP_MAX_OPTIONS options
+ */
+esp_err_t coap_msg_parse(const uint8_t *buf, size_t len, coap_msg_t *msg);
+
+/**
+ * @brief Find an option
+ * @param msg Parsed message
+ * @param number Option number
+ * @param after Index to continue from (0 for the first occurrence, previous result + 1 for the next)
+ * @return Index into msg->options, -1 if not present
+ */
+int coap_msg_find_option(const coap_msg_t *msg, uint16_t number, int after);
+
+/**
+ * @brief Decode an unsigned integer option value (0 to 4 bytes, big-endian)
+ */
+uint32_t coap_option_uint(const coap_option_t *option);
+
+/**
+ * @brief Message writer over a caller-provided buffer
+ *
+ * Options must be added in ascending number order. Running out of space sets
+ * a sticky overflow flag reported by coap_writer_finish().
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    uint16_t last_option;
+    bool overflow;
+    bool misordered;
+} coap_writer_t;
+
+/**
+ * @brief Write the message header and token
+ */
+void coap_writer_init(coap_writer_t *w, uint8_t *buf, size_t size, coap_type_t type, uint8_t code,
+                      uint16_t message_id, const uint8_t *token, uint8_t token_len);
+
+void coap_writer_option(coap_writer_t *w, uint16_t number, const void *value, size_t len);
+
+/**
+ * @brief Add an unsigned integer option using the shortest encoding
+ */
+void coap_writer_option_uint(coap_writer_t *w, uint16_t number, uint32_t value);
+
+/**
+ * @brief Append the payload marker and payload (nothing is written for an empty payload)
+ */
+void coap_writer_payload(coap_writer_t *w, const void *data, size_t len);
+
+/**
+ * @brief Finish the message
+ * @param w Writer
+ * @param len Output: message length
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the buffer was too small,
+ *         ESP_ERR_INVALID_STATE if options were added out of order
+ */
+esp_err_t coap_writer_finish(const coap_writer_t *w, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
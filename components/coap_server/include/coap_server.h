@@ -0,0 +1,34 @@
+#pragma once
+
+#include "esp_err.h"
+#include "wifi_web.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start the CoAP endpoint
+ *
+ * Serves the same state as the HTTP API over UDP:
+ *  - /state     GET (Observe, Block2, Accept json/cbor), PUT/POST/PATCH with a JSON update
+ *  - /power     PUT/POST "on"/"off"/"1"/"0"/"true"/"false" or {"is_on":bool}
+ *  - /setpoint  PUT/POST a number or {"setpoint_temp":number}
+ *  - /.well-known/core  resource discovery
+ *
+ * @param ctx Web server context owning the state
+ * @param port UDP port to listen on
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if already running, or an error code
+ */
+esp_err_t coap_server_start(wifi_web_ctx_t *ctx, uint16_t port);
+
+/**
+ * @brief Stop the CoAP endpoint and drop all observers
+ * @return ESP_OK on success
+ */
+esp_err_t coap_server_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,211 @@
+#include "coap_msg.h"
+#include <string.h>
+
+#define COAP_HEADER_LEN 4
+#define COAP_PAYLOAD_MARKER 0xFF
+#define COAP_OPTION_EXT8 13
+#define COAP_OPTION_EXT16 14
+#define COAP_OPTION_EXT8_BASE 13
+#define COAP_OPTION_EXT16_BASE 269
+
+// Decode a delta or length nibble with its extended bytes
+static esp_err_t read_option_field(uint8_t nibble, const uint8_t **pos, const uint8_t *end, uint32_t *value) {
+    if (nibble < COAP_OPTION_EXT8) {
+        *value = nibble;
+    } else if (nibble == COAP_OPTION_EXT8) {
+        if (end - *pos < 1) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        *value = **pos + COAP_OPTION_EXT8_BASE;
+        *pos += 1;
+    } else if (nibble == COAP_OPTION_EXT16) {
+        if (end - *pos < 2) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        *value = ((uint32_t)(*pos)[0] << 8 | (*pos)[1]) + COAP_OPTION_EXT16_BASE;
+        *pos += 2;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t coap_msg_parse(const uint8_t *buf, size_t len, coap_msg_t *msg) {
+    if (buf == NULL || msg == NULL || len < COAP_HEADER_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(msg, 0, sizeof(*msg));
+    if ((buf[0] >> 6) != COAP_VERSION) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    msg->type = (coap_type_t)((buf[0] >> 4) & 0x03);
+    msg->token_len = buf[0] & 0x0F;
+    msg->code = buf[1];
+    msg->message_id = (uint16_t)(buf[2] << 8 | buf[3]);
+
+    if (msg->token_len > COAP_TOKEN_MAX_LEN || len < (size_t)COAP_HEADER_LEN + msg->token_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(msg->token, buf + COAP_HEADER_LEN, msg->token_len);
+
+    // An empty message is exactly the header
+    if (msg->code == COAP_CODE_EMPTY && (len != COAP_HEADER_LEN || msg->token_len != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uint8_t *pos = buf + COAP_HEADER_LEN + msg->token_len;
+    const uint8_t *end = buf + len;
+    uint32_t number = 0;
+    while (pos < end) {
+        if (*pos == COAP_PAYLOAD_MARKER) {
+            pos++;
+            // A marker followed by nothing is a format error
+            if (pos == end) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            msg->payload = pos;
+            msg->payload_len = end - pos;
+            break;
+        }
+
+        uint8_t header = *pos++;
+        uint32_t delta;
+        uint32_t option_len;
+        if (read_option_field(header >> 4, &pos, end, &delta) != ESP_OK ||
+            read_option_field(header & 0x0F, &pos, end, &option_len) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        number += delta;
+        if (number > UINT16_MAX || option_len > (uint32_t)(end - pos)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (msg->option_count == COAP_MAX_OPTIONS) {
+            return ESP_ERR_NO_MEM;
+        }
+
+        coap_option_t *option = &msg->options[msg->option_count++];
+        option->number = (uint16_t)number;
+        option->len = (uint16_t)option_len;
+        option->value = pos;
+        pos += option_len;
+    }
+    return ESP_OK;
+}
+
+int coap_msg_find_option(const coap_msg_t *msg, uint16_t number, int after) {
+    for (size_t i = after < 0 ? 0 : (size_t)after; i < msg->option_count; i++) {
+        if (msg->options[i].number == number) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+uint32_t coap_option_uint(const coap_option_t *option) {
+    uint32_t value = 0;
+    for (uint16_t i = 0; i < option->len && i < 4; i++) {
+        value = value << 8 | option->value[i];
+    }
+    return value;
+}
+
+static void put(coap_writer_t *w, const void *data, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    if (w->overflow || w->len + n > w->size) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+}
+
+void coap_writer_init(coap_writer_t *w, uint8_t *buf, size_t size, coap_type_t type, uint8_t code,
+                      uint16_t message_id, const uint8_t *token, uint8_t token_len) {
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->last_option = 0;
+    w->overflow = token_len > COAP_TOKEN_MAX_LEN;
+    w->misordered = false;
+
+    uint8_t header[COAP_HEADER_LEN] = {
+        (uint8_t)(COAP_VERSION << 6 | (type & 0x03) << 4 | (token_len & 0x0F)),
+        code,
+        (uint8_t)(message_id >> 8),
+        (uint8_t)message_id
+    };
+    put(w, header, sizeof(header));
+    put(w, token, token_len);
+}
+
+// Nibble for a delta/length and the extended bytes that follow the option header
+static uint8_t encode_option_field(uint32_t value, uint8_t *ext, size_t *ext_len) {
+    if (value < COAP_OPTION_EXT8_BASE) {
+        *ext_len = 0;
+        return (uint8_t)value;
+    }
+    if (value < COAP_OPTION_EXT16_BASE) {
+        ext[0] = (uint8_t)(value - COAP_OPTION_EXT8_BASE);
+        *ext_len = 1;
+        return COAP_OPTION_EXT8;
+    }
+    value -= COAP_OPTION_EXT16_BASE;
+    ext[0] = (uint8_t)(value >> 8);
+    ext[1] = (uint8_t)value;
+    *ext_len = 2;
+    return COAP_OPTION_EXT16;
+}
+
+void coap_writer_option(coap_writer_t *w, uint16_t number, const void *value, size_t len) {
+    if (number < w->last_option) {
+        w->misordered = true;
+        return;
+    }
+
+    uint8_t header[5];
+    size_t delta_len;
+    size_t len_len;
+    uint8_t delta_nibble = encode_option_field(number - w->last_option, header + 1, &delta_len);
+    uint8_t len_nibble = encode_option_field((uint32_t)len, header + 1 + delta_len, &len_len);
+    header[0] = (uint8_t)(delta_nibble << 4 | len_nibble);
+
+    put(w, header, 1 + delta_len + len_len);
+    put(w, value, len);
+    w->last_option = number;
+}
+
+void coap_writer_option_uint(coap_writer_t *w, uint16_t number, uint32_t value) {
+    uint8_t bytes[4];
+    size_t len = 0;
+    // Leading zero bytes are dropped; zero itself is the empty value
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        uint8_t byte = (uint8_t)(value >> shift);
+        if (len > 0 || byte != 0) {
+            bytes[len++] = byte;
+        }
+    }
+    coap_writer_option(w, number, bytes, len);
+}
+
+void coap_writer_payload(coap_writer_t *w, const void *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    uint8_t marker = COAP_PAYLOAD_MARKER;
+    put(w, &marker, 1);
+    put(w, data, len);
+}
+
+esp_err_t coap_writer_finish(const coap_writer_t *w, size_t *len) {
+    if (w->misordered) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (w->overflow) {
+        return ESP_ERR_NO_MEM;
+    }
+    *len = w->len;
+    return ESP_OK;
+}
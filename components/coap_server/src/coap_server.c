@@ -0,0 +1,630 @@
+#include "coap_server.h"
+#include "coap_msg.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+static const char *TAG = "COAP";
+
+#define COAP_BUF_SIZE 320
+#define COAP_PAYLOAD_MAX 256
+#define COAP_BLOCK_SZX_MAX 4            // 256-byte blocks, the largest that fits COAP_BUF_SIZE
+#define COAP_PATH_MAX 32
+#define COAP_ETAG_LEN 5                 // State version plus representation
+#define COAP_MAX_OBSERVERS 4
+#define COAP_OBSERVE_SEQ_MASK 0xFFFFFFu // Observe values are 24 bits
+#define COAP_OBSERVE_CON_INTERVAL 16    // Every Nth notification is confirmable to detect gone clients
+#define COAP_IDLE_POLL_MS 1000          // Bounds coap_server_stop() latency while nobody observes
+#define COAP_OBSERVE_POLL_MS 50         // Notification latency while observers are registered
+#define COAP_TASK_STACK 4096
+#define COAP_TASK_PRIORITY 5
+
+typedef struct {
+    bool active;
+    struct sockaddr_in addr;
+    uint8_t token[COAP_TOKEN_MAX_LEN];
+    uint8_t token_len;
+    uint16_t content_format;
+    uint32_t version;     // State version last sent
+    uint32_t seq;         // Observe sequence number
+    uint32_t sent;        // Notifications sent, selects the confirmable ones
+    uint16_t last_mid;    // Message ID of the last notification, matched against RST
+    bool awaiting_ack;    // The last confirmable notification has not been acknowledged yet
+    uint16_t con_mid;
+} coap_observer_t;
+
+typedef struct {
+    uint8_t code;
+    int content_format;   // -1 when the response has no payload
+    const uint8_t *payload;
+    size_t payload_len;
+    bool has_etag;
+    uint8_t etag[COAP_ETAG_LEN];
+    bool observe;
+    uint32_t observe_seq;
+} coap_response_t;
+
+// Everything below is owned by the server task; only notify_pending and running are shared
+static struct {
+    wifi_web_ctx_t *ctx;
+    int sock;
+    TaskHandle_t task;
+    bool running;
+    bool notify_pending;
+    bool listener_added;
+    uint16_t next_mid;
+    coap_observer_t observers[COAP_MAX_OBSERVERS];
+    uint8_t rx[COAP_BUF_SIZE];
+    uint8_t tx[COAP_BUF_SIZE];
+    uint8_t payload[COAP_PAYLOAD_MAX];
+} g_coap = { .sock = -1 };
+
+static const char WELL_KNOWN_CORE[] =
+    "</state>;rt=\"teapot.state\";ct=\"50 60\";obs,"
+    "</power>;rt=\"teapot.power\";ct=\"0 50\","
+    "</setpoint>;rt=\"teapot.setpoint\";ct=\"0 50\"";
+
+static bool same_endpoint(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static void send_datagram(const struct sockaddr_in *to, size_t len) {
+    sendto(g_coap.sock, g_coap.tx, len, 0, (const struct sockaddr *)to, sizeof(*to));
+}
+
+static void send_empty(coap_type_t type, uint16_t message_id, const struct sockaddr_in *to) {
+    coap_writer_t w;
+    size_t len;
+    coap_writer_init(&w, g_coap.tx, sizeof(g_coap.tx), type, COAP_CODE_EMPTY, message_id, NULL, 0);
+    if (coap_writer_finish(&w, &len) == ESP_OK) {
+        send_datagram(to, len);
+    }
+}
+
+static bool get_path(const coap_msg_t *msg, char *path, size_t size) {
+    size_t len = 0;
+    for (int i = coap_msg_find_option(msg, COAP_OPTION_URI_PATH, 0); i >= 0;
+         i = coap_msg_find_option(msg, COAP_OPTION_URI_PATH, i + 1)) {
+        const coap_option_t *segment = &msg->options[i];
+        if (len + 1 + segment->len >= size) {
+            return false;
+        }
+        if (len > 0) {
+            path[len++] = '/';
+        }
+        memcpy(path + len, segment->value, segment->len);
+        len += segment->len;
+    }
+    path[len] = '\0';
+    return true;
+}
+
+static int request_content_format(const coap_msg_t *msg) {
+    int index = coap_msg_find_option(msg, COAP_OPTION_CONTENT_FORMAT, 0);
+    return index < 0 ? -1 : (int)coap_option_uint(&msg->options[index]);
+}
+
+// Content-Format to answer with, -1 if the Accept option asks for something we cannot produce
+static int negotiate_format(const coap_msg_t *msg) {
+    int index = coap_msg_find_option(msg, COAP_OPTION_ACCEPT, 0);
+    if (index < 0) {
+        return COAP_FORMAT_JSON;
+    }
+    uint32_t accept = coap_option_uint(&msg->options[index]);
+    return accept == COAP_FORMAT_JSON || accept == COAP_FORMAT_CBOR ? (int)accept : -1;
+}
+
+// Render the shared state representation into the payload buffer
+static bool render_state(uint16_t content_format, coap_response_t *resp, uint32_t *version) {
+    wifi_web_format_t format = content_format == COAP_FORMAT_CBOR ? WIFI_WEB_FORMAT_CBOR : WIFI_WEB_FORMAT_JSON;
+    size_t len;
+    if (wifi_web_render_state(g_coap.ctx, format, g_coap.payload, sizeof(g_coap.payload), &len, version) != ESP_OK) {
+        return false;
+    }
+
+    resp->payload = g_coap.payload;
+    resp->payload_len = len;
+    resp->content_format = content_format;
+    resp->has_etag = true;
+    resp->etag[0] = (uint8_t)(*version >> 24);
+    resp->etag[1] = (uint8_t)(*version >> 16);
+    resp->etag[2] = (uint8_t)(*version >> 8);
+    resp->etag[3] = (uint8_t)*version;
+    resp->etag[4] = (uint8_t)format;
+    return true;
+}
+
+static void send_response(const coap_msg_t *req, const struct sockaddr_in *to, const coap_response_t *response) {
+    coap_response_t resp = *response;
+    coap_type_t type = req->type == COAP_TYPE_CON ? COAP_TYPE_ACK : COAP_TYPE_NON;
+    uint16_t message_id = type == COAP_TYPE_ACK ? req->message_id : g_coap.next_mid++;
+
+    // Block2: serve one slice when the client asked for a block or the body does not fit one
+    uint32_t szx = COAP_BLOCK_SZX_MAX;
+    uint32_t num = 0;
+    bool block = false;
+    int index = coap_msg_find_option(req, COAP_OPTION_BLOCK2, 0);
+    if (index >= 0) {
+        uint32_t value = coap_option_uint(&req->options[index]);
+        num = value >> 4;
+        szx = (value & 0x07) < szx ? (value & 0x07) : szx;
+        block = true;
+    }
+    size_t block_size = (size_t)1 << (szx + 4);
+    size_t total = resp.payload_len;
+    bool more = false;
+    if (COAP_CODE_CLASS(resp.code) == 2 && resp.payload != NULL && (block || total > block_size)) {
+        block = true;
+        size_t offset = (size_t)num * block_size;
+        if (offset > 0 && offset >= total) {
+            resp = (coap_response_t){ .code = COAP_CODE_BAD_OPTION, .content_format = -1 };
+            block = false;
+        } else {
+            resp.payload += offset;
+            resp.payload_len = total - offset < block_size ? total - offset : block_size;
+            more = offset + resp.payload_len < total;
+        }
+    } else {
+        block = false;
+    }
+
+    coap_writer_t w;
+    coap_writer_init(&w, g_coap.tx, sizeof(g_coap.tx), type, resp.code, message_id, req->token, req->token_len);
+    if (resp.has_etag) {
+        coap_writer_option(&w, COAP_OPTION_ETAG, resp.etag, sizeof(resp.etag));
+    }
+    if (resp.observe) {
+        coap_writer_option_uint(&w, COAP_OPTION_OBSERVE, resp.observe_seq);
+    }
+    if (resp.content_format >= 0) {
+        coap_writer_option_uint(&w, COAP_OPTION_CONTENT_FORMAT, (uint32_t)resp.content_format);
+    }
+    if (block) {
+        coap_writer_option_uint(&w, COAP_OPTION_BLOCK2, num << 4 | (more ? 0x08 : 0) | szx);
+        if (num == 0) {
+            coap_writer_option_uint(&w, COAP_OPTION_SIZE2, (uint32_t)total);
+        }
+    }
+    coap_writer_payload(&w, resp.payload, resp.payload_len);
+
+    size_t len;
+    if (coap_writer_finish(&w, &len) == ESP_OK) {
+        send_datagram(to, len);
+    } else {
+        ESP_LOGW(TAG, "Response does not fit the datagram buffer");
+    }
+}
+
+static coap_observer_t *observe_register(const coap_msg_t *req, const struct sockaddr_in *from,
+                                         uint16_t content_format, uint32_t version) {
+    coap_observer_t *slot = NULL;
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        coap_observer_t *obs = &g_coap.observers[i];
+        // Same endpoint and token is a re-registration and keeps its sequence
+        if (obs->active && same_endpoint(&obs->addr, from) && obs->token_len == req->token_len &&
+            memcmp(obs->token, req->token, req->token_len) == 0) {
+            slot = obs;
+            break;
+        }
+        if (!obs->active && slot == NULL) {
+            slot = obs;
+        }
+    }
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    if (!slot->active) {
+        memset(slot, 0, sizeof(*slot));
+        slot->addr = *from;
+        slot->token_len = req->token_len;
+        memcpy(slot->token, req->token, req->token_len);
+        slot->active = true;
+    }
+    slot->content_format = content_format;
+    slot->version = version;
+    slot->seq = (slot->seq + 1) & COAP_OBSERVE_SEQ_MASK;
+    return slot;
+}
+
+static void observe_deregister(const coap_msg_t *req, const struct sockaddr_in *from) {
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        coap_observer_t *obs = &g_coap.observers[i];
+        if (obs->active && same_endpoint(&obs->addr, from) && obs->token_len == req->token_len &&
+            memcmp(obs->token, req->token, req->token_len) == 0) {
+            obs->active = false;
+        }
+    }
+}
+
+// ACK or RST to one of our notifications
+static void observe_handle_reply(const coap_msg_t *msg, const struct sockaddr_in *from) {
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        coap_observer_t *obs = &g_coap.observers[i];
+        if (!obs->active || !same_endpoint(&obs->addr, from)) {
+            continue;
+        }
+        if (msg->type == COAP_TYPE_RST && (msg->message_id == obs->last_mid || msg->message_id == obs->con_mid)) {
+            obs->active = false;
+        } else if (msg->type == COAP_TYPE_ACK && obs->awaiting_ack && msg->message_id == obs->con_mid) {
+            obs->awaiting_ack = false;
+        }
+    }
+}
+
+static bool has_observers(void) {
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        if (g_coap.observers[i].active) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void notify_observers(void) {
+    for (int i = 0; i < COAP_MAX_OBSERVERS; i++) {
+        coap_observer_t *obs = &g_coap.observers[i];
+        if (!obs->active) {
+            continue;
+        }
+
+        coap_response_t resp = { .code = COAP_CODE_CONTENT, .content_format = -1 };
+        uint32_t version;
+        if (!render_state(obs->content_format, &resp, &version) || version == obs->version) {
+            continue;
+        }
+
+        // No retransmissions: an unacknowledged confirmable notification means the client is gone
+        bool confirmable = ++obs->sent % COAP_OBSERVE_CON_INTERVAL == 0;
+        if (confirmable && obs->awaiting_ack) {
+            ESP_LOGI(TAG, "Observer %d did not acknowledge, removing", i);
+            obs->active = false;
+            continue;
+        }
+
+        obs->version = version;
+        obs->seq = (obs->seq + 1) & COAP_OBSERVE_SEQ_MASK;
+        obs->last_mid = g_coap.next_mid++;
+        if (confirmable) {
+            obs->awaiting_ack = true;
+            obs->con_mid = obs->last_mid;
+        }
+
+        coap_writer_t w;
+        coap_writer_init(&w, g_coap.tx, sizeof(g_coap.tx), confirmable ? COAP_TYPE_CON : COAP_TYPE_NON,
+                         COAP_CODE_CONTENT, obs->last_mid, obs->token, obs->token_len);
+        coap_writer_option(&w, COAP_OPTION_ETAG, resp.etag, sizeof(resp.etag));
+        coap_writer_option_uint(&w, COAP_OPTION_OBSERVE, obs->seq);
+        coap_writer_option_uint(&w, COAP_OPTION_CONTENT_FORMAT, (uint32_t)resp.content_format);
+        coap_writer_payload(&w, resp.payload, resp.payload_len);
+
+        size_t len;
+        if (coap_writer_finish(&w, &len) == ESP_OK) {
+            send_datagram(&obs->addr, len);
+        }
+    }
+}
+
+static void apply_update(const coap_msg_t *req, const teapot_state_update_t *update, coap_response_t *resp) {
+    if (wifi_web_apply_update(g_coap.ctx, update) != ESP_OK) {
+        resp->code = COAP_CODE_BAD_REQUEST;
+        return;
+    }
+
+    // Like PATCH /api/state, the answer carries the resulting state
+    int format = negotiate_format(req);
+    uint32_t version;
+    resp->code = COAP_CODE_CHANGED;
+    render_state(format < 0 ? COAP_FORMAT_JSON : (uint16_t)format, resp, &version);
+}
+
+// JSON bodies are shared with the HTTP API; returns false if the body is not JSON at all
+static bool parse_json_update(const coap_msg_t *req, teapot_state_update_t *update, esp_err_t *ret) {
+    int format = request_content_format(req);
+    if (format != COAP_FORMAT_JSON && !(format < 0 && req->payload_len > 0 && req->payload[0] == '{')) {
+        return false;
+    }
+    *ret = wifi_web_parse_update((const char *)req->payload, req->payload_len, update);
+    return true;
+}
+
+static bool text_equals(const coap_msg_t *req, const char *text) {
+    size_t len = strlen(text);
+    return req->payload_len == len && strncasecmp((const char *)req->payload, text, len) == 0;
+}
+
+static void handle_state(const coap_msg_t *req, const struct sockaddr_in *from, coap_response_t *resp) {
+    if (req->code == COAP_METHOD_GET) {
+        int format = negotiate_format(req);
+        uint32_t version;
+        if (format < 0) {
+            resp->code = COAP_CODE_NOT_ACCEPTABLE;
+            return;
+        }
+        if (!render_state((uint16_t)format, resp, &version)) {
+            resp->code = COAP_CODE_INTERNAL_ERROR;
+            return;
+        }
+        resp->code = COAP_CODE_CONTENT;
+
+        int index = coap_msg_find_option(req, COAP_OPTION_OBSERVE, 0);
+        if (index >= 0) {
+            if (coap_option_uint(&req->options[index]) == 0) {
+                coap_observer_t *obs = observe_register(req, from, (uint16_t)format, version);
+                // A full table answers without Observe, which tells the client it is not registered
+                if (obs != NULL) {
+                    resp->observe = true;
+                    resp->observe_seq = obs->seq;
+                }
+            } else {
+                observe_deregister(req, from);
+            }
+        }
+
+        // The client already holds this representation: 2.03 Valid without a body
+        for (index = coap_msg_find_option(req, COAP_OPTION_ETAG, 0); index >= 0;
+             index = coap_msg_find_option(req, COAP_OPTION_ETAG, index + 1)) {
+            const coap_option_t *etag = &req->options[index];
+            if (etag->len == COAP_ETAG_LEN && memcmp(etag->value, resp->etag, COAP_ETAG_LEN) == 0) {
+                resp->code = COAP_CODE_VALID;
+                resp->payload = NULL;
+                resp->payload_len = 0;
+                resp->content_format = -1;
+                break;
+            }
+        }
+        return;
+    }
+
+    if (req->code != COAP_METHOD_PUT && req->code != COAP_METHOD_POST && req->code != COAP_METHOD_PATCH) {
+        resp->code = COAP_CODE_METHOD_NOT_ALLOWED;
+        return;
+    }
+
+    teapot_state_update_t update;
+    esp_err_t ret;
+    if (!parse_json_update(req, &update, &ret)) {
+        resp->code = COAP_CODE_UNSUPPORTED_FORMAT;
+        return;
+    }
+    if (ret != ESP_OK) {
+        resp->code = COAP_CODE_BAD_REQUEST;
+        return;
+    }
+    apply_update(req, &update, resp);
+}
+
+static void handle_power(const coap_msg_t *req, coap_response_t *resp) {
+    if (req->code != COAP_METHOD_PUT && req->code != COAP_METHOD_POST) {
+        resp->code = COAP_CODE_METHOD_NOT_ALLOWED;
+        return;
+    }
+
+    teapot_state_update_t update = { .fields = WIFI_WEB_UPDATE_IS_ON };
+    esp_err_t ret;
+    if (parse_json_update(req, &update, &ret)) {
+        if (ret != ESP_OK || update.fields != WIFI_WEB_UPDATE_IS_ON) {
+            resp->code = COAP_CODE_BAD_REQUEST;
+            return;
+        }
+    } else if (text_equals(req, "on") || text_equals(req, "1") || text_equals(req, "true")) {
+        update.is_on = true;
+    } else if (text_equals(req, "off") || text_equals(req, "0") || text_equals(req, "false")) {
+        update.is_on = false;
+    } else {
+        resp->code = COAP_CODE_BAD_REQUEST;
+        return;
+    }
+    apply_update(req, &update, resp);
+}
+
+static void handle_setpoint(const coap_msg_t *req, coap_response_t *resp) {
+    if (req->code != COAP_METHOD_PUT && req->code != COAP_METHOD_POST) {
+        resp->code = COAP_CODE_METHOD_NOT_ALLOWED;
+        return;
+    }
+
+    teapot_state_update_t update = { .fields = WIFI_WEB_UPDATE_SETPOINT };
+    esp_err_t ret;
+    if (parse_json_update(req, &update, &ret)) {
+        if (ret != ESP_OK || update.fields != WIFI_WEB_UPDATE_SETPOINT) {
+            resp->code = COAP_CODE_BAD_REQUEST;
+            return;
+        }
+    } else {
+        char text[16];
+        char *end;
+        if (req->payload_len == 0 || req->payload_len >= sizeof(text)) {
+            resp->code = COAP_CODE_BAD_REQUEST;
+            return;
+        }
+        memcpy(text, req->payload, req->payload_len);
+        text[req->payload_len] = '\0';
+        update.setpoint_temp = strtof(text, &end);
+        if (end == text || *end != '\0') {
+            resp->code = COAP_CODE_BAD_REQUEST;
+            return;
+        }
+    }
+    apply_update(req, &update, resp);
+}
+
+static void handle_request(const coap_msg_t *req, const struct sockaddr_in *from) {
+    coap_response_t resp = { .code = COAP_CODE_NOT_FOUND, .content_format = -1 };
+
+    // Unrecognized critical options must be rejected (RFC 7252 section 5.4.1)
+    for (size_t i = 0; i < req->option_count; i++) {
+        uint16_t number = req->options[i].number;
+        if (COAP_OPTION_IS_CRITICAL(number) && number != COAP_OPTION_URI_HOST && number != COAP_OPTION_URI_PORT &&
+            number != COAP_OPTION_URI_PATH && number != COAP_OPTION_URI_QUERY &&
+            number != COAP_OPTION_ACCEPT && number != COAP_OPTION_BLOCK2) {
+            resp.code = COAP_CODE_BAD_OPTION;
+            send_response(req, from, &resp);
+            return;
+        }
+    }
+
+    char path[COAP_PATH_MAX];
+    if (!get_path(req, path, sizeof(path))) {
+        send_response(req, from, &resp);
+        return;
+    }
+
+    if (strcmp(path, "state") == 0) {
+        handle_state(req, from, &resp);
+    } else if (strcmp(path, "power") == 0) {
+        handle_power(req, &resp);
+    } else if (strcmp(path, "setpoint") == 0) {
+        handle_setpoint(req, &resp);
+    } else if (strcmp(path, ".well-known/core") == 0) {
+        if (req->code == COAP_METHOD_GET) {
+            resp.code = COAP_CODE_CONTENT;
+            resp.content_format = COAP_FORMAT_LINK;
+            resp.payload = (const uint8_t *)WELL_KNOWN_CORE;
+            resp.payload_len = sizeof(WELL_KNOWN_CORE) - 1;
+        } else {
+            resp.code = COAP_CODE_METHOD_NOT_ALLOWED;
+        }
+    }
+    send_response(req, from, &resp);
+}
+
+static void handle_datagram(const uint8_t *buf, size_t len, const struct sockaddr_in *from) {
+    coap_msg_t msg;
+    if (coap_msg_parse(buf, len, &msg) != ESP_OK) {
+        // Reject malformed confirmable messages so the sender stops retransmitting
+        if (len >= 4 && ((buf[0] >> 4) & 0x03) == COAP_TYPE_CON) {
+            send_empty(COAP_TYPE_RST, (uint16_t)(buf[2] << 8 | buf[3]), from);
+        }
+        return;
+    }
+
+    if (msg.type == COAP_TYPE_ACK || msg.type == COAP_TYPE_RST) {
+        observe_handle_reply(&msg, from);
+        return;
+    }
+    // Empty CON is a ping; responses are never expected by a server
+    if (msg.code == COAP_CODE_EMPTY || COAP_CODE_CLASS(msg.code) != 0) {
+        if (msg.type == COAP_TYPE_CON) {
+            send_empty(COAP_TYPE_RST, msg.message_id, from);
+        }
+        return;
+    }
+
+    // Retransmitted CONs are processed again; every request here is idempotent
+    handle_request(&msg, from);
+}
+
+static void coap_state_listener(wifi_web_ctx_t *ctx, void *arg) {
+    __atomic_store_n(&g_coap.notify_pending, true, __ATOMIC_RELEASE);
+}
+
+static void coap_task(void *arg) {
+    ESP_LOGI(TAG, "CoAP server task started");
+
+    while (__atomic_load_n(&g_coap.running, __ATOMIC_ACQUIRE)) {
+        // State changes only set a flag, so poll faster while someone is waiting for them
+        int timeout_ms = has_observers() ? COAP_OBSERVE_POLL_MS : COAP_IDLE_POLL_MS;
+        struct timeval tv = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000
+        };
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(g_coap.sock, &readfds);
+
+        if (select(g_coap.sock + 1, &readfds, NULL, NULL, &tv) > 0) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            int len = recvfrom(g_coap.sock, g_coap.rx, sizeof(g_coap.rx), 0, (struct sockaddr *)&from, &from_len);
+            if (len > 0 && from.sin_family == AF_INET) {
+                handle_datagram(g_coap.rx, (size_t)len, &from);
+            }
+        }
+
+        if (__atomic_exchange_n(&g_coap.notify_pending, false, __ATOMIC_ACQ_REL)) {
+            notify_observers();
+        }
+    }
+
+    close(g_coap.sock);
+    g_coap.sock = -1;
+    ESP_LOGI(TAG, "CoAP server task stopped");
+    __atomic_store_n(&g_coap.task, NULL, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+esp_err_t coap_server_start(wifi_web_ctx_t *ctx, uint16_t port) {
+    if (ctx == NULL || port == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (g_coap.task != NULL) {
+        ESP_LOGW(TAG, "CoAP server already running");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(TAG, "Failed to bind UDP port %u: errno %d", port, errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    g_coap.ctx = ctx;
+    g_coap.sock = sock;
+    g_coap.next_mid = (uint16_t)esp_random();
+    memset(g_coap.observers, 0, sizeof(g_coap.observers));
+    __atomic_store_n(&g_coap.running, true, __ATOMIC_RELEASE);
+
+    if (!g_coap.listener_added) {
+        esp_err_t ret = wifi_web_add_state_listener(coap_state_listener, NULL);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to subscribe to state changes, Observe disabled: %s", esp_err_to_name(ret));
+        }
+        g_coap.listener_added = ret == ESP_OK;
+    }
+
+    BaseType_t task_ret = xTaskCreate(coap_task, "coap", COAP_TASK_STACK, NULL, COAP_TASK_PRIORITY, &g_coap.task);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create CoAP server task");
+        __atomic_store_n(&g_coap.running, false, __ATOMIC_RELEASE);
+        close(sock);
+        g_coap.sock = -1;
+        g_coap.task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "CoAP server listening on UDP port %u", port);
+    return ESP_OK;
+}
+
+esp_err_t coap_server_stop(void) {
+    if (__atomic_load_n(&g_coap.task, __ATOMIC_ACQUIRE) == NULL) {
+        return ESP_OK;
+    }
+
+    // The task notices within one select() timeout and closes the socket itself
+    __atomic_store_n(&g_coap.running, false, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&g_coap.task, __ATOMIC_ACQUIRE) != NULL) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return ESP_OK;
+}
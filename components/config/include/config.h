@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +15,25 @@ extern "C" {
 #define CONFIG_TEMP_MIN 20.0f
 #define CONFIG_TEMP_MAX 100.0f
 #define CONFIG_DEFAULT_SETPOINT 85.0f
+#define CONFIG_DEFAULT_COAP_PORT 5683
+#define CONFIG_MQTT_URI_MAX_LEN 127
+#define CONFIG_MQTT_TOPIC_MAX_LEN 63
+#define CONFIG_MQTT_BATCH_WINDOW_MIN 1
+#define CONFIG_MQTT_BATCH_WINDOW_MAX 3600
+#define CONFIG_DEFAULT_MQTT_TOPIC "teapot"
+#define CONFIG_DEFAULT_MQTT_BATCH_WINDOW 60
+#define CONFIG_NVS_NAMESPACE "teapot_cfg"
+#define CONFIG_NVS_SCHEMA_VERSION 2
+#define CONFIG_SAVE_DEBOUNCE_MS 2000
+#define CONFIG_MAX_OBSERVERS 4
+
+// Groups of settings reported to config observers
+#define CONFIG_FIELD_WIFI       (1u << 0)  // ssid, password
+#define CONFIG_FIELD_RELAY_GPIO (1u << 1)
+#define CONFIG_FIELD_TEMP_GPIO  (1u << 2)
+#define CONFIG_FIELD_SETPOINT   (1u << 3)  // default_setpoint
+#define CONFIG_FIELD_COAP       (1u << 4)
+#define CONFIG_FIELD_MQTT       (1u << 5)
 
 typedef struct {
     char ssid[CONFIG_WIFI_SSID_MAX_LEN + 1];
@@ -25,10 +45,18 @@ typedef struct {
     int temp_sensor_gpio;
 } teapot_gpio_config_t;
 
+typedef struct {
+    char uri[CONFIG_MQTT_URI_MAX_LEN + 1];      ///< Broker URI, e.g. "mqtt://192.168.1.10", empty disables MQTT
+    char topic[CONFIG_MQTT_TOPIC_MAX_LEN + 1];  ///< Topic prefix without a trailing '/'
+    uint16_t batch_window_s;                    ///< Samples are published once per window
+} teapot_mqtt_config_t;
+
 typedef struct {
     teapot_wifi_config_t wifi;
     teapot_gpio_config_t gpio;
     float default_setpoint;
+    uint16_t coap_port;  ///< UDP port of the CoAP endpoint, 0 disables it
+    teapot_mqtt_config_t mqtt;
 } teapot_config_t;
 
 esp_err_t config_init_default(teapot_config_t *config);
@@ -39,6 +67,29 @@ esp_err_t config_set_wifi_password(teapot_config_t *config, const char *password
 esp_err_t config_set_relay_gpio(teapot_config_t *config, int gpio);
 esp_err_t config_set_temp_sensor_gpio(teapot_config_t *config, int gpio);
 esp_err_t config_set_default_setpoint(teapot_config_t *config, float setpoint);
+esp_err_t config_set_coap_port(teapot_config_t *config, int port);
+
+// Persistent config in NVS: config_load() overlays saved values on the config image
+// (config_image.h) or, without one, the generated values. The overlay remembers the image
+// it was made on and is dropped once a different image is flashed, so flashing a new
+// config.bin re-provisions an edited unit.
+// config_save() validates and commits after CONFIG_SAVE_DEBOUNCE_MS without further saves
+esp_err_t config_load(teapot_config_t *config);
+esp_err_t config_save(const teapot_config_t *config);
+esp_err_t config_flush(void);
+esp_err_t config_erase_stored(void);
+
+// Live reconfiguration: config_apply() copies a validated config over the running one and
+// calls, in the caller's task, each observer whose mask intersects the CONFIG_FIELD_* diff.
+// The copy is made under a lock; other tasks read the running config through
+// config_snapshot(), which takes the same lock, so they never see a half-applied change.
+// The applying task and its observers may read the running config directly.
+typedef void (*config_observer_t)(const teapot_config_t *config, uint32_t changed, void *arg);
+
+uint32_t config_diff(const teapot_config_t *a, const teapot_config_t *b);
+esp_err_t config_add_observer(uint32_t fields, config_observer_t observer, void *arg);
+esp_err_t config_apply(teapot_config_t *running, const teapot_config_t *updated);
+esp_err_t config_snapshot(const teapot_config_t *running, teapot_config_t *out);
 
 #ifdef __cplusplus
 }
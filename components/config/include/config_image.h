@@ -0,0 +1,53 @@
+#pragma once
+
+#include "config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary config written by scripts/config_image.py into its own partition, so a unit can be
+// re-provisioned by flashing that partition alone. Little-endian, no padding.
+#define CONFIG_IMAGE_PARTITION_LABEL "config"
+#define CONFIG_IMAGE_MAGIC 0x47464354u  // "TCFG"
+#define CONFIG_IMAGE_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;     // CONFIG_IMAGE_MAGIC
+    uint16_t version;   // CONFIG_IMAGE_VERSION
+    uint16_t length;    // Payload bytes following the header
+    uint32_t crc32;     // esp_rom_crc32_le(0, payload, length), same as zlib.crc32
+} config_image_header_t;
+
+typedef struct __attribute__((packed)) {
+    char wifi_ssid[CONFIG_WIFI_SSID_MAX_LEN + 1];          // NUL-padded
+    char wifi_password[CONFIG_WIFI_PASSWORD_MAX_LEN + 1];
+    int8_t relay_gpio;
+    int8_t temp_sensor_gpio;
+    int16_t default_setpoint_centi;                      // Hundredths of °C
+    uint16_t coap_port;
+    char mqtt_uri[CONFIG_MQTT_URI_MAX_LEN + 1];
+    char mqtt_topic[CONFIG_MQTT_TOPIC_MAX_LEN + 1];
+    uint16_t mqtt_batch_window_s;
+} config_image_payload_t;
+
+typedef struct __attribute__((packed)) {
+    config_image_header_t header;
+    config_image_payload_t payload;
+} config_image_t;
+
+// Check header and CRC of an image and unpack it. The generator validated the values with
+// the rules of config_validate(), so a matching CRC is enough to trust them.
+// Returns ESP_ERR_NOT_FOUND without a magic (erased partition), ESP_ERR_NOT_SUPPORTED for
+// another version, ESP_ERR_INVALID_SIZE or ESP_ERR_INVALID_CRC for a damaged image.
+esp_err_t config_image_decode(const void *data, size_t size, teapot_config_t *config);
+
+// Map the config partition and decode it; crc32 (may be NULL) receives the payload CRC,
+// which identifies the flashed image
+esp_err_t config_image_load(teapot_config_t *config, uint32_t *crc32);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,11 @@ esp_err_t config_init_default(teapot_config_t *config) {
     config->gpio.relay_gpio = 4;
     config->gpio.temp_sensor_gpio = 5;
     config->default_setpoint = CONFIG_DEFAULT_SETPOINT;
+    config->coap_port = CONFIG_DEFAULT_COAP_PORT;
+    config->mqtt.uri[0] = '\0';
+    strncpy(config->mqtt.topic, CONFIG_DEFAULT_MQTT_TOPIC, CONFIG_MQTT_TOPIC_MAX_LEN);
+    config->mqtt.topic[CONFIG_MQTT_TOPIC_MAX_LEN] = '\0';
+    config->mqtt.batch_window_s = CONFIG_DEFAULT_MQTT_BATCH_WINDOW;
 
     return ESP_OK;
 }
@@ -38,6 +43,13 @@ esp_err_t config_init_from_generated(teapot_config_t *config) {
     config->gpio.relay_gpio = RELAY_GPIO;
     config->gpio.temp_sensor_gpio = TEMP_SENSOR_GPIO;
     config->default_setpoint = DEFAULT_SETPOINT;
+    config->coap_port = COAP_PORT;
+
+    strncpy(config->mqtt.uri, MQTT_URI, CONFIG_MQTT_URI_MAX_LEN);
+    config->mqtt.uri[CONFIG_MQTT_URI_MAX_LEN] = '\0';
+    strncpy(config->mqtt.topic, MQTT_TOPIC, CONFIG_MQTT_TOPIC_MAX_LEN);
+    config->mqtt.topic[CONFIG_MQTT_TOPIC_MAX_LEN] = '\0';
+    config->mqtt.batch_window_s = MQTT_BATCH_WINDOW;
 
     return ESP_OK;
 }
@@ -78,6 +90,19 @@ esp_err_t config_validate(const teapot_config_t *config) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    if (strlen(config->mqtt.uri) > 0) {
+        size_t topic_len = strlen(config->mqtt.topic);
+        // The prefix is extended with "/state", "/cmd/#" etc., so wildcards and a trailing '/' are not allowed
+        if (topic_len == 0 || config->mqtt.topic[topic_len - 1] == '/' ||
+            strpbrk(config->mqtt.topic, "+#") != NULL) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (config->mqtt.batch_window_s < CONFIG_MQTT_BATCH_WINDOW_MIN ||
+            config->mqtt.batch_window_s > CONFIG_MQTT_BATCH_WINDOW_MAX) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
     return ESP_OK;
 }
 
@@ -161,4 +186,18 @@ esp_err_t config_set_default_setpoint(teapot_config_t *config, float setpoint) {
     config->default_setpoint = setpoint;
 
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t config_set_coap_port(teapot_config_t *config, int port) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (port < 0 || port > UINT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    config->coap_port = (uint16_t)port;
+
+    return ESP_OK;
+}
@@ -0,0 +1,89 @@
+#include "config_image.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include <string.h>
+
+static const char *TAG = "CONFIG";
+
+_Static_assert(sizeof(config_image_header_t) == 12, "config image header layout changed");
+_Static_assert(sizeof(config_image_payload_t) == 298, "config image payload layout changed, bump CONFIG_IMAGE_VERSION");
+
+static void copy_string(char *dst, const char *src, size_t size) {
+    memcpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+esp_err_t config_image_decode(const void *data, size_t size, teapot_config_t *config) {
+    if (data == NULL || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (size < sizeof(config_image_header_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    config_image_header_t header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != CONFIG_IMAGE_MAGIC) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (header.version != CONFIG_IMAGE_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (header.length != sizeof(config_image_payload_t) || size < sizeof(header) + header.length) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const uint8_t *payload_bytes = (const uint8_t *)data + sizeof(header);
+    if (esp_rom_crc32_le(0, payload_bytes, header.length) != header.crc32) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    config_image_payload_t payload;
+    memcpy(&payload, payload_bytes, sizeof(payload));
+
+    memset(config, 0, sizeof(*config));
+    copy_string(config->wifi.ssid, payload.wifi_ssid, sizeof(config->wifi.ssid));
+    copy_string(config->wifi.password, payload.wifi_password, sizeof(config->wifi.password));
+    config->gpio.relay_gpio = payload.relay_gpio;
+    config->gpio.temp_sensor_gpio = payload.temp_sensor_gpio;
+    config->default_setpoint = (float)payload.default_setpoint_centi / 100.0f;
+    config->coap_port = payload.coap_port;
+    copy_string(config->mqtt.uri, payload.mqtt_uri, sizeof(config->mqtt.uri));
+    copy_string(config->mqtt.topic, payload.mqtt_topic, sizeof(config->mqtt.topic));
+    config->mqtt.batch_window_s = payload.mqtt_batch_window_s;
+    return ESP_OK;
+}
+
+esp_err_t config_image_load(teapot_config_t *config, uint32_t *crc32) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           CONFIG_IMAGE_PARTITION_LABEL);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (part->size < sizeof(config_image_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Read in place through the cache instead of copying the partition to RAM first
+    const void *data;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t ret = esp_partition_mmap(part, 0, sizeof(config_image_t), ESP_PARTITION_MMAP_DATA, &data, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = config_image_decode(data, sizeof(config_image_t), config);
+    if (ret == ESP_OK && crc32 != NULL) {
+        *crc32 = ((const config_image_header_t *)data)->crc32;
+    }
+    esp_partition_munmap(handle);
+
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Config image rejected: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
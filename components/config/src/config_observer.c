@@ -0,0 +1,96 @@
+#include "config.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <inttypes.h>
+#include <string.h>
+
+static const char *TAG = "CONFIG";
+
+static struct {
+    uint32_t fields;
+    config_observer_t fn;
+    void *arg;
+} g_observers[CONFIG_MAX_OBSERVERS];
+static uint32_t g_observer_count = 0;
+// Guards the copy in config_apply() against concurrent config_snapshot() calls
+static portMUX_TYPE g_config_lock = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t config_diff(const teapot_config_t *a, const teapot_config_t *b) {
+    uint32_t changed = 0;
+    if (strcmp(a->wifi.ssid, b->wifi.ssid) != 0 || strcmp(a->wifi.password, b->wifi.password) != 0) {
+        changed |= CONFIG_FIELD_WIFI;
+    }
+    if (a->gpio.relay_gpio != b->gpio.relay_gpio) {
+        changed |= CONFIG_FIELD_RELAY_GPIO;
+    }
+    if (a->gpio.temp_sensor_gpio != b->gpio.temp_sensor_gpio) {
+        changed |= CONFIG_FIELD_TEMP_GPIO;
+    }
+    if (a->default_setpoint != b->default_setpoint) {
+        changed |= CONFIG_FIELD_SETPOINT;
+    }
+    if (a->coap_port != b->coap_port) {
+        changed |= CONFIG_FIELD_COAP;
+    }
+    if (strcmp(a->mqtt.uri, b->mqtt.uri) != 0 || strcmp(a->mqtt.topic, b->mqtt.topic) != 0 ||
+        a->mqtt.batch_window_s != b->mqtt.batch_window_s) {
+        changed |= CONFIG_FIELD_MQTT;
+    }
+    return changed;
+}
+
+// Observers are registered during startup, before the first config_apply()
+esp_err_t config_add_observer(uint32_t fields, config_observer_t observer, void *arg) {
+    if (observer == NULL || fields == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t index = __atomic_load_n(&g_observer_count, __ATOMIC_ACQUIRE);
+    if (index >= CONFIG_MAX_OBSERVERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    g_observers[index].fields = fields;
+    g_observers[index].fn = observer;
+    g_observers[index].arg = arg;
+    __atomic_store_n(&g_observer_count, index + 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+esp_err_t config_apply(teapot_config_t *running, const teapot_config_t *updated) {
+    if (running == NULL || updated == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = config_validate(updated);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Only the applying task writes the running config, so it can be compared unlocked
+    uint32_t changed = config_diff(running, updated);
+    if (changed == 0) {
+        return ESP_OK;
+    }
+    taskENTER_CRITICAL(&g_config_lock);
+    *running = *updated;
+    taskEXIT_CRITICAL(&g_config_lock);
+    ESP_LOGI(TAG, "Config changed (fields 0x%02" PRIx32 ")", changed);
+
+    uint32_t count = __atomic_load_n(&g_observer_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        if (g_observers[i].fields & changed) {
+            g_observers[i].fn(running, g_observers[i].fields & changed, g_observers[i].arg);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t config_snapshot(const teapot_config_t *running, teapot_config_t *out) {
+    if (running == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&g_config_lock);
+    *out = *running;
+    taskEXIT_CRITICAL(&g_config_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,314 @@
+#include "config.h"
+#include "config_image.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <inttypes.h>
+#include <string.h>
+
+static const char *TAG = "CONFIG";
+
+// NVS keys are limited to 15 characters
+#define KEY_SCHEMA "schema"
+#define KEY_SSID "ssid"
+#define KEY_PASSWORD "password"
+#define KEY_RELAY_GPIO "relay_gpio"
+#define KEY_TEMP_GPIO "temp_gpio"
+#define KEY_SETPOINT "setpoint_c"      // Hundredths of °C, NVS has no float type
+#define KEY_COAP_PORT "coap_port"
+#define KEY_MQTT_URI "mqtt_uri"
+#define KEY_MQTT_TOPIC "mqtt_topic"
+#define KEY_MQTT_WINDOW "mqtt_window"
+#define KEY_BASE_CRC "base_crc"        // Image the values were saved on, 0 without one (schema 2)
+
+// CRC of the config image found by config_load(), 0 if none was used
+static uint32_t g_base_crc = 0;
+
+// Latest config handed to config_save(), written once the debounce timer fires
+static portMUX_TYPE g_pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static teapot_config_t g_pending;
+static bool g_pending_valid = false;
+static uint32_t g_pending_saves = 0;
+static esp_timer_handle_t g_save_timer = NULL;
+static bool g_shutdown_registered = false;
+
+static esp_err_t init_nvs(void) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition was truncated or has a new format, erasing it");
+        ret = nvs_flash_erase();
+        if (ret == ESP_OK) {
+            ret = nvs_flash_init();
+        }
+    }
+    return ret;
+}
+
+// Each released schema change adds a case that rewrites the keys of version `from`
+// into version from + 1. Fields added later need no migration: missing keys keep
+// their generated defaults.
+static esp_err_t migrate_schema(nvs_handle_t handle, uint16_t from) {
+    switch (from) {
+    case 1:
+        // Edits from before the image tracking were made on whatever image is flashed now
+        return nvs_set_u32(handle, KEY_BASE_CRC, g_base_crc);
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+static void read_string(nvs_handle_t handle, const char *key, char *buf, size_t size) {
+    char value[CONFIG_MQTT_URI_MAX_LEN + 1];
+    size_t len = sizeof(value);
+    // Copied only on success so a missing or oversized entry keeps the default
+    if (nvs_get_str(handle, key, value, &len) == ESP_OK && len <= size) {
+        memcpy(buf, value, len);
+    }
+}
+
+static void read_fields(nvs_handle_t handle, teapot_config_t *config) {
+    read_string(handle, KEY_SSID, config->wifi.ssid, sizeof(config->wifi.ssid));
+    read_string(handle, KEY_PASSWORD, config->wifi.password, sizeof(config->wifi.password));
+    read_string(handle, KEY_MQTT_URI, config->mqtt.uri, sizeof(config->mqtt.uri));
+    read_string(handle, KEY_MQTT_TOPIC, config->mqtt.topic, sizeof(config->mqtt.topic));
+
+    int32_t value;
+    if (nvs_get_i32(handle, KEY_RELAY_GPIO, &value) == ESP_OK) {
+        config->gpio.relay_gpio = value;
+    }
+    if (nvs_get_i32(handle, KEY_TEMP_GPIO, &value) == ESP_OK) {
+        config->gpio.temp_sensor_gpio = value;
+    }
+    if (nvs_get_i32(handle, KEY_SETPOINT, &value) == ESP_OK) {
+        config->default_setpoint = (float)value / 100.0f;
+    }
+
+    uint16_t u16;
+    if (nvs_get_u16(handle, KEY_COAP_PORT, &u16) == ESP_OK) {
+        config->coap_port = u16;
+    }
+    if (nvs_get_u16(handle, KEY_MQTT_WINDOW, &u16) == ESP_OK) {
+        config->mqtt.batch_window_s = u16;
+    }
+}
+
+// NVS skips entries whose value did not change, so rewriting every key costs
+// flash writes only for the fields that were actually edited
+static esp_err_t write_config(const teapot_config_t *config) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    int32_t setpoint = (int32_t)(config->default_setpoint * 100.0f + 0.5f);
+    ret = nvs_set_u16(handle, KEY_SCHEMA, CONFIG_NVS_SCHEMA_VERSION);
+    if (ret == ESP_OK) ret = nvs_set_u32(handle, KEY_BASE_CRC, g_base_crc);
+    if (ret == ESP_OK) ret = nvs_set_str(handle, KEY_SSID, config->wifi.ssid);
+    if (ret == ESP_OK) ret = nvs_set_str(handle, KEY_PASSWORD, config->wifi.password);
+    if (ret == ESP_OK) ret = nvs_set_i32(handle, KEY_RELAY_GPIO, config->gpio.relay_gpio);
+    if (ret == ESP_OK) ret = nvs_set_i32(handle, KEY_TEMP_GPIO, config->gpio.temp_sensor_gpio);
+    if (ret == ESP_OK) ret = nvs_set_i32(handle, KEY_SETPOINT, setpoint);
+    if (ret == ESP_OK) ret = nvs_set_u16(handle, KEY_COAP_PORT, config->coap_port);
+    if (ret == ESP_OK) ret = nvs_set_str(handle, KEY_MQTT_URI, config->mqtt.uri);
+    if (ret == ESP_OK) ret = nvs_set_str(handle, KEY_MQTT_TOPIC, config->mqtt.topic);
+    if (ret == ESP_OK) ret = nvs_set_u16(handle, KEY_MQTT_WINDOW, config->mqtt.batch_window_s);
+    if (ret == ESP_OK) ret = nvs_commit(handle);
+
+    nvs_close(handle);
+    return ret;
+}
+
+static void save_timer_cb(void *arg) {
+    esp_err_t ret = config_flush();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save config: %s", esp_err_to_name(ret));
+    }
+}
+
+static void shutdown_handler(void) {
+    config_flush();
+}
+
+static esp_err_t ensure_save_timer(void) {
+    if (g_save_timer != NULL) {
+        return ESP_OK;
+    }
+    const esp_timer_create_args_t args = {
+        .callback = save_timer_cb,
+        .name = "config_save"
+    };
+    esp_err_t ret = esp_timer_create(&args, &g_save_timer);
+    if (ret == ESP_OK && !g_shutdown_registered) {
+        // A restart right after an edit would otherwise drop the pending save
+        g_shutdown_registered = esp_register_shutdown_handler(shutdown_handler) == ESP_OK;
+    }
+    return ret;
+}
+
+esp_err_t config_load(teapot_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The flashed config image replaces the compiled-in defaults, so a unit can be
+    // re-provisioned without a rebuild; NVS edits from /api/config win over both until
+    // a different image is flashed
+    g_base_crc = 0;
+    esp_err_t ret = config_image_load(config, &g_base_crc);
+    if (ret != ESP_OK) {
+        g_base_crc = 0;
+        ret = config_init_from_generated(config);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    ret = init_nvs();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    nvs_handle_t handle;
+    ret = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint16_t schema;
+    ret = nvs_get_u16(handle, KEY_SCHEMA, &schema);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        // Nothing saved yet, the image or generated config applies
+        nvs_close(handle);
+        return ESP_OK;
+    }
+    if (ret == ESP_OK && schema > CONFIG_NVS_SCHEMA_VERSION) {
+        ESP_LOGW(TAG, "Stored config has schema %u, newer than %u; using the generated config",
+                 schema, CONFIG_NVS_SCHEMA_VERSION);
+        ret = ESP_ERR_NOT_SUPPORTED;
+    }
+    while (ret == ESP_OK && schema < CONFIG_NVS_SCHEMA_VERSION) {
+        ret = migrate_schema(handle, schema);
+        if (ret == ESP_OK) {
+            schema++;
+            ret = nvs_set_u16(handle, KEY_SCHEMA, schema);
+        }
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+            ESP_LOGI(TAG, "Migrated stored config to schema %u", schema);
+        }
+    }
+    if (ret != ESP_OK) {
+        nvs_close(handle);
+        return ret == ESP_ERR_NOT_SUPPORTED ? ESP_OK : ret;
+    }
+
+    uint32_t base_crc;
+    if (nvs_get_u32(handle, KEY_BASE_CRC, &base_crc) != ESP_OK || base_crc != g_base_crc) {
+        // The edits were made on another image; the one flashed now is meant to replace them
+        ESP_LOGI(TAG, "Config image changed since the last edit, dropping stored config");
+        ret = nvs_erase_all(handle);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+        return ret;
+    }
+
+    teapot_config_t stored = *config;
+    read_fields(handle, &stored);
+    nvs_close(handle);
+
+    // A bad entry must not keep the device from booting with a working config
+    ret = config_validate(&stored);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Stored config is invalid (%s), using the generated config", esp_err_to_name(ret));
+        return ESP_OK;
+    }
+    *config = stored;
+    return ESP_OK;
+}
+
+esp_err_t config_save(const teapot_config_t *config) {
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = config_validate(config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = ensure_save_timer();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    taskENTER_CRITICAL(&g_pending_lock);
+    g_pending = *config;
+    g_pending_valid = true;
+    g_pending_saves++;
+    taskEXIT_CRITICAL(&g_pending_lock);
+
+    // Every save restarts the quiet period, so a burst of edits ends in one commit
+    esp_timer_stop(g_save_timer);
+    return esp_timer_start_once(g_save_timer, (uint64_t)CONFIG_SAVE_DEBOUNCE_MS * 1000);
+}
+
+esp_err_t config_flush(void) {
+    teapot_config_t config;
+    uint32_t saves;
+
+    taskENTER_CRITICAL(&g_pending_lock);
+    bool pending = g_pending_valid;
+    if (pending) {
+        config = g_pending;
+        saves = g_pending_saves;
+        g_pending_valid = false;
+        g_pending_saves = 0;
+    }
+    taskEXIT_CRITICAL(&g_pending_lock);
+
+    if (!pending) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = write_config(&config);
+    if (ret != ESP_OK) {
+        // Keep it for the next attempt unless a newer config arrived meanwhile
+        taskENTER_CRITICAL(&g_pending_lock);
+        if (!g_pending_valid) {
+            g_pending = config;
+            g_pending_valid = true;
+            g_pending_saves = saves;
+        }
+        taskEXIT_CRITICAL(&g_pending_lock);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Config saved (%" PRIu32 " edits in one commit)", saves);
+    return ESP_OK;
+}
+
+esp_err_t config_erase_stored(void) {
+    if (g_save_timer != NULL) {
+        esp_timer_stop(g_save_timer);
+    }
+    taskENTER_CRITICAL(&g_pending_lock);
+    g_pending_valid = false;
+    g_pending_saves = 0;
+    taskEXIT_CRITICAL(&g_pending_lock);
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_erase_all(handle);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
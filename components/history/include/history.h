@@ -0,0 +1,115 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HISTORY_DUMP_MAGIC 0x31545348u ///< "HST1" little-endian, header of binary dumps
+
+/**
+ * @brief Resolution tiers
+ *
+ * Every tier aggregates the samples falling into fixed slots of period_ms since
+ * boot, so slot * period_ms is the uptime at which a point starts. The control
+ * loop samples every ~2.75 s (conversion time plus a 2 s delay), which is why
+ * the finest tier is 5 s rather than 1 s.
+ */
+#define HISTORY_TIER_COUNT 3
+#define HISTORY_TIER0_PERIOD_MS 5000u     ///< 5 s
+#define HISTORY_TIER0_POINTS 360          ///< 30 min
+#define HISTORY_TIER1_PERIOD_MS 60000u    ///< 1 min
+#define HISTORY_TIER1_POINTS 720          ///< 12 h
+#define HISTORY_TIER2_PERIOD_MS 600000u   ///< 10 min
+#define HISTORY_TIER2_POINTS 288          ///< 48 h
+
+/**
+ * @brief Aggregate of one slot, as stored in RAM and sent by /api/history
+ *
+ * Temperatures are in hundredths of °C. A slot without samples (sensor errors,
+ * or before the first sample of a restarted tier) has samples == 0.
+ */
+typedef struct {
+    int16_t avg_centi;
+    int16_t min_centi;
+    int16_t max_centi;
+    uint8_t relay_pct;    ///< Share of samples taken with the relay on, 0..100
+    uint8_t samples;      ///< Samples aggregated, saturates at 255
+} history_point_t;
+
+/**
+ * @brief Header preceding points in a binary dump
+ */
+typedef struct {
+    uint32_t magic;       ///< HISTORY_DUMP_MAGIC
+    uint8_t tier;
+    uint8_t point_size;   ///< sizeof(history_point_t)
+    uint16_t capacity;    ///< Points kept in this tier
+    uint32_t period_ms;   ///< Slot length
+    uint32_t first_slot;  ///< Slot of the first point in the dump
+    uint32_t next_slot;   ///< Slot the next closed point will get; pass as since= to fetch only newer points
+    uint32_t reserved;
+    int64_t now_us;       ///< esp_timer_get_time() when the dump was taken
+} history_dump_header_t;
+
+/**
+ * @brief Total RAM used by the point buffers, fixed at compile time
+ */
+#define HISTORY_MEMORY_BYTES \
+    ((HISTORY_TIER0_POINTS + HISTORY_TIER1_POINTS + HISTORY_TIER2_POINTS) * sizeof(history_point_t))
+
+/**
+ * @brief Add a sample to every tier
+ *
+ * O(HISTORY_TIER_COUNT): each tier keeps a running aggregate of its open slot and
+ * stores it when a sample lands in a later slot. Safe to call from one task while
+ * others read.
+ * @param timestamp_us esp_timer_get_time() of the sample; must not go backwards
+ * @param temperature Temperature in °C
+ * @param relay_on Relay state after the control step
+ */
+void history_record(int64_t timestamp_us, float temperature, bool relay_on);
+
+/**
+ * @brief Get the stored range of a tier
+ * @param tier Tier index
+ * @param first_slot Output: oldest stored slot
+ * @param next_slot Output: slot the next closed point will get (first_slot == next_slot when empty)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown tier
+ */
+esp_err_t history_range(uint8_t tier, uint32_t *first_slot, uint32_t *next_slot);
+
+/**
+ * @brief Get the slot length and capacity of a tier
+ * @param tier Tier index
+ * @param period_ms Output: slot length
+ * @param capacity Output: points kept
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown tier
+ */
+esp_err_t history_tier_info(uint8_t tier, uint32_t *period_ms, uint16_t *capacity);
+
+/**
+ * @brief Copy consecutive points starting at a slot
+ *
+ * Slots that were overwritten meanwhile are returned as empty points, so
+ * out[i] always belongs to slot from_slot + i.
+ * @param tier Tier index
+ * @param from_slot First slot to copy
+ * @param out Output array
+ * @param max Capacity of the output array
+ * @return Number of points copied, 0 once from_slot reaches the next slot
+ */
+size_t history_read(uint8_t tier, uint32_t from_slot, history_point_t *out, size_t max);
+
+/**
+ * @brief Drop all points and open slots
+ */
+void history_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,177 @@
+#include "history.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+_Static_assert(sizeof(history_point_t) == 8, "history_point_t is part of the /api/history format");
+_Static_assert(sizeof(history_dump_header_t) == 32, "history_dump_header_t is part of the /api/history format");
+
+typedef struct {
+    history_point_t *points;
+    uint16_t capacity;
+    uint32_t period_ms;
+    uint32_t next_slot;   // Slot of the next stored point
+    uint32_t count;       // Stored points, ending at next_slot - 1
+
+    // Running aggregate of the slot currently being filled
+    bool open;
+    uint32_t open_slot;
+    int32_t sum;
+    int16_t min;
+    int16_t max;
+    uint16_t samples;
+    uint16_t relay_samples;
+} history_tier_t;
+
+static history_point_t g_points0[HISTORY_TIER0_POINTS];
+static history_point_t g_points1[HISTORY_TIER1_POINTS];
+static history_point_t g_points2[HISTORY_TIER2_POINTS];
+
+static history_tier_t g_tiers[HISTORY_TIER_COUNT] = {
+    { .points = g_points0, .capacity = HISTORY_TIER0_POINTS, .period_ms = HISTORY_TIER0_PERIOD_MS },
+    { .points = g_points1, .capacity = HISTORY_TIER1_POINTS, .period_ms = HISTORY_TIER1_PERIOD_MS },
+    { .points = g_points2, .capacity = HISTORY_TIER2_POINTS, .period_ms = HISTORY_TIER2_PERIOD_MS },
+};
+
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void store_point(history_tier_t *tier, uint32_t slot, const history_point_t *point) {
+    if (tier->count == 0) {
+        tier->next_slot = slot;
+    }
+
+    // Slots skipped because no sample arrived become empty points; a gap longer
+    // than the buffer would overwrite everything, so only the tail is written
+    if (slot - tier->next_slot > tier->capacity) {
+        tier->next_slot = slot - tier->capacity;
+    }
+    while (tier->next_slot != slot) {
+        memset(&tier->points[tier->next_slot % tier->capacity], 0, sizeof(history_point_t));
+        tier->next_slot++;
+        if (tier->count < tier->capacity) {
+            tier->count++;
+        }
+    }
+
+    tier->points[slot % tier->capacity] = *point;
+    tier->next_slot = slot + 1;
+    if (tier->count < tier->capacity) {
+        tier->count++;
+    }
+}
+
+static void close_slot(history_tier_t *tier) {
+    history_point_t point = {
+        .avg_centi = (int16_t)(tier->sum / (int32_t)tier->samples),
+        .min_centi = tier->min,
+        .max_centi = tier->max,
+        .relay_pct = (uint8_t)(tier->relay_samples * 100u / tier->samples),
+        .samples = tier->samples > UINT8_MAX ? UINT8_MAX : (uint8_t)tier->samples
+    };
+    store_point(tier, tier->open_slot, &point);
+    tier->open = false;
+}
+
+void history_record(int64_t timestamp_us, float temperature, bool relay_on) {
+    float scaled = temperature * 100.0f;
+    if (scaled > INT16_MAX) {
+        scaled = INT16_MAX;
+    } else if (scaled < INT16_MIN) {
+        scaled = INT16_MIN;
+    }
+    int16_t centi = (int16_t)(scaled + (scaled < 0 ? -0.5f : 0.5f));
+    uint64_t uptime_ms = (uint64_t)timestamp_us / 1000;
+
+    taskENTER_CRITICAL(&g_lock);
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+        history_tier_t *tier = &g_tiers[i];
+        uint32_t slot = (uint32_t)(uptime_ms / tier->period_ms);
+
+        if (tier->open && tier->open_slot != slot) {
+            close_slot(tier);
+        }
+        if (!tier->open) {
+            tier->open = true;
+            tier->open_slot = slot;
+            tier->sum = 0;
+            tier->min = centi;
+            tier->max = centi;
+            tier->samples = 0;
+            tier->relay_samples = 0;
+        }
+
+        tier->sum += centi;
+        if (centi < tier->min) {
+            tier->min = centi;
+        }
+        if (centi > tier->max) {
+            tier->max = centi;
+        }
+        // The sum stays within int32 and the counters within uint16 for any slot of
+        // up to 65535 samples, far more than the 10 min tier collects
+        if (tier->samples < UINT16_MAX) {
+            tier->samples++;
+            tier->relay_samples += relay_on ? 1 : 0;
+        }
+    }
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+esp_err_t history_range(uint8_t tier, uint32_t *first_slot, uint32_t *next_slot) {
+    if (tier >= HISTORY_TIER_COUNT || first_slot == NULL || next_slot == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&g_lock);
+    *next_slot = g_tiers[tier].next_slot;
+    *first_slot = g_tiers[tier].next_slot - g_tiers[tier].count;
+    taskEXIT_CRITICAL(&g_lock);
+    return ESP_OK;
+}
+
+esp_err_t history_tier_info(uint8_t tier, uint32_t *period_ms, uint16_t *capacity) {
+    if (tier >= HISTORY_TIER_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (period_ms != NULL) {
+        *period_ms = g_tiers[tier].period_ms;
+    }
+    if (capacity != NULL) {
+        *capacity = g_tiers[tier].capacity;
+    }
+    return ESP_OK;
+}
+
+size_t history_read(uint8_t tier, uint32_t from_slot, history_point_t *out, size_t max) {
+    if (tier >= HISTORY_TIER_COUNT || out == NULL) {
+        return 0;
+    }
+
+    const history_tier_t *t = &g_tiers[tier];
+    size_t count = 0;
+
+    taskENTER_CRITICAL(&g_lock);
+    uint32_t first = t->next_slot - t->count;
+    // Signed distances keep the comparisons right across slot wrap-around
+    while (count < max && (int32_t)(t->next_slot - (from_slot + (uint32_t)count)) > 0) {
+        uint32_t slot = from_slot + (uint32_t)count;
+        if ((int32_t)(slot - first) >= 0) {
+            out[count] = t->points[slot % t->capacity];
+        } else {
+            memset(&out[count], 0, sizeof(out[count]));
+        }
+        count++;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+
+    return count;
+}
+
+void history_reset(void) {
+    taskENTER_CRITICAL(&g_lock);
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+        g_tiers[i].next_slot = 0;
+        g_tiers[i].count = 0;
+        g_tiers[i].open = false;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+}
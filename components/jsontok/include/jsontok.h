@@ -0,0 +1,103 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Token type
+ */
+typedef enum {
+    JSONTOK_UNDEFINED = 0,
+    JSONTOK_OBJECT,
+    JSONTOK_ARRAY,
+    JSONTOK_STRING,     ///< start/end exclude the quotes, escapes are kept as is
+    JSONTOK_PRIMITIVE   ///< number, true, false or null
+} jsontok_type_t;
+
+/**
+ * @brief Token pointing into the parsed buffer (jsmn-style, nothing is copied)
+ */
+typedef struct {
+    jsontok_type_t type;
+    int start;   ///< Offset of the first character
+    int end;     ///< Offset past the last character
+    int size;    ///< Number of children (members for objects, 1 for object keys)
+    int parent;  ///< Index of the parent token, -1 for the root
+} jsontok_t;
+
+/**
+ * @brief Tokenize a JSON document in place
+ * @param json JSON text (does not need to be NUL-terminated)
+ * @param len Length of the text
+ * @param tokens Output token array
+ * @param max_tokens Capacity of the token array
+ * @param count Output: number of tokens produced
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if there are more tokens than max_tokens,
+ *         ESP_ERR_INVALID_ARG on malformed or truncated JSON
+ */
+esp_err_t jsontok_parse(const char *json, size_t len, jsontok_t *tokens, size_t max_tokens, int *count);
+
+/**
+ * @brief Find the value of a member of the root object
+ * @param json Parsed JSON text
+ * @param tokens Tokens produced by jsontok_parse
+ * @param count Number of tokens
+ * @param key Member name
+ * @return Index of the value token, -1 if the root is not an object or the key is missing
+ */
+int jsontok_find(const char *json, const jsontok_t *tokens, int count, const char *key);
+
+/**
+ * @brief Read a boolean member of the root object
+ * @param json Parsed JSON text
+ * @param tokens Tokens produced by jsontok_parse
+ * @param count Number of tokens
+ * @param key Member name
+ * @param value Output value
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if missing, ESP_ERR_INVALID_ARG if not a boolean
+ */
+esp_err_t jsontok_get_bool(const char *json, const jsontok_t *tokens, int count, const char *key, bool *value);
+
+/**
+ * @brief Read a numeric member of the root object
+ * @param json Parsed JSON text
+ * @param tokens Tokens produced by jsontok_parse
+ * @param count Number of tokens
+ * @param key Member name
+ * @param value Output value
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if missing, ESP_ERR_INVALID_ARG if not a number
+ */
+esp_err_t jsontok_get_float(const char *json, const jsontok_t *tokens, int count, const char *key, float *value);
+
+/**
+ * @brief Read an integer member of the root object
+ * @param json Parsed JSON text
+ * @param tokens Tokens produced by jsontok_parse
+ * @param count Number of tokens
+ * @param key Member name
+ * @param value Output value
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if missing, ESP_ERR_INVALID_ARG if not an integer
+ */
+esp_err_t jsontok_get_int(const char *json, const jsontok_t *tokens, int count, const char *key, int *value);
+
+/**
+ * @brief Copy a string member of the root object, resolving escapes
+ * @param json Parsed JSON text
+ * @param tokens Tokens produced by jsontok_parse
+ * @param count Number of tokens
+ * @param key Member name
+ * @param buf Output buffer (NUL-terminated on success)
+ * @param size Size of the output buffer
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if missing, ESP_ERR_INVALID_ARG if not a string,
+ *         ESP_ERR_INVALID_SIZE if it does not fit
+ */
+esp_err_t jsontok_get_string(const char *json, const jsontok_t *tokens, int count, const char *key, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
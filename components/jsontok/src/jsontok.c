@@ -0,0 +1,436 @@
+#include "jsontok.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define NUMBER_MAX_LEN 31
+
+// What the grammar allows at the current position
+typedef enum {
+    EXPECT_VALUE,
+    EXPECT_VALUE_OR_CLOSE,  // right after '['
+    EXPECT_KEY,
+    EXPECT_KEY_OR_CLOSE,    // right after '{'
+    EXPECT_COLON,
+    EXPECT_COMMA_OR_CLOSE,
+    EXPECT_END              // the root value is complete
+} expect_t;
+
+static jsontok_t *new_token(jsontok_t *tokens, size_t max_tokens, int *next, jsontok_type_t type,
+                            int start, int end, int parent) {
+    if ((size_t)*next >= max_tokens) {
+        return NULL;
+    }
+    jsontok_t *tok = &tokens[(*next)++];
+    tok->type = type;
+    tok->start = start;
+    tok->end = end;
+    tok->size = 0;
+    tok->parent = parent;
+    return tok;
+}
+
+// A key token is a string whose parent is an object
+static bool is_key(const jsontok_t *tokens, int index) {
+    return index >= 0 && tokens[index].type == JSONTOK_STRING &&
+           tokens[index].parent >= 0 && tokens[tokens[index].parent].type == JSONTOK_OBJECT;
+}
+
+// Attach a new value to the current container; objects only accept string keys
+static esp_err_t attach(jsontok_t *tokens, int super, jsontok_type_t type) {
+    if (super < 0) {
+        return ESP_OK;
+    }
+    if (tokens[super].type == JSONTOK_OBJECT && type != JSONTOK_STRING) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (is_key(tokens, super) && tokens[super].size > 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    tokens[super].size++;
+    return ESP_OK;
+}
+
+// State after a complete value: a separator inside a container, nothing at the top level
+static expect_t after_value(const jsontok_t *tokens, int super) {
+    if (is_key(tokens, super)) {
+        super = tokens[super].parent;
+    }
+    return super < 0 ? EXPECT_END : EXPECT_COMMA_OR_CLOSE;
+}
+
+static bool expects_value(expect_t expect) {
+    return expect == EXPECT_VALUE || expect == EXPECT_VALUE_OR_CLOSE;
+}
+
+static int is_hex(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static esp_err_t scan_string(const char *json, size_t len, size_t *pos) {
+    for (size_t i = *pos + 1; i < len; i++) {
+        char c = json[i];
+        if (c == '"') {
+            *pos = i;
+            return ESP_OK;
+        }
+        if ((unsigned char)c < 0x20) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (c == '\\') {
+            if (++i >= len) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            switch (json[i]) {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                break;
+            case 'u':
+                if (i + 4 >= len) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                for (int k = 1; k <= 4; k++) {
+                    if (!is_hex(json[i + k])) {
+                        return ESP_ERR_INVALID_ARG;
+                    }
+                }
+                // An embedded NUL would silently truncate the decoded C string
+                if (memcmp(json + i + 1, "0000", 4) == 0) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                i += 4;
+                break;
+            default:
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+static size_t scan_primitive(const char *json, size_t len, size_t pos) {
+    while (pos < len) {
+        char c = json[pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ']' || c == '}' || c == ':') {
+            break;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+esp_err_t jsontok_parse(const char *json, size_t len, jsontok_t *tokens, size_t max_tokens, int *count) {
+    if (json == NULL || tokens == NULL || count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int next = 0;
+    int super = -1;
+    int roots = 0;
+    expect_t expect = EXPECT_VALUE;
+
+    for (size_t pos = 0; pos < len; pos++) {
+        char c = json[pos];
+        jsontok_t *tok;
+
+        switch (c) {
+        case '{':
+        case '[': {
+            jsontok_type_t type = c == '{' ? JSONTOK_OBJECT : JSONTOK_ARRAY;
+            if (!expects_value(expect) || attach(tokens, super, type) != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            tok = new_token(tokens, max_tokens, &next, type, (int)pos, -1, super);
+            if (tok == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            roots += super < 0;
+            super = next - 1;
+            expect = type == JSONTOK_OBJECT ? EXPECT_KEY_OR_CLOSE : EXPECT_VALUE_OR_CLOSE;
+            break;
+        }
+        case '}':
+        case ']': {
+            jsontok_type_t type = c == '}' ? JSONTOK_OBJECT : JSONTOK_ARRAY;
+            // Rejects a trailing comma and a key without a value
+            if (expect != EXPECT_COMMA_OR_CLOSE &&
+                expect != (type == JSONTOK_OBJECT ? EXPECT_KEY_OR_CLOSE : EXPECT_VALUE_OR_CLOSE)) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (is_key(tokens, super)) {
+                if (tokens[super].size == 0) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                super = tokens[super].parent;
+            }
+            if (super < 0 || tokens[super].type != type || tokens[super].end != -1) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            tokens[super].end = (int)pos + 1;
+            super = tokens[super].parent;
+            expect = after_value(tokens, super);
+            break;
+        }
+        case '"': {
+            size_t start = pos;
+            bool key = expect == EXPECT_KEY || expect == EXPECT_KEY_OR_CLOSE;
+            if (!key && !expects_value(expect)) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (scan_string(json, len, &pos) != ESP_OK || attach(tokens, super, JSONTOK_STRING) != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (new_token(tokens, max_tokens, &next, JSONTOK_STRING, (int)start + 1, (int)pos, super) == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            roots += super < 0;
+            expect = key ? EXPECT_COLON : after_value(tokens, super);
+            break;
+        }
+        case ':':
+            // The key just parsed becomes the parent of the value that follows
+            if (expect != EXPECT_COLON || next == 0 || super < 0 || tokens[super].type != JSONTOK_OBJECT ||
+                tokens[next - 1].type != JSONTOK_STRING || tokens[next - 1].parent != super) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            super = next - 1;
+            expect = EXPECT_VALUE;
+            break;
+        case ',':
+            if (expect != EXPECT_COMMA_OR_CLOSE) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (is_key(tokens, super)) {
+                if (tokens[super].size == 0) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                super = tokens[super].parent;
+            }
+            if (super < 0) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            expect = tokens[super].type == JSONTOK_OBJECT ? EXPECT_KEY : EXPECT_VALUE;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        default: {
+            if (c != '-' && (c < '0' || c > '9') && c != 't' && c != 'f' && c != 'n') {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (!expects_value(expect) || attach(tokens, super, JSONTOK_PRIMITIVE) != ESP_OK) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            size_t end = scan_primitive(json, len, pos);
+            if (new_token(tokens, max_tokens, &next, JSONTOK_PRIMITIVE, (int)pos, (int)end, super) == NULL) {
+                return ESP_ERR_NO_MEM;
+            }
+            roots += super < 0;
+            pos = end - 1;
+            expect = after_value(tokens, super);
+            break;
+        }
+        }
+    }
+
+    // Unclosed containers mean the document was truncated
+    for (int i = 0; i < next; i++) {
+        if (tokens[i].end == -1) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (expect != EXPECT_END || roots != 1 || is_key(tokens, super)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *count = next;
+    return ESP_OK;
+}
+
+int jsontok_find(const char *json, const jsontok_t *tokens, int count, const char *key) {
+    if (json == NULL || tokens == NULL || key == NULL || count < 1 || tokens[0].type != JSONTOK_OBJECT) {
+        return -1;
+    }
+
+    size_t key_len = strlen(key);
+    for (int i = 1; i < count - 1; i++) {
+        const jsontok_t *tok = &tokens[i];
+        if (tok->parent == 0 && tok->type == JSONTOK_STRING &&
+            (size_t)(tok->end - tok->start) == key_len &&
+            memcmp(json + tok->start, key, key_len) == 0) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+static bool token_equals(const char *json, const jsontok_t *tok, const char *literal) {
+    size_t len = strlen(literal);
+    return (size_t)(tok->end - tok->start) == len && memcmp(json + tok->start, literal, len) == 0;
+}
+
+esp_err_t jsontok_get_bool(const char *json, const jsontok_t *tokens, int count, const char *key, bool *value) {
+    int index = jsontok_find(json, tokens, count, key);
+    if (index < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const jsontok_t *tok = &tokens[index];
+    if (tok->type != JSONTOK_PRIMITIVE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (token_equals(json, tok, "true")) {
+        *value = true;
+    } else if (token_equals(json, tok, "false")) {
+        *value = false;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+// Copy a numeric token into a NUL-terminated scratch buffer for strto*()
+static esp_err_t number_text(const char *json, const jsontok_t *tok, char *buf) {
+    int len = tok->end - tok->start;
+    if (tok->type != JSONTOK_PRIMITIVE || len <= 0 || len > NUMBER_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char first = json[tok->start];
+    if (first != '-' && (first < '0' || first > '9')) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(buf, json + tok->start, len);
+    buf[len] = '\0';
+    return ESP_OK;
+}
+
+esp_err_t jsontok_get_float(const char *json, const jsontok_t *tokens, int count, const char *key, float *value) {
+    int index = jsontok_find(json, tokens, count, key);
+    if (index < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    char buf[NUMBER_MAX_LEN + 1];
+    if (number_text(json, &tokens[index], buf) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char *end;
+    float parsed = strtof(buf, &end);
+    if (*end != '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *value = parsed;
+    return ESP_OK;
+}
+
+esp_err_t jsontok_get_int(const char *json, const jsontok_t *tokens, int count, const char *key, int *value) {
+    int index = jsontok_find(json, tokens, count, key);
+    if (index < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    char buf[NUMBER_MAX_LEN + 1];
+    if (number_text(json, &tokens[index], buf) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char *end;
+    long parsed = strtol(buf, &end, 10);
+    if (*end != '\0' || parsed < INT_MIN || parsed > INT_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *value = (int)parsed;
+    return ESP_OK;
+}
+
+static unsigned parse_hex4(const char *p) {
+    unsigned value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else {
+            value |= c - 'A' + 10;
+        }
+    }
+    return value;
+}
+
+static size_t utf8_encode(unsigned cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+esp_err_t jsontok_get_string(const char *json, const jsontok_t *tokens, int count, const char *key, char *buf, size_t size) {
+    int index = jsontok_find(json, tokens, count, key);
+    if (index < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const jsontok_t *tok = &tokens[index];
+    if (tok->type != JSONTOK_STRING || buf == NULL || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t out = 0;
+    for (int i = tok->start; i < tok->end; i++) {
+        char encoded[4];
+        size_t n = 1;
+        encoded[0] = json[i];
+
+        // Escapes were validated by the tokenizer
+        if (json[i] == '\\') {
+            char e = json[++i];
+            switch (e) {
+            case 'b': encoded[0] = '\b'; break;
+            case 'f': encoded[0] = '\f'; break;
+            case 'n': encoded[0] = '\n'; break;
+            case 'r': encoded[0] = '\r'; break;
+            case 't': encoded[0] = '\t'; break;
+            case 'u': {
+                unsigned cp = parse_hex4(json + i + 1);
+                if (cp == 0) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                i += 4;
+                // Combine a UTF-16 surrogate pair when the low half follows
+                if (cp >= 0xD800 && cp <= 0xDBFF && i + 6 < tok->end && json[i + 1] == '\\' && json[i + 2] == 'u') {
+                    unsigned low = parse_hex4(json + i + 3);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+                n = utf8_encode(cp, encoded);
+                break;
+            }
+            default: encoded[0] = e; break;
+            }
+        }
+
+        if (out + n >= size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(buf + out, encoded, n);
+        out += n;
+    }
+    buf[out] = '\0';
+    return ESP_OK;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_MAX_BUCKETS 10     ///< Finite histogram buckets, +Inf comes on top
+#define METRICS_MAX_SERIES  16     ///< Labelled histogram series shared by all metrics
+#define METRICS_LABELS_LEN  48     ///< Label set of a series including the terminator
+#define METRICS_RENDER_MIN  192    ///< Smallest buffer metrics_render() always makes progress with
+
+/**
+ * @brief Metric identifiers
+ *
+ * Histograms record durations in microseconds and are exported in seconds.
+ * Keep the numbering stable, it is the export order.
+ */
+typedef enum {
+    METRIC_HTTP_REQUEST_DURATION = 0,   ///< Histogram, one series per handler, see metrics_register_series()
+    METRIC_ONEWIRE_TRANSACTION_DURATION,///< Histogram, scratchpad read of the DS18B20
+    METRIC_ONEWIRE_CRC_ERRORS,          ///< Counter
+    METRIC_TEMP_CONVERSION_DURATION,    ///< Histogram, conversion trigger until the result is ready
+    METRIC_CONTROL_JITTER,              ///< Histogram, change of the control loop period between steps
+    METRIC_RELAY_CYCLES,                ///< Counter, off to on transitions
+    METRIC_HEAP_FREE,                   ///< Gauge, bytes
+    METRIC_HEAP_MIN_FREE,               ///< Gauge, bytes
+    METRIC_MAX
+} metric_id_t;
+
+/**
+ * @brief Handle of a labelled histogram series
+ */
+typedef uint8_t metrics_series_t;
+
+/**
+ * @brief Snapshot of one histogram series
+ */
+typedef struct {
+    uint32_t buckets[METRICS_MAX_BUCKETS + 1]; ///< Per bucket, not cumulative; the last one is +Inf
+    uint32_t count;                            ///< Sum of buckets
+    uint64_t sum_us;
+} metrics_histogram_t;
+
+/**
+ * @brief Position of a streaming render, zero-initialize before the first call
+ */
+typedef struct {
+    uint8_t metric;
+    uint8_t series;
+    uint8_t line;
+} metrics_cursor_t;
+
+/**
+ * @brief Add one to a counter
+ *
+ * This call and the other updates below are safe from any task. Counters, gauges and
+ * histogram buckets are 32-bit and updated with single atomic instructions. The 64-bit
+ * histogram sum is not lock-free: RV32 has no 64-bit atomics, so the compiler calls
+ * libatomic, which ESP-IDF implements as a short critical section with interrupts masked.
+ * Calls with an id of the wrong type are ignored.
+ * @param id Counter
+ */
+void metrics_inc(metric_id_t id);
+
+/**
+ * @brief Set a gauge
+ * @param id Gauge
+ * @param value New value
+ */
+void metrics_set(metric_id_t id, uint32_t value);
+
+/**
+ * @brief Record a duration in the unlabelled series of a histogram
+ * @param id Histogram
+ * @param value_us Duration in microseconds
+ */
+void metrics_observe(metric_id_t id, uint32_t value_us);
+
+/**
+ * @brief Record a duration in a labelled series
+ * @param series Handle from metrics_register_series()
+ * @param value_us Duration in microseconds
+ */
+void metrics_observe_series(metrics_series_t series, uint32_t value_us);
+
+/**
+ * @brief Get a labelled series of a histogram, creating it on first use
+ *
+ * Takes a spinlock, call it at setup rather than on hot paths. Registering the same
+ * labels again returns the existing series, so counts survive a server restart.
+ * @param id Histogram
+ * @param labels Prometheus label set without braces, e.g. uri="/api/state",method="GET"
+ * @param series Output: handle for metrics_observe_series()
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a non-histogram or too long labels,
+ *         ESP_ERR_NO_MEM when all METRICS_MAX_SERIES are taken
+ */
+esp_err_t metrics_register_series(metric_id_t id, const char *labels, metrics_series_t *series);
+
+/**
+ * @brief Get the value of a counter or gauge
+ * @param id Counter or gauge
+ * @return Current value, 0 for other ids
+ */
+uint32_t metrics_get(metric_id_t id);
+
+/**
+ * @brief Copy the unlabelled series of a histogram
+ * @param id Histogram
+ * @param out Output snapshot
+ * @return ESP_OK or ESP_ERR_INVALID_ARG
+ */
+esp_err_t metrics_read_histogram(metric_id_t id, metrics_histogram_t *out);
+
+/**
+ * @brief Copy a labelled series
+ * @param series Handle from metrics_register_series()
+ * @param out Output snapshot
+ * @return ESP_OK or ESP_ERR_INVALID_ARG
+ */
+esp_err_t metrics_read_series(metrics_series_t series, metrics_histogram_t *out);
+
+/**
+ * @brief Render the next lines of the Prometheus text exposition
+ *
+ * Only whole lines are written, so every call can be sent as one chunk. Each line
+ * reads the live values, a scrape is not one atomic snapshot.
+ * @param cursor Position, advanced past the rendered lines
+ * @param buf Output buffer, at least METRICS_RENDER_MIN bytes
+ * @param len Size of the output buffer
+ * @return Number of bytes written, 0 once everything was rendered
+ */
+size_t metrics_render(metrics_cursor_t *cursor, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
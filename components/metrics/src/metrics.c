@@ -0,0 +1,327 @@
+#include "metrics.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef enum {
+    METRIC_TYPE_COUNTER,
+    METRIC_TYPE_GAUGE,
+    METRIC_TYPE_HISTOGRAM
+} metric_type_t;
+
+typedef struct {
+    const char *name;
+    const char *help;
+    metric_type_t type;
+    bool labelled;              ///< Histogram exported through registered series only
+    const uint32_t *bounds_us;  ///< Ascending upper bounds of the finite buckets
+    uint8_t bucket_count;
+} metric_desc_t;
+
+#define BOUNDS(array) (array), (uint8_t)(sizeof(array) / sizeof((array)[0]))
+
+static const uint32_t k_http_bounds[] = {
+    1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+// A scratchpad read is reset + 11 bytes, about 7 ms on a healthy bus
+static const uint32_t k_onewire_bounds[] = {
+    2000, 5000, 7500, 10000, 15000, 25000, 50000, 100000
+};
+// 12-bit conversions take up to 750 ms
+static const uint32_t k_conversion_bounds[] = {
+    100000, 200000, 400000, 600000, 700000, 750000, 800000, 900000, 1000000, 1500000
+};
+static const uint32_t k_jitter_bounds[] = {
+    1000, 5000, 10000, 20000, 50000, 100000, 250000, 500000, 1000000
+};
+
+static const metric_desc_t k_metrics[METRIC_MAX] = {
+    [METRIC_HTTP_REQUEST_DURATION] = {
+        "teapot_http_request_duration_seconds", "Time spent in HTTP handlers",
+        METRIC_TYPE_HISTOGRAM, true, BOUNDS(k_http_bounds) },
+    [METRIC_ONEWIRE_TRANSACTION_DURATION] = {
+        "teapot_onewire_transaction_duration_seconds", "DS18B20 scratchpad read time",
+        METRIC_TYPE_HISTOGRAM, false, BOUNDS(k_onewire_bounds) },
+    [METRIC_ONEWIRE_CRC_ERRORS] = {
+        "teapot_onewire_crc_errors_total", "DS18B20 scratchpad reads with a bad CRC",
+        METRIC_TYPE_COUNTER },
+    [METRIC_TEMP_CONVERSION_DURATION] = {
+        "teapot_temp_conversion_duration_seconds", "Temperature conversion time",
+        METRIC_TYPE_HISTOGRAM, false, BOUNDS(k_conversion_bounds) },
+    [METRIC_CONTROL_JITTER] = {
+        "teapot_control_period_jitter_seconds", "Change of the control loop period from one step to the next",
+        METRIC_TYPE_HISTOGRAM, false, BOUNDS(k_jitter_bounds) },
+    [METRIC_RELAY_CYCLES] = {
+        "teapot_relay_cycles_total", "Relay off to on transitions",
+        METRIC_TYPE_COUNTER },
+    [METRIC_HEAP_FREE] = {
+        "teapot_heap_free_bytes", "Free heap",
+        METRIC_TYPE_GAUGE },
+    [METRIC_HEAP_MIN_FREE] = {
+        "teapot_heap_min_free_bytes", "Lowest free heap since boot",
+        METRIC_TYPE_GAUGE },
+};
+
+typedef struct {
+    uint32_t buckets[METRICS_MAX_BUCKETS + 1];
+    uint64_t sum_us;
+} histogram_t;
+
+typedef struct {
+    uint8_t metric;
+    char labels[METRICS_LABELS_LEN];
+    histogram_t histogram;
+} series_t;
+
+static uint32_t g_values[METRIC_MAX];
+static histogram_t g_histograms[METRIC_MAX];
+static series_t g_series[METRICS_MAX_SERIES];
+static uint32_t g_series_count = 0;
+static portMUX_TYPE g_series_lock = portMUX_INITIALIZER_UNLOCKED;
+
+_Static_assert(METRIC_MAX <= UINT8_MAX, "metrics_cursor_t stores metric ids in a byte");
+_Static_assert(METRICS_MAX_SERIES <= UINT8_MAX, "metrics_series_t is a byte");
+
+static bool is_type(metric_id_t id, metric_type_t type) {
+    return (unsigned)id < METRIC_MAX && k_metrics[id].type == type;
+}
+
+void metrics_inc(metric_id_t id) {
+    if (is_type(id, METRIC_TYPE_COUNTER)) {
+        __atomic_fetch_add(&g_values[id], 1, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_set(metric_id_t id, uint32_t value) {
+    if (is_type(id, METRIC_TYPE_GAUGE)) {
+        __atomic_store_n(&g_values[id], value, __ATOMIC_RELAXED);
+    }
+}
+
+// The bucket and the sum are two separate atomics, so a reader may see one without the other
+static void histogram_observe(histogram_t *histogram, const metric_desc_t *desc, uint32_t value_us) {
+    uint8_t bucket = 0;
+    while (bucket < desc->bucket_count && value_us > desc->bounds_us[bucket]) {
+        bucket++;
+    }
+    __atomic_fetch_add(&histogram->buckets[bucket], 1, __ATOMIC_RELAXED);
+    // A libatomic call on RV32, see metrics_inc()
+    __atomic_fetch_add(&histogram->sum_us, value_us, __ATOMIC_RELAXED);
+}
+
+void metrics_observe(metric_id_t id, uint32_t value_us) {
+    if (is_type(id, METRIC_TYPE_HISTOGRAM) && !k_metrics[id].labelled) {
+        histogram_observe(&g_histograms[id], &k_metrics[id], value_us);
+    }
+}
+
+void metrics_observe_series(metrics_series_t series, uint32_t value_us) {
+    if (series < __atomic_load_n(&g_series_count, __ATOMIC_ACQUIRE)) {
+        histogram_observe(&g_series[series].histogram, &k_metrics[g_series[series].metric], value_us);
+    }
+}
+
+esp_err_t metrics_register_series(metric_id_t id, const char *labels, metrics_series_t *series) {
+    if (!is_type(id, METRIC_TYPE_HISTOGRAM) || !k_metrics[id].labelled || labels == NULL || series == NULL ||
+        strlen(labels) >= METRICS_LABELS_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&g_series_lock);
+    for (uint32_t i = 0; i < g_series_count; i++) {
+        if (g_series[i].metric == id && strcmp(g_series[i].labels, labels) == 0) {
+            *series = (metrics_series_t)i;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    if (ret != ESP_OK && g_series_count < METRICS_MAX_SERIES) {
+        series_t *slot = &g_series[g_series_count];
+        memset(slot, 0, sizeof(*slot));
+        slot->metric = (uint8_t)id;
+        strcpy(slot->labels, labels);
+        *series = (metrics_series_t)g_series_count;
+        // Published last: observers and the renderer only look below the count
+        __atomic_store_n(&g_series_count, g_series_count + 1, __ATOMIC_RELEASE);
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&g_series_lock);
+    return ret;
+}
+
+uint32_t metrics_get(metric_id_t id) {
+    if (is_type(id, METRIC_TYPE_COUNTER) || is_type(id, METRIC_TYPE_GAUGE)) {
+        return __atomic_load_n(&g_values[id], __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+static void histogram_read(const histogram_t *histogram, metrics_histogram_t *out) {
+    out->count = 0;
+    for (size_t i = 0; i <= METRICS_MAX_BUCKETS; i++) {
+        out->buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+        out->count += out->buckets[i];
+    }
+    out->sum_us = __atomic_load_n(&histogram->sum_us, __ATOMIC_RELAXED);
+}
+
+esp_err_t metrics_read_histogram(metric_id_t id, metrics_histogram_t *out) {
+    if (!is_type(id, METRIC_TYPE_HISTOGRAM) || k_metrics[id].labelled || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    histogram_read(&g_histograms[id], out);
+    return ESP_OK;
+}
+
+esp_err_t metrics_read_series(metrics_series_t series, metrics_histogram_t *out) {
+    if (series >= __atomic_load_n(&g_series_count, __ATOMIC_ACQUIRE) || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    histogram_read(&g_series[series].histogram, out);
+    return ESP_OK;
+}
+
+// Microseconds as decimal seconds without trailing zeros, e.g. 750000 -> "0.75"
+static void format_seconds(char *buf, size_t len, uint64_t us) {
+    unsigned long whole = (unsigned long)(us / 1000000);
+    unsigned long frac = (unsigned long)(us % 1000000);
+    if (frac == 0) {
+        snprintf(buf, len, "%lu", whole);
+        return;
+    }
+    int digits = 6;
+    while (frac % 10 == 0) {
+        frac /= 10;
+        digits--;
+    }
+    snprintf(buf, len, "%lu.%0*lu", whole, digits, frac);
+}
+
+static const char *type_name(metric_type_t type) {
+    switch (type) {
+    case METRIC_TYPE_COUNTER:
+        return "counter";
+    case METRIC_TYPE_GAUGE:
+        return "gauge";
+    default:
+        return "histogram";
+    }
+}
+
+// Moves the cursor onto the next series of its histogram; false once there is none
+static bool find_series(metrics_cursor_t *cursor, const histogram_t **histogram, const char **labels) {
+    if (!k_metrics[cursor->metric].labelled) {
+        *histogram = &g_histograms[cursor->metric];
+        *labels = "";
+        return cursor->series == 0;
+    }
+
+    uint32_t count = __atomic_load_n(&g_series_count, __ATOMIC_ACQUIRE);
+    while (cursor->series < count && g_series[cursor->series].metric != cursor->metric) {
+        cursor->series++;
+        cursor->line = 2;
+    }
+    if (cursor->series >= count) {
+        return false;
+    }
+    *histogram = &g_series[cursor->series].histogram;
+    *labels = g_series[cursor->series].labels;
+    return true;
+}
+
+// Row of a histogram series: the buckets, +Inf, _sum and _count
+static int format_histogram_row(const metric_desc_t *desc, const histogram_t *histogram, const char *labels,
+                                unsigned row, char *line, size_t size) {
+    metrics_histogram_t snapshot;
+    histogram_read(histogram, &snapshot);
+    const char *sep = labels[0] != '\0' ? "," : "";
+    char value[24];
+
+    if (row <= desc->bucket_count) {
+        uint32_t cumulative = 0;
+        for (unsigned i = 0; i <= row; i++) {
+            cumulative += snapshot.buckets[i];
+        }
+        if (row == desc->bucket_count) {
+            // The last finite bucket may have been read before a concurrent observation
+            cumulative = snapshot.count;
+            strcpy(value, "+Inf");
+        } else {
+            format_seconds(value, sizeof(value), desc->bounds_us[row]);
+        }
+        return snprintf(line, size, "%s_bucket{%s%sle=\"%s\"} %lu\n", desc->name, labels, sep, value,
+                        (unsigned long)cumulative);
+    }
+
+    const char *open = labels[0] != '\0' ? "{" : "";
+    const char *close = labels[0] != '\0' ? "}" : "";
+    if (row == desc->bucket_count + 1u) {
+        format_seconds(value, sizeof(value), snapshot.sum_us);
+        return snprintf(line, size, "%s_sum%s%s%s %s\n", desc->name, open, labels, close, value);
+    }
+    return snprintf(line, size, "%s_count%s%s%s %lu\n", desc->name, open, labels, close,
+                    (unsigned long)snapshot.count);
+}
+
+// Formats the line at the cursor, first moving it past positions that have none.
+// Returns 0 once all metrics are rendered.
+static int format_line(metrics_cursor_t *cursor, char *line, size_t size) {
+    while (cursor->metric < METRIC_MAX) {
+        const metric_desc_t *desc = &k_metrics[cursor->metric];
+        if (cursor->line == 0) {
+            return snprintf(line, size, "# HELP %s %s\n", desc->name, desc->help);
+        }
+        if (cursor->line == 1) {
+            return snprintf(line, size, "# TYPE %s %s\n", desc->name, type_name(desc->type));
+        }
+
+        if (desc->type != METRIC_TYPE_HISTOGRAM) {
+            if (cursor->line == 2) {
+                return snprintf(line, size, "%s %lu\n", desc->name,
+                                (unsigned long)__atomic_load_n(&g_values[cursor->metric], __ATOMIC_RELAXED));
+            }
+        } else {
+            const histogram_t *histogram;
+            const char *labels;
+            while (find_series(cursor, &histogram, &labels)) {
+                unsigned row = cursor->line - 2u;
+                if (row <= desc->bucket_count + 2u) {
+                    return format_histogram_row(desc, histogram, labels, row, line, size);
+                }
+                cursor->series++;
+                cursor->line = 2;
+            }
+        }
+
+        cursor->metric++;
+        cursor->series = 0;
+        cursor->line = 0;
+    }
+    return 0;
+}
+
+size_t metrics_render(metrics_cursor_t *cursor, char *buf, size_t len) {
+    if (cursor == NULL || buf == NULL) {
+        return 0;
+    }
+
+    size_t used = 0;
+    char line[METRICS_RENDER_MIN];
+    int n;
+    while ((n = format_line(cursor, line, sizeof(line))) > 0) {
+        if ((size_t)n >= sizeof(line)) {
+            n = sizeof(line) - 1;
+            line[n - 1] = '\n';
+        }
+        // Keep the line for the next call; a fresh buffer always has room for it
+        if (used + (size_t)n > len) {
+            break;
+        }
+        memcpy(buf + used, line, (size_t)n);
+        used += (size_t)n;
+        cursor->line++;
+    }
+    return used;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "esp_err.h"
+#include "config.h"
+#include "wifi_web.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start publishing telemetry to an MQTT broker
+ *
+ * Topics under the configured prefix:
+ *  - <prefix>/status        "online"/"offline" (retained, offline is the last will)
+ *  - <prefix>/state         JSON state as served by GET /api/state (retained), published
+ *                           when power, setpoint or relay change; temperature alone does not
+ *  - <prefix>/samples       control-loop samples batched once per batch window, see telemetry_batch.h
+ *  - <prefix>/cmd/power     "on"/"off"/"1"/"0"/"true"/"false" -> wifi_web_set_power()
+ *  - <prefix>/cmd/setpoint  number -> wifi_web_set_setpoint()
+ *  - <prefix>/cmd/state     JSON update as accepted by PATCH /api/state
+ *
+ * Samples are queued in RAM while the broker is unreachable (up to TELEMETRY_QUEUE_CAPACITY,
+ * oldest dropped first) and drained on reconnect.
+ *
+ * To try it against a local broker:
+ *   mosquitto -v
+ *   mosquitto_sub -v -t 'teapot/#'
+ *   mosquitto_pub -t teapot/cmd/power -m on
+ *
+ * @param ctx Web server context owning the state
+ * @param config Broker settings; the strings are copied
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if already running, or an error code
+ */
+esp_err_t mqtt_telemetry_start(wifi_web_ctx_t *ctx, const teapot_mqtt_config_t *config);
+
+/**
+ * @brief Disconnect from the broker and stop publishing
+ *
+ * Queued samples are discarded.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t mqtt_telemetry_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_QUEUE_CAPACITY 256     ///< Samples kept while the broker is unreachable (~8.5 min at 2 s)
+#define TELEMETRY_BATCH_MAX_SAMPLES 64   ///< Samples per published message
+#define TELEMETRY_SAMPLE_JSON_MAX 25     ///< "[4294967295,-327.68,1,1],"
+#define TELEMETRY_BATCH_JSON_OVERHEAD 56 ///< {"t0":..,"dropped":..,"samples":[ ... ]}
+#define TELEMETRY_BATCH_BUF_SIZE \
+    (TELEMETRY_BATCH_JSON_OVERHEAD + TELEMETRY_BATCH_MAX_SAMPLES * TELEMETRY_SAMPLE_JSON_MAX)
+
+#define TELEMETRY_SAMPLE_IS_ON (1u << 0)
+#define TELEMETRY_SAMPLE_RELAY (1u << 1)
+
+/**
+ * @brief Compact control-loop sample, 8 bytes
+ */
+typedef struct {
+    uint32_t uptime_ms;   ///< Milliseconds since boot, wraps after ~49 days
+    int16_t temp_centi;   ///< Temperature in hundredths of a degree
+    uint8_t flags;        ///< TELEMETRY_SAMPLE_* bits
+} telemetry_sample_t;
+
+/**
+ * @brief Fixed-size FIFO of samples that overwrites the oldest entry when full
+ *
+ * Samples are addressed by a sequence number that keeps counting across
+ * overwrites, so a reader can copy a batch out, publish it without holding
+ * a lock and then release exactly what it sent even if the queue wrapped
+ * in the meantime. Not thread-safe: the caller provides the locking.
+ */
+typedef struct {
+    telemetry_sample_t samples[TELEMETRY_QUEUE_CAPACITY];
+    uint32_t head_seq;    ///< Sequence number of the oldest queued sample
+    uint32_t count;
+    uint32_t dropped;     ///< Samples overwritten before they were released
+} telemetry_queue_t;
+
+/**
+ * @brief Empty the queue and reset the drop counter
+ * @param queue Queue
+ */
+void telemetry_queue_init(telemetry_queue_t *queue);
+
+/**
+ * @brief Append a sample, overwriting the oldest one if the queue is full
+ * @param queue Queue
+ * @param sample Sample to copy
+ */
+void telemetry_queue_push(telemetry_queue_t *queue, const telemetry_sample_t *sample);
+
+/**
+ * @brief Copy the oldest samples without removing them
+ * @param queue Queue
+ * @param out Destination array
+ * @param max Capacity of out
+ * @param first_seq Sequence number of out[0]
+ * @return Number of samples copied
+ */
+size_t telemetry_queue_peek(const telemetry_queue_t *queue, telemetry_sample_t *out, size_t max, uint32_t *first_seq);
+
+/**
+ * @brief Remove every sample with a sequence number before end_seq
+ *
+ * Samples already overwritten are skipped, so releasing a stale batch never
+ * removes samples pushed after it was peeked.
+ *
+ * @param queue Queue
+ * @param end_seq first_seq from telemetry_queue_peek() plus the number of samples sent
+ */
+void telemetry_queue_release(telemetry_queue_t *queue, uint32_t end_seq);
+
+/**
+ * @brief Encode samples as one JSON batch message
+ *
+ * Format: {"t0":<uptime_ms>,"dropped":<n>,"samples":[[<dt_ms>,<temp>,<is_on>,<relay>],...]}
+ * where dt_ms is relative to t0, the uptime of the first sample.
+ *
+ * @param samples Samples, oldest first
+ * @param count Number of samples, at most TELEMETRY_BATCH_MAX_SAMPLES fit TELEMETRY_BATCH_BUF_SIZE
+ * @param dropped Samples lost to queue overflow, reported so gaps are visible downstream
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @param len Length of the JSON text (not NUL-terminated)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on bad arguments, ESP_ERR_NO_MEM if buf is too small
+ */
+esp_err_t telemetry_batch_encode(const telemetry_sample_t *samples, size_t count, uint32_t dropped,
+                                 char *buf, size_t size, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,346 @@
+#include "mqtt_telemetry.h"
+#include "telemetry_batch.h"
+#include "mqtt_client.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "MQTT_TELEMETRY";
+
+#define MQTT_TOPIC_SUFFIX_MAX 16        // Longest suffix is "/cmd/setpoint"
+#define MQTT_TOPIC_BUF_SIZE (CONFIG_MQTT_TOPIC_MAX_LEN + MQTT_TOPIC_SUFFIX_MAX)
+#define MQTT_STATE_BUF_SIZE 160
+#define MQTT_COMMAND_MAX 128
+#define MQTT_QOS 1
+#define MQTT_TASK_STACK 4096
+#define MQTT_TASK_PRIORITY 4
+// A publish that races a disconnect is parked in the esp-mqtt outbox and the batch leaves
+// the queue; the limit keeps that outbox within what the queue itself could hold, after
+// which publishing fails and the samples stay queued. 64 bytes per message cover the topic
+// and the packet header.
+#define MQTT_OUTBOX_LIMIT \
+    ((TELEMETRY_QUEUE_CAPACITY / TELEMETRY_BATCH_MAX_SAMPLES) * (TELEMETRY_BATCH_BUF_SIZE + 64) + \
+     2 * (MQTT_STATE_BUF_SIZE + 64))
+
+#define EV_STATE_CHANGED (1u << 0)
+#define EV_CONNECTED     (1u << 1)
+#define EV_STOP          (1u << 2)
+
+// The queue and connected flag are shared with the listeners and the esp-mqtt task;
+// everything else is owned by the publisher task
+static struct {
+    wifi_web_ctx_t *ctx;
+    esp_mqtt_client_handle_t client;
+    TaskHandle_t task;
+    portMUX_TYPE lock;
+    telemetry_queue_t queue;
+    bool connected;
+    bool listeners_added;
+    TickType_t window_ticks;
+    char status_topic[MQTT_TOPIC_BUF_SIZE];
+    char state_topic[MQTT_TOPIC_BUF_SIZE];
+    char samples_topic[MQTT_TOPIC_BUF_SIZE];
+    char cmd_prefix[MQTT_TOPIC_BUF_SIZE];
+    char cmd_filter[MQTT_TOPIC_BUF_SIZE];
+    wifi_web_state_packed_t last_state;
+    bool last_state_valid;
+    telemetry_sample_t batch[TELEMETRY_BATCH_MAX_SAMPLES];
+    char batch_json[TELEMETRY_BATCH_BUF_SIZE];
+    uint8_t state_json[MQTT_STATE_BUF_SIZE];
+} g_mqtt = { .lock = portMUX_INITIALIZER_UNLOCKED };
+
+static void notify_task(uint32_t events) {
+    TaskHandle_t task = __atomic_load_n(&g_mqtt.task, __ATOMIC_ACQUIRE);
+    if (task != NULL) {
+        xTaskNotify(task, events, eSetBits);
+    }
+}
+
+static void mqtt_state_listener(wifi_web_ctx_t *ctx, void *arg) {
+    notify_task(EV_STATE_CHANGED);
+}
+
+static void mqtt_sample_listener(wifi_web_ctx_t *ctx, const teapot_sample_t *sample, void *arg) {
+    if (__atomic_load_n(&g_mqtt.task, __ATOMIC_ACQUIRE) == NULL) {
+        return;
+    }
+
+    float centi = sample->temperature * 100.0f;
+    telemetry_sample_t entry = {
+        .uptime_ms = (uint32_t)(sample->timestamp_us / 1000),
+        .temp_centi = (int16_t)(centi + (centi < 0 ? -0.5f : 0.5f)),
+        .flags = (sample->is_on ? TELEMETRY_SAMPLE_IS_ON : 0) | (sample->relay_on ? TELEMETRY_SAMPLE_RELAY : 0)
+    };
+    taskENTER_CRITICAL(&g_mqtt.lock);
+    telemetry_queue_push(&g_mqtt.queue, &entry);
+    taskEXIT_CRITICAL(&g_mqtt.lock);
+}
+
+// Publishes the retained state when anything but the temperature changed
+static void publish_state(bool force) {
+    wifi_web_state_packed_t packed;
+    size_t len;
+    if (wifi_web_render_state(g_mqtt.ctx, WIFI_WEB_FORMAT_PACKED, (uint8_t *)&packed, sizeof(packed), &len, NULL) != ESP_OK) {
+        return;
+    }
+    if (!force && g_mqtt.last_state_valid &&
+        packed.flags == g_mqtt.last_state.flags && packed.setpoint_centi == g_mqtt.last_state.setpoint_centi) {
+        return;
+    }
+
+    if (wifi_web_render_state(g_mqtt.ctx, WIFI_WEB_FORMAT_JSON, g_mqtt.state_json, sizeof(g_mqtt.state_json), &len, NULL) != ESP_OK) {
+        return;
+    }
+    if (esp_mqtt_client_publish(g_mqtt.client, g_mqtt.state_topic, (const char *)g_mqtt.state_json, (int)len, MQTT_QOS, 1) >= 0) {
+        g_mqtt.last_state = packed;
+        g_mqtt.last_state_valid = true;
+    }
+}
+
+// Sends everything queued, TELEMETRY_BATCH_MAX_SAMPLES per message; stops at the first failure
+// (including a full outbox, see MQTT_OUTBOX_LIMIT) and keeps the rest queued for the next
+// window or reconnect
+static void publish_samples(void) {
+    while (__atomic_load_n(&g_mqtt.connected, __ATOMIC_ACQUIRE)) {
+        uint32_t first_seq;
+        uint32_t dropped;
+        taskENTER_CRITICAL(&g_mqtt.lock);
+        size_t count = telemetry_queue_peek(&g_mqtt.queue, g_mqtt.batch, TELEMETRY_BATCH_MAX_SAMPLES, &first_seq);
+        dropped = g_mqtt.queue.dropped;
+        taskEXIT_CRITICAL(&g_mqtt.lock);
+        if (count == 0) {
+            return;
+        }
+
+        size_t len;
+        if (telemetry_batch_encode(g_mqtt.batch, count, dropped, g_mqtt.batch_json, sizeof(g_mqtt.batch_json), &len) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to encode sample batch");
+            return;
+        }
+        if (esp_mqtt_client_publish(g_mqtt.client, g_mqtt.samples_topic, g_mqtt.batch_json, (int)len, MQTT_QOS, 0) < 0) {
+            ESP_LOGW(TAG, "Failed to publish %u samples, keeping them queued", (unsigned)count);
+            return;
+        }
+
+        taskENTER_CRITICAL(&g_mqtt.lock);
+        telemetry_queue_release(&g_mqtt.queue, first_seq + (uint32_t)count);
+        // Only the drops reported in this batch are cleared; later ones go out with the next batch
+        g_mqtt.queue.dropped -= dropped;
+        taskEXIT_CRITICAL(&g_mqtt.lock);
+    }
+}
+
+static esp_err_t parse_power(const char *text, bool *is_on) {
+    static const char *const on[] = { "on", "1", "true" };
+    static const char *const off[] = { "off", "0", "false" };
+    for (size_t i = 0; i < sizeof(on) / sizeof(on[0]); i++) {
+        if (strcasecmp(text, on[i]) == 0) {
+            *is_on = true;
+            return ESP_OK;
+        }
+        if (strcasecmp(text, off[i]) == 0) {
+            *is_on = false;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+// Runs in the esp-mqtt task; every command ends up in the same validated setters as HTTP
+static void handle_command(const char *topic, int topic_len, const char *data, int data_len) {
+    size_t prefix_len = strlen(g_mqtt.cmd_prefix);
+    if (topic_len <= (int)prefix_len || strncmp(topic, g_mqtt.cmd_prefix, prefix_len) != 0) {
+        return;
+    }
+    const char *name = topic + prefix_len;
+    int name_len = topic_len - (int)prefix_len;
+
+    char payload[MQTT_COMMAND_MAX];
+    if (data_len < 0 || data_len >= (int)sizeof(payload)) {
+        ESP_LOGW(TAG, "Ignoring oversized command on %.*s", topic_len, topic);
+        return;
+    }
+    memcpy(payload, data, (size_t)data_len);
+    payload[data_len] = '\0';
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    if (name_len == 5 && strncmp(name, "power", 5) == 0) {
+        bool is_on;
+        ret = parse_power(payload, &is_on);
+        if (ret == ESP_OK) {
+            ret = wifi_web_set_power(g_mqtt.ctx, is_on);
+        }
+    } else if (name_len == 8 && strncmp(name, "setpoint", 8) == 0) {
+        char *end;
+        float setpoint = strtof(payload, &end);
+        ret = end != payload && *end == '\0' ? wifi_web_set_setpoint(g_mqtt.ctx, setpoint) : ESP_ERR_INVALID_ARG;
+    } else if (name_len == 5 && strncmp(name, "state", 5) == 0) {
+        teapot_state_update_t update;
+        ret = wifi_web_parse_update(payload, (size_t)data_len, &update);
+        if (ret == ESP_OK) {
+            ret = wifi_web_apply_update(g_mqtt.ctx, &update);
+        }
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Rejected command on %.*s: %s", topic_len, topic, esp_err_to_name(ret));
+    }
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected to broker");
+        __atomic_store_n(&g_mqtt.connected, true, __ATOMIC_RELEASE);
+        esp_mqtt_client_subscribe(event->client, g_mqtt.cmd_filter, MQTT_QOS);
+        notify_task(EV_CONNECTED);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "Disconnected from broker, buffering samples");
+        __atomic_store_n(&g_mqtt.connected, false, __ATOMIC_RELEASE);
+        break;
+    case MQTT_EVENT_DATA:
+        // Commands are tiny; a fragmented message can only be a malformed one
+        if (event->current_data_offset != 0 || event->data_len != event->total_data_len) {
+            break;
+        }
+        handle_command(event->topic, event->topic_len, event->data, event->data_len);
+        break;
+    default:
+        break;
+    }
+}
+
+static void mqtt_telemetry_task(void *arg) {
+    ESP_LOGI(TAG, "Telemetry task started");
+    TickType_t next_flush = xTaskGetTickCount() + g_mqtt.window_ticks;
+
+    while (1) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = (int32_t)(next_flush - now) > 0 ? next_flush - now : 0;
+        uint32_t events = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &events, wait);
+
+        if (events & EV_STOP) {
+            break;
+        }
+
+        bool connected = __atomic_load_n(&g_mqtt.connected, __ATOMIC_ACQUIRE);
+        if (events & EV_CONNECTED) {
+            esp_mqtt_client_publish(g_mqtt.client, g_mqtt.status_topic, "online", 0, MQTT_QOS, 1);
+            publish_state(true);
+            // Drain what was buffered while offline instead of waiting for the window
+            publish_samples();
+        } else if ((events & EV_STATE_CHANGED) && connected) {
+            publish_state(false);
+        }
+
+        if ((int32_t)(xTaskGetTickCount() - next_flush) >= 0) {
+            publish_samples();
+            next_flush = xTaskGetTickCount() + g_mqtt.window_ticks;
+        }
+    }
+
+    ESP_LOGI(TAG, "Telemetry task stopped");
+    __atomic_store_n(&g_mqtt.task, NULL, __ATOMIC_RELEASE);
+    vTaskDelete(NULL);
+}
+
+esp_err_t mqtt_telemetry_start(wifi_web_ctx_t *ctx, const teapot_mqtt_config_t *config) {
+    if (ctx == NULL || config == NULL || config->uri[0] == '\0' || config->batch_window_s == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (g_mqtt.task != NULL) {
+        ESP_LOGW(TAG, "MQTT telemetry already running");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    g_mqtt.ctx = ctx;
+    g_mqtt.window_ticks = pdMS_TO_TICKS((uint32_t)config->batch_window_s * 1000);
+    g_mqtt.last_state_valid = false;
+    g_mqtt.connected = false;
+    snprintf(g_mqtt.status_topic, sizeof(g_mqtt.status_topic), "%s/status", config->topic);
+    snprintf(g_mqtt.state_topic, sizeof(g_mqtt.state_topic), "%s/state", config->topic);
+    snprintf(g_mqtt.samples_topic, sizeof(g_mqtt.samples_topic), "%s/samples", config->topic);
+    snprintf(g_mqtt.cmd_prefix, sizeof(g_mqtt.cmd_prefix), "%s/cmd/", config->topic);
+    snprintf(g_mqtt.cmd_filter, sizeof(g_mqtt.cmd_filter), "%s/cmd/+", config->topic);
+    telemetry_queue_init(&g_mqtt.queue);
+
+    const esp_mqtt_client_config_t mqtt_config = {
+        .broker.address.uri = config->uri,
+        .session.last_will = {
+            .topic = g_mqtt.status_topic,
+            .msg = "offline",
+            .qos = MQTT_QOS,
+            .retain = 1
+        },
+        .outbox.limit = MQTT_OUTBOX_LIMIT
+    };
+    g_mqtt.client = esp_mqtt_client_init(&mqtt_config);
+    if (g_mqtt.client == NULL) {
+        ESP_LOGE(TAG, "Failed to create MQTT client");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_mqtt_client_register_event(g_mqtt.client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
+    if (!g_mqtt.listeners_added) {
+        esp_err_t ret = wifi_web_add_state_listener(mqtt_state_listener, NULL);
+        if (ret == ESP_OK) {
+            ret = wifi_web_add_sample_listener(mqtt_sample_listener, NULL);
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to subscribe to state changes: %s", esp_err_to_name(ret));
+            esp_mqtt_client_destroy(g_mqtt.client);
+            g_mqtt.client = NULL;
+            return ret;
+        }
+        g_mqtt.listeners_added = true;
+    }
+
+    // The task must exist before the client can report a connection to it
+    BaseType_t task_ret = xTaskCreate(mqtt_telemetry_task, "mqtt_telemetry", MQTT_TASK_STACK, NULL,
+                                      MQTT_TASK_PRIORITY, &g_mqtt.task);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create telemetry task");
+        g_mqtt.task = NULL;
+        esp_mqtt_client_destroy(g_mqtt.client);
+        g_mqtt.client = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Connects (and reconnects) in the background once the network is up
+    esp_err_t ret = esp_mqtt_client_start(g_mqtt.client);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MQTT client: %s", esp_err_to_name(ret));
+        mqtt_telemetry_stop();
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Publishing telemetry to %s under %s/, batch window %us",
+             config->uri, config->topic, (unsigned)config->batch_window_s);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_telemetry_stop(void) {
+    // Stop the publisher first: it may be inside esp_mqtt_client_publish() right now
+    if (__atomic_load_n(&g_mqtt.task, __ATOMIC_ACQUIRE) != NULL) {
+        notify_task(EV_STOP);
+        while (__atomic_load_n(&g_mqtt.task, __ATOMIC_ACQUIRE) != NULL) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+
+    if (g_mqtt.client != NULL) {
+        esp_mqtt_client_destroy(g_mqtt.client);
+        g_mqtt.client = NULL;
+    }
+    __atomic_store_n(&g_mqtt.connected, false, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
@@ -0,0 +1,84 @@
+#include "telemetry_batch.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+void telemetry_queue_init(telemetry_queue_t *queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+void telemetry_queue_push(telemetry_queue_t *queue, const telemetry_sample_t *sample) {
+    if (queue->count == TELEMETRY_QUEUE_CAPACITY) {
+        queue->head_seq++;
+        queue->count--;
+        queue->dropped++;
+    }
+    uint32_t seq = queue->head_seq + queue->count;
+    queue->samples[seq % TELEMETRY_QUEUE_CAPACITY] = *sample;
+    queue->count++;
+}
+
+size_t telemetry_queue_peek(const telemetry_queue_t *queue, telemetry_sample_t *out, size_t max, uint32_t *first_seq) {
+    size_t n = queue->count < max ? queue->count : max;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = queue->samples[(queue->head_seq + i) % TELEMETRY_QUEUE_CAPACITY];
+    }
+    *first_seq = queue->head_seq;
+    return n;
+}
+
+void telemetry_queue_release(telemetry_queue_t *queue, uint32_t end_seq) {
+    // Signed distance keeps the comparison right across sequence wrap-around
+    while (queue->count > 0 && (int32_t)(end_seq - queue->head_seq) > 0) {
+        queue->head_seq++;
+        queue->count--;
+    }
+}
+
+// snprintf into the remaining space; returns false once the output no longer fits
+__attribute__((format(printf, 4, 5)))
+static bool append(char *buf, size_t size, size_t *pos, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *pos, size - *pos, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size - *pos) {
+        return false;
+    }
+    *pos += (size_t)n;
+    return true;
+}
+
+esp_err_t telemetry_batch_encode(const telemetry_sample_t *samples, size_t count, uint32_t dropped,
+                                 char *buf, size_t size, size_t *len) {
+    if ((samples == NULL && count > 0) || buf == NULL || len == NULL || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t t0 = count > 0 ? samples[0].uptime_ms : 0;
+    size_t pos = 0;
+    if (!append(buf, size, &pos, "{\"t0\":%" PRIu32 ",\"dropped\":%" PRIu32 ",\"samples\":[", t0, dropped)) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const telemetry_sample_t *s = &samples[i];
+        int centi = s->temp_centi;
+        unsigned magnitude = (unsigned)(centi < 0 ? -centi : centi);
+        if (!append(buf, size, &pos, "%s[%" PRIu32 ",%s%u.%02u,%d,%d]",
+                    i > 0 ? "," : "",
+                    s->uptime_ms - t0,
+                    centi < 0 ? "-" : "", magnitude / 100, magnitude % 100,
+                    (s->flags & TELEMETRY_SAMPLE_IS_ON) != 0,
+                    (s->flags & TELEMETRY_SAMPLE_RELAY) != 0)) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (!append(buf, size, &pos, "]}")) {
+        return ESP_ERR_NO_MEM;
+    }
+    *len = pos;
+    return ESP_OK;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "esp_err.h"
+#include "profiler_pc.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROFILER_MAX_TASKS        24    ///< Tasks tracked; more make the snapshots fail
+#define PROFILER_TASK_NAME_LEN    16
+#define PROFILER_SAMPLE_PERIOD_MS 1000  ///< Interval between run-time snapshots
+#define PROFILER_WINDOW_SLOTS     10    ///< Snapshots kept, the CPU window is about their span
+
+/**
+ * @brief One task as reported by GET /api/profile
+ */
+typedef struct {
+    char name[PROFILER_TASK_NAME_LEN];
+    uint32_t task_number;     ///< FreeRTOS task number, unique for the lifetime of the task
+    uint8_t state;            ///< eTaskState, see profiler_task_state_name()
+    uint8_t priority;         ///< Current priority
+    uint32_t stack_free_min;  ///< Stack bytes never used since the task started
+    uint32_t cpu_centi;       ///< Share of CPU time over the window, hundredths of a percent
+} profiler_task_t;
+
+/**
+ * @brief PC sampling counters, see profiler_pc_table_t
+ */
+typedef struct {
+    uint32_t hz;
+    uint32_t samples;
+    uint32_t isr_samples;
+    uint32_t dropped;
+} profiler_pc_stats_t;
+
+/**
+ * @brief Start the periodic run-time snapshots and, if configured, PC sampling
+ *
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED without run-time stats, ESP_ERR_INVALID_STATE
+ *         if already started, or the error of the timer setup
+ */
+esp_err_t profiler_start(void);
+
+/**
+ * @brief Take a snapshot of all tasks
+ *
+ * CPU shares cover the time since the oldest kept snapshot, which is up to
+ * PROFILER_WINDOW_SLOTS * PROFILER_SAMPLE_PERIOD_MS ago.
+ * @param tasks Output array, PROFILER_MAX_TASKS entries are always enough
+ * @param max Capacity of the output array
+ * @param count Output: number of tasks written
+ * @param window_us Output: length of the CPU window
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED without run-time stats, ESP_ERR_INVALID_STATE
+ *         before profiler_start(), ESP_ERR_NO_MEM if more than PROFILER_MAX_TASKS tasks exist
+ */
+esp_err_t profiler_get_tasks(profiler_task_t *tasks, size_t max, size_t *count, uint32_t *window_us);
+
+/**
+ * @brief Get printable name of a task state
+ * @param state eTaskState value
+ * @return Static string such as "blocked", "unknown" for unknown values
+ */
+const char *profiler_task_state_name(uint8_t state);
+
+/**
+ * @brief Share of a counter delta in hundredths of a percent
+ *
+ * Wrap-around of 32-bit run-time counters is handled by the caller passing deltas.
+ * @param part Run time of one task over the window
+ * @param total Run time of all cores over the window
+ * @return 0..10000, 0 if total is 0
+ */
+uint32_t profiler_cpu_centi(uint32_t part, uint32_t total);
+
+/**
+ * @brief Get the PC sampling counters
+ * @param stats Output counters
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED unless CONFIG_PROFILER_PC_SAMPLING is enabled,
+ *         ESP_ERR_INVALID_STATE if the sampling timer is not running
+ */
+esp_err_t profiler_pc_stats(profiler_pc_stats_t *stats);
+
+/**
+ * @brief Copy sampled PCs, see profiler_pc_read()
+ * @param index In: 0 to start, out: where to continue
+ * @param out Output array
+ * @param max Capacity of the output array
+ * @return Number of bins copied, 0 once done or without PC sampling
+ */
+size_t profiler_pc_bins(size_t *index, profiler_pc_bin_t *out, size_t max);
+
+/**
+ * @brief Discard the PC samples, e.g. before profiling a specific scenario
+ */
+void profiler_pc_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROFILER_PC_BINS   256  ///< Distinct program counters kept (power of two)
+#define PROFILER_PC_PROBES 8    ///< Bins tried before a sample counts as dropped
+
+/**
+ * @brief Number of samples that hit one program counter
+ */
+typedef struct {
+    uint32_t pc;
+    uint32_t count;
+} profiler_pc_bin_t;
+
+/**
+ * @brief Open-addressing histogram of sampled program counters
+ */
+typedef struct {
+    profiler_pc_bin_t bins[PROFILER_PC_BINS];
+    uint32_t samples;       ///< All samples, including the ISR and dropped ones
+    uint32_t isr_samples;   ///< Samples that interrupted another interrupt handler
+    uint32_t dropped;       ///< Samples whose PC found no free bin
+} profiler_pc_table_t;
+
+/**
+ * @brief Count one sample
+ *
+ * For a single writer such as the sampling interrupt; readers may run concurrently
+ * and see a bin whose count is still 0.
+ * @param table Histogram
+ * @param pc Interrupted program counter, 0 if the sample interrupted an interrupt handler
+ */
+void profiler_pc_record(profiler_pc_table_t *table, uint32_t pc);
+
+/**
+ * @brief Copy used bins, continuing at an index
+ * @param table Histogram
+ * @param index In: first bin to look at (0 to start), out: where to continue
+ * @param out Output array
+ * @param max Capacity of the output array
+ * @return Number of bins copied, 0 once the table is exhausted
+ */
+size_t profiler_pc_read(const profiler_pc_table_t *table, size_t *index, profiler_pc_bin_t *out, size_t max);
+
+/**
+ * @brief Empty the histogram; the caller keeps the writer out meanwhile
+ * @param table Histogram
+ */
+void profiler_pc_clear(profiler_pc_table_t *table);
+
+#ifdef __cplusplus
+}
+#endif
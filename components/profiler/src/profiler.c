@@ -0,0 +1,283 @@
+#include "profiler.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <string.h>
+#if CONFIG_PROFILER_PC_SAMPLING
+#include "driver/gptimer.h"
+#include "riscv/rvruntime-frames.h"
+#endif
+
+static const char *TAG = "PROFILER";
+
+#define PROFILER_STATS_SUPPORTED (CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+
+uint32_t profiler_cpu_centi(uint32_t part, uint32_t total) {
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t centi = (uint64_t)part * 10000u / total;
+    return centi > 10000 ? 10000 : (uint32_t)centi;
+}
+
+const char *profiler_task_state_name(uint8_t state) {
+    switch (state) {
+    case eRunning:
+        return "running";
+    case eReady:
+        return "ready";
+    case eBlocked:
+        return "blocked";
+    case eSuspended:
+        return "suspended";
+    case eDeleted:
+        return "deleted";
+    default:
+        return "unknown";
+    }
+}
+
+#if CONFIG_PROFILER_PC_SAMPLING
+
+static profiler_pc_table_t g_pc_table;
+static gptimer_handle_t g_pc_timer = NULL;
+static portMUX_TYPE g_pc_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// The interrupt entry saved the task's registers on its own stack and left that stack
+// pointer in the first TCB word (pxTopOfStack); the saved frame starts with mepc.
+// A sample that interrupted another handler has no task frame and counts as PC 0.
+static bool pc_sample_isr(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *arg) {
+    uint32_t pc = 0;
+    if (!xPortInterruptedFromISRContext()) {
+        const RvExcFrame *frame = *(RvExcFrame *const *)xTaskGetCurrentTaskHandle();
+        pc = frame->mepc;
+    }
+    portENTER_CRITICAL_ISR(&g_pc_lock);
+    profiler_pc_record(&g_pc_table, pc);
+    portEXIT_CRITICAL_ISR(&g_pc_lock);
+    return false;
+}
+
+static esp_err_t pc_sampling_start(void) {
+    const gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    esp_err_t ret = gptimer_new_timer(&timer_config, &g_pc_timer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    const gptimer_event_callbacks_t callbacks = {
+        .on_alarm = pc_sample_isr,
+    };
+    const gptimer_alarm_config_t alarm = {
+        .alarm_count = 1000000 / CONFIG_PROFILER_PC_SAMPLE_HZ,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    ret = gptimer_register_event_callbacks(g_pc_timer, &callbacks, NULL);
+    if (ret == ESP_OK) {
+        ret = gptimer_set_alarm_action(g_pc_timer, &alarm);
+    }
+    if (ret == ESP_OK) {
+        ret = gptimer_enable(g_pc_timer);
+    }
+    if (ret == ESP_OK) {
+        ret = gptimer_start(g_pc_timer);
+        if (ret != ESP_OK) {
+            gptimer_disable(g_pc_timer);
+        }
+    }
+    if (ret != ESP_OK) {
+        gptimer_del_timer(g_pc_timer);
+        g_pc_timer = NULL;
+    }
+    return ret;
+}
+
+esp_err_t profiler_pc_stats(profiler_pc_stats_t *stats) {
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (g_pc_timer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    stats->hz = CONFIG_PROFILER_PC_SAMPLE_HZ;
+    stats->samples = g_pc_table.samples;
+    stats->isr_samples = g_pc_table.isr_samples;
+    stats->dropped = g_pc_table.dropped;
+    return ESP_OK;
+}
+
+size_t profiler_pc_bins(size_t *index, profiler_pc_bin_t *out, size_t max) {
+    if (index == NULL || out == NULL) {
+        return 0;
+    }
+    return profiler_pc_read(&g_pc_table, index, out, max);
+}
+
+void profiler_pc_reset(void) {
+    portENTER_CRITICAL(&g_pc_lock);
+    profiler_pc_clear(&g_pc_table);
+    portEXIT_CRITICAL(&g_pc_lock);
+}
+
+#else
+
+esp_err_t profiler_pc_stats(profiler_pc_stats_t *stats) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+size_t profiler_pc_bins(size_t *index, profiler_pc_bin_t *out, size_t max) {
+    return 0;
+}
+
+void profiler_pc_reset(void) {
+}
+
+#endif // CONFIG_PROFILER_PC_SAMPLING
+
+#if PROFILER_STATS_SUPPORTED
+
+typedef struct {
+    uint32_t task_number;
+    configRUN_TIME_COUNTER_TYPE runtime;
+} task_runtime_t;
+
+typedef struct {
+    int64_t time_us;
+    configRUN_TIME_COUNTER_TYPE total;
+    uint8_t count;
+    task_runtime_t tasks[PROFILER_MAX_TASKS];
+} snapshot_t;
+
+// g_status is scratch space for uxTaskGetSystemState(), shared by the timer and readers under g_lock
+static TaskStatus_t g_status[PROFILER_MAX_TASKS];
+static snapshot_t g_ring[PROFILER_WINDOW_SLOTS];
+static uint32_t g_snapshots = 0;
+static SemaphoreHandle_t g_lock = NULL;
+static StaticSemaphore_t g_lock_buf;
+static esp_timer_handle_t g_timer = NULL;
+
+static void snapshot_timer_cb(void *arg) {
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    configRUN_TIME_COUNTER_TYPE total;
+    UBaseType_t count = uxTaskGetSystemState(g_status, PROFILER_MAX_TASKS, &total);
+    if (count > 0) {
+        snapshot_t *snapshot = &g_ring[g_snapshots % PROFILER_WINDOW_SLOTS];
+        snapshot->time_us = esp_timer_get_time();
+        snapshot->total = total;
+        snapshot->count = (uint8_t)count;
+        for (UBaseType_t i = 0; i < count; i++) {
+            snapshot->tasks[i].task_number = g_status[i].xTaskNumber;
+            snapshot->tasks[i].runtime = g_status[i].ulRunTimeCounter;
+        }
+        g_snapshots++;
+    }
+    xSemaphoreGive(g_lock);
+}
+
+esp_err_t profiler_start(void) {
+    if (g_lock != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    g_lock = xSemaphoreCreateMutexStatic(&g_lock_buf);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = snapshot_timer_cb,
+        .name = "profiler"
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &g_timer);
+    if (ret == ESP_OK) {
+        snapshot_timer_cb(NULL);
+        ret = esp_timer_start_periodic(g_timer, PROFILER_SAMPLE_PERIOD_MS * 1000ULL);
+        if (ret != ESP_OK) {
+            esp_timer_delete(g_timer);
+            g_timer = NULL;
+        }
+    }
+    if (ret != ESP_OK) {
+        vSemaphoreDelete(g_lock);
+        g_lock = NULL;
+        return ret;
+    }
+
+#if CONFIG_PROFILER_PC_SAMPLING
+    // Task stats are useful on their own, so a missing timer only costs the PC histogram
+    esp_err_t pc_ret = pc_sampling_start();
+    if (pc_ret != ESP_OK) {
+        ESP_LOGW(TAG, "PC sampling unavailable: %s", esp_err_to_name(pc_ret));
+    }
+#endif
+
+    ESP_LOGI(TAG, "Profiler started, %d s CPU window", PROFILER_WINDOW_SLOTS * PROFILER_SAMPLE_PERIOD_MS / 1000);
+    return ESP_OK;
+}
+
+esp_err_t profiler_get_tasks(profiler_task_t *tasks, size_t max, size_t *count, uint32_t *window_us) {
+    if (tasks == NULL || count == NULL || window_us == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (g_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    configRUN_TIME_COUNTER_TYPE total;
+    UBaseType_t found = uxTaskGetSystemState(g_status, PROFILER_MAX_TASKS, &total);
+    if (found == 0) {
+        xSemaphoreGive(g_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // The oldest kept snapshot is the next one to be overwritten
+    const snapshot_t *base = &g_ring[g_snapshots < PROFILER_WINDOW_SLOTS ? 0 : g_snapshots % PROFILER_WINDOW_SLOTS];
+    *window_us = (uint32_t)(esp_timer_get_time() - base->time_us);
+    // Run-time counters advance on every core at once, 100% means all cores busy
+    uint32_t total_delta = (uint32_t)(total - base->total) * portNUM_PROCESSORS;
+
+    size_t written = 0;
+    for (UBaseType_t i = 0; i < found && written < max; i++) {
+        const TaskStatus_t *status = &g_status[i];
+        // Tasks created after the snapshot count from zero
+        configRUN_TIME_COUNTER_TYPE before = 0;
+        for (uint8_t j = 0; j < base->count; j++) {
+            if (base->tasks[j].task_number == status->xTaskNumber) {
+                before = base->tasks[j].runtime;
+                break;
+            }
+        }
+
+        profiler_task_t *task = &tasks[written++];
+        strncpy(task->name, status->pcTaskName, sizeof(task->name) - 1);
+        task->name[sizeof(task->name) - 1] = '\0';
+        task->task_number = status->xTaskNumber;
+        task->state = (uint8_t)status->eCurrentState;
+        task->priority = (uint8_t)status->uxCurrentPriority;
+        task->stack_free_min = (uint32_t)status->usStackHighWaterMark;
+        task->cpu_centi = profiler_cpu_centi((uint32_t)(status->ulRunTimeCounter - before), total_delta);
+    }
+    xSemaphoreGive(g_lock);
+
+    *count = written;
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t profiler_start(void) {
+    ESP_LOGW(TAG, "Enable CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t profiler_get_tasks(profiler_task_t *tasks, size_t max, size_t *count, uint32_t *window_us) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif // PROFILER_STATS_SUPPORTED
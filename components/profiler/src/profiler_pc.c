@@ -0,0 +1,47 @@
+#include "profiler_pc.h"
+#include <string.h>
+
+_Static_assert((PROFILER_PC_BINS & (PROFILER_PC_BINS - 1)) == 0, "PROFILER_PC_BINS must be a power of two");
+
+// Fibonacci hashing; instructions are at least 2-byte aligned, so bit 0 carries nothing
+static size_t pc_hash(uint32_t pc) {
+    return (size_t)(((pc >> 1) * 2654435761u) >> 24) & (PROFILER_PC_BINS - 1);
+}
+
+void profiler_pc_record(profiler_pc_table_t *table, uint32_t pc) {
+    table->samples++;
+    if (pc == 0) {
+        table->isr_samples++;
+        return;
+    }
+
+    size_t slot = pc_hash(pc);
+    for (size_t probe = 0; probe < PROFILER_PC_PROBES; probe++) {
+        profiler_pc_bin_t *bin = &table->bins[(slot + probe) & (PROFILER_PC_BINS - 1)];
+        if (bin->pc == 0) {
+            bin->pc = pc;
+        }
+        if (bin->pc == pc) {
+            bin->count++;
+            return;
+        }
+    }
+    table->dropped++;
+}
+
+size_t profiler_pc_read(const profiler_pc_table_t *table, size_t *index, profiler_pc_bin_t *out, size_t max) {
+    size_t count = 0;
+    size_t i = *index;
+    while (i < PROFILER_PC_BINS && count < max) {
+        profiler_pc_bin_t bin = table->bins[i++];
+        if (bin.pc != 0 && bin.count != 0) {
+            out[count++] = bin;
+        }
+    }
+    *index = i;
+    return count;
+}
+
+void profiler_pc_clear(profiler_pc_table_t *table) {
+    memset(table, 0, sizeof(*table));
+}
@@ -28,6 +28,18 @@ esp_err_t relay_init(const teapot_config_t *config, relay_handle_t *handle);
  */
 esp_err_t relay_deinit(relay_handle_t handle);
 
+/**
+ * @brief Switch the relay off and move it to another GPIO
+ *
+ * The old pin is released only after the new one is configured. On failure the relay
+ * stays off on the old pin and the handle keeps using it.
+ * @param handle Relay handle
+ * @param gpio New GPIO pin
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the handle is NULL or the pin is out of range,
+ *         or the gpio_config() error if the new pin cannot be configured
+ */
+esp_err_t relay_set_gpio(relay_handle_t handle, int gpio);
+
 /**
  * @brief Turn relay ON
  * @param handle Relay handle
@@ -2,6 +2,8 @@
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "config.h"
+#include "trace.h"
+#include "metrics.h"
 #include <string.h>
 
 static const char *TAG = "RELAY";
@@ -59,14 +61,55 @@ esp_err_t relay_deinit(relay_handle_t handle) {
     return ESP_OK;
 }
 
+esp_err_t relay_set_gpio(relay_handle_t handle, int gpio) {
+    if (handle == NULL || gpio < CONFIG_GPIO_MIN || gpio > CONFIG_GPIO_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (gpio == handle->gpio) {
+        return ESP_OK;
+    }
+    
+    // The old pin keeps driving the relay off until the new one is configured, so a
+    // failure leaves the handle on a working pin
+    gpio_set_level(handle->gpio, RELAY_OFF);
+    handle->current_state = false;
+    trace_record(TRACE_EV_RELAY_OFF, handle->gpio, 0, 0);
+    
+    // Latch the off level before the pin becomes an output so it never glitches on
+    gpio_num_t new_gpio = (gpio_num_t)gpio;
+    gpio_set_level(new_gpio, RELAY_OFF);
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << new_gpio,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+    esp_err_t ret = gpio_config(&io_conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure GPIO %d: %s", new_gpio, esp_err_to_name(ret));
+        return ret;
+    }
+    gpio_set_level(new_gpio, RELAY_OFF);
+    
+    // Reset leaves the old pin pulled up, which the active-low module reads as off
+    gpio_reset_pin(handle->gpio);
+    ESP_LOGI(TAG, "Relay moved from GPIO %d to GPIO %d", handle->gpio, new_gpio);
+    handle->gpio = new_gpio;
+    return ESP_OK;
+}
+
 esp_err_t relay_on(relay_handle_t handle) {
     if (handle == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
     
     gpio_set_level(handle->gpio, RELAY_ON);
+    if (!handle->current_state) {
+        metrics_inc(METRIC_RELAY_CYCLES);
+    }
     handle->current_state = true;
-    ESP_LOGI(TAG, "Relay ON (GPIO %d)", handle->gpio);
+    trace_record(TRACE_EV_RELAY_ON, handle->gpio, 0, 0);
     return ESP_OK;
 }
 
@@ -77,7 +120,7 @@ esp_err_t relay_off(relay_handle_t handle) {
     
     gpio_set_level(handle->gpio, RELAY_OFF);
     handle->current_state = false;
-    ESP_LOGI(TAG, "Relay OFF (GPIO %d)", handle->gpio);
+    trace_record(TRACE_EV_RELAY_OFF, handle->gpio, 0, 0);
     return ESP_OK;
 }
 
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sample_log_codec.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SAMPLE_LOG_PARTITION_LABEL "sample_log"
+#define SAMPLE_LOG_PAGE_SIZE 256        ///< Flash program page; the log is written in whole pages
+#define SAMPLE_LOG_HEADER_SIZE 16
+#define SAMPLE_LOG_PAYLOAD_SIZE (SAMPLE_LOG_PAGE_SIZE - SAMPLE_LOG_HEADER_SIZE)
+#define SAMPLE_LOG_QUEUE_LEN 16         ///< Samples waiting for the logger task
+
+/**
+ * @brief Header at the start of every flash page
+ */
+typedef struct {
+    uint32_t seq;         ///< Page sequence number, 0xFFFFFFFF while erased
+    uint16_t boot;        ///< Boot counter, increments on every start
+    uint16_t len;         ///< Payload bytes used
+    uint32_t base_ms;     ///< Uptime the first record is relative to
+    uint32_t crc;         ///< CRC-32 of the header (crc = 0) and the used payload
+} sample_log_page_header_t;
+
+/**
+ * @brief Reader over the whole log, oldest record first
+ *
+ * Holds one page in memory, so exporting needs no more RAM than that regardless
+ * of the log size. Pages written after the reader was opened are not returned.
+ */
+typedef struct {
+    uint32_t page;        ///< Next flash page to look at
+    uint32_t pages_left;
+    uint32_t end_seq;     ///< First sequence number not to return
+    uint32_t last_seq;    ///< Last page returned, guards against pages rewritten meanwhile
+    bool have_last;
+    bool ram_pending;     ///< The unflushed RAM page still has to be returned
+    uint16_t boot;
+    sample_log_decoder_t dec;
+    uint8_t page_buf[SAMPLE_LOG_PAGE_SIZE];
+} sample_log_reader_t;
+
+/**
+ * @brief Mount the log partition and start the logger task
+ *
+ * Scans the partition for the newest page, so records continue after the last
+ * reboot. Without a "sample_log" partition logging stays disabled.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the partition is missing, or an error code
+ */
+esp_err_t sample_log_init(void);
+
+/**
+ * @brief Queue a control-loop sample
+ *
+ * Never blocks: the sample is dropped when the logger task is behind. A relay
+ * record is added whenever relay_on differs from the previous sample.
+ * @param timestamp_us esp_timer_get_time() of the sample
+ * @param temperature Temperature in °C
+ * @param relay_on Relay state after the control step
+ */
+void sample_log_record(int64_t timestamp_us, float temperature, bool relay_on);
+
+/**
+ * @brief Write the partially filled RAM page to flash
+ *
+ * Also runs from a shutdown handler so esp_restart() loses nothing.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if logging is disabled, or an error code
+ */
+esp_err_t sample_log_flush(void);
+
+/**
+ * @brief Erase the whole log
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if logging is disabled, or an error code
+ */
+esp_err_t sample_log_erase(void);
+
+/**
+ * @brief Start reading the log from the oldest record
+ * @param reader Reader
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if logging is disabled
+ */
+esp_err_t sample_log_reader_open(sample_log_reader_t *reader);
+
+/**
+ * @brief Read the next record
+ * @param reader Reader
+ * @param boot Output: boot counter of the record
+ * @param rec Output: record
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND after the last record, or a flash read error
+ */
+esp_err_t sample_log_reader_next(sample_log_reader_t *reader, uint16_t *boot, sample_log_record_t *rec);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Record types stored in a log page
+ */
+typedef enum {
+    SAMPLE_LOG_REC_SAMPLE = 0,     ///< Temperature sample
+    SAMPLE_LOG_REC_RELAY_OFF = 1,  ///< Relay switched off
+    SAMPLE_LOG_REC_RELAY_ON = 2,   ///< Relay switched on
+} sample_log_rec_type_t;
+
+/**
+ * @brief Decoded log record
+ */
+typedef struct {
+    uint32_t uptime_ms;   ///< Milliseconds since the boot that wrote the record
+    uint8_t type;         ///< sample_log_rec_type_t
+    int16_t temp_centi;   ///< Temperature in hundredths of °C, SAMPLE_LOG_REC_SAMPLE only
+} sample_log_record_t;
+
+/**
+ * @brief Appends records to one page payload
+ *
+ * Every record starts with a varint of (ms since the previous record << 2 | type);
+ * samples add a zigzag varint of the temperature change since the previous sample
+ * in the page. A steady 2.75 s sample costs 3 bytes. Pages decode independently:
+ * the first delta is relative to base_ms and to 0 °C.
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    uint32_t last_ms;
+    int16_t last_temp;
+} sample_log_encoder_t;
+
+/**
+ * @brief Decoder state for one page payload
+ */
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    uint32_t last_ms;
+    int16_t last_temp;
+} sample_log_decoder_t;
+
+/**
+ * @brief Start a new payload
+ * @param enc Encoder
+ * @param buf Payload buffer
+ * @param size Size of buf
+ * @param base_ms Uptime the first record is relative to
+ */
+void sample_log_encoder_init(sample_log_encoder_t *enc, uint8_t *buf, size_t size, uint32_t base_ms);
+
+/**
+ * @brief Append a record
+ * @param enc Encoder
+ * @param rec Record; uptime_ms must not be before the previous record
+ * @return true if appended, false if it does not fit (the payload is left unchanged)
+ */
+bool sample_log_encode(sample_log_encoder_t *enc, const sample_log_record_t *rec);
+
+/**
+ * @brief Start decoding a payload
+ * @param dec Decoder
+ * @param buf Payload
+ * @param len Payload length
+ * @param base_ms base_ms the payload was encoded with
+ */
+void sample_log_decoder_init(sample_log_decoder_t *dec, const uint8_t *buf, size_t len, uint32_t base_ms);
+
+/**
+ * @brief Decode the next record
+ * @param dec Decoder
+ * @param rec Output record
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND at the end of the payload,
+ *         ESP_ERR_INVALID_SIZE if the payload is truncated or corrupt
+ */
+esp_err_t sample_log_decode(sample_log_decoder_t *dec, sample_log_record_t *rec);
+
+/**
+ * @brief Render a record as one CSV line: boot,uptime_ms,event,temperature,relay
+ * @param boot Boot counter of the page holding the record
+ * @param rec Record
+ * @param buf Output buffer
+ * @param size Size of buf
+ * @return Length of the line including the trailing newline, 0 if it does not fit
+ */
+size_t sample_log_format_csv(uint16_t boot, const sample_log_record_t *rec, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,344 @@
+#include "sample_log.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <string.h>
+
+static const char *TAG = "SAMPLE_LOG";
+
+#define SAMPLE_LOG_SECTOR_SIZE 4096
+#define SAMPLE_LOG_PAGES_PER_SECTOR (SAMPLE_LOG_SECTOR_SIZE / SAMPLE_LOG_PAGE_SIZE)
+#define SAMPLE_LOG_ERASED_SEQ 0xFFFFFFFFu
+#define SAMPLE_LOG_TASK_STACK 3072
+#define SAMPLE_LOG_TASK_PRIORITY 2      // Below the control loop and httpd: flash writes wait for idle time
+#define SAMPLE_LOG_SHUTDOWN_WAIT_MS 100
+
+_Static_assert(sizeof(sample_log_page_header_t) == SAMPLE_LOG_HEADER_SIZE, "page header layout");
+
+typedef struct {
+    uint32_t uptime_ms;
+    int16_t temp_centi;
+    bool relay_on;
+} queued_sample_t;
+
+// The page buffer, encoder and write position are guarded by lock; the queue
+// is the only thing the control loop touches
+static struct {
+    const esp_partition_t *partition;
+    uint32_t page_count;
+    QueueHandle_t queue;
+    SemaphoreHandle_t lock;
+    TaskHandle_t task;
+    uint32_t write_page;      // Next page to program
+    uint32_t next_seq;
+    uint16_t boot;
+    bool have_relay;
+    bool last_relay;
+    uint8_t page[SAMPLE_LOG_PAGE_SIZE];
+    sample_log_encoder_t enc;
+    uint32_t page_base_ms;
+    bool page_open;
+} g_log;
+
+// Created once at boot and never deleted, so none of it comes from the heap
+static StaticSemaphore_t g_lock_buf;
+static StaticQueue_t g_queue_buf;
+static uint8_t g_queue_storage[SAMPLE_LOG_QUEUE_LEN * sizeof(queued_sample_t)];
+static StaticTask_t g_task_buf;
+static StackType_t g_task_stack[SAMPLE_LOG_TASK_STACK];
+
+static uint32_t page_crc(const sample_log_page_header_t *header, const uint8_t *payload) {
+    sample_log_page_header_t copy = *header;
+    copy.crc = 0;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&copy, sizeof(copy));
+    return esp_rom_crc32_le(crc, payload, header->len);
+}
+
+static esp_err_t read_header(uint32_t page, sample_log_page_header_t *header) {
+    return esp_partition_read(g_log.partition, (size_t)page * SAMPLE_LOG_PAGE_SIZE, header, sizeof(*header));
+}
+
+static void open_page(uint32_t base_ms) {
+    // Unused bytes stay 0xFF so programming the page only touches the payload
+    memset(g_log.page, 0xFF, sizeof(g_log.page));
+    sample_log_encoder_init(&g_log.enc, g_log.page + SAMPLE_LOG_HEADER_SIZE, SAMPLE_LOG_PAYLOAD_SIZE, base_ms);
+    g_log.page_base_ms = base_ms;
+    g_log.page_open = true;
+}
+
+// Caller holds lock. Pages are programmed in order around the partition, erasing a
+// sector only when the write position enters it, so every sector wears evenly
+static esp_err_t write_page_locked(void) {
+    if (!g_log.page_open || g_log.enc.len == 0) {
+        return ESP_OK;
+    }
+
+    if (g_log.write_page % SAMPLE_LOG_PAGES_PER_SECTOR == 0) {
+        esp_err_t ret = esp_partition_erase_range(g_log.partition,
+                                                  (size_t)g_log.write_page * SAMPLE_LOG_PAGE_SIZE,
+                                                  SAMPLE_LOG_SECTOR_SIZE);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    sample_log_page_header_t header = {
+        .seq = g_log.next_seq,
+        .boot = g_log.boot,
+        .len = (uint16_t)g_log.enc.len,
+        .base_ms = g_log.page_base_ms
+    };
+    header.crc = page_crc(&header, g_log.page + SAMPLE_LOG_HEADER_SIZE);
+    memcpy(g_log.page, &header, sizeof(header));
+
+    esp_err_t ret = esp_partition_write(g_log.partition, (size_t)g_log.write_page * SAMPLE_LOG_PAGE_SIZE,
+                                        g_log.page, SAMPLE_LOG_PAGE_SIZE);
+    // A failed page is skipped rather than retried: its sector is erased on the next lap anyway
+    g_log.write_page = (g_log.write_page + 1) % g_log.page_count;
+    g_log.next_seq++;
+    g_log.page_open = false;
+    return ret;
+}
+
+static void append_locked(const sample_log_record_t *rec) {
+    if (!g_log.page_open) {
+        open_page(rec->uptime_ms);
+    }
+    if (sample_log_encode(&g_log.enc, rec)) {
+        return;
+    }
+
+    esp_err_t ret = write_page_locked();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to write log page: %s", esp_err_to_name(ret));
+    }
+    open_page(rec->uptime_ms);
+    sample_log_encode(&g_log.enc, rec);
+}
+
+static void sample_log_task(void *arg) {
+    queued_sample_t sample;
+    while (1) {
+        if (xQueueReceive(g_log.queue, &sample, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        xSemaphoreTake(g_log.lock, portMAX_DELAY);
+        if (!g_log.have_relay || sample.relay_on != g_log.last_relay) {
+            sample_log_record_t relay = {
+                .uptime_ms = sample.uptime_ms,
+                .type = sample.relay_on ? SAMPLE_LOG_REC_RELAY_ON : SAMPLE_LOG_REC_RELAY_OFF
+            };
+            append_locked(&relay);
+            g_log.have_relay = true;
+            g_log.last_relay = sample.relay_on;
+        }
+        sample_log_record_t rec = {
+            .uptime_ms = sample.uptime_ms,
+            .type = SAMPLE_LOG_REC_SAMPLE,
+            .temp_centi = sample.temp_centi
+        };
+        append_locked(&rec);
+        xSemaphoreGive(g_log.lock);
+    }
+}
+
+void sample_log_record(int64_t timestamp_us, float temperature, bool relay_on) {
+    if (g_log.queue == NULL) {
+        return;
+    }
+    float centi = temperature * 100.0f;
+    queued_sample_t sample = {
+        .uptime_ms = (uint32_t)(timestamp_us / 1000),
+        .temp_centi = (int16_t)(centi + (centi < 0 ? -0.5f : 0.5f)),
+        .relay_on = relay_on
+    };
+    xQueueSend(g_log.queue, &sample, 0);
+}
+
+esp_err_t sample_log_flush(void) {
+    if (g_log.lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(g_log.lock, pdMS_TO_TICKS(SAMPLE_LOG_SHUTDOWN_WAIT_MS)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    esp_err_t ret = write_page_locked();
+    xSemaphoreGive(g_log.lock);
+    return ret;
+}
+
+static void sample_log_shutdown_handler(void) {
+    sample_log_flush();
+}
+
+esp_err_t sample_log_erase(void) {
+    if (g_log.lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(g_log.lock, portMAX_DELAY);
+    esp_err_t ret = esp_partition_erase_range(g_log.partition, 0, g_log.partition->size);
+    g_log.write_page = 0;
+    g_log.page_open = false;
+    g_log.have_relay = false;
+    xSemaphoreGive(g_log.lock);
+    return ret;
+}
+
+// Finds where the previous boot stopped: the newest sector is the one whose first
+// page has the highest sequence number, and inside it the first erased page
+static void find_write_position(void) {
+    uint32_t sectors = g_log.page_count / SAMPLE_LOG_PAGES_PER_SECTOR;
+    bool found = false;
+    uint32_t newest_sector = 0;
+    uint32_t newest_seq = 0;
+
+    for (uint32_t s = 0; s < sectors; s++) {
+        sample_log_page_header_t header;
+        if (read_header(s * SAMPLE_LOG_PAGES_PER_SECTOR, &header) != ESP_OK || header.seq == SAMPLE_LOG_ERASED_SEQ) {
+            continue;
+        }
+        if (!found || (int32_t)(header.seq - newest_seq) > 0) {
+            found = true;
+            newest_sector = s;
+            newest_seq = header.seq;
+        }
+    }
+
+    g_log.write_page = 0;
+    g_log.next_seq = 0;
+    g_log.boot = 0;
+    if (!found) {
+        return;
+    }
+
+    uint32_t first = newest_sector * SAMPLE_LOG_PAGES_PER_SECTOR;
+    uint32_t used = 0;
+    for (; used < SAMPLE_LOG_PAGES_PER_SECTOR; used++) {
+        sample_log_page_header_t header;
+        if (read_header(first + used, &header) != ESP_OK || header.seq == SAMPLE_LOG_ERASED_SEQ) {
+            break;
+        }
+        g_log.boot = header.boot + 1;
+    }
+    g_log.write_page = (first + used) % g_log.page_count;
+    g_log.next_seq = newest_seq + used;
+}
+
+esp_err_t sample_log_init(void) {
+    if (g_log.task != NULL) {
+        return ESP_OK;
+    }
+
+    g_log.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                               SAMPLE_LOG_PARTITION_LABEL);
+    if (g_log.partition == NULL) {
+        ESP_LOGW(TAG, "No \"%s\" partition, sample log disabled", SAMPLE_LOG_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    g_log.page_count = (g_log.partition->size / SAMPLE_LOG_SECTOR_SIZE) * SAMPLE_LOG_PAGES_PER_SECTOR;
+    if (g_log.page_count == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    find_write_position();
+
+    g_log.lock = xSemaphoreCreateMutexStatic(&g_lock_buf);
+    g_log.queue = xQueueCreateStatic(SAMPLE_LOG_QUEUE_LEN, sizeof(queued_sample_t), g_queue_storage, &g_queue_buf);
+    g_log.task = xTaskCreateStatic(sample_log_task, "sample_log", SAMPLE_LOG_TASK_STACK, NULL,
+                                   SAMPLE_LOG_TASK_PRIORITY, g_task_stack, &g_task_buf);
+    if (g_log.task == NULL) {
+        ESP_LOGE(TAG, "Failed to create logger task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_register_shutdown_handler(sample_log_shutdown_handler);
+    ESP_LOGI(TAG, "Sample log: %" PRIu32 " pages, boot %u, next page %" PRIu32,
+             g_log.page_count, g_log.boot, g_log.write_page);
+    return ESP_OK;
+}
+
+esp_err_t sample_log_reader_open(sample_log_reader_t *reader) {
+    if (g_log.lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(reader, 0, sizeof(*reader));
+    xSemaphoreTake(g_log.lock, portMAX_DELAY);
+    // The oldest page follows the write position; erased ones are skipped while reading
+    reader->page = g_log.write_page;
+    reader->end_seq = g_log.next_seq;
+    reader->ram_pending = g_log.page_open && g_log.enc.len > 0;
+    xSemaphoreGive(g_log.lock);
+    reader->pages_left = g_log.page_count;
+    return ESP_OK;
+}
+
+// Loads the next valid flash page into the reader, or the RAM page once flash is exhausted
+static esp_err_t load_next_page(sample_log_reader_t *reader) {
+    while (reader->pages_left > 0) {
+        uint32_t page = reader->page;
+        reader->page = (reader->page + 1) % g_log.page_count;
+        reader->pages_left--;
+
+        esp_err_t ret = esp_partition_read(g_log.partition, (size_t)page * SAMPLE_LOG_PAGE_SIZE,
+                                           reader->page_buf, SAMPLE_LOG_PAGE_SIZE);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        sample_log_page_header_t header;
+        memcpy(&header, reader->page_buf, sizeof(header));
+        if (header.seq == SAMPLE_LOG_ERASED_SEQ || header.len > SAMPLE_LOG_PAYLOAD_SIZE ||
+            (int32_t)(reader->end_seq - header.seq) <= 0 ||
+            (reader->have_last && (int32_t)(header.seq - reader->last_seq) <= 0) ||
+            page_crc(&header, reader->page_buf + SAMPLE_LOG_HEADER_SIZE) != header.crc) {
+            continue;
+        }
+
+        reader->last_seq = header.seq;
+        reader->have_last = true;
+        reader->boot = header.boot;
+        sample_log_decoder_init(&reader->dec, reader->page_buf + SAMPLE_LOG_HEADER_SIZE, header.len, header.base_ms);
+        return ESP_OK;
+    }
+
+    if (reader->ram_pending) {
+        reader->ram_pending = false;
+        xSemaphoreTake(g_log.lock, portMAX_DELAY);
+        // The page may have been flushed since open; then it was already returned or is past end_seq
+        bool still_open = g_log.page_open && g_log.next_seq == reader->end_seq;
+        size_t len = g_log.enc.len;
+        uint32_t base_ms = g_log.page_base_ms;
+        if (still_open) {
+            memcpy(reader->page_buf, g_log.page, SAMPLE_LOG_PAGE_SIZE);
+        }
+        reader->boot = g_log.boot;
+        xSemaphoreGive(g_log.lock);
+        if (still_open) {
+            sample_log_decoder_init(&reader->dec, reader->page_buf + SAMPLE_LOG_HEADER_SIZE, len, base_ms);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t sample_log_reader_next(sample_log_reader_t *reader, uint16_t *boot, sample_log_record_t *rec) {
+    while (1) {
+        esp_err_t ret = sample_log_decode(&reader->dec, rec);
+        if (ret == ESP_OK) {
+            *boot = reader->boot;
+            return ESP_OK;
+        }
+        // A corrupt tail only loses the rest of its page
+        ret = load_next_page(reader);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#include "sample_log_codec.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+#define VARINT_MAX_LEN 10
+
+static size_t put_varint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[n++] = byte | (value != 0 ? 0x80 : 0);
+    } while (value != 0);
+    return n;
+}
+
+static bool get_varint(sample_log_decoder_t *dec, uint64_t *value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 7 * VARINT_MAX_LEN; shift += 7) {
+        if (dec->pos >= dec->len) {
+            return false;
+        }
+        uint8_t byte = dec->buf[dec->pos++];
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+void sample_log_encoder_init(sample_log_encoder_t *enc, uint8_t *buf, size_t size, uint32_t base_ms) {
+    enc->buf = buf;
+    enc->size = size;
+    enc->len = 0;
+    enc->last_ms = base_ms;
+    enc->last_temp = 0;
+}
+
+bool sample_log_encode(sample_log_encoder_t *enc, const sample_log_record_t *rec) {
+    uint8_t tmp[2 * VARINT_MAX_LEN];
+    uint32_t dt = rec->uptime_ms - enc->last_ms;
+    size_t n = put_varint(tmp, ((uint64_t)dt << 2) | (rec->type & 0x3));
+    if (rec->type == SAMPLE_LOG_REC_SAMPLE) {
+        n += put_varint(tmp + n, zigzag((int32_t)rec->temp_centi - enc->last_temp));
+    }
+    if (enc->len + n > enc->size) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        enc->buf[enc->len++] = tmp[i];
+    }
+    enc->last_ms = rec->uptime_ms;
+    if (rec->type == SAMPLE_LOG_REC_SAMPLE) {
+        enc->last_temp = rec->temp_centi;
+    }
+    return true;
+}
+
+void sample_log_decoder_init(sample_log_decoder_t *dec, const uint8_t *buf, size_t len, uint32_t base_ms) {
+    dec->buf = buf;
+    dec->len = len;
+    dec->pos = 0;
+    dec->last_ms = base_ms;
+    dec->last_temp = 0;
+}
+
+esp_err_t sample_log_decode(sample_log_decoder_t *dec, sample_log_record_t *rec) {
+    if (dec->pos >= dec->len) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint64_t head;
+    if (!get_varint(dec, &head) || (head >> 2) > UINT32_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    rec->type = (uint8_t)(head & 0x3);
+    rec->uptime_ms = dec->last_ms + (uint32_t)(head >> 2);
+    rec->temp_centi = 0;
+
+    if (rec->type == SAMPLE_LOG_REC_SAMPLE) {
+        uint64_t delta;
+        if (!get_varint(dec, &delta) || delta > UINT32_MAX) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        int32_t temp = dec->last_temp + unzigzag((uint32_t)delta);
+        if (temp < INT16_MIN || temp > INT16_MAX) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        rec->temp_centi = (int16_t)temp;
+        dec->last_temp = rec->temp_centi;
+    } else if (rec->type != SAMPLE_LOG_REC_RELAY_OFF && rec->type != SAMPLE_LOG_REC_RELAY_ON) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    dec->last_ms = rec->uptime_ms;
+    return ESP_OK;
+}
+
+size_t sample_log_format_csv(uint16_t boot, const sample_log_record_t *rec, char *buf, size_t size) {
+    int n;
+    if (rec->type == SAMPLE_LOG_REC_SAMPLE) {
+        int centi = rec->temp_centi;
+        unsigned magnitude = (unsigned)(centi < 0 ? -centi : centi);
+        n = snprintf(buf, size, "%u,%" PRIu32 ",sample,%s%u.%02u,\n", boot, rec->uptime_ms,
+                     centi < 0 ? "-" : "", magnitude / 100, magnitude % 100);
+    } else {
+        n = snprintf(buf, size, "%u,%" PRIu32 ",relay,,%d\n", boot, rec->uptime_ms,
+                     rec->type == SAMPLE_LOG_REC_RELAY_ON);
+    }
+    if (n < 0 || (size_t)n >= size) {
+        return 0;
+    }
+    return (size_t)n;
+}
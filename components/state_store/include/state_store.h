@@ -0,0 +1,75 @@
+#pragma once
+
+#include "esp_err.h"
+#include "wifi_web.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATE_STORE_NVS_NAMESPACE "teapot_state"
+#define STATE_STORE_RECORD_VERSION 1
+#define STATE_STORE_STABLE_MS 5000          ///< Values must stay unchanged this long before they are written
+#define STATE_STORE_MIN_INTERVAL_MS 60000   ///< At most one flash write per interval
+
+#define STATE_STORE_FLAG_IS_ON (1u << 0)
+
+/**
+ * @brief Control fields of the state as kept in NVS
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t version;         ///< STATE_STORE_RECORD_VERSION
+    uint8_t flags;           ///< STATE_STORE_FLAG_* bits
+    int16_t setpoint_centi;  ///< Setpoint in hundredths of °C
+} state_store_record_t;
+
+/**
+ * @brief Build the stored record of a state; the current temperature is not kept
+ * @param state State to encode
+ * @param record Output record
+ */
+void state_store_encode(const teapot_state_t *state, state_store_record_t *record);
+
+/**
+ * @brief Turn a stored record back into a state update
+ * @param record Record read from NVS
+ * @param update Update setting is_on and setpoint_temp
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED for another record version,
+ *         ESP_ERR_INVALID_ARG if a field is out of range
+ */
+esp_err_t state_store_decode(const state_store_record_t *record, teapot_state_update_t *update);
+
+/**
+ * @brief Apply the power state and setpoint saved before the last reset
+ *
+ * Call after wifi_web_init() and before wifi_web_start_temp_sensor(), so the control
+ * loop starts with the restored values. NVS must already be initialized.
+ *
+ * @param ctx Web server context owning the state
+ * @return ESP_OK if restored or nothing was saved, otherwise an error code (the state is left as is)
+ */
+esp_err_t state_store_restore(wifi_web_ctx_t *ctx);
+
+/**
+ * @brief Start saving power state and setpoint changes
+ *
+ * A change is written once the values have been stable for STATE_STORE_STABLE_MS, and
+ * not sooner than STATE_STORE_MIN_INTERVAL_MS after the previous write, so dragging the
+ * setpoint slider costs one write. Temperature updates never cause a write. A pending
+ * change is also written by a shutdown handler on esp_restart().
+ *
+ * @param ctx Web server context owning the state
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if already started, or an error code
+ */
+esp_err_t state_store_start(wifi_web_ctx_t *ctx);
+
+/**
+ * @brief Write a pending change now
+ * @return ESP_OK on success or if nothing is pending, otherwise an NVS error
+ */
+esp_err_t state_store_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
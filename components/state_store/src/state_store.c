@@ -0,0 +1,200 @@
+#include "state_store.h"
+#include "config.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+static const char *TAG = "STATE_STORE";
+
+#define KEY_STATE "state"
+
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static state_store_record_t g_latest;    // Last control values seen by the listener
+static state_store_record_t g_written;   // What NVS holds
+static int64_t g_last_write_us = 0;      // 0 until the first write of this boot
+static esp_timer_handle_t g_timer = NULL;
+static wifi_web_ctx_t *g_ctx = NULL;
+
+void state_store_encode(const teapot_state_t *state, state_store_record_t *record) {
+    memset(record, 0, sizeof(*record));
+    record->version = STATE_STORE_RECORD_VERSION;
+    record->flags = state->is_on ? STATE_STORE_FLAG_IS_ON : 0;
+    record->setpoint_centi = (int16_t)(state->setpoint_temp * 100.0f + 0.5f);
+}
+
+esp_err_t state_store_decode(const state_store_record_t *record, teapot_state_update_t *update) {
+    if (record->version != STATE_STORE_RECORD_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    float setpoint = (float)record->setpoint_centi / 100.0f;
+    if ((record->flags & ~STATE_STORE_FLAG_IS_ON) != 0 ||
+        setpoint < CONFIG_TEMP_MIN || setpoint > CONFIG_TEMP_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(update, 0, sizeof(*update));
+    update->fields = WIFI_WEB_UPDATE_IS_ON | WIFI_WEB_UPDATE_SETPOINT;
+    update->is_on = (record->flags & STATE_STORE_FLAG_IS_ON) != 0;
+    update->setpoint_temp = setpoint;
+    return ESP_OK;
+}
+
+esp_err_t state_store_restore(wifi_web_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(STATE_STORE_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    state_store_record_t record;
+    size_t len = sizeof(record);
+    ret = nvs_get_blob(handle, KEY_STATE, &record, &len);
+    nvs_close(handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (len != sizeof(record)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    teapot_state_update_t update;
+    ret = state_store_decode(&record, &update);
+    if (ret == ESP_OK) {
+        ret = wifi_web_apply_update(ctx, &update);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    taskENTER_CRITICAL(&g_lock);
+    g_written = record;
+    g_latest = record;
+    taskEXIT_CRITICAL(&g_lock);
+
+    ESP_LOGI(TAG, "Restored state: %s, setpoint %.1f°C", update.is_on ? "on" : "off", update.setpoint_temp);
+    return ESP_OK;
+}
+
+esp_err_t state_store_flush(void) {
+    taskENTER_CRITICAL(&g_lock);
+    state_store_record_t record = g_latest;
+    bool pending = memcmp(&record, &g_written, sizeof(record)) != 0;
+    taskEXIT_CRITICAL(&g_lock);
+
+    if (!pending) {
+        return ESP_OK;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(STATE_STORE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_blob(handle, KEY_STATE, &record, sizeof(record));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    taskENTER_CRITICAL(&g_lock);
+    g_written = record;
+    g_last_write_us = esp_timer_get_time();
+    taskEXIT_CRITICAL(&g_lock);
+    ESP_LOGD(TAG, "State saved");
+    return ESP_OK;
+}
+
+static void save_timer_cb(void *arg) {
+    esp_err_t ret = state_store_flush();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save state: %s", esp_err_to_name(ret));
+    }
+}
+
+static void shutdown_handler(void) {
+    state_store_flush();
+}
+
+// Runs in the task that changed the state: compare and re-arm the timer, nothing more
+static void state_changed(wifi_web_ctx_t *ctx, void *arg) {
+    teapot_state_t state;
+    if (wifi_web_get_state(ctx, &state) != ESP_OK) {
+        return;
+    }
+    state_store_record_t record;
+    state_store_encode(&state, &record);
+
+    int64_t now = esp_timer_get_time();
+    int64_t due = now + (int64_t)STATE_STORE_STABLE_MS * 1000;
+
+    taskENTER_CRITICAL(&g_lock);
+    // Temperature-only changes must not push the stability window further out
+    bool changed = memcmp(&record, &g_latest, sizeof(record)) != 0;
+    g_latest = record;
+    if (g_last_write_us != 0 && due < g_last_write_us + (int64_t)STATE_STORE_MIN_INTERVAL_MS * 1000) {
+        due = g_last_write_us + (int64_t)STATE_STORE_MIN_INTERVAL_MS * 1000;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+
+    if (changed) {
+        esp_timer_stop(g_timer);
+        esp_timer_start_once(g_timer, (uint64_t)(due - now));
+    }
+}
+
+esp_err_t state_store_start(wifi_web_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (g_ctx != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = save_timer_cb,
+        .name = "state_save"
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &g_timer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Without a restored record the boot values count as written: they are the defaults anyway
+    teapot_state_t state;
+    wifi_web_get_state(ctx, &state);
+    state_store_record_t record;
+    state_store_encode(&state, &record);
+    taskENTER_CRITICAL(&g_lock);
+    if (g_written.version == 0) {
+        g_written = record;
+    }
+    g_latest = record;
+    taskEXIT_CRITICAL(&g_lock);
+
+    ret = wifi_web_add_state_listener(state_changed, NULL);
+    if (ret != ESP_OK) {
+        esp_timer_delete(g_timer);
+        g_timer = NULL;
+        return ret;
+    }
+    esp_register_shutdown_handler(shutdown_handler);
+    g_ctx = ctx;
+    return ESP_OK;
+}
@@ -4,6 +4,8 @@
 #include "onewire_device.h"
 #include "ds18b20.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
 #include <string.h>
 
 static const char *TAG = "TEMP_SENSOR";
@@ -118,7 +120,13 @@ esp_err_t temp_sensor_trigger_conversion(temp_sensor_handle_t handle) {
         return ESP_ERR_INVALID_STATE;
     }
     
-    return ds18b20_trigger_temperature_conversion(handle->ds);
+    // The driver waits out the conversion time before returning
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = ds18b20_trigger_temperature_conversion(handle->ds);
+    if (ret == ESP_OK) {
+        metrics_observe(METRIC_TEMP_CONVERSION_DURATION, (uint32_t)(esp_timer_get_time() - start));
+    }
+    return ret;
 }
 
 esp_err_t temp_sensor_read(temp_sensor_handle_t handle, float *temperature) {
@@ -126,7 +134,13 @@ esp_err_t temp_sensor_read(temp_sensor_handle_t handle, float *temperature) {
         return ESP_ERR_INVALID_STATE;
     }
     
-    return ds18b20_get_measurement(handle->ds, temperature);
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = ds18b20_get_measurement(handle->ds, temperature);
+    metrics_observe(METRIC_ONEWIRE_TRANSACTION_DURATION, (uint32_t)(esp_timer_get_time() - start));
+    if (ret == ESP_ERR_INVALID_CRC) {
+        metrics_inc(METRIC_ONEWIRE_CRC_ERRORS);
+    }
+    return ret;
 }
 
 esp_err_t temp_sensor_read_temperature(temp_sensor_handle_t handle, float *temperature) {
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_RING_SIZE 128   ///< Number of events kept in RAM (power of two)
+#define TRACE_MAX_ARGS  3
+#define TRACE_DUMP_MAGIC 0x31435254u ///< "TRC1" little-endian, header of binary dumps
+
+/**
+ * @brief Scale a temperature in °C to the integer representation used in event args
+ */
+#define TRACE_CENTI(value) ((int32_t)((value) * 100.0f))
+
+/**
+ * @brief Event identifiers
+ *
+ * Argument meaning is documented per event; temperatures are in hundredths of °C.
+ * Keep the numbering stable, scripts/trace_decode.py relies on it.
+ */
+typedef enum {
+    TRACE_EV_NONE = 0,
+    TRACE_EV_TEMP_SAMPLE = 1,       ///< a0 = temperature
+    TRACE_EV_TEMP_READ_ERROR = 2,   ///< a0 = esp_err_t
+    TRACE_EV_TEMP_INVALID = 3,      ///< a0 = temperature reported by the sensor
+    TRACE_EV_RELAY_ON = 4,          ///< a0 = GPIO
+    TRACE_EV_RELAY_OFF = 5,         ///< a0 = GPIO
+    TRACE_EV_CONTROL_POWER_OFF = 6, ///< relay forced off because power is off
+    TRACE_EV_CONTROL_AUTO = 7,      ///< a0 = relay on, a1 = temperature, a2 = setpoint
+    TRACE_EV_POWER_SET = 8,         ///< a0 = is_on
+    TRACE_EV_SETPOINT_SET = 9,      ///< a0 = setpoint
+    TRACE_EV_MAX
+} trace_event_id_t;
+
+/**
+ * @brief Fixed-size binary event as stored in the ring and sent by /api/trace
+ */
+typedef struct {
+    uint32_t seq;           ///< Sequence number + 1 (0 marks an empty or in-flight slot)
+    uint32_t timestamp_us;  ///< Lower 32 bits of esp_timer_get_time()
+    uint16_t id;            ///< trace_event_id_t
+    uint16_t reserved;
+    int32_t args[TRACE_MAX_ARGS];
+} trace_event_t;
+
+/**
+ * @brief Header preceding events in a binary dump
+ */
+typedef struct {
+    uint32_t magic;         ///< TRACE_DUMP_MAGIC
+    uint16_t event_size;    ///< sizeof(trace_event_t)
+    uint16_t ring_size;     ///< TRACE_RING_SIZE
+    uint32_t next_seq;      ///< Sequence number the next recorded event will get
+    uint32_t reserved;
+    int64_t now_us;         ///< esp_timer_get_time() when the dump was taken
+} trace_dump_header_t;
+
+/**
+ * @brief Record an event
+ *
+ * Lock-free and safe to call from any task. Does no formatting, the oldest
+ * events are overwritten when the ring is full.
+ * @param id Event identifier
+ * @param a0 First argument
+ * @param a1 Second argument
+ * @param a2 Third argument
+ */
+void trace_record(trace_event_id_t id, int32_t a0, int32_t a1, int32_t a2);
+
+/**
+ * @brief Copy recorded events starting at a sequence number
+ *
+ * Events that were already overwritten are skipped, so the first copied event
+ * may be newer than from_seq.
+ * @param from_seq First sequence number of interest (0 for the oldest available)
+ * @param out Output array
+ * @param max Capacity of the output array
+ * @param next_seq Output: sequence number to pass on the next call
+ * @return Number of events copied
+ */
+size_t trace_read(uint32_t from_seq, trace_event_t *out, size_t max, uint32_t *next_seq);
+
+/**
+ * @brief Get sequence number the next recorded event will get
+ * @return Sequence number
+ */
+uint32_t trace_next_seq(void);
+
+/**
+ * @brief Get printable name of an event
+ * @param id Event identifier
+ * @return Static string, "UNKNOWN" for unknown ids
+ */
+const char *trace_event_name(uint16_t id);
+
+/**
+ * @brief Render an event as one line of text (without trailing newline)
+ * @param event Event to render
+ * @param buf Output buffer
+ * @param len Size of the output buffer
+ * @return Number of characters written (excluding terminator)
+ */
+int trace_format_event(const trace_event_t *event, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
@@ -0,0 +1,138 @@
+#include "trace.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+_Static_assert((TRACE_RING_SIZE & TRACE_RING_MASK) == 0, "TRACE_RING_SIZE must be a power of two");
+
+static trace_event_t g_ring[TRACE_RING_SIZE];
+static uint32_t g_head = 0;
+
+static const char *const g_event_names[TRACE_EV_MAX] = {
+    [TRACE_EV_NONE] = "NONE",
+    [TRACE_EV_TEMP_SAMPLE] = "TEMP_SAMPLE",
+    [TRACE_EV_TEMP_READ_ERROR] = "TEMP_READ_ERROR",
+    [TRACE_EV_TEMP_INVALID] = "TEMP_INVALID",
+    [TRACE_EV_RELAY_ON] = "RELAY_ON",
+    [TRACE_EV_RELAY_OFF] = "RELAY_OFF",
+    [TRACE_EV_CONTROL_POWER_OFF] = "CONTROL_POWER_OFF",
+    [TRACE_EV_CONTROL_AUTO] = "CONTROL_AUTO",
+    [TRACE_EV_POWER_SET] = "POWER_SET",
+    [TRACE_EV_SETPOINT_SET] = "SETPOINT_SET",
+};
+
+void trace_record(trace_event_id_t id, int32_t a0, int32_t a1, int32_t a2) {
+    uint32_t seq = __atomic_fetch_add(&g_head, 1, __ATOMIC_RELAXED);
+    trace_event_t *slot = &g_ring[seq & TRACE_RING_MASK];
+
+    // Mark the slot as in-flight so readers skip it until it is complete; the fence keeps
+    // the payload stores below from becoming visible before the mark
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->timestamp_us = (uint32_t)esp_timer_get_time();
+    slot->id = (uint16_t)id;
+    slot->reserved = 0;
+    slot->args[0] = a0;
+    slot->args[1] = a1;
+    slot->args[2] = a2;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t trace_next_seq(void) {
+    return __atomic_load_n(&g_head, __ATOMIC_ACQUIRE);
+}
+
+size_t trace_read(uint32_t from_seq, trace_event_t *out, size_t max, uint32_t *next_seq) {
+    uint32_t head = trace_next_seq();
+    uint32_t seq = from_seq;
+
+    if ((int32_t)(head - seq) < 0) {
+        seq = head;
+    } else if (head - seq > TRACE_RING_SIZE) {
+        seq = head - TRACE_RING_SIZE;
+    }
+
+    size_t count = 0;
+    while (seq != head && count < max) {
+        const trace_event_t *slot = &g_ring[seq & TRACE_RING_MASK];
+        uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (before == seq + 1) {
+            out[count] = *slot;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            // A writer may have reused the slot while it was being copied
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == before) {
+                count++;
+            }
+        }
+        seq++;
+    }
+
+    if (next_seq != NULL) {
+        *next_seq = seq;
+    }
+    return count;
+}
+
+const char *trace_event_name(uint16_t id) {
+    if (id >= TRACE_EV_MAX || g_event_names[id] == NULL) {
+        return "UNKNOWN";
+    }
+    return g_event_names[id];
+}
+
+static void format_centi(char *buf, size_t len, int32_t value) {
+    const char *sign = value < 0 ? "-" : "";
+    uint32_t abs_value = value < 0 ? (uint32_t)(-(int64_t)value) : (uint32_t)value;
+    snprintf(buf, len, "%s%lu.%02lu", sign, (unsigned long)(abs_value / 100), (unsigned long)(abs_value % 100));
+}
+
+int trace_format_event(const trace_event_t *event, char *buf, size_t len) {
+    if (event == NULL || buf == NULL || len == 0) {
+        return 0;
+    }
+
+    char t0[16], t1[16];
+    const char *name = trace_event_name(event->id);
+    unsigned long seq = (unsigned long)(event->seq - 1);
+    unsigned long ts = (unsigned long)event->timestamp_us;
+    int n;
+
+    switch (event->id) {
+    case TRACE_EV_TEMP_SAMPLE:
+    case TRACE_EV_TEMP_INVALID:
+        format_centi(t0, sizeof(t0), event->args[0]);
+        n = snprintf(buf, len, "%lu %lu %s temp=%s", seq, ts, name, t0);
+        break;
+    case TRACE_EV_TEMP_READ_ERROR:
+        n = snprintf(buf, len, "%lu %lu %s err=0x%lx", seq, ts, name, (unsigned long)event->args[0]);
+        break;
+    case TRACE_EV_RELAY_ON:
+    case TRACE_EV_RELAY_OFF:
+        n = snprintf(buf, len, "%lu %lu %s gpio=%ld", seq, ts, name, (long)event->args[0]);
+        break;
+    case TRACE_EV_CONTROL_AUTO:
+        format_centi(t0, sizeof(t0), event->args[1]);
+        format_centi(t1, sizeof(t1), event->args[2]);
+        n = snprintf(buf, len, "%lu %lu %s relay=%s temp=%s setpoint=%s", seq, ts, name,
+                     event->args[0] ? "ON" : "OFF", t0, t1);
+        break;
+    case TRACE_EV_POWER_SET:
+        n = snprintf(buf, len, "%lu %lu %s %s", seq, ts, name, event->args[0] ? "ON" : "OFF");
+        break;
+    case TRACE_EV_SETPOINT_SET:
+        format_centi(t0, sizeof(t0), event->args[0]);
+        n = snprintf(buf, len, "%lu %lu %s setpoint=%s", seq, ts, name, t0);
+        break;
+    default:
+        n = snprintf(buf, len, "%lu %lu %s %ld %ld %ld", seq, ts, name,
+                     (long)event->args[0], (long)event->args[1], (long)event->args[2]);
+        break;
+    }
+
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n >= len ? (int)(len - 1) : n;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "esp_err.h"
+#include "web_storage_cache.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WEB_STORAGE_PARTITION_LABEL "web_storage"
+#define WEB_STORAGE_BASE_PATH "/www"
+#define WEB_STORAGE_MAX_FILES 5   ///< Files open at once (SPIFFS only)
+
+/**
+ * @brief An open file, either a cached copy in RAM or a stream from the file system
+ */
+typedef struct {
+    const uint8_t *data;                 ///< Whole file contents when served from the cache, else NULL
+    size_t size;
+    size_t pos;
+    FILE *fp;                            ///< Set when the file is streamed
+    web_storage_cache_entry_t *entry;
+} web_storage_file_t;
+
+/**
+ * @brief Mount the web_storage partition with the file system chosen in menuconfig
+ *
+ * Remounts if already mounted, which also empties the file cache.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the partition is missing, or an error code
+ */
+esp_err_t web_storage_mount(void);
+
+/**
+ * @brief Unmount the partition and free the file cache
+ * @return ESP_OK on success (also when nothing was mounted), or an error code
+ */
+esp_err_t web_storage_unmount(void);
+
+bool web_storage_is_mounted(void);
+
+/**
+ * @brief Name of the configured file system, "spiffs" or "littlefs"
+ */
+const char *web_storage_backend_name(void);
+
+/**
+ * @brief Open a file by its path under the mount point, e.g. "/index.html"
+ *
+ * Mounts the partition on first use. Files up to WEB_STORAGE_CACHE_FILE_MAX are read
+ * once and then served from RAM, so repeated requests do not reopen them.
+ * Must be called from one task at a time.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the file does not exist, or an error code
+ */
+esp_err_t web_storage_open(const char *path, web_storage_file_t *file);
+
+/**
+ * @brief Copy up to len bytes from the current position
+ * @return Bytes read, 0 at the end of the file
+ */
+size_t web_storage_read(web_storage_file_t *file, void *buf, size_t len);
+
+/**
+ * @brief Move the read position, e.g. to the start of a requested byte range
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE past the end of the file, or ESP_FAIL
+ */
+esp_err_t web_storage_seek(web_storage_file_t *file, size_t offset);
+
+void web_storage_close(web_storage_file_t *file);
+
+/**
+ * @brief Cache hit and miss counters since the last mount
+ */
+void web_storage_get_cache_stats(uint32_t *hits, uint32_t *misses);
+
+#ifdef __cplusplus
+}
+#endif
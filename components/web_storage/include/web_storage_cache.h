@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WEB_STORAGE_CACHE_SLOTS 4
+#define WEB_STORAGE_CACHE_FILE_MAX 8192      ///< Larger files are always streamed from flash
+#define WEB_STORAGE_CACHE_BYTES_MAX 24576    ///< Arena size shared by all cached files
+#define WEB_STORAGE_PATH_MAX 64
+
+/**
+ * @brief A whole file held in RAM, keyed by its path under the mount point
+ */
+typedef struct {
+    char path[WEB_STORAGE_PATH_MAX];
+    uint8_t *data;        ///< Points into the cache arena, NULL while the slot is free
+    size_t size;
+    uint32_t last_used;   ///< Cache clock at the last lookup, for LRU eviction
+    uint8_t refs;         ///< Open handles; a referenced entry is never evicted
+} web_storage_cache_entry_t;
+
+/**
+ * @brief LRU cache of small files, bounded by slot count and total bytes
+ *
+ * File contents live in a fixed arena inside the cache, so caching never touches the heap.
+ * Not thread-safe; the web server uses it from the httpd task only.
+ */
+typedef struct {
+    web_storage_cache_entry_t entries[WEB_STORAGE_CACHE_SLOTS];
+    uint8_t arena[WEB_STORAGE_CACHE_BYTES_MAX];
+    size_t bytes;
+    uint32_t clock;
+    uint32_t hits;
+    uint32_t misses;
+} web_storage_cache_t;
+
+/**
+ * @brief Look up a file and mark it as most recently used
+ * @return The entry, or NULL on a miss
+ */
+web_storage_cache_entry_t *web_storage_cache_get(web_storage_cache_t *cache, const char *path);
+
+/**
+ * @brief Allocate an entry of `size` bytes for the caller to fill
+ *
+ * Evicts least recently used, unreferenced entries until both a free slot and a
+ * contiguous range of the arena are available.
+ * @return The entry, or NULL if the file is too large or everything left is referenced
+ */
+web_storage_cache_entry_t *web_storage_cache_insert(web_storage_cache_t *cache, const char *path, size_t size);
+
+/**
+ * @brief Release one entry, e.g. after the file could not be read into it
+ */
+void web_storage_cache_remove(web_storage_cache_t *cache, web_storage_cache_entry_t *entry);
+
+/**
+ * @brief Release all entries; none may be referenced
+ */
+void web_storage_cache_clear(web_storage_cache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,213 @@
+#include "web_storage.h"
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_littlefs.h"
+#include "sdkconfig.h"
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "WEB_STORAGE";
+
+static bool g_mounted = false;
+static web_storage_cache_t g_cache;
+
+#if CONFIG_WEB_STORAGE_LITTLEFS
+
+static esp_err_t backend_register(void) {
+    esp_vfs_littlefs_conf_t conf = {
+        .base_path = WEB_STORAGE_BASE_PATH,
+        .partition_label = WEB_STORAGE_PARTITION_LABEL,
+        .format_if_mount_failed = true,
+    };
+    return esp_vfs_littlefs_register(&conf);
+}
+
+static esp_err_t backend_unregister(void) {
+    return esp_vfs_littlefs_unregister(WEB_STORAGE_PARTITION_LABEL);
+}
+
+static esp_err_t backend_info(size_t *total, size_t *used) {
+    return esp_littlefs_info(WEB_STORAGE_PARTITION_LABEL, total, used);
+}
+
+const char *web_storage_backend_name(void) {
+    return "littlefs";
+}
+
+#else
+
+static esp_err_t backend_register(void) {
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = WEB_STORAGE_BASE_PATH,
+        .partition_label = WEB_STORAGE_PARTITION_LABEL,
+        .max_files = WEB_STORAGE_MAX_FILES,
+        .format_if_mount_failed = true,
+    };
+    return esp_vfs_spiffs_register(&conf);
+}
+
+static esp_err_t backend_unregister(void) {
+    return esp_vfs_spiffs_unregister(WEB_STORAGE_PARTITION_LABEL);
+}
+
+static esp_err_t backend_info(size_t *total, size_t *used) {
+    return esp_spiffs_info(WEB_STORAGE_PARTITION_LABEL, total, used);
+}
+
+const char *web_storage_backend_name(void) {
+    return "spiffs";
+}
+
+#endif
+
+esp_err_t web_storage_mount(void) {
+    esp_err_t ret = web_storage_unmount();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to unmount %s: %s", web_storage_backend_name(), esp_err_to_name(ret));
+    }
+
+    ret = backend_register();
+    if (ret != ESP_OK) {
+        if (ret == ESP_FAIL) {
+            ESP_LOGE(TAG, "Failed to mount or format filesystem");
+        } else if (ret == ESP_ERR_NOT_FOUND) {
+            ESP_LOGE(TAG, "Failed to find %s partition", WEB_STORAGE_PARTITION_LABEL);
+        } else {
+            ESP_LOGE(TAG, "Failed to initialize %s (%s)", web_storage_backend_name(), esp_err_to_name(ret));
+        }
+        return ret;
+    }
+
+    size_t total = 0, used = 0;
+    ret = backend_info(&total, &used);
+    if (ret != ESP_OK) {
+        ESP_LOGD(TAG, "Failed to get partition information (%s)", esp_err_to_name(ret));
+    } else {
+        ESP_LOGI(TAG, "%s partition size: total: %u, used: %u", web_storage_backend_name(),
+                 (unsigned)total, (unsigned)used);
+    }
+
+    // List files for debugging; walking the directory is slow, skip it otherwise
+    DIR *dir = esp_log_level_get(TAG) >= ESP_LOG_DEBUG ? opendir(WEB_STORAGE_BASE_PATH) : NULL;
+    if (dir != NULL) {
+        ESP_LOGD(TAG, "Files in %s:", WEB_STORAGE_BASE_PATH);
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            ESP_LOGD(TAG, "  %s", entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    g_mounted = true;
+    return ESP_OK;
+}
+
+esp_err_t web_storage_unmount(void) {
+    web_storage_cache_clear(&g_cache);
+    memset(&g_cache, 0, sizeof(g_cache));
+    if (!g_mounted) {
+        return ESP_OK;
+    }
+    g_mounted = false;
+    return backend_unregister();
+}
+
+bool web_storage_is_mounted(void) {
+    return g_mounted;
+}
+
+esp_err_t web_storage_open(const char *path, web_storage_file_t *file) {
+    if (path == NULL || file == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(file, 0, sizeof(*file));
+
+    if (!g_mounted) {
+        esp_err_t ret = web_storage_mount();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    web_storage_cache_entry_t *entry = web_storage_cache_get(&g_cache, path);
+    if (entry != NULL) {
+        entry->refs++;
+        file->entry = entry;
+        file->data = entry->data;
+        file->size = entry->size;
+        return ESP_OK;
+    }
+
+    char full_path[sizeof(WEB_STORAGE_BASE_PATH) + WEB_STORAGE_PATH_MAX];
+    if (snprintf(full_path, sizeof(full_path), "%s%s", WEB_STORAGE_BASE_PATH, path) >= (int)sizeof(full_path)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    FILE *fp = fopen(full_path, "rb");
+    if (fp == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) == 0 && st.st_size >= 0) {
+        file->size = (size_t)st.st_size;
+        entry = web_storage_cache_insert(&g_cache, path, file->size);
+    }
+    if (entry != NULL) {
+        if (fread(entry->data, 1, entry->size, fp) == entry->size) {
+            fclose(fp);
+            entry->refs++;
+            file->entry = entry;
+            file->data = entry->data;
+            return ESP_OK;
+        }
+        web_storage_cache_remove(&g_cache, entry);
+        rewind(fp);
+    }
+
+    file->fp = fp;
+    return ESP_OK;
+}
+
+size_t web_storage_read(web_storage_file_t *file, void *buf, size_t len) {
+    if (file->fp != NULL) {
+        return fread(buf, 1, len, file->fp);
+    }
+    size_t n = file->size - file->pos;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(buf, file->data + file->pos, n);
+    file->pos += n;
+    return n;
+}
+
+esp_err_t web_storage_seek(web_storage_file_t *file, size_t offset) {
+    if (offset > file->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (file->fp != NULL) {
+        return fseek(file->fp, (long)offset, SEEK_SET) == 0 ? ESP_OK : ESP_FAIL;
+    }
+    file->pos = offset;
+    return ESP_OK;
+}
+
+void web_storage_close(web_storage_file_t *file) {
+    if (file->fp != NULL) {
+        fclose(file->fp);
+    }
+    if (file->entry != NULL && file->entry->refs > 0) {
+        file->entry->refs--;
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+void web_storage_get_cache_stats(uint32_t *hits, uint32_t *misses) {
+    if (hits != NULL) {
+        *hits = g_cache.hits;
+    }
+    if (misses != NULL) {
+        *misses = g_cache.misses;
+    }
+}
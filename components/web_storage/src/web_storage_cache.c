@@ -0,0 +1,98 @@
+#include "web_storage_cache.h"
+#include <stdbool.h>
+#include <string.h>
+
+web_storage_cache_entry_t *web_storage_cache_get(web_storage_cache_t *cache, const char *path) {
+    for (size_t i = 0; i < WEB_STORAGE_CACHE_SLOTS; i++) {
+        web_storage_cache_entry_t *entry = &cache->entries[i];
+        if (entry->data != NULL && strcmp(entry->path, path) == 0) {
+            entry->last_used = ++cache->clock;
+            cache->hits++;
+            return entry;
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+// Lowest arena offset where `size` bytes fit between the live entries
+static bool find_gap(const web_storage_cache_t *cache, size_t size, size_t *offset) {
+    bool found = false;
+    // Candidates are the start of the arena and the end of every live entry
+    for (size_t c = 0; c <= WEB_STORAGE_CACHE_SLOTS; c++) {
+        size_t start = 0;
+        if (c < WEB_STORAGE_CACHE_SLOTS) {
+            const web_storage_cache_entry_t *entry = &cache->entries[c];
+            if (entry->data == NULL) {
+                continue;
+            }
+            start = (size_t)(entry->data - cache->arena) + entry->size;
+        }
+        if (start + size > WEB_STORAGE_CACHE_BYTES_MAX || (found && start >= *offset)) {
+            continue;
+        }
+        bool overlaps = false;
+        for (size_t i = 0; i < WEB_STORAGE_CACHE_SLOTS && !overlaps; i++) {
+            const web_storage_cache_entry_t *entry = &cache->entries[i];
+            size_t begin = (size_t)(entry->data - cache->arena);
+            overlaps = entry->data != NULL && start < begin + entry->size && begin < start + size;
+        }
+        if (!overlaps) {
+            *offset = start;
+            found = true;
+        }
+    }
+    return found;
+}
+
+web_storage_cache_entry_t *web_storage_cache_insert(web_storage_cache_t *cache, const char *path, size_t size) {
+    if (size > WEB_STORAGE_CACHE_FILE_MAX || strlen(path) >= WEB_STORAGE_PATH_MAX) {
+        return NULL;
+    }
+
+    web_storage_cache_entry_t *slot;
+    size_t offset;
+    for (;;) {
+        slot = NULL;
+        web_storage_cache_entry_t *lru = NULL;
+        for (size_t i = 0; i < WEB_STORAGE_CACHE_SLOTS; i++) {
+            web_storage_cache_entry_t *entry = &cache->entries[i];
+            if (entry->data == NULL) {
+                if (slot == NULL) {
+                    slot = entry;
+                }
+            } else if (entry->refs == 0 && (lru == NULL || entry->last_used < lru->last_used)) {
+                lru = entry;
+            }
+        }
+        if (slot != NULL && find_gap(cache, size, &offset)) {
+            break;
+        }
+        if (lru == NULL) {
+            return NULL;
+        }
+        web_storage_cache_remove(cache, lru);
+    }
+
+    slot->data = cache->arena + offset;
+    strcpy(slot->path, path);
+    slot->size = size;
+    slot->refs = 0;
+    slot->last_used = ++cache->clock;
+    cache->bytes += size;
+    return slot;
+}
+
+void web_storage_cache_remove(web_storage_cache_t *cache, web_storage_cache_entry_t *entry) {
+    if (entry->data == NULL) {
+        return;
+    }
+    cache->bytes -= entry->size;
+    memset(entry, 0, sizeof(*entry));
+}
+
+void web_storage_cache_clear(web_storage_cache_t *cache) {
+    for (size_t i = 0; i < WEB_STORAGE_CACHE_SLOTS; i++) {
+        web_storage_cache_remove(cache, &cache->entries[i]);
+    }
+}
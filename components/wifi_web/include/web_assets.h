@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Web asset embedded into the firmware at build time
+ *
+ * Generated from data/ by scripts/gen_web_assets.py; the body is minified and gzip-compressed.
+ */
+typedef struct {
+    const char *path;          ///< URL path, e.g. "/index.html" or "/static/styles.1a2b3c4d.css"
+    const char *file;          ///< Source file path in data/ (and in SPIFFS)
+    const char *content_type;  ///< MIME type of the uncompressed content
+    const char *etag;          ///< Weak ETag derived from the content hash, including quotes
+    const char *cache_control; ///< Cache-Control value ("immutable" for fingerprinted URLs)
+    const uint8_t *data;       ///< gzip-compressed body
+    size_t size;               ///< Size of the compressed body in bytes
+} web_asset_t;
+
+/**
+ * @brief Page with an initial-state slot, split at the slot
+ *
+ * `prefix` is a gzip member cut after the text before the slot: deflate blocks flushed
+ * to a byte boundary, none of them final. The server appends a final stored block with
+ * the state and `suffix`, then the gzip trailer.
+ */
+typedef struct {
+    const char *path;          ///< URL path of the page, also in web_assets
+    const uint8_t *prefix;     ///< gzip header and deflate blocks of the text before the slot
+    size_t prefix_size;
+    uint32_t prefix_crc;       ///< CRC-32 of the text before the slot
+    uint32_t prefix_len;       ///< Length of the text before the slot
+    const char *suffix;        ///< Text after the slot, sent uncompressed
+    size_t suffix_len;
+} web_template_t;
+
+extern const web_asset_t web_assets[];
+extern const size_t web_assets_count;
+extern const web_template_t web_templates[];
+extern const size_t web_templates_count;
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,7 +3,9 @@
 #include "esp_err.h"
 #include "esp_http_server.h"
 #include "config.h"
+#include "freertos/FreeRTOS.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #ifdef __cplusplus
@@ -16,14 +18,85 @@ typedef struct {
     float current_temp;
 } teapot_state_t;
 
+#define WIFI_WEB_UPDATE_IS_ON    (1u << 0)  ///< Изменить is_on
+#define WIFI_WEB_UPDATE_SETPOINT (1u << 1)  ///< Изменить setpoint_temp
+
+/**
+ * @brief Набор изменений состояния, применяемых одной операцией
+ */
 typedef struct {
+    uint32_t fields;      ///< Битовая маска WIFI_WEB_UPDATE_* заданных полей
+    bool is_on;
+    float setpoint_temp;
+} teapot_state_update_t;
+
+/**
+ * @brief Представление состояния (общее для HTTP и других транспортов)
+ */
+typedef enum {
+    WIFI_WEB_FORMAT_JSON = 0,  ///< application/json
+    WIFI_WEB_FORMAT_CBOR,      ///< application/cbor
+    WIFI_WEB_FORMAT_PACKED     ///< wifi_web_state_packed_t
+} wifi_web_format_t;
+
+#define WIFI_WEB_STATE_PACKED_VERSION 1
+#define WIFI_WEB_STATE_PACKED_IS_ON   (1u << 0)  ///< Бит flags: чайник включен
+#define WIFI_WEB_STATE_PACKED_RELAY   (1u << 1)  ///< Бит flags: реле замкнуто
+
+/**
+ * @brief Состояние в компактном бинарном формате (Accept: application/vnd.smart-teapot.state)
+ *
+ * Фиксированная раскладка без выравнивания, little-endian; температуры в сотых долях °C.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t format_version;   ///< WIFI_WEB_STATE_PACKED_VERSION
+    uint8_t flags;            ///< Биты WIFI_WEB_STATE_PACKED_*
+    int16_t setpoint_centi;
+    int16_t current_centi;
+    uint32_t state_version;   ///< Совпадает с версией в ETag
+} wifi_web_state_packed_t;
+
+typedef struct wifi_web_ctx wifi_web_ctx_t;
+
+/**
+ * @brief Обработчик изменения состояния
+ *
+ * Вызывается из задачи, изменившей состояние (httpd, датчик температуры и т.д.),
+ * поэтому должен быть коротким: например, выставить флаг или разбудить свою задачу.
+ */
+typedef void (*wifi_web_state_listener_t)(wifi_web_ctx_t *ctx, void *arg);
+
+#define WIFI_WEB_MAX_LISTENERS 4
+
+/**
+ * @brief Одно измерение цикла управления
+ */
+typedef struct {
+    int64_t timestamp_us;  ///< esp_timer_get_time() в момент измерения
+    float temperature;     ///< Измеренная температура, °C
+    float setpoint_temp;   ///< Уставка на момент измерения
+    bool is_on;            ///< Чайник включен
+    bool relay_on;         ///< Состояние реле после шага управления
+} teapot_sample_t;
+
+/**
+ * @brief Обработчик измерений
+ *
+ * Вызывается из задачи датчика температуры после каждого успешного измерения
+ * и не должен блокироваться: цикл управления ждёт его завершения.
+ */
+typedef void (*wifi_web_sample_listener_t)(wifi_web_ctx_t *ctx, const teapot_sample_t *sample, void *arg);
+
+struct wifi_web_ctx {
     httpd_handle_t server;
     teapot_state_t state;
-    teapot_config_t *config;
+    portMUX_TYPE state_lock;  ///< Защищает state от частично применённых изменений
+    uint32_t state_version;  ///< Увеличивается при каждом изменении состояния
+    teapot_config_t *config;  ///< Текущая конфигурация, изменяется через config_apply()
     void *temp_sensor_handle;
     void *temp_task_handle;
     void *relay_handle;
-} wifi_web_ctx_t;
+};
 
 /**
  * @brief Инициализация контекста веб-сервера (валидация и инициализация состояния)
@@ -34,10 +107,10 @@ typedef struct {
 esp_err_t wifi_web_init_ctx(wifi_web_ctx_t *ctx, teapot_config_t *config);
 
 /**
- * @brief Инициализация SPIFFS файловой системы
+ * @brief Монтирование файловой системы веб-ресурсов (SPIFFS или LittleFS, выбирается в menuconfig)
  * @return ESP_OK в случае успеха, иначе код ошибки
  */
-esp_err_t wifi_web_init_spiffs(void);
+esp_err_t wifi_web_init_storage(void);
 
 /**
  * @brief Инициализация WiFi Access Point
@@ -47,7 +120,20 @@ esp_err_t wifi_web_init_spiffs(void);
 esp_err_t wifi_web_init_wifi(teapot_config_t *config);
 
 /**
- * @brief Полная инициализация WiFi веб-сервера (включает WiFi AP и SPIFFS)
+ * @brief Инициализация реле (контекст должен быть уже инициализирован)
+ *
+ * Реле сразу выключается, поэтому при загрузке этот шаг выполняется как можно раньше.
+ * @param ctx Контекст веб-сервера
+ * @return ESP_OK в случае успеха, иначе код ошибки
+ */
+esp_err_t wifi_web_init_relay(wifi_web_ctx_t *ctx);
+
+/**
+ * @brief Полная инициализация WiFi веб-сервера (контекст, реле и WiFi AP)
+ *
+ * Файловая система монтируется лениво, при первом запросе файла, которого нет во встроенных ресурсах.
+ * Подписывается на изменения конфигурации: SSID и пароль точки доступа, GPIO реле
+ * и датчика применяются без перезагрузки (реле на время переключения выключается).
  * @param ctx Контекст веб-сервера
  * @param config Конфигурация чайника (будет валидирована внутри)
  * @return ESP_OK в случае успеха, иначе код ошибки
@@ -84,6 +170,54 @@ esp_err_t wifi_web_set_power(wifi_web_ctx_t *ctx, bool is_on);
  */
 esp_err_t wifi_web_set_setpoint(wifi_web_ctx_t *ctx, float temperature);
 
+/**
+ * @brief Атомарно применить несколько изменений состояния
+ *
+ * Все поля проверяются до применения: при ошибке состояние не изменяется.
+ * @param ctx Контекст веб-сервера
+ * @param update Изменения (применяются только поля из update->fields)
+ * @return ESP_OK в случае успеха, ESP_ERR_INVALID_ARG если хотя бы одно поле некорректно
+ */
+esp_err_t wifi_web_apply_update(wifi_web_ctx_t *ctx, const teapot_state_update_t *update);
+
+/**
+ * @brief Разобрать JSON-тело изменения состояния ({"is_on":bool, "setpoint_temp":number}, любое подмножество)
+ * @param json Текст JSON (без завершающего нуля)
+ * @param len Длина текста
+ * @param update Результат разбора (состояние не изменяется)
+ * @return ESP_OK в случае успеха, ESP_ERR_INVALID_ARG при некорректном теле или неизвестных полях
+ */
+esp_err_t wifi_web_parse_update(const char *json, size_t len, teapot_state_update_t *update);
+
+/**
+ * @brief Сериализовать текущее состояние в том же виде, что отдаёт GET /api/state
+ * @param ctx Контекст веб-сервера
+ * @param format Представление
+ * @param buf Буфер для результата
+ * @param size Размер буфера
+ * @param len Длина результата в байтах
+ * @param version Версия состояния, соответствующая результату (может быть NULL)
+ * @return ESP_OK в случае успеха, ESP_ERR_NO_MEM если буфер слишком мал
+ */
+esp_err_t wifi_web_render_state(wifi_web_ctx_t *ctx, wifi_web_format_t format,
+                                uint8_t *buf, size_t size, size_t *len, uint32_t *version);
+
+/**
+ * @brief Подписаться на изменения состояния
+ * @param listener Обработчик
+ * @param arg Аргумент обработчика
+ * @return ESP_OK в случае успеха, ESP_ERR_NO_MEM если достигнут предел WIFI_WEB_MAX_LISTENERS
+ */
+esp_err_t wifi_web_add_state_listener(wifi_web_state_listener_t listener, void *arg);
+
+/**
+ * @brief Подписаться на измерения цикла управления
+ * @param listener Обработчик
+ * @param arg Аргумент обработчика
+ * @return ESP_OK в случае успеха, ESP_ERR_NO_MEM если достигнут предел WIFI_WEB_MAX_LISTENERS
+ */
+esp_err_t wifi_web_add_sample_listener(wifi_web_sample_listener_t listener, void *arg);
+
 /**
  * @brief Получить текущее состояние чайника
  * @param ctx Контекст веб-сервера
@@ -101,7 +235,28 @@ esp_err_t wifi_web_get_state(wifi_web_ctx_t *ctx, teapot_state_t *state);
 esp_err_t wifi_web_set_current_temp(wifi_web_ctx_t *ctx, float temperature);
 
 /**
- * @brief Запустить задачу чтения температуры с датчика
+ * @brief Одна итерация цикла управления для корректного измерения
+ *
+ * Обновляет текущую температуру, переключает реле (если оно инициализировано) и
+ * рассылает измерение подписчикам. Задача датчика вызывает её на каждое чтение;
+ * в установившемся режиме куча не используется.
+ * @param ctx Контекст веб-сервера
+ * @param temperature Измеренная температура в градусах Цельсия
+ * @return ESP_OK в случае успеха, иначе код ошибки
+ */
+esp_err_t wifi_web_process_sample(wifi_web_ctx_t *ctx, float temperature);
+
+/**
+ * @brief Найти датчик температуры на шине 1-Wire, не запуская цикл управления
+ *
+ * Позволяет выполнить поиск датчика параллельно с запуском WiFi.
+ * @param ctx Контекст веб-сервера
+ * @return ESP_OK в случае успеха, иначе код ошибки
+ */
+esp_err_t wifi_web_init_temp_sensor(wifi_web_ctx_t *ctx);
+
+/**
+ * @brief Запустить задачу чтения температуры с датчика (датчик ищется, если ещё не найден)
  * @param ctx Контекст веб-сервера
  * @return ESP_OK в случае успеха, иначе код ошибки
  */
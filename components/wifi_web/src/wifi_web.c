@@ -1,7 +1,9 @@
 #include "wifi_web.h"
+#include "web_assets.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
-#include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_netif.h"
@@ -10,173 +12,1900 @@
 #include "config.h"
 #include "temp_sensor.h"
 #include "relay.h"
+#include "trace.h"
+#include "history.h"
+#include "sample_log.h"
+#include "boot_graph.h"
+#include "web_storage.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "esp_system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "cJSON.h"
+#include "jsontok.h"
+#include "cborenc.h"
+#include "lwip/sockets.h"
 #include <string.h>
-#include <dirent.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+#include <strings.h>
+#include <unistd.h>
 #include <assert.h>
 
 static const char *TAG = "WIFI_WEB";
-static const char *SPIFFS_BASE_PATH = "/spiffs";
 static wifi_web_ctx_t *g_ctx = NULL;
 static bool server_started_from_event = false;
 static esp_event_handler_instance_t wifi_event_handler_instance = NULL;
 
-static esp_err_t send_json_response(httpd_req_t *req, cJSON *json) {
-    char *json_str = cJSON_Print(json);
-    if (json_str == NULL) {
+#define STATE_FIELD_IS_ON         (1u << 0)
+#define STATE_FIELD_RELAY_STATE   (1u << 1)
+#define STATE_FIELD_SETPOINT_TEMP (1u << 2)
+#define STATE_FIELD_CURRENT_TEMP  (1u << 3)
+#define STATE_FIELDS_ALL          0x0Fu
+
+// Everything a client sees: control state plus the relay output
+typedef struct {
+    bool is_on;
+    bool relay_state;
+    float setpoint_temp;
+    float current_temp;
+} state_snapshot_t;
+
+#define WS_MAX_CLIENTS 4
+#define WS_QUEUE_LEN 4
+#define WS_MSG_MAX 128
+#define WS_RETRY_DELAY_US (50 * 1000)
+
+// Request bodies are parsed in place on the handler stack, no heap involved
+#define REQUEST_BODY_MAX 256
+#define REQUEST_TOKENS_MAX 16
+#define REQUEST_RECV_RETRIES 3
+#define CONFIG_BODY_MAX 640
+#define CONFIG_TOKENS_MAX 24
+
+// The control task lives as long as the firmware, so its stack is not taken from the heap.
+// It is only ever deleted by another task, which makes the buffers reusable right away.
+#define TEMP_TASK_STACK 4096
+#define TEMP_TASK_PRIORITY 5
+static StackType_t g_temp_task_stack[TEMP_TASK_STACK];
+static StaticTask_t g_temp_task_buf;
+
+typedef struct {
+    uint8_t len;
+    char data[WS_MSG_MAX];
+} ws_msg_t;
+
+// Per-client bounded send queue, only touched from the httpd task
+typedef struct {
+    int fd;          // -1 when the slot is free
+    uint8_t head;
+    uint8_t count;
+    ws_msg_t queue[WS_QUEUE_LEN];
+} ws_client_t;
+
+static ws_client_t g_ws_clients[WS_MAX_CLIENTS];
+static int g_ws_client_count = 0;
+static bool g_ws_broadcast_pending = false;
+static state_snapshot_t g_ws_last_sent;
+static esp_timer_handle_t g_ws_retry_timer = NULL;
+
+static const char *get_state_json(wifi_web_ctx_t *ctx, int *len, uint32_t *version_out);
+
+static const web_asset_t *find_embedded_asset(const char *path) {
+    for (size_t i = 0; i < web_assets_count; i++) {
+        if (strcmp(web_assets[i].path, path) == 0) {
+            return &web_assets[i];
+        }
+    }
+    return NULL;
+}
+
+static bool client_accepts_gzip(httpd_req_t *req) {
+    char accept[64];
+    esp_err_t ret = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept));
+    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return strstr(accept, "gzip") != NULL;
+}
+
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+    char if_none_match[96];
+    esp_err_t ret = httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match));
+    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    
+    // Weak comparison: ignore the W/ prefix on both sides
+    const char *opaque = strncmp(etag, "W/", 2) == 0 ? etag + 2 : etag;
+    return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, opaque) != NULL;
+}
+
+static const struct {
+    const char *ext;
+    const char *type;
+} k_mime_types[] = {
+    { ".html", "text/html" },
+    { ".css", "text/css" },
+    { ".js", "application/javascript" },
+    { ".json", "application/json" },
+    { ".webmanifest", "application/manifest+json" },
+    { ".txt", "text/plain" },
+    { ".csv", "text/csv" },
+    { ".svg", "image/svg+xml" },
+    { ".png", "image/png" },
+    { ".jpg", "image/jpeg" },
+    { ".ico", "image/x-icon" },
+    { ".woff2", "font/woff2" },
+};
+
+static const char *mime_type_for(const char *path) {
+    const char *ext = strrchr(path, '.');
+    if (ext != NULL && strchr(ext, '/') == NULL) {
+        for (size_t i = 0; i < sizeof(k_mime_types) / sizeof(k_mime_types[0]); i++) {
+            if (strcasecmp(ext, k_mime_types[i].ext) == 0) {
+                return k_mime_types[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// URIs are not percent-decoded, so any '%' is refused along with "." and ".." segments
+static bool static_path_is_safe(const char *path) {
+    if (path[0] != '/' || strpbrk(path, "\\%") != NULL) {
+        return false;
+    }
+    for (const char *seg = path + 1; *seg != '\0'; ) {
+        size_t len = strcspn(seg, "/");
+        if (len == 0 || (len == 1 && seg[0] == '.') || (len == 2 && seg[0] == '.' && seg[1] == '.')) {
+            return false;
+        }
+        seg += len;
+        if (*seg == '/') {
+            seg++;
+        }
+    }
+    return true;
+}
+
+// Single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range; anything else, including
+// multiple ranges, is answered with the whole body. Returns 1 for a range, 0 without one and
+// -1 when the range lies past the end.
+static int parse_range(httpd_req_t *req, size_t size, size_t *start, size_t *len) {
+    char range[48];
+    if (httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) != ESP_OK ||
+        strncmp(range, "bytes=", 6) != 0 || strchr(range, ',') != NULL) {
+        return 0;
+    }
+    
+    const char *spec = range + 6;
+    char *end;
+    if (spec[0] == '-') {
+        if (!isdigit((unsigned char)spec[1])) {
+            return 0;
+        }
+        unsigned long suffix = strtoul(spec + 1, &end, 10);
+        if (*end != '\0') {
+            return 0;
+        }
+        if (suffix == 0 || size == 0) {
+            return -1;
+        }
+        *len = suffix < size ? suffix : size;
+        *start = size - *len;
+        return 1;
+    }
+    
+    if (!isdigit((unsigned char)spec[0])) {
+        return 0;
+    }
+    unsigned long first = strtoul(spec, &end, 10);
+    if (*end != '-') {
+        return 0;
+    }
+    unsigned long last = ULONG_MAX;
+    if (end[1] != '\0') {
+        if (!isdigit((unsigned char)end[1])) {
+            return 0;
+        }
+        last = strtoul(end + 1, &end, 10);
+        if (*end != '\0' || last < first) {
+            return 0;
+        }
+    }
+    if (first >= size) {
+        return -1;
+    }
+    if (last >= size) {
+        last = size - 1;
+    }
+    *start = first;
+    *len = last - first + 1;
+    return 1;
+}
+
+typedef struct {
+    const char *status;
+    const char *content_type;
+    const char *encoding;        // NULL or "gzip"
+    const char *etag;
+    const char *cache_control;
+    char content_range[48];      // Empty unless a 206 or 416
+    size_t length;               // Body bytes
+    bool ranges;                 // Range requests are honoured
+} static_resp_t;
+
+// esp_http_server would write the body of a HEAD response too, so its header block is sent by hand
+static esp_err_t send_head_response(httpd_req_t *req, const static_resp_t *resp) {
+    char head[512];
+    int len = snprintf(head, sizeof(head),
+                       "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nVary: Accept-Encoding\r\n",
+                       resp->status, resp->content_type, (unsigned)resp->length);
+    if (resp->ranges) {
+        len += snprintf(head + len, sizeof(head) - len, "Accept-Ranges: bytes\r\n");
+    }
+    if (resp->encoding != NULL) {
+        len += snprintf(head + len, sizeof(head) - len, "Content-Encoding: %s\r\n", resp->encoding);
+    }
+    if (resp->etag != NULL) {
+        len += snprintf(head + len, sizeof(head) - len, "ETag: %s\r\n", resp->etag);
+    }
+    if (resp->cache_control != NULL) {
+        len += snprintf(head + len, sizeof(head) - len, "Cache-Control: %s\r\n", resp->cache_control);
+    }
+    if (resp->content_range[0] != '\0') {
+        len += snprintf(head + len, sizeof(head) - len, "Content-Range: %s\r\n", resp->content_range);
+    }
+    len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    if (len >= (int)sizeof(head)) {
+        return ESP_FAIL;
+    }
+    return httpd_send(req, head, len) == len ? ESP_OK : ESP_FAIL;
+}
+
+static void set_static_headers(httpd_req_t *req, const static_resp_t *resp) {
+    httpd_resp_set_status(req, resp->status);
+    httpd_resp_set_type(req, resp->content_type);
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    if (resp->ranges) {
+        httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+    }
+    if (resp->encoding != NULL) {
+        httpd_resp_set_hdr(req, "Content-Encoding", resp->encoding);
+    }
+    if (resp->etag != NULL) {
+        httpd_resp_set_hdr(req, "ETag", resp->etag);
+    }
+    if (resp->cache_control != NULL) {
+        httpd_resp_set_hdr(req, "Cache-Control", resp->cache_control);
+    }
+    if (resp->content_range[0] != '\0') {
+        httpd_resp_set_hdr(req, "Content-Range", resp->content_range);
+    }
+}
+
+// Body from `data` when it is in memory, otherwise resp->length bytes streamed from `file`
+static esp_err_t send_static_response(httpd_req_t *req, const static_resp_t *resp,
+                                      const uint8_t *data, web_storage_file_t *file) {
+    if (req->method == HTTP_HEAD && resp->length > 0) {
+        return send_head_response(req, resp);
+    }
+    
+    set_static_headers(req, resp);
+    if (req->method == HTTP_HEAD || resp->length == 0) {
+        return httpd_resp_send(req, NULL, 0);
+    }
+    if (data != NULL) {
+        return httpd_resp_send(req, (const char *)data, resp->length);
+    }
+    
+    char buffer[512];
+    size_t remaining = resp->length;
+    esp_err_t ret = ESP_OK;
+    while (remaining > 0) {
+        size_t read_bytes = web_storage_read(file, buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+        if (read_bytes == 0) {
+            // Without the terminating chunk the client sees a truncated body instead of a short
+            // file; returning ESP_FAIL makes httpd close the connection
+            ESP_LOGE(TAG, "Short read of %s: %u bytes missing", req->uri, (unsigned)remaining);
+            return ESP_FAIL;
+        }
+        if (httpd_resp_send_chunk(req, buffer, read_bytes) != ESP_OK) {
+            ret = ESP_FAIL;
+            break;
+        }
+        remaining -= read_bytes;
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ret;
+}
+
+// Apply a Range request to a body of `size` bytes and send it
+static esp_err_t send_static_body(httpd_req_t *req, static_resp_t *resp,
+                                  const uint8_t *data, web_storage_file_t *file, size_t size) {
+    size_t start = 0;
+    size_t len = size;
+    resp->ranges = true;
+    int range = parse_range(req, size, &start, &len);
+    if (range < 0) {
+        resp->status = "416 Range Not Satisfiable";
+        snprintf(resp->content_range, sizeof(resp->content_range), "bytes */%u", (unsigned)size);
+        resp->length = 0;
+        return send_static_response(req, resp, NULL, NULL);
+    }
+    if (range > 0 && (data != NULL || web_storage_seek(file, start) == ESP_OK)) {
+        resp->status = "206 Partial Content";
+        snprintf(resp->content_range, sizeof(resp->content_range), "bytes %u-%u/%u",
+                 (unsigned)start, (unsigned)(start + len - 1), (unsigned)size);
+    } else {
+        start = 0;
+        len = size;
+    }
+    resp->length = len;
+    return send_static_response(req, resp, data != NULL ? data + start : NULL, file);
+}
+
+static const web_template_t *find_template(const char *path) {
+    for (size_t i = 0; i < web_templates_count; i++) {
+        if (strcmp(web_templates[i].path, path) == 0) {
+            return &web_templates[i];
+        }
+    }
+    return NULL;
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+// Stored block header, "{"version":N,"state":...}", the template suffix and the gzip trailer
+#define STATE_PAGE_TAIL_MAX (5 + 32 + WS_MSG_MAX + 256 + 8)
+
+// Finish the template's gzip member with the current state, without compressing anything
+// at request time: one final stored block holds the state and the rest of the page, and
+// the CRC continues from the one of the precompressed part
+static esp_err_t send_state_page(httpd_req_t *req, static_resp_t *resp, const web_template_t *tpl) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
+    int state_len;
+    uint32_t version;
+    const char *state = get_state_json(ctx, &state_len, &version);
+    if (state == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    
+    // The page changes with the state, so its validator carries the state version as well
+    char etag[48];
+    snprintf(etag, sizeof(etag), "%.*s-v%" PRIu32 "\"", (int)strlen(resp->etag) - 1, resp->etag, version);
+    resp->etag = etag;
+    if (etag_matches(req, etag)) {
+        resp->status = "304 Not Modified";
+        return send_static_response(req, resp, NULL, NULL);
+    }
+    
+    uint8_t tail[STATE_PAGE_TAIL_MAX];
+    size_t pos = 5;
+    int n = snprintf((char *)tail + pos, sizeof(tail) - pos, "{\"version\":%" PRIu32 ",\"state\":%.*s}",
+                     version, state_len, state);
+    if (n < 0 || pos + n + tpl->suffix_len + 8 > sizeof(tail)) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    pos += n;
+    memcpy(tail + pos, tpl->suffix, tpl->suffix_len);
+    pos += tpl->suffix_len;
+    
+    uint16_t stored_len = (uint16_t)(pos - 5);
+    tail[0] = 0x01;  // BFINAL = 1, BTYPE = 00 (stored)
+    put_le16(tail + 1, stored_len);
+    put_le16(tail + 3, (uint16_t)~stored_len);
+    put_le32(tail + pos, esp_rom_crc32_le(tpl->prefix_crc, tail + 5, stored_len));
+    put_le32(tail + pos + 4, tpl->prefix_len + stored_len);
+    pos += 8;
+    
+    resp->encoding = "gzip";
+    resp->length = tpl->prefix_size + pos;
+    if (req->method == HTTP_HEAD) {
+        return send_head_response(req, resp);
+    }
+    set_static_headers(req, resp);
+    if (httpd_resp_send_chunk(req, (const char *)tpl->prefix, tpl->prefix_size) != ESP_OK ||
+        httpd_resp_send_chunk(req, (const char *)tail, pos) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Handler for GET and HEAD /*: any file of the embedded assets or the web storage.
+// Embedded assets are gzip-compressed; a client without gzip gets the original file from
+// storage. Storage files are served from a "<path>.gz" sibling when one exists.
+static esp_err_t static_file_handler(httpd_req_t *req) {
+    char path[WEB_STORAGE_PATH_MAX];
+    size_t len = strcspn(req->uri, "?#");
+    if (len == 0 || len >= sizeof(path)) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    memcpy(path, req->uri, len);
+    path[len] = '\0';
+    if (path[len - 1] == '/') {
+        if (len + strlen("index.html") >= sizeof(path)) {
+            httpd_resp_send_404(req);
+            return ESP_FAIL;
+        }
+        strcat(path, "index.html");
+    }
+    if (!static_path_is_safe(path)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid path");
+        return ESP_FAIL;
+    }
+    
+    static_resp_t resp = {
+        .status = "200 OK",
+        .content_type = mime_type_for(path),
+    };
+    bool gzip_ok = client_accepts_gzip(req);
+    const char *file_path = path;
+    
+    const web_asset_t *asset = find_embedded_asset(path);
+    if (asset != NULL) {
+        resp.content_type = asset->content_type;
+        resp.etag = asset->etag;
+        resp.cache_control = asset->cache_control;
+        const web_template_t *tpl = gzip_ok ? find_template(path) : NULL;
+        if (tpl != NULL) {
+            return send_state_page(req, &resp, tpl);
+        }
+        if (etag_matches(req, asset->etag)) {
+            resp.status = "304 Not Modified";
+            return send_static_response(req, &resp, NULL, NULL);
+        }
+        if (gzip_ok) {
+            resp.encoding = "gzip";
+            return send_static_body(req, &resp, asset->data, NULL, asset->size);
+        }
+        file_path = asset->file;
+    }
+    
+    // Mounted on first use: embedded assets cover the usual requests, so boot does not wait for it
+    web_storage_file_t file;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    if (gzip_ok) {
+        char gz_path[WEB_STORAGE_PATH_MAX + 3];
+        snprintf(gz_path, sizeof(gz_path), "%s.gz", file_path);
+        ret = web_storage_open(gz_path, &file);
+        if (ret == ESP_OK) {
+            resp.encoding = "gzip";
+        }
+    }
+    if (ret != ESP_OK) {
+        ret = web_storage_open(file_path, &file);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGD(TAG, "No file for %s: %s", path, esp_err_to_name(ret));
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    
+    ret = send_static_body(req, &resp, file.data, &file, file.size);
+    web_storage_close(&file);
+    return ret;
+}
+
+static void take_state_snapshot(wifi_web_ctx_t *ctx, state_snapshot_t *snap) {
+    snap->relay_state = false;
+    if (ctx->relay_handle != NULL) {
+        relay_get_state((relay_handle_t)ctx->relay_handle, &snap->relay_state);
+    }
+    taskENTER_CRITICAL(&ctx->state_lock);
+    snap->is_on = ctx->state.is_on;
+    snap->setpoint_temp = ctx->state.setpoint_temp;
+    snap->current_temp = ctx->state.current_temp;
+    taskEXIT_CRITICAL(&ctx->state_lock);
+}
+
+static uint32_t state_snapshot_diff(const state_snapshot_t *a, const state_snapshot_t *b) {
+    uint32_t changed = 0;
+    if (a->is_on != b->is_on) {
+        changed |= STATE_FIELD_IS_ON;
+    }
+    if (a->relay_state != b->relay_state) {
+        changed |= STATE_FIELD_RELAY_STATE;
+    }
+    if (a->setpoint_temp != b->setpoint_temp) {
+        changed |= STATE_FIELD_SETPOINT_TEMP;
+    }
+    if (a->current_temp != b->current_temp) {
+        changed |= STATE_FIELD_CURRENT_TEMP;
+    }
+    return changed;
+}
+
+// Minimal JSON writer over a caller-provided buffer: no heap, no printf
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} json_writer_t;
+
+static void jw_raw(json_writer_t *w, const char *str, size_t n) {
+    if (w->overflow || w->len + n > w->size) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, str, n);
+    w->len += n;
+}
+
+static void jw_key(json_writer_t *w, const char *key) {
+    if (w->len > 1) {
+        jw_raw(w, ",", 1);
+    }
+    jw_raw(w, "\"", 1);
+    jw_raw(w, key, strlen(key));
+    jw_raw(w, "\":", 2);
+}
+
+static void jw_bool(json_writer_t *w, bool value) {
+    if (value) {
+        jw_raw(w, "true", 4);
+    } else {
+        jw_raw(w, "false", 5);
+    }
+}
+
+// Temperatures are rendered with two decimals in fixed point, avoiding float formatting
+static void jw_temp(json_writer_t *w, float value) {
+    int32_t centi = (int32_t)(value * 100.0f + (value < 0 ? -0.5f : 0.5f));
+    char digits[16];
+    size_t pos = sizeof(digits);
+    uint32_t abs_value = centi < 0 ? (uint32_t)(-(int64_t)centi) : (uint32_t)centi;
+    
+    do {
+        digits[--pos] = (char)('0' + abs_value % 10);
+        abs_value /= 10;
+        if (pos == sizeof(digits) - 2) {
+            digits[--pos] = '.';
+        }
+    } while (abs_value > 0 || pos > sizeof(digits) - 4);
+    
+    if (centi < 0) {
+        digits[--pos] = '-';
+    }
+    jw_raw(w, digits + pos, sizeof(digits) - pos);
+}
+
+// Render the selected fields of a snapshot as a compact JSON object
+static int render_state_json(char *buf, size_t size, const state_snapshot_t *snap, uint32_t fields) {
+    json_writer_t w = { .buf = buf, .size = size };
+    
+    jw_raw(&w, "{", 1);
+    if (fields & STATE_FIELD_IS_ON) {
+        jw_key(&w, "is_on");
+        jw_bool(&w, snap->is_on);
+    }
+    if (fields & STATE_FIELD_RELAY_STATE) {
+        jw_key(&w, "relay_state");
+        jw_bool(&w, snap->relay_state);
+    }
+    if (fields & STATE_FIELD_SETPOINT_TEMP) {
+        jw_key(&w, "setpoint_temp");
+        jw_temp(&w, snap->setpoint_temp);
+    }
+    if (fields & STATE_FIELD_CURRENT_TEMP) {
+        jw_key(&w, "current_temp");
+        jw_temp(&w, snap->current_temp);
+    }
+    jw_raw(&w, "}", 1);
+    
+    return w.overflow ? -1 : (int)w.len;
+}
+
+// Same fields and keys as render_state_json, encoded as a CBOR map
+static int render_state_cbor(uint8_t *buf, size_t size, const state_snapshot_t *snap, uint32_t fields) {
+    cborenc_t enc;
+    cborenc_init(&enc, buf, size);
+    
+    cborenc_map(&enc, __builtin_popcount(fields & STATE_FIELDS_ALL));
+    if (fields & STATE_FIELD_IS_ON) {
+        cborenc_cstr(&enc, "is_on");
+        cborenc_bool(&enc, snap->is_on);
+    }
+    if (fields & STATE_FIELD_RELAY_STATE) {
+        cborenc_cstr(&enc, "relay_state");
+        cborenc_bool(&enc, snap->relay_state);
+    }
+    if (fields & STATE_FIELD_SETPOINT_TEMP) {
+        cborenc_cstr(&enc, "setpoint_temp");
+        cborenc_float(&enc, snap->setpoint_temp);
+    }
+    if (fields & STATE_FIELD_CURRENT_TEMP) {
+        cborenc_cstr(&enc, "current_temp");
+        cborenc_float(&enc, snap->current_temp);
+    }
+    
+    size_t len;
+    return cborenc_finish(&enc, &len) == ESP_OK ? (int)len : -1;
+}
+
+static int render_state_packed(uint8_t *buf, size_t size, const state_snapshot_t *snap, uint32_t version) {
+    wifi_web_state_packed_t packed = {
+        .format_version = WIFI_WEB_STATE_PACKED_VERSION,
+        .flags = (snap->is_on ? WIFI_WEB_STATE_PACKED_IS_ON : 0) |
+                 (snap->relay_state ? WIFI_WEB_STATE_PACKED_RELAY : 0),
+        .setpoint_centi = (int16_t)TRACE_CENTI(snap->setpoint_temp),
+        .current_centi = (int16_t)TRACE_CENTI(snap->current_temp),
+        .state_version = version
+    };
+    if (size < sizeof(packed)) {
+        return -1;
+    }
+    memcpy(buf, &packed, sizeof(packed));
+    return sizeof(packed);
+}
+
+esp_err_t wifi_web_render_state(wifi_web_ctx_t *ctx, wifi_web_format_t format,
+                                uint8_t *buf, size_t size, size_t *len, uint32_t *version) {
+    if (ctx == NULL || buf == NULL || len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // Read the version before the snapshot: a concurrent change is then reported again later, never lost
+    uint32_t snap_version = __atomic_load_n(&ctx->state_version, __ATOMIC_ACQUIRE);
+    state_snapshot_t snap;
+    take_state_snapshot(ctx, &snap);
+    
+    int ret;
+    switch (format) {
+    case WIFI_WEB_FORMAT_JSON:
+        ret = render_state_json((char *)buf, size, &snap, STATE_FIELDS_ALL);
+        break;
+    case WIFI_WEB_FORMAT_CBOR:
+        ret = render_state_cbor(buf, size, &snap, STATE_FIELDS_ALL);
+        break;
+    case WIFI_WEB_FORMAT_PACKED:
+        ret = render_state_packed(buf, size, &snap, snap_version);
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ret < 0) {
         return ESP_ERR_NO_MEM;
     }
+    
+    *len = (size_t)ret;
+    if (version != NULL) {
+        *version = snap_version;
+    }
+    return ESP_OK;
+}
+
+// Rendered GET /api/state body, only touched from the httpd task
+static struct {
+    bool valid;
+    uint32_t version;
+    int len;
+    char body[WS_MSG_MAX];
+} g_state_cache;
+
+static const char *get_state_json(wifi_web_ctx_t *ctx, int *len, uint32_t *version_out) {
+    // Read the version before the snapshot: a concurrent change then only forces one extra render
+    uint32_t version = __atomic_load_n(&ctx->state_version, __ATOMIC_ACQUIRE);
+    if (!g_state_cache.valid || g_state_cache.version != version) {
+        state_snapshot_t snap;
+        take_state_snapshot(ctx, &snap);
+        g_state_cache.len = render_state_json(g_state_cache.body, sizeof(g_state_cache.body), &snap, STATE_FIELDS_ALL);
+        g_state_cache.version = version;
+        g_state_cache.valid = g_state_cache.len > 0;
+    }
+    *len = g_state_cache.len;
+    *version_out = g_state_cache.version;
+    return g_state_cache.valid ? g_state_cache.body : NULL;
+}
+
+static esp_err_t send_success_response(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"success\":true}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t send_not_modified(httpd_req_t *req, const char *etag) {
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+}
+
+#define CONTENT_TYPE_CBOR "application/cbor"
+#define CONTENT_TYPE_PACKED "application/vnd.smart-teapot.state"
+
+// Pick the representation from the Accept header; JSON unless a binary format is asked for
+static wifi_web_format_t negotiate_format(httpd_req_t *req) {
+    char accept[96];
+    esp_err_t ret = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return WIFI_WEB_FORMAT_JSON;
+    }
+    if (strstr(accept, CONTENT_TYPE_CBOR) != NULL) {
+        return WIFI_WEB_FORMAT_CBOR;
+    }
+    if (strstr(accept, CONTENT_TYPE_PACKED) != NULL) {
+        return WIFI_WEB_FORMAT_PACKED;
+    }
+    return WIFI_WEB_FORMAT_JSON;
+}
+
+// Each representation gets its own validator: "v<n>" for JSON, "v<n>c" CBOR, "v<n>p" packed
+static void format_state_etag(char *buf, size_t size, uint32_t version, wifi_web_format_t format) {
+    static const char *const suffix[] = { "", "c", "p" };
+    snprintf(buf, size, "\"v%" PRIu32 "%s\"", version, suffix[format]);
+}
+
+// Send the state tagged with its version; with conditional set, 304 if the client already has it
+static esp_err_t send_state_response(httpd_req_t *req, wifi_web_ctx_t *ctx, bool conditional) {
+    wifi_web_format_t format = negotiate_format(req);
+    const char *content_type = "application/json";
+    const char *body;
+    int len;
+    uint32_t version;
+    uint8_t binary[WS_MSG_MAX];
+    
+    if (format == WIFI_WEB_FORMAT_JSON) {
+        body = get_state_json(ctx, &len, &version);
+    } else {
+        // Binary forms are small enough to encode on every request straight into the send buffer
+        size_t binary_len;
+        body = NULL;
+        if (wifi_web_render_state(ctx, format, binary, sizeof(binary), &binary_len, &version) == ESP_OK) {
+            body = (const char *)binary;
+            len = (int)binary_len;
+        }
+        content_type = format == WIFI_WEB_FORMAT_CBOR ? CONTENT_TYPE_CBOR : CONTENT_TYPE_PACKED;
+    }
+    if (body == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    
+    char etag[20];
+    format_state_etag(etag, sizeof(etag), version, format);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+    if (conditional && etag_matches(req, etag)) {
+        return send_not_modified(req, etag);
+    }
+    
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_type(req, content_type);
+    return httpd_resp_send(req, body, len);
+}
+
+#define LONGPOLL_MAX_WAITERS 3
+#define LONGPOLL_DEFAULT_TIMEOUT_MS 30000
+#define LONGPOLL_MAX_TIMEOUT_MS 60000
+#define LONGPOLL_TICK_US (1000 * 1000)
+
+// Parked GET /api/state?wait= requests; the table is only touched from the httpd task
+typedef struct {
+    httpd_req_t *req;     // Async copy of the request, NULL when the slot is free
+    uint32_t version;     // Version the client already has
+    int64_t deadline_us;
+} longpoll_waiter_t;
+
+static longpoll_waiter_t g_longpoll_waiters[LONGPOLL_MAX_WAITERS];
+static uint32_t g_longpoll_count = 0;
+static bool g_longpoll_pending = false;
+static esp_timer_handle_t g_longpoll_timer = NULL;
+
+static void longpoll_complete(wifi_web_ctx_t *ctx, longpoll_waiter_t *waiter, bool changed) {
+    httpd_req_t *req = waiter->req;
+    waiter->req = NULL;
+    __atomic_sub_fetch(&g_longpoll_count, 1, __ATOMIC_SEQ_CST);
+    
+    if (changed) {
+        send_state_response(req, ctx, false);
+    } else {
+        char etag[20];
+        format_state_etag(etag, sizeof(etag), waiter->version, negotiate_format(req));
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        httpd_resp_set_hdr(req, "Vary", "Accept");
+        send_not_modified(req, etag);
+    }
+    httpd_req_async_handler_complete(req);
+}
+
+// Answer every waiter whose version is stale or whose timeout expired
+static void longpoll_work(void *arg) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)arg;
+    __atomic_store_n(&g_longpoll_pending, false, __ATOMIC_RELEASE);
+    
+    uint32_t version = __atomic_load_n(&ctx->state_version, __ATOMIC_ACQUIRE);
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < LONGPOLL_MAX_WAITERS; i++) {
+        longpoll_waiter_t *waiter = &g_longpoll_waiters[i];
+        if (waiter->req == NULL) {
+            continue;
+        }
+        if (waiter->version != version) {
+            longpoll_complete(ctx, waiter, true);
+        } else if (now >= waiter->deadline_us) {
+            longpoll_complete(ctx, waiter, false);
+        }
+    }
+    
+    if (__atomic_load_n(&g_longpoll_count, __ATOMIC_RELAXED) == 0 && g_longpoll_timer != NULL) {
+        esp_timer_stop(g_longpoll_timer);
+    }
+}
+
+// Called from any task: queue one pass over the waiters, coalescing concurrent triggers
+static void longpoll_schedule(wifi_web_ctx_t *ctx) {
+    if (ctx->server == NULL || __atomic_load_n(&g_longpoll_count, __ATOMIC_SEQ_CST) == 0) {
+        return;
+    }
+    if (__atomic_exchange_n(&g_longpoll_pending, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    if (httpd_queue_work(ctx->server, longpoll_work, ctx) != ESP_OK) {
+        __atomic_store_n(&g_longpoll_pending, false, __ATOMIC_RELEASE);
+    }
+}
+
+static void longpoll_timer_cb(void *arg) {
+    longpoll_schedule((wifi_web_ctx_t *)arg);
+}
+
+// Used on shutdown: release every parked request so httpd_stop does not leak them
+static void longpoll_cancel_work(void *arg) {
+    for (int i = 0; i < LONGPOLL_MAX_WAITERS; i++) {
+        longpoll_waiter_t *waiter = &g_longpoll_waiters[i];
+        if (waiter->req == NULL) {
+            continue;
+        }
+        httpd_req_t *req = waiter->req;
+        waiter->req = NULL;
+        __atomic_sub_fetch(&g_longpoll_count, 1, __ATOMIC_SEQ_CST);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, NULL, 0);
+        httpd_req_async_handler_complete(req);
+    }
+}
+
+// Detach the request from the httpd worker and park it until the state moves past version
+static esp_err_t longpoll_park(httpd_req_t *req, wifi_web_ctx_t *ctx, uint32_t version, uint32_t timeout_ms) {
+    longpoll_waiter_t *waiter = NULL;
+    for (int i = 0; i < LONGPOLL_MAX_WAITERS; i++) {
+        if (g_longpoll_waiters[i].req == NULL) {
+            waiter = &g_longpoll_waiters[i];
+            break;
+        }
+    }
+    if (waiter == NULL) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    
+    httpd_req_t *async_req;
+    esp_err_t ret = httpd_req_async_handler_begin(req, &async_req);
+    if (ret != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ret;
+    }
+    
+    waiter->req = async_req;
+    waiter->version = version;
+    waiter->deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    __atomic_add_fetch(&g_longpoll_count, 1, __ATOMIC_SEQ_CST);
+    
+    if (g_longpoll_timer != NULL && !esp_timer_is_active(g_longpoll_timer)) {
+        esp_timer_start_periodic(g_longpoll_timer, LONGPOLL_TICK_US);
+    }
+    
+    // notify_state_changed bumps the version before checking the waiter count, so a change
+    // that raced with parking is either seen here or schedules longpoll_work
+    if (__atomic_load_n(&ctx->state_version, __ATOMIC_SEQ_CST) != version) {
+        longpoll_complete(ctx, waiter, true);
+    }
+    return ESP_OK;
+}
+
+// Handler for GET /api/state[?wait=<version>[&timeout=<ms>]]
+static esp_err_t api_state_get_handler(httpd_req_t *req) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
+    
+    bool wait = false;
+    uint32_t wait_version = 0;
+    uint32_t timeout_ms = LONGPOLL_DEFAULT_TIMEOUT_MS;
+    
+    char query[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[16];
+        if (httpd_query_key_value(query, "wait", value, sizeof(value)) == ESP_OK) {
+            wait_version = (uint32_t)strtoul(value, NULL, 10);
+            wait = true;
+        }
+        if (httpd_query_key_value(query, "timeout", value, sizeof(value)) == ESP_OK) {
+            timeout_ms = (uint32_t)strtoul(value, NULL, 10);
+            if (timeout_ms > LONGPOLL_MAX_TIMEOUT_MS) {
+                timeout_ms = LONGPOLL_MAX_TIMEOUT_MS;
+            }
+        }
+    }
+    
+    if (!wait || timeout_ms == 0 || wait_version != __atomic_load_n(&ctx->state_version, __ATOMIC_ACQUIRE)) {
+        return send_state_response(req, ctx, true);
+    }
+    return longpoll_park(req, ctx, wait_version, timeout_ms);
+}
+
+static esp_err_t send_bad_request(httpd_req_t *req) {
+    httpd_resp_set_status(req, "400 Bad Request");
+    httpd_resp_send(req, "Bad Request", HTTPD_RESP_USE_STRLEN);
+    return ESP_FAIL;
+}
+
+// Read the whole request body into buf; short reads and socket timeouts are retried
+static esp_err_t read_request_body(httpd_req_t *req, char *buf, size_t size, size_t *len) {
+    if (req->content_len == 0 || req->content_len >= size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    size_t received = 0;
+    int timeouts = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts <= REQUEST_RECV_RETRIES) {
+            continue;
+        }
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    buf[received] = '\0';
+    *len = received;
+    return ESP_OK;
+}
+
+// Receive and tokenize a JSON request body; on failure the error response is already sent
+static esp_err_t receive_json_body(httpd_req_t *req, char *buf, size_t size,
+                                   jsontok_t *tokens, size_t max_tokens, int *count) {
+    size_t len;
+    esp_err_t ret = read_request_body(req, buf, size, &len);
+    if (ret == ESP_ERR_INVALID_SIZE) {
+        return send_bad_request(req);
+    }
+    if (ret != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    if (jsontok_parse(buf, len, tokens, max_tokens, count) != ESP_OK) {
+        return send_bad_request(req);
+    }
+    return ESP_OK;
+}
+
+// Handler for POST /api/power
+static esp_err_t api_power_post_handler(httpd_req_t *req) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
+    
+    char content[REQUEST_BODY_MAX];
+    jsontok_t tokens[REQUEST_TOKENS_MAX];
+    int count;
+    if (receive_json_body(req, content, sizeof(content), tokens, REQUEST_TOKENS_MAX, &count) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    
+    bool is_on;
+    if (jsontok_get_bool(content, tokens, count, "is_on", &is_on) != ESP_OK) {
+        return send_bad_request(req);
+    }
+    
+    wifi_web_set_power(ctx, is_on);
+    return send_success_response(req);
+}
+
+// Handler for POST /api/setpoint
+static esp_err_t api_setpoint_post_handler(httpd_req_t *req) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
+    
+    char content[REQUEST_BODY_MAX];
+    jsontok_t tokens[REQUEST_TOKENS_MAX];
+    int count;
+    if (receive_json_body(req, content, sizeof(content), tokens, REQUEST_TOKENS_MAX, &count) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    
+    float temp;
+    if (jsontok_get_float(content, tokens, count, "temperature", &temp) != ESP_OK ||
+        temp < CONFIG_TEMP_MIN || temp > CONFIG_TEMP_MAX) {
+        return send_bad_request(req);
+    }
+    
+    wifi_web_set_setpoint(ctx, temp);
+    return send_success_response(req);
+}
+
+// Writable state members; anything else in an update body is rejected rather than ignored
+static const char *const k_update_keys[] = { "is_on", "setpoint_temp", "temperature" };
+
+// Parse {"is_on":bool, "setpoint_temp":number} (any subset) into an update, applying nothing
+static esp_err_t parse_state_update(const char *json, const jsontok_t *tokens, int count,
+                                    teapot_state_update_t *update) {
+    memset(update, 0, sizeof(*update));
+    if (count < 1 || tokens[0].type != JSONTOK_OBJECT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    for (int i = 1; i < count; i++) {
+        if (tokens[i].parent != 0) {
+            continue;
+        }
+        bool known = false;
+        for (size_t k = 0; k < sizeof(k_update_keys) / sizeof(k_update_keys[0]); k++) {
+            size_t key_len = strlen(k_update_keys[k]);
+            if ((size_t)(tokens[i].end - tokens[i].start) == key_len &&
+                memcmp(json + tokens[i].start, k_update_keys[k], key_len) == 0) {
+                known = true;
+                break;
+            }
+        }
+        if (!known) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    
+    esp_err_t ret = jsontok_get_bool(json, tokens, count, "is_on", &update->is_on);
+    if (ret == ESP_OK) {
+        update->fields |= WIFI_WEB_UPDATE_IS_ON;
+    } else if (ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_float(json, tokens, count, "setpoint_temp", &update->setpoint_temp);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        ret = jsontok_get_float(json, tokens, count, "temperature", &update->setpoint_temp);
+    }
+    if (ret == ESP_OK) {
+        update->fields |= WIFI_WEB_UPDATE_SETPOINT;
+    } else if (ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    return update->fields != 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t wifi_web_parse_update(const char *json, size_t len, teapot_state_update_t *update) {
+    if (json == NULL || update == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    jsontok_t tokens[REQUEST_TOKENS_MAX];
+    int count;
+    if (jsontok_parse(json, len, tokens, REQUEST_TOKENS_MAX, &count) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return parse_state_update(json, tokens, count, update);
+}
+
+// Handler for PATCH /api/state: applies any subset of fields at once and answers with the new state
+static esp_err_t api_state_patch_handler(httpd_req_t *req) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
+    
+    char content[REQUEST_BODY_MAX];
+    jsontok_t tokens[REQUEST_TOKENS_MAX];
+    int count;
+    if (receive_json_body(req, content, sizeof(content), tokens, REQUEST_TOKENS_MAX, &count) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    
+    teapot_state_update_t update;
+    if (parse_state_update(content, tokens, count, &update) != ESP_OK ||
+        wifi_web_apply_update(ctx, &update) != ESP_OK) {
+        return send_bad_request(req);
+    }
+    
+    return send_state_response(req, ctx, false);
+}
+
+// Handler for GET /api/trace[?since=<seq>][&format=text]
+static esp_err_t api_trace_get_handler(httpd_req_t *req) {
+    uint32_t since = 0;
+    bool as_text = false;
+    
+    char query[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[16];
+        if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+            since = (uint32_t)strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK) {
+            as_text = strcmp(value, "text") == 0;
+        }
+    }
+    
+    trace_event_t events[16];
+    uint32_t seq = since;
+    uint32_t end = trace_next_seq();
+    
+    if (as_text) {
+        httpd_resp_set_type(req, "text/plain");
+    } else {
+        trace_dump_header_t header = {
+            .magic = TRACE_DUMP_MAGIC,
+            .event_size = sizeof(trace_event_t),
+            .ring_size = TRACE_RING_SIZE,
+            .next_seq = end,
+            .now_us = esp_timer_get_time()
+        };
+        httpd_resp_set_type(req, "application/octet-stream");
+        if (httpd_resp_send_chunk(req, (const char *)&header, sizeof(header)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    
+    // Stop at the head captured above so a busy writer cannot keep the response open
+    size_t count;
+    while ((int32_t)(end - seq) > 0 &&
+           (count = trace_read(seq, events, sizeof(events) / sizeof(events[0]), &seq)) > 0) {
+        esp_err_t ret = ESP_OK;
+        if (as_text) {
+            char line[96];
+            for (size_t i = 0; i < count && ret == ESP_OK; i++) {
+                int len = trace_format_event(&events[i], line, sizeof(line) - 1);
+                line[len++] = '\n';
+                ret = httpd_resp_send_chunk(req, line, len);
+            }
+        } else {
+            ret = httpd_resp_send_chunk(req, (const char *)events, count * sizeof(trace_event_t));
+        }
+        if (ret != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Handler for GET /api/history?tier=<n>[&since=<slot>]: history_dump_header_t followed by points
+static esp_err_t api_history_get_handler(httpd_req_t *req) {
+    uint8_t tier = 0;
+    uint32_t since = 0;
+    
+    char query[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[16];
+        if (httpd_query_key_value(query, "tier", value, sizeof(value)) == ESP_OK) {
+            char *end;
+            unsigned long parsed = strtoul(value, &end, 10);
+            if (end == value || *end != '\0' || parsed >= HISTORY_TIER_COUNT) {
+                return send_bad_request(req);
+            }
+            tier = (uint8_t)parsed;
+        }
+        if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+            since = (uint32_t)strtoul(value, NULL, 10);
+        }
+    }
+    
+    uint32_t first;
+    uint32_t end;
+    uint32_t period_ms;
+    uint16_t capacity;
+    history_range(tier, &first, &end);
+    history_tier_info(tier, &period_ms, &capacity);
+    // A client that is up to date (or ahead after a reboot) gets an empty dump it can resync from
+    if ((int32_t)(since - first) > 0 && (int32_t)(end - since) >= 0) {
+        first = since;
+    }
+    
+    history_dump_header_t header = {
+        .magic = HISTORY_DUMP_MAGIC,
+        .tier = tier,
+        .point_size = sizeof(history_point_t),
+        .capacity = capacity,
+        .period_ms = period_ms,
+        .first_slot = first,
+        .next_slot = end,
+        .now_us = esp_timer_get_time()
+    };
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    if (httpd_resp_send_chunk(req, (const char *)&header, sizeof(header)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    
+    // Up to 30 min of 5 s points would be 2.8 KB, so stream in small chunks instead of buffering
+    history_point_t points[32];
+    uint32_t slot = first;
+    while ((int32_t)(end - slot) > 0) {
+        size_t max = end - slot < 32 ? end - slot : 32;
+        size_t count = history_read(tier, slot, points, max);
+        if (count == 0) {
+            break;
+        }
+        if (httpd_resp_send_chunk(req, (const char *)points, count * sizeof(history_point_t)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        slot += (uint32_t)count;
+    }
+    
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Handler for GET /api/log.csv: decodes the flash log page by page, so RAM use does not grow with the log
+static esp_err_t api_log_csv_handler(httpd_req_t *req) {
+    static sample_log_reader_t reader;  // httpd runs one handler at a time, keep the page buffer off its stack
+    if (sample_log_reader_open(&reader) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Sample log is not available");
+        return ESP_FAIL;
+    }
+    
+    httpd_resp_set_type(req, "text/csv");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"teapot-log.csv\"");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    
+    static const char header[] = "boot,uptime_ms,event,temperature,relay\n";
+    char chunk[512];
+    size_t len = sizeof(header) - 1;
+    memcpy(chunk, header, len);
+    
+    uint16_t boot;
+    sample_log_record_t rec;
+    esp_err_t ret;
+    while ((ret = sample_log_reader_next(&reader, &boot, &rec)) == ESP_OK) {
+        size_t n = sample_log_format_csv(boot, &rec, chunk + len, sizeof(chunk) - len);
+        if (n == 0) {
+            if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            len = 0;
+            n = sample_log_format_csv(boot, &rec, chunk, sizeof(chunk));
+        }
+        len += n;
+    }
+    if (ret != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Sample log export stopped: %s", esp_err_to_name(ret));
+    }
+    
+    if (len > 0 && httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
 
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t ret = httpd_resp_send(req, json_str, HTTPD_RESP_USE_STRLEN);
-    free(json_str);
-    return ret;
+static void jw_string(json_writer_t *w, const char *str) {
+    jw_raw(w, "\"", 1);
+    for (const char *p = str; *p != '\0'; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            char esc[2] = { '\\', (char)c };
+            jw_raw(w, esc, 2);
+        } else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F] };
+            jw_raw(w, esc, sizeof(esc));
+        } else {
+            jw_raw(w, (const char *)&c, 1);
+        }
+    }
+    jw_raw(w, "\"", 1);
 }
 
-static esp_err_t send_file_from_spiffs(httpd_req_t *req, const char *filepath, const char *content_type) {
-    char filepath_full[256];
-    snprintf(filepath_full, sizeof(filepath_full), "%s%s", SPIFFS_BASE_PATH, filepath);
-    
-    FILE *file = fopen(filepath_full, "r");
-    if (file == NULL) {
-        ESP_LOGE(TAG, "Failed to open file: %s", filepath_full);
-        httpd_resp_send_404(req);
+static void jw_int(json_writer_t *w, int32_t value) {
+    char digits[12];
+    size_t pos = sizeof(digits);
+    uint32_t abs_value = value < 0 ? (uint32_t)(-(int64_t)value) : (uint32_t)value;
+    do {
+        digits[--pos] = (char)('0' + abs_value % 10);
+        abs_value /= 10;
+    } while (abs_value > 0);
+    if (value < 0) {
+        digits[--pos] = '-';
+    }
+    jw_raw(w, digits + pos, sizeof(digits) - pos);
+}
+
+// The password is write-only: GET only tells whether one is set
+static int render_config_json(char *buf, size_t size, const teapot_config_t *config) {
+    json_writer_t w = { .buf = buf, .size = size };
+    
+    jw_raw(&w, "{", 1);
+    jw_key(&w, "wifi_ssid");
+    jw_string(&w, config->wifi.ssid);
+    jw_key(&w, "wifi_password_set");
+    jw_bool(&w, config->wifi.password[0] != '\0');
+    jw_key(&w, "relay_gpio");
+    jw_int(&w, config->gpio.relay_gpio);
+    jw_key(&w, "temp_sensor_gpio");
+    jw_int(&w, config->gpio.temp_sensor_gpio);
+    jw_key(&w, "default_setpoint");
+    jw_temp(&w, config->default_setpoint);
+    jw_key(&w, "coap_port");
+    jw_int(&w, config->coap_port);
+    jw_key(&w, "mqtt_uri");
+    jw_string(&w, config->mqtt.uri);
+    jw_key(&w, "mqtt_topic");
+    jw_string(&w, config->mqtt.topic);
+    jw_key(&w, "mqtt_batch_window_s");
+    jw_int(&w, config->mqtt.batch_window_s);
+    jw_raw(&w, "}", 1);
+    
+    return w.overflow ? -1 : (int)w.len;
+}
+
+static esp_err_t send_config_response(httpd_req_t *req, wifi_web_ctx_t *ctx) {
+    static char body[CONFIG_BODY_MAX];
+    int len = render_config_json(body, sizeof(body), ctx->config);
+    if (len < 0) {
+        httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, body, len);
+}
 
-    httpd_resp_set_type(req, content_type);
+static const char *const k_config_keys[] = {
+    "wifi_ssid", "wifi_password", "relay_gpio", "temp_sensor_gpio", "default_setpoint",
+    "coap_port", "mqtt_uri", "mqtt_topic", "mqtt_batch_window_s"
+};
+
+// Apply any subset of k_config_keys to config; the caller validates the result as a whole
+static esp_err_t parse_config_update(const char *json, const jsontok_t *tokens, int count,
+                                     teapot_config_t *config) {
+    if (count < 1 || tokens[0].type != JSONTOK_OBJECT) {
+        return ESP_ERR_INVALID_ARG;
+    }
     
-    char buffer[512];
-    size_t read_bytes;
-    esp_err_t ret = ESP_OK;
+    for (int i = 1; i < count; i++) {
+        if (tokens[i].parent != 0) {
+            continue;
+        }
+        bool known = false;
+        for (size_t k = 0; k < sizeof(k_config_keys) / sizeof(k_config_keys[0]); k++) {
+            size_t key_len = strlen(k_config_keys[k]);
+            if ((size_t)(tokens[i].end - tokens[i].start) == key_len &&
+                memcmp(json + tokens[i].start, k_config_keys[k], key_len) == 0) {
+                known = true;
+                break;
+            }
+        }
+        if (!known) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
     
-    while ((read_bytes = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        if (httpd_resp_send_chunk(req, buffer, read_bytes) != ESP_OK) {
-            ret = ESP_FAIL;
-            break;
+    char str[CONFIG_MQTT_URI_MAX_LEN + 1];
+    int num;
+    float value;
+    
+    esp_err_t ret = jsontok_get_string(json, tokens, count, "wifi_ssid", str, sizeof(str));
+    if (ret == ESP_OK) {
+        ret = config_set_wifi_ssid(config, str);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_string(json, tokens, count, "wifi_password", str, sizeof(str));
+    if (ret == ESP_OK) {
+        ret = config_set_wifi_password(config, str);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_int(json, tokens, count, "relay_gpio", &num);
+    if (ret == ESP_OK) {
+        ret = config_set_relay_gpio(config, num);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_int(json, tokens, count, "temp_sensor_gpio", &num);
+    if (ret == ESP_OK) {
+        ret = config_set_temp_sensor_gpio(config, num);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_float(json, tokens, count, "default_setpoint", &value);
+    if (ret == ESP_OK) {
+        ret = config_set_default_setpoint(config, value);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_int(json, tokens, count, "coap_port", &num);
+    if (ret == ESP_OK) {
+        ret = config_set_coap_port(config, num);
+    }
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_string(json, tokens, count, "mqtt_uri", config->mqtt.uri, sizeof(config->mqtt.uri));
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    ret = jsontok_get_string(json, tokens, count, "mqtt_topic", config->mqtt.topic, sizeof(config->mqtt.topic));
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_FOUND) {
+        return ret;
+    }
+    
+    ret = jsontok_get_int(json, tokens, count, "mqtt_batch_window_s", &num);
+    if (ret == ESP_OK) {
+        if (num < CONFIG_MQTT_BATCH_WINDOW_MIN || num > CONFIG_MQTT_BATCH_WINDOW_MAX) {
+            return ESP_ERR_INVALID_ARG;
         }
+        config->mqtt.batch_window_s = (uint16_t)num;
+    } else if (ret != ESP_ERR_NOT_FOUND) {
+        return ret;
     }
     
-    fclose(file);
-    httpd_resp_send_chunk(req, NULL, 0);
-    return ret;
-}
-
-static esp_err_t index_html_handler(httpd_req_t *req) {
-    return send_file_from_spiffs(req, "/index.html", "text/html");
+    return ESP_OK;
 }
 
-static esp_err_t styles_css_handler(httpd_req_t *req) {
-    return send_file_from_spiffs(req, "/styles.css", "text/css");
+// Handler for GET /api/boot: per-stage timestamps of the boot sequence
+static esp_err_t api_boot_get_handler(httpd_req_t *req) {
+    static char body[2048];
+    size_t len;
+    if (boot_graph_render_json(body, sizeof(body), &len) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, body, len);
 }
 
-static esp_err_t script_js_handler(httpd_req_t *req) {
-    return send_file_from_spiffs(req, "/script.js", "application/javascript");
+// Handler for GET /metrics: Prometheus text exposition, rendered chunk by chunk
+static esp_err_t metrics_get_handler(httpd_req_t *req) {
+    // Heap gauges are sampled per scrape rather than on every allocation
+    metrics_set(METRIC_HEAP_FREE, esp_get_free_heap_size());
+    metrics_set(METRIC_HEAP_MIN_FREE, esp_get_minimum_free_heap_size());
+    
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    
+    char chunk[512];
+    metrics_cursor_t cursor = {0};
+    size_t len;
+    while ((len = metrics_render(&cursor, chunk, sizeof(chunk))) > 0) {
+        if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-static esp_err_t api_state_get_handler(httpd_req_t *req) {
-    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
-    bool relay_state = false;
+// Handler for GET /api/profile[?reset=1]: per-task CPU share over the profiler window, stack
+// headroom and state, plus the PC histogram when sampling is enabled. reset=1 clears the
+// PC samples after they were sent.
+static esp_err_t api_profile_get_handler(httpd_req_t *req) {
+    static profiler_task_t tasks[PROFILER_MAX_TASKS];  // httpd runs one handler at a time
+    size_t count;
+    uint32_t window_us;
+    esp_err_t ret = profiler_get_tasks(tasks, PROFILER_MAX_TASKS, &count, &window_us);
+    if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(ret));
+        return ESP_FAIL;
+    }
     
-    if (ctx->relay_handle != NULL) {
-        relay_get_state((relay_handle_t)ctx->relay_handle, &relay_state);
+    bool reset = false;
+    char query[32];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        char value[8];
+        reset = httpd_query_key_value(query, "reset", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0;
     }
     
-    cJSON *json = cJSON_CreateObject();
-    cJSON_AddBoolToObject(json, "is_on", ctx->state.is_on);
-    cJSON_AddBoolToObject(json, "relay_state", relay_state);
-    cJSON_AddNumberToObject(json, "setpoint_temp", ctx->state.setpoint_temp);
-    cJSON_AddNumberToObject(json, "current_temp", ctx->state.current_temp);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
     
-    esp_err_t ret = send_json_response(req, json);
-    cJSON_Delete(json);
-    return ret;
+    char line[160];
+    int len = snprintf(line, sizeof(line), "{\"window_us\":%" PRIu32 ",\"tasks\":[", window_us);
+    if (httpd_resp_send_chunk(req, line, len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const profiler_task_t *task = &tasks[i];
+        len = snprintf(line, sizeof(line),
+                       "%s{\"name\":\"%s\",\"number\":%" PRIu32 ",\"state\":\"%s\",\"priority\":%u,"
+                       "\"cpu\":%" PRIu32 ".%02" PRIu32 ",\"stack_free\":%" PRIu32 "}",
+                       i > 0 ? "," : "", task->name, task->task_number, profiler_task_state_name(task->state),
+                       task->priority, task->cpu_centi / 100, task->cpu_centi % 100, task->stack_free_min);
+        if (httpd_resp_send_chunk(req, line, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    
+    profiler_pc_stats_t stats;
+    if (profiler_pc_stats(&stats) == ESP_OK) {
+        len = snprintf(line, sizeof(line), "],\"pc\":{\"hz\":%" PRIu32 ",\"samples\":%" PRIu32
+                       ",\"isr\":%" PRIu32 ",\"dropped\":%" PRIu32 ",\"bins\":[",
+                       stats.hz, stats.samples, stats.isr_samples, stats.dropped);
+        if (httpd_resp_send_chunk(req, line, len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        
+        profiler_pc_bin_t bins[6];  // 6 bins of up to 24 characters fit the line
+        size_t index = 0;
+        size_t found;
+        bool first = true;
+        while ((found = profiler_pc_bins(&index, bins, sizeof(bins) / sizeof(bins[0]))) > 0) {
+            len = 0;
+            for (size_t i = 0; i < found; i++) {
+                len += snprintf(line + len, sizeof(line) - len, "%s[%" PRIu32 ",%" PRIu32 "]",
+                                first ? "" : ",", bins[i].pc, bins[i].count);
+                first = false;
+            }
+            if (httpd_resp_send_chunk(req, line, len) != ESP_OK) {
+                return ESP_FAIL;
+            }
+        }
+        if (reset) {
+            profiler_pc_reset();
+        }
+        ret = httpd_resp_send_chunk(req, "]}}", 3);
+    } else {
+        ret = httpd_resp_send_chunk(req, "]}", 2);
+    }
+    if (ret != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-// Handler for POST /api/power
-static esp_err_t api_power_post_handler(httpd_req_t *req) {
+// Handler for GET /api/config
+static esp_err_t api_config_get_handler(httpd_req_t *req) {
+    return send_config_response(req, (wifi_web_ctx_t *)req->user_ctx);
+}
+
+// Handler for POST /api/config: validates the merged config, applies it live and queues a debounced NVS commit
+static esp_err_t api_config_post_handler(httpd_req_t *req) {
     wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
     
-    char content[256];
-    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
-    if (ret <= 0) {
-        httpd_resp_send_500(req);
+    static char content[CONFIG_BODY_MAX];
+    jsontok_t tokens[CONFIG_TOKENS_MAX];
+    int count;
+    if (receive_json_body(req, content, sizeof(content), tokens, CONFIG_TOKENS_MAX, &count) != ESP_OK) {
         return ESP_FAIL;
     }
-    content[ret] = '\0';
     
-    cJSON *json = cJSON_Parse(content);
-    if (json == NULL) {
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "Bad Request", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+    // Edit a copy so a rejected body leaves nothing half applied
+    teapot_config_t updated = *ctx->config;
+    if (parse_config_update(content, tokens, count, &updated) != ESP_OK ||
+        config_validate(&updated) != ESP_OK) {
+        return send_bad_request(req);
     }
     
-    cJSON *is_on_item = cJSON_GetObjectItem(json, "is_on");
-    if (!cJSON_IsBool(is_on_item)) {
-        cJSON_Delete(json);
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "Bad Request", HTTPD_RESP_USE_STRLEN);
+    esp_err_t ret = config_save(&updated);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save config: %s", esp_err_to_name(ret));
+        httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    // Observers reconfigure their subsystems from this task; the AP change is deferred
+    // so this response still reaches the client
+    config_apply(ctx->config, &updated);
+    
+    return send_config_response(req, ctx);
+}
+
+static ws_client_t *ws_find_client(int fd) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (g_ws_clients[i].fd == fd) {
+            return &g_ws_clients[i];
+        }
+    }
+    return NULL;
+}
+
+static void ws_reset_clients(void) {
+    memset(g_ws_clients, 0, sizeof(g_ws_clients));
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        g_ws_clients[i].fd = -1;
+    }
+    __atomic_store_n(&g_ws_client_count, 0, __ATOMIC_RELAXED);
+}
+
+static void ws_remove_client(int fd) {
+    ws_client_t *client = ws_find_client(fd);
+    if (client != NULL) {
+        client->fd = -1;
+        client->count = 0;
+        __atomic_fetch_sub(&g_ws_client_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void ws_push(ws_client_t *client, const char *data, int len) {
+    ws_msg_t *msg = &client->queue[(client->head + client->count) % WS_QUEUE_LEN];
+    memcpy(msg->data, data, len);
+    msg->len = (uint8_t)len;
+    client->count++;
+}
+
+static void ws_enqueue(wifi_web_ctx_t *ctx, ws_client_t *client, const char *data, int len) {
+    if (client->count < WS_QUEUE_LEN) {
+        ws_push(client, data, len);
+        return;
+    }
     
-    ctx->state.is_on = cJSON_IsTrue(is_on_item);
-    ESP_LOGI(TAG, "Power set to: %s", ctx->state.is_on ? "ON" : "OFF");
-    cJSON_Delete(json);
+    // Slow client: drop its queued deltas and resync it with one full snapshot
+    state_snapshot_t snap;
+    char full[WS_MSG_MAX];
+    take_state_snapshot(ctx, &snap);
+    int full_len = render_state_json(full, sizeof(full), &snap, STATE_FIELDS_ALL);
+    client->head = 0;
+    client->count = 0;
+    if (full_len > 0) {
+        ws_push(client, full, full_len);
+    }
+}
+
+static bool ws_socket_writable(int fd) {
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    struct timeval tv = { 0, 0 };
+    return select(fd + 1, NULL, &wfds, NULL, &tv) > 0;
+}
+
+static void ws_retry_timer_cb(void *arg);
+
+// Send queued frames to every client that can take them without blocking the httpd task
+static void ws_drain(wifi_web_ctx_t *ctx) {
+    bool backlog = false;
+    
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        ws_client_t *client = &g_ws_clients[i];
+        while (client->fd >= 0 && client->count > 0) {
+            if (!ws_socket_writable(client->fd)) {
+                backlog = true;
+                break;
+            }
+            
+            ws_msg_t *msg = &client->queue[client->head];
+            httpd_ws_frame_t frame = {
+                .final = true,
+                .type = HTTPD_WS_TYPE_TEXT,
+                .payload = (uint8_t *)msg->data,
+                .len = msg->len
+            };
+            if (httpd_ws_send_frame_async(ctx->server, client->fd, &frame) != ESP_OK) {
+                int fd = client->fd;
+                ws_remove_client(fd);
+                httpd_sess_trigger_close(ctx->server, fd);
+                break;
+            }
+            client->head = (client->head + 1) % WS_QUEUE_LEN;
+            client->count--;
+        }
+    }
     
-    cJSON *response = cJSON_CreateObject();
-    cJSON_AddBoolToObject(response, "success", true);
-    esp_err_t err = send_json_response(req, response);
-    cJSON_Delete(response);
-    return err;
+    if (backlog && g_ws_retry_timer != NULL && !esp_timer_is_active(g_ws_retry_timer)) {
+        esp_timer_start_once(g_ws_retry_timer, WS_RETRY_DELAY_US);
+    }
 }
 
-// Handler for POST /api/setpoint
-static esp_err_t api_setpoint_post_handler(httpd_req_t *req) {
-    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
+static void ws_drain_work(void *arg) {
+    ws_drain((wifi_web_ctx_t *)arg);
+}
+
+static void ws_retry_timer_cb(void *arg) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)arg;
+    if (ctx->server != NULL) {
+        httpd_queue_work(ctx->server, ws_drain_work, ctx);
+    }
+}
+
+static void ws_broadcast_work(void *arg) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)arg;
+    __atomic_store_n(&g_ws_broadcast_pending, false, __ATOMIC_RELEASE);
+    
+    state_snapshot_t snap;
+    take_state_snapshot(ctx, &snap);
+    uint32_t changed = state_snapshot_diff(&g_ws_last_sent, &snap);
+    if (changed == 0) {
+        return;
+    }
+    g_ws_last_sent = snap;
     
-    char content[256];
-    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
-    if (ret <= 0) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+    char delta[WS_MSG_MAX];
+    int len = render_state_json(delta, sizeof(delta), &snap, changed);
+    if (len <= 0) {
+        return;
     }
-    content[ret] = '\0';
     
-    cJSON *json = cJSON_Parse(content);
-    if (json == NULL) {
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "Bad Request", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (g_ws_clients[i].fd >= 0) {
+            ws_enqueue(ctx, &g_ws_clients[i], delta, len);
+        }
+    }
+    ws_drain(ctx);
+}
+
+// Registered once at startup and never removed, so readers only need the published count
+static struct {
+    wifi_web_state_listener_t fn;
+    void *arg;
+} g_listeners[WIFI_WEB_MAX_LISTENERS];
+static uint32_t g_listener_count = 0;
+
+esp_err_t wifi_web_add_state_listener(wifi_web_state_listener_t listener, void *arg) {
+    if (listener == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
     
-    cJSON *temp_item = cJSON_GetObjectItem(json, "temperature");
-    if (!cJSON_IsNumber(temp_item)) {
-        cJSON_Delete(json);
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "Bad Request", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+    uint32_t index = __atomic_load_n(&g_listener_count, __ATOMIC_ACQUIRE);
+    if (index >= WIFI_WEB_MAX_LISTENERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    g_listeners[index].fn = listener;
+    g_listeners[index].arg = arg;
+    __atomic_store_n(&g_listener_count, index + 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+static struct {
+    wifi_web_sample_listener_t fn;
+    void *arg;
+} g_sample_listeners[WIFI_WEB_MAX_LISTENERS];
+static uint32_t g_sample_listener_count = 0;
+
+esp_err_t wifi_web_add_sample_listener(wifi_web_sample_listener_t listener, void *arg) {
+    if (listener == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
     
-    float temp = (float)cJSON_GetNumberValue(temp_item);
-    if (temp < CONFIG_TEMP_MIN || temp > CONFIG_TEMP_MAX) {
-        cJSON_Delete(json);
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_send(req, "Bad Request", HTTPD_RESP_USE_STRLEN);
-        return ESP_FAIL;
+    uint32_t index = __atomic_load_n(&g_sample_listener_count, __ATOMIC_ACQUIRE);
+    if (index >= WIFI_WEB_MAX_LISTENERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    g_sample_listeners[index].fn = listener;
+    g_sample_listeners[index].arg = arg;
+    __atomic_store_n(&g_sample_listener_count, index + 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+// Feeds the history and the sample listeners with one control-loop reading
+static void publish_sample(wifi_web_ctx_t *ctx, float temperature, relay_handle_t relay) {
+    teapot_state_t state;
+    wifi_web_get_state(ctx, &state);
+    bool relay_on = false;
+    if (relay != NULL) {
+        relay_get_state(relay, &relay_on);
+    }
+    teapot_sample_t sample = {
+        .timestamp_us = esp_timer_get_time(),
+        .temperature = temperature,
+        .setpoint_temp = state.setpoint_temp,
+        .is_on = state.is_on,
+        .relay_on = relay_on
+    };
+    history_record(sample.timestamp_us, temperature, relay_on);
+    sample_log_record(sample.timestamp_us, temperature, relay_on);
+    
+    uint32_t listeners = __atomic_load_n(&g_sample_listener_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < listeners; i++) {
+        g_sample_listeners[i].fn(ctx, &sample, g_sample_listeners[i].arg);
+    }
+}
+
+// Called from any task after the state changed: bumps the version, wakes long-poll
+// waiters and listeners, and coalesces WebSocket pushes into one httpd work item
+static void notify_state_changed(wifi_web_ctx_t *ctx) {
+    __atomic_add_fetch(&ctx->state_version, 1, __ATOMIC_SEQ_CST);
+    longpoll_schedule(ctx);
+    
+    uint32_t listeners = __atomic_load_n(&g_listener_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < listeners; i++) {
+        g_listeners[i].fn(ctx, g_listeners[i].arg);
+    }
+    
+    if (ctx->server == NULL || __atomic_load_n(&g_ws_client_count, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    if (__atomic_exchange_n(&g_ws_broadcast_pending, true, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    if (httpd_queue_work(ctx->server, ws_broadcast_work, ctx) != ESP_OK) {
+        __atomic_store_n(&g_ws_broadcast_pending, false, __ATOMIC_RELEASE);
+    }
+}
+
+static void ws_reply_error(wifi_web_ctx_t *ctx, int fd, const char *message) {
+    ws_client_t *client = ws_find_client(fd);
+    if (client == NULL) {
+        return;
+    }
+    char buf[WS_MSG_MAX];
+    int len = snprintf(buf, sizeof(buf), "{\"error\":\"%s\"}", message);
+    if (len > 0 && len < (int)sizeof(buf)) {
+        ws_enqueue(ctx, client, buf, len);
+        ws_drain(ctx);
     }
+}
+
+// Apply a command received over the socket, same body as PATCH /api/state
+static esp_err_t ws_apply_command(wifi_web_ctx_t *ctx, const char *payload, size_t len) {
+    teapot_state_update_t update;
+    esp_err_t ret = wifi_web_parse_update(payload, len, &update);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return wifi_web_apply_update(ctx, &update);
+}
+
+// Handler for /ws: state pushes out, power/setpoint commands in
+static esp_err_t ws_handler(httpd_req_t *req) {
+    wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)req->user_ctx;
+    int fd = httpd_req_to_sockfd(req);
     
-    ctx->state.setpoint_temp = temp;
-    ESP_LOGI(TAG, "Setpoint set to: %.1f°C", temp);
-    cJSON_Delete(json);
+    if (req->method == HTTP_GET) {
+        // Handshake done: register the client and give it the full state
+        ws_client_t *client = ws_find_client(-1);
+        if (client == NULL) {
+            ESP_LOGW(TAG, "WebSocket client limit reached, rejecting fd %d", fd);
+            return ESP_FAIL;
+        }
+        client->fd = fd;
+        client->head = 0;
+        client->count = 0;
+        __atomic_fetch_add(&g_ws_client_count, 1, __ATOMIC_RELAXED);
+        
+        state_snapshot_t snap;
+        char full[WS_MSG_MAX];
+        take_state_snapshot(ctx, &snap);
+        int len = render_state_json(full, sizeof(full), &snap, STATE_FIELDS_ALL);
+        if (len > 0) {
+            ws_enqueue(ctx, client, full, len);
+            ws_drain(ctx);
+        }
+        return ESP_OK;
+    }
+    
+    uint8_t payload[WS_MSG_MAX];
+    httpd_ws_frame_t frame = { 0 };
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (frame.len >= sizeof(payload)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
     
-    cJSON *response = cJSON_CreateObject();
-    cJSON_AddBoolToObject(response, "success", true);
-    esp_err_t err = send_json_response(req, response);
-    cJSON_Delete(response);
-    return err;
+    frame.payload = payload;
+    ret = httpd_ws_recv_frame(req, &frame, sizeof(payload) - 1);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (frame.type != HTTPD_WS_TYPE_TEXT) {
+        return ESP_OK;
+    }
+    if (ws_apply_command(ctx, (const char *)payload, frame.len) != ESP_OK) {
+        ws_reply_error(ctx, fd, "bad request");
+    }
+    return ESP_OK;
+}
+
+// Session close hook: forget WebSocket clients, then close the socket as httpd would
+static void ws_close_fn(httpd_handle_t hd, int sockfd) {
+    ws_remove_client(sockfd);
+    close(sockfd);
 }
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
@@ -203,20 +1932,112 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         } else if (server_started_from_event) {
             ESP_LOGD(TAG, "Server start already attempted from event, skipping");
         }
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STACONNECTED) {
-        wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
-        ESP_LOGI(TAG, "Station connected: %02x:%02x:%02x:%02x:%02x:%02x",
-                 event->mac[0], event->mac[1], event->mac[2],
-                 event->mac[3], event->mac[4], event->mac[5]);
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STADISCONNECTED) {
-        wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
-        ESP_LOGI(TAG, "Station disconnected: %02x:%02x:%02x:%02x:%02x:%02x",
-                 event->mac[0], event->mac[1], event->mac[2],
-                 event->mac[3], event->mac[4], event->mac[5]);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STACONNECTED) {
+        wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
+        ESP_LOGI(TAG, "Station connected: %02x:%02x:%02x:%02x:%02x:%02x",
+                 event->mac[0], event->mac[1], event->mac[2],
+                 event->mac[3], event->mac[4], event->mac[5]);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STADISCONNECTED) {
+        wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
+        ESP_LOGI(TAG, "Station disconnected: %02x:%02x:%02x:%02x:%02x:%02x",
+                 event->mac[0], event->mac[1], event->mac[2],
+                 event->mac[3], event->mac[4], event->mac[5]);
+    }
+}
+
+// Build the soft-AP settings from config (validation already checked the password length)
+static void build_ap_config(const teapot_config_t *config, wifi_config_t *out) {
+    wifi_config_t wifi_config = {
+        .ap = {
+            .ssid_len = strlen(config->wifi.ssid),
+            .channel = 1,
+            .password = "",
+            .max_connection = 4,
+            .authmode = WIFI_AUTH_OPEN
+        },
+    };
+    strncpy((char*)wifi_config.ap.ssid, config->wifi.ssid, sizeof(wifi_config.ap.ssid) - 1);
+    wifi_config.ap.ssid[sizeof(wifi_config.ap.ssid) - 1] = '\0';
+    
+    bool has_password = strlen(config->wifi.password) > 0;
+    if (has_password) {
+        strncpy((char*)wifi_config.ap.password, config->wifi.password, sizeof(wifi_config.ap.password) - 1);
+        wifi_config.ap.password[sizeof(wifi_config.ap.password) - 1] = '\0';
+        wifi_config.ap.authmode = WIFI_AUTH_WPA2_PSK;
+        ESP_LOGI(TAG, "WiFi AP configured with password (WPA2_PSK)");
+    } else {
+        ESP_LOGI(TAG, "WiFi AP configured as open network (no password)");
+    }
+    *out = wifi_config;
+}
+
+// Reapplied from a timer: the AP restarts and drops its clients, so the HTTP response
+// that triggered the change gets a moment to leave first
+static void ap_reconfig_timer_cb(void *arg) {
+    wifi_web_ctx_t *ctx = g_ctx;
+    if (ctx == NULL) {
+        return;
+    }
+    // Runs in the esp_timer task while a newer POST may be applying its config
+    teapot_config_t config;
+    config_snapshot(ctx->config, &config);
+    wifi_config_t wifi_config;
+    build_ap_config(&config, &wifi_config);
+    esp_err_t ret = esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to apply WiFi AP config: %s", esp_err_to_name(ret));
+        return;
+    }
+    ESP_LOGI(TAG, "WiFi Access Point reconfigured. SSID: %s", config.wifi.ssid);
+}
+
+#define AP_RECONFIG_DELAY_US (1000 * 1000)
+
+static esp_timer_handle_t g_ap_reconfig_timer = NULL;
+static bool g_config_observer_added = false;
+// CONFIG_FIELD_* pin changes waiting for the control loop to apply them
+static uint32_t g_pin_changes_pending = 0;
+
+// Config observer, runs in the task that called config_apply() (usually httpd)
+static void config_changed(const teapot_config_t *config, uint32_t changed, void *arg) {
+    wifi_web_ctx_t *ctx = g_ctx;
+    if (ctx == NULL) {
+        return;
+    }
+    
+    if ((changed & CONFIG_FIELD_WIFI) && g_ap_reconfig_timer != NULL) {
+        esp_timer_stop(g_ap_reconfig_timer);
+        esp_timer_start_once(g_ap_reconfig_timer, AP_RECONFIG_DELAY_US);
+    }
+    
+    uint32_t pins = changed & (CONFIG_FIELD_RELAY_GPIO | CONFIG_FIELD_TEMP_GPIO);
+    if (pins == 0) {
+        return;
+    }
+    if (ctx->temp_task_handle != NULL) {
+        // The control loop owns relay and sensor, it switches pins between two steps
+        __atomic_or_fetch(&g_pin_changes_pending, pins, __ATOMIC_RELEASE);
+        return;
+    }
+    
+    // No control loop: nothing else drives the relay, and the new sensor pin may be
+    // what kept it from starting
+    if ((pins & CONFIG_FIELD_RELAY_GPIO) && ctx->relay_handle != NULL) {
+        relay_set_gpio((relay_handle_t)ctx->relay_handle, config->gpio.relay_gpio);
+    }
+    if (pins & CONFIG_FIELD_TEMP_GPIO) {
+        if (ctx->temp_sensor_handle != NULL) {
+            temp_sensor_deinit((temp_sensor_handle_t)ctx->temp_sensor_handle);
+            ctx->temp_sensor_handle = NULL;
+        }
+        esp_err_t ret = wifi_web_start_temp_sensor(ctx);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Temperature sensor still unavailable: %s", esp_err_to_name(ret));
+        }
     }
 }
 
-// Initialize context only (for unit tests)
+// Initialize context (first boot stage, and for unit tests)
 esp_err_t wifi_web_init_ctx(wifi_web_ctx_t *ctx, teapot_config_t *config) {
     if (ctx == NULL || config == NULL) {
         return ESP_ERR_INVALID_ARG;
@@ -229,8 +2050,15 @@ esp_err_t wifi_web_init_ctx(wifi_web_ctx_t *ctx, teapot_config_t *config) {
         return ret;
     }
     
+    if (g_ctx != NULL && g_ctx->server != NULL) {
+        wifi_web_stop(g_ctx);
+    }
+    server_started_from_event = false;
+    
     // Initialize context
     memset(ctx, 0, sizeof(wifi_web_ctx_t));
+    portMUX_INITIALIZE(&ctx->state_lock);
+    g_state_cache.valid = false;
     ctx->config = config;
     ctx->state.is_on = false;
     ctx->state.setpoint_temp = config->default_setpoint;
@@ -238,63 +2066,35 @@ esp_err_t wifi_web_init_ctx(wifi_web_ctx_t *ctx, teapot_config_t *config) {
     ctx->server = NULL;
     ctx->temp_sensor_handle = NULL;
     ctx->temp_task_handle = NULL;
+    g_ctx = ctx;
     
-    return ESP_OK;
-}
-
-// Initialize SPIFFS only (for unit tests)
-esp_err_t wifi_web_init_spiffs(void) {
-    // Unmount SPIFFS if already mounted
-    esp_err_t ret = esp_vfs_spiffs_unregister("web_storage");
-    if (ret == ESP_OK) {
-        ESP_LOGD(TAG, "SPIFFS unmounted before remounting");
-    } else if (ret != ESP_ERR_INVALID_STATE && ret != ESP_ERR_NOT_FOUND) {
-        ESP_LOGW(TAG, "Failed to unmount SPIFFS: %s", esp_err_to_name(ret));
-    }
-    
-    esp_vfs_spiffs_conf_t spiffs_conf = {
-        .base_path = SPIFFS_BASE_PATH,
-        .partition_label = "web_storage",
-        .max_files = 5,
-        .format_if_mount_failed = true
-    };
-    
-    ret = esp_vfs_spiffs_register(&spiffs_conf);
-    if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
-            ESP_LOGE(TAG, "Failed to mount or format filesystem");
-        } else if (ret == ESP_ERR_NOT_FOUND) {
-            ESP_LOGE(TAG, "Failed to find SPIFFS partition");
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
+    if (g_ap_reconfig_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = ap_reconfig_timer_cb,
+            .name = "ap_reconfig"
+        };
+        ret = esp_timer_create(&timer_args, &g_ap_reconfig_timer);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to create AP reconfig timer: %s", esp_err_to_name(ret));
         }
-        return ret;
-    }
-    
-    size_t total = 0, used = 0;
-    ret = esp_spiffs_info("web_storage", &total, &used);
-    if (ret != ESP_OK) {
-        ESP_LOGD(TAG, "Failed to get SPIFFS partition information (%s)", esp_err_to_name(ret));
-    } else {
-        ESP_LOGI(TAG, "SPIFFS partition size: total: %d, used: %d", total, used);
     }
-    
-    // List files in SPIFFS for debugging
-    DIR *dir = opendir(SPIFFS_BASE_PATH);
-    if (dir != NULL) {
-        ESP_LOGI(TAG, "Files in SPIFFS:");
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            ESP_LOGI(TAG, "  %s", entry->d_name);
+    if (!g_config_observer_added) {
+        ret = config_add_observer(CONFIG_FIELD_WIFI | CONFIG_FIELD_RELAY_GPIO | CONFIG_FIELD_TEMP_GPIO,
+                                  config_changed, NULL);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Config changes will need a restart: %s", esp_err_to_name(ret));
         }
-        closedir(dir);
-    } else {
-        ESP_LOGW(TAG, "Failed to open SPIFFS directory: %s", SPIFFS_BASE_PATH);
+        g_config_observer_added = ret == ESP_OK;
     }
     
     return ESP_OK;
 }
 
+// Mount the web file system only (for unit tests)
+esp_err_t wifi_web_init_storage(void) {
+    return web_storage_mount();
+}
+
 // Initialize WiFi AP only
 esp_err_t wifi_web_init_wifi(teapot_config_t *config) {
     if (config == NULL) {
@@ -364,28 +2164,8 @@ esp_err_t wifi_web_init_wifi(teapot_config_t *config) {
     }
     
     // Configure WiFi Access Point
-    wifi_config_t wifi_config = {
-        .ap = {
-            .ssid_len = strlen(config->wifi.ssid),
-            .channel = 1,
-            .password = "",
-            .max_connection = 4,
-            .authmode = WIFI_AUTH_OPEN
-        },
-    };
-    strncpy((char*)wifi_config.ap.ssid, config->wifi.ssid, sizeof(wifi_config.ap.ssid) - 1);
-    wifi_config.ap.ssid[sizeof(wifi_config.ap.ssid) - 1] = '\0';
-    
-    // Set password if provided (validation already checked min length)
-    bool has_password = strlen(config->wifi.password) > 0;
-    if (has_password) {
-        strncpy((char*)wifi_config.ap.password, config->wifi.password, sizeof(wifi_config.ap.password) - 1);
-        wifi_config.ap.password[sizeof(wifi_config.ap.password) - 1] = '\0';
-        wifi_config.ap.authmode = WIFI_AUTH_WPA2_PSK;
-        ESP_LOGI(TAG, "WiFi AP configured with password (WPA2_PSK)");
-    } else {
-        ESP_LOGI(TAG, "WiFi AP configured as open network (no password)");
-    }
+    wifi_config_t wifi_config;
+    build_ap_config(config, &wifi_config);
     
     // Stop WiFi if already started (for tests cleanup)
     wifi_mode_t current_mode;
@@ -405,45 +2185,91 @@ esp_err_t wifi_web_init_wifi(teapot_config_t *config) {
     return ESP_OK;
 }
 
-// Full initialization (for main.c)
-esp_err_t wifi_web_init(wifi_web_ctx_t *ctx, teapot_config_t *config) {
-    if (ctx == NULL || config == NULL) {
+esp_err_t wifi_web_init_relay(wifi_web_ctx_t *ctx) {
+    if (ctx == NULL || ctx->config == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    if (g_ctx != NULL && g_ctx->server != NULL) {
-        wifi_web_stop(g_ctx);
+    relay_handle_t relay;
+    esp_err_t ret = relay_init(ctx->config, &relay);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize relay: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ctx->relay_handle = (void *)relay;
+    ESP_LOGI(TAG, "Relay initialized");
+    return ESP_OK;
+}
+
+// Full initialization in one call; main.c runs the same steps as separate boot stages
+esp_err_t wifi_web_init(wifi_web_ctx_t *ctx, teapot_config_t *config) {
+    if (ctx == NULL || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
-    
-    server_started_from_event = false;
     
     esp_err_t ret = wifi_web_init_ctx(ctx, config);
     if (ret != ESP_OK) {
         return ret;
     }
     
-    g_ctx = ctx;
-    
-    ret = wifi_web_init_spiffs();
+    // The relay first: the heater pin is driven off before anything slower runs
+    ret = wifi_web_init_relay(ctx);
     if (ret != ESP_OK) {
         return ret;
     }
     
-    ret = wifi_web_init_wifi(config);
-    if (ret != ESP_OK) {
-        return ret;
+    return wifi_web_init_wifi(config);
+}
+
+// Handlers are registered through a wrapper that times them into METRIC_HTTP_REQUEST_DURATION,
+// one series per URI and method. The wrapper gets the route as user_ctx and hands the
+// handler its own user_ctx back, so handlers are unaware of it. For WebSocket routes every
+// frame is timed, and an async long-poll only counts until it is handed off.
+#define HTTP_MAX_URI_HANDLERS 20
+
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+    metrics_series_t series;
+    bool timed;
+} timed_route_t;
+
+static timed_route_t g_timed_routes[HTTP_MAX_URI_HANDLERS];
+static size_t g_timed_route_count = 0;
+
+static esp_err_t timed_handler(httpd_req_t *req) {
+    const timed_route_t *route = (const timed_route_t *)req->user_ctx;
+    req->user_ctx = route->user_ctx;
+    
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = route->handler(req);
+    if (route->timed) {
+        metrics_observe_series(route->series, (uint32_t)(esp_timer_get_time() - start));
+    }
+    return ret;
+}
+
+static esp_err_t register_timed_handler(httpd_handle_t server, httpd_uri_t *uri) {
+    if (g_timed_route_count >= HTTP_MAX_URI_HANDLERS) {
+        return ESP_ERR_NO_MEM;
     }
     
-    relay_handle_t relay;
-    ret = relay_init(config, &relay);
+    timed_route_t *route = &g_timed_routes[g_timed_route_count++];
+    route->handler = uri->handler;
+    route->user_ctx = uri->user_ctx;
+    
+    char labels[METRICS_LABELS_LEN];
+    snprintf(labels, sizeof(labels), "uri=\"%s\",method=\"%s\"", uri->uri, http_method_str(uri->method));
+    esp_err_t ret = metrics_register_series(METRIC_HTTP_REQUEST_DURATION, labels, &route->series);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to initialize relay: %s", esp_err_to_name(ret));
-        return ret;
+        ESP_LOGW(TAG, "No latency metric for %s: %s", labels, esp_err_to_name(ret));
     }
-    ctx->relay_handle = (void *)relay;
-    ESP_LOGI(TAG, "Relay initialized");
+    route->timed = ret == ESP_OK;
     
-    return ESP_OK;
+    httpd_uri_t timed = *uri;
+    timed.handler = timed_handler;
+    timed.user_ctx = route;
+    return httpd_register_uri_handler(server, &timed);
 }
 
 esp_err_t wifi_web_start(wifi_web_ctx_t *ctx) {
@@ -459,6 +2285,33 @@ esp_err_t wifi_web_start(wifi_web_ctx_t *ctx) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.max_uri_len = 512;
     config.lru_purge_enable = true;
+    config.max_uri_handlers = HTTP_MAX_URI_HANDLERS;
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.close_fn = ws_close_fn;
+    
+    ws_reset_clients();
+    if (g_ws_retry_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = ws_retry_timer_cb,
+            .arg = ctx,
+            .name = "ws_retry"
+        };
+        esp_err_t timer_ret = esp_timer_create(&timer_args, &g_ws_retry_timer);
+        if (timer_ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to create WebSocket retry timer: %s", esp_err_to_name(timer_ret));
+        }
+    }
+    if (g_longpoll_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = longpoll_timer_cb,
+            .arg = ctx,
+            .name = "longpoll"
+        };
+        esp_err_t timer_ret = esp_timer_create(&timer_args, &g_longpoll_timer);
+        if (timer_ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to create long-poll timer: %s", esp_err_to_name(timer_ret));
+        }
+    }
     
     esp_err_t ret = httpd_start(&ctx->server, &config);
     if (ret != ESP_OK) {
@@ -477,62 +2330,129 @@ esp_err_t wifi_web_start(wifi_web_ctx_t *ctx) {
     
     // Server started successfully - flag already set in event handler
     
-    // Register URI handlers
-    httpd_uri_t index_uri = {
-        .uri = "/",
+    // Register URI handlers; the previous server is gone, so its routes can be reused
+    g_timed_route_count = 0;
+    httpd_uri_t state_get_uri = {
+        .uri = "/api/state",
         .method = HTTP_GET,
-        .handler = index_html_handler,
+        .handler = api_state_get_handler,
+        .user_ctx = ctx
+    };
+    register_timed_handler(ctx->server, &state_get_uri);
+    
+    httpd_uri_t state_patch_uri = {
+        .uri = "/api/state",
+        .method = HTTP_PATCH,
+        .handler = api_state_patch_handler,
+        .user_ctx = ctx
+    };
+    register_timed_handler(ctx->server, &state_patch_uri);
+    
+    httpd_uri_t power_post_uri = {
+        .uri = "/api/power",
+        .method = HTTP_POST,
+        .handler = api_power_post_handler,
+        .user_ctx = ctx
+    };
+    register_timed_handler(ctx->server, &power_post_uri);
+    
+    httpd_uri_t setpoint_post_uri = {
+        .uri = "/api/setpoint",
+        .method = HTTP_POST,
+        .handler = api_setpoint_post_handler,
         .user_ctx = ctx
     };
-    httpd_register_uri_handler(ctx->server, &index_uri);
+    register_timed_handler(ctx->server, &setpoint_post_uri);
     
-    httpd_uri_t html_uri = {
-        .uri = "/index.html",
+    httpd_uri_t trace_get_uri = {
+        .uri = "/api/trace",
         .method = HTTP_GET,
-        .handler = index_html_handler,
+        .handler = api_trace_get_handler,
         .user_ctx = ctx
     };
-    httpd_register_uri_handler(ctx->server, &html_uri);
+    register_timed_handler(ctx->server, &trace_get_uri);
     
-    httpd_uri_t css_uri = {
-        .uri = "/styles.css",
+    httpd_uri_t history_get_uri = {
+        .uri = "/api/history",
         .method = HTTP_GET,
-        .handler = styles_css_handler,
+        .handler = api_history_get_handler,
         .user_ctx = ctx
     };
-    httpd_register_uri_handler(ctx->server, &css_uri);
+    register_timed_handler(ctx->server, &history_get_uri);
     
-    httpd_uri_t js_uri = {
-        .uri = "/script.js",
+    httpd_uri_t log_csv_uri = {
+        .uri = "/api/log.csv",
         .method = HTTP_GET,
-        .handler = script_js_handler,
+        .handler = api_log_csv_handler,
         .user_ctx = ctx
     };
-    httpd_register_uri_handler(ctx->server, &js_uri);
+    register_timed_handler(ctx->server, &log_csv_uri);
     
-    httpd_uri_t state_get_uri = {
-        .uri = "/api/state",
+    httpd_uri_t config_get_uri = {
+        .uri = "/api/config",
         .method = HTTP_GET,
-        .handler = api_state_get_handler,
+        .handler = api_config_get_handler,
         .user_ctx = ctx
     };
-    httpd_register_uri_handler(ctx->server, &state_get_uri);
+    register_timed_handler(ctx->server, &config_get_uri);
     
-    httpd_uri_t power_post_uri = {
-        .uri = "/api/power",
+    httpd_uri_t config_post_uri = {
+        .uri = "/api/config",
         .method = HTTP_POST,
-        .handler = api_power_post_handler,
+        .handler = api_config_post_handler,
         .user_ctx = ctx
     };
-    httpd_register_uri_handler(ctx->server, &power_post_uri);
+    register_timed_handler(ctx->server, &config_post_uri);
     
-    httpd_uri_t setpoint_post_uri = {
-        .uri = "/api/setpoint",
-        .method = HTTP_POST,
-        .handler = api_setpoint_post_handler,
+    httpd_uri_t boot_get_uri = {
+        .uri = "/api/boot",
+        .method = HTTP_GET,
+        .handler = api_boot_get_handler,
+        .user_ctx = ctx
+    };
+    register_timed_handler(ctx->server, &boot_get_uri);
+    
+    httpd_uri_t profile_get_uri = {
+        .uri = "/api/profile",
+        .method = HTTP_GET,
+        .handler = api_profile_get_handler,
+        .user_ctx = ctx
+    };
+    register_timed_handler(ctx->server, &profile_get_uri);
+    
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_get_handler,
+        .user_ctx = ctx
+    };
+    register_timed_handler(ctx->server, &metrics_uri);
+    
+    httpd_uri_t ws_uri = {
+        .uri = "/ws",
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = ctx,
+        .is_websocket = true
+    };
+    register_timed_handler(ctx->server, &ws_uri);
+    
+    // Registered last so the wildcard does not shadow the endpoints above
+    httpd_uri_t files_get_uri = {
+        .uri = "/*",
+        .method = HTTP_GET,
+        .handler = static_file_handler,
+        .user_ctx = ctx
+    };
+    register_timed_handler(ctx->server, &files_get_uri);
+    
+    httpd_uri_t files_head_uri = {
+        .uri = "/*",
+        .method = HTTP_HEAD,
+        .handler = static_file_handler,
         .user_ctx = ctx
     };
-    httpd_register_uri_handler(ctx->server, &setpoint_post_uri);
+    register_timed_handler(ctx->server, &files_head_uri);
     
     ESP_LOGI(TAG, "HTTP server started");
     return ESP_OK;
@@ -551,7 +2471,18 @@ esp_err_t wifi_web_stop(wifi_web_ctx_t *ctx) {
         ESP_LOGI(TAG, "Relay deinitialized");
     }
     
+    if (g_ws_retry_timer != NULL) {
+        esp_timer_stop(g_ws_retry_timer);
+    }
+    if (g_longpoll_timer != NULL) {
+        esp_timer_stop(g_longpoll_timer);
+    }
+    
     if (ctx->server != NULL) {
+        // Queued ahead of the stop request, so parked long-polls are answered first
+        if (__atomic_load_n(&g_longpoll_count, __ATOMIC_SEQ_CST) > 0) {
+            httpd_queue_work(ctx->server, longpoll_cancel_work, NULL);
+        }
         esp_err_t ret = httpd_stop(ctx->server);
         if (ret != ESP_OK) {
             return ret;
@@ -561,33 +2492,57 @@ esp_err_t wifi_web_stop(wifi_web_ctx_t *ctx) {
     }
     
     server_started_from_event = false;
-    esp_vfs_spiffs_unregister("web_storage");
-    ESP_LOGI(TAG, "SPIFFS unmounted");
+    if (web_storage_is_mounted()) {
+        web_storage_unmount();
+        ESP_LOGI(TAG, "Web storage unmounted");
+    }
     
     return ESP_OK;
 }
 
 esp_err_t wifi_web_set_power(wifi_web_ctx_t *ctx, bool is_on) {
-    if (ctx == NULL) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    
-    ctx->state.is_on = is_on;
-    ESP_LOGI(TAG, "Power set to: %s", is_on ? "ON" : "OFF");
-    return ESP_OK;
+    teapot_state_update_t update = {
+        .fields = WIFI_WEB_UPDATE_IS_ON,
+        .is_on = is_on
+    };
+    return wifi_web_apply_update(ctx, &update);
 }
 
 esp_err_t wifi_web_set_setpoint(wifi_web_ctx_t *ctx, float temperature) {
-    if (ctx == NULL) {
+    teapot_state_update_t update = {
+        .fields = WIFI_WEB_UPDATE_SETPOINT,
+        .setpoint_temp = temperature
+    };
+    return wifi_web_apply_update(ctx, &update);
+}
+
+esp_err_t wifi_web_apply_update(wifi_web_ctx_t *ctx, const teapot_state_update_t *update) {
+    if (ctx == NULL || update == NULL || update->fields == 0) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    if (temperature < CONFIG_TEMP_MIN || temperature > CONFIG_TEMP_MAX) {
+    // Validate everything first so a rejected update leaves the state untouched
+    if ((update->fields & WIFI_WEB_UPDATE_SETPOINT) &&
+        (update->setpoint_temp < CONFIG_TEMP_MIN || update->setpoint_temp > CONFIG_TEMP_MAX)) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    ctx->state.setpoint_temp = temperature;
-    ESP_LOGI(TAG, "Setpoint set to: %.1f°C", temperature);
+    taskENTER_CRITICAL(&ctx->state_lock);
+    if (update->fields & WIFI_WEB_UPDATE_IS_ON) {
+        ctx->state.is_on = update->is_on;
+    }
+    if (update->fields & WIFI_WEB_UPDATE_SETPOINT) {
+        ctx->state.setpoint_temp = update->setpoint_temp;
+    }
+    taskEXIT_CRITICAL(&ctx->state_lock);
+    
+    if (update->fields & WIFI_WEB_UPDATE_IS_ON) {
+        trace_record(TRACE_EV_POWER_SET, update->is_on, 0, 0);
+    }
+    if (update->fields & WIFI_WEB_UPDATE_SETPOINT) {
+        trace_record(TRACE_EV_SETPOINT_SET, TRACE_CENTI(update->setpoint_temp), 0, 0);
+    }
+    notify_state_changed(ctx);
     return ESP_OK;
 }
 
@@ -596,7 +2551,9 @@ esp_err_t wifi_web_get_state(wifi_web_ctx_t *ctx, teapot_state_t *state) {
         return ESP_ERR_INVALID_ARG;
     }
     
+    taskENTER_CRITICAL(&ctx->state_lock);
     *state = ctx->state;
+    taskEXIT_CRITICAL(&ctx->state_lock);
     return ESP_OK;
 }
 
@@ -605,68 +2562,152 @@ esp_err_t wifi_web_set_current_temp(wifi_web_ctx_t *ctx, float temperature) {
         return ESP_ERR_INVALID_ARG;
     }
     
+    taskENTER_CRITICAL(&ctx->state_lock);
+    bool changed = ctx->state.current_temp != temperature;
     ctx->state.current_temp = temperature;
+    taskEXIT_CRITICAL(&ctx->state_lock);
+    
+    if (changed) {
+        notify_state_changed(ctx);
+    }
+    return ESP_OK;
+}
+
+// One thermostat step for a fresh reading: switches the relay towards the setpoint
+static void control_step(wifi_web_ctx_t *ctx, relay_handle_t relay, float temperature) {
+    // One consistent copy: a concurrent PATCH must not mix old and new fields
+    teapot_state_t state;
+    wifi_web_get_state(ctx, &state);
+    
+    bool current_state;
+    relay_get_state(relay, &current_state);
+    
+    if (!state.is_on) {
+        if (current_state) {
+            relay_set_state(relay, false);
+            trace_record(TRACE_EV_CONTROL_POWER_OFF, 0, 0, 0);
+            notify_state_changed(ctx);
+        }
+        return;
+    }
+    
+    bool should_be_on = temperature < state.setpoint_temp;
+    if (should_be_on != current_state) {
+        relay_set_state(relay, should_be_on);
+        trace_record(TRACE_EV_CONTROL_AUTO, should_be_on,
+                     TRACE_CENTI(temperature), TRACE_CENTI(state.setpoint_temp));
+        notify_state_changed(ctx);
+    }
+}
+
+// Move relay and/or sensor to the pins of the current config. The heater is switched off
+// first and stays off until the next valid reading on the (possibly new) sensor.
+static void apply_pin_changes(wifi_web_ctx_t *ctx, uint32_t pins, relay_handle_t relay) {
+    if (relay != NULL) {
+        bool relay_on;
+        relay_get_state(relay, &relay_on);
+        if (relay_on) {
+            relay_set_state(relay, false);
+            notify_state_changed(ctx);
+        }
+        if (pins & CONFIG_FIELD_RELAY_GPIO) {
+            teapot_config_t config;
+            config_snapshot(ctx->config, &config);
+            esp_err_t ret = relay_set_gpio(relay, config.gpio.relay_gpio);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to move relay: %s", esp_err_to_name(ret));
+            }
+        }
+    }
+    
+    if ((pins & CONFIG_FIELD_TEMP_GPIO) && ctx->temp_sensor_handle != NULL) {
+        temp_sensor_deinit((temp_sensor_handle_t)ctx->temp_sensor_handle);
+        ctx->temp_sensor_handle = NULL;
+    }
+}
+
+esp_err_t wifi_web_process_sample(wifi_web_ctx_t *ctx, float temperature) {
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    relay_handle_t relay = (relay_handle_t)ctx->relay_handle;
+    wifi_web_set_current_temp(ctx, temperature);
+    trace_record(TRACE_EV_TEMP_SAMPLE, TRACE_CENTI(temperature), 0, 0);
+    
+    if (relay != NULL) {
+        control_step(ctx, relay, temperature);
+    }
+    publish_sample(ctx, temperature, relay);
     return ESP_OK;
 }
 
 static void temp_sensor_task(void *pvParameters) {
     wifi_web_ctx_t *ctx = (wifi_web_ctx_t *)pvParameters;
-    temp_sensor_handle_t sensor = (temp_sensor_handle_t)ctx->temp_sensor_handle;
     relay_handle_t relay = (relay_handle_t)ctx->relay_handle;
     
     ESP_LOGI(TAG, "Temperature sensor task started");
     
+    // Period-to-period jitter of the control steps, for METRIC_CONTROL_JITTER
+    int64_t last_step_us = 0;
+    int64_t last_period_us = 0;
+    
     while (1) {
+        uint32_t pins = __atomic_exchange_n(&g_pin_changes_pending, 0, __ATOMIC_ACQUIRE);
+        if (pins != 0) {
+            apply_pin_changes(ctx, pins, relay);
+        }
+        
+        // Re-enumerate after a pin change; without a sensor no step runs, so the heater stays off
+        if (ctx->temp_sensor_handle == NULL) {
+            teapot_config_t config;
+            config_snapshot(ctx->config, &config);
+            temp_sensor_handle_t new_sensor;
+            esp_err_t init_ret = temp_sensor_init(&config, TEMP_SENSOR_RESOLUTION_12BIT, &new_sensor);
+            if (init_ret != ESP_OK) {
+                trace_record(TRACE_EV_TEMP_READ_ERROR, init_ret, 0, 0);
+                vTaskDelay(pdMS_TO_TICKS(2000));
+                continue;
+            }
+            ctx->temp_sensor_handle = (void *)new_sensor;
+            ESP_LOGI(TAG, "Temperature sensor re-initialized on GPIO %d", config.gpio.temp_sensor_gpio);
+        }
+        temp_sensor_handle_t sensor = (temp_sensor_handle_t)ctx->temp_sensor_handle;
+        
         float temperature;
         esp_err_t ret = temp_sensor_read_temperature(sensor, &temperature);
         
         if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to read temperature: %s", esp_err_to_name(ret));
+            trace_record(TRACE_EV_TEMP_READ_ERROR, ret, 0, 0);
             vTaskDelay(pdMS_TO_TICKS(2000));
             continue;
         }
         
         if (temperature == 85.0f || temperature == -85.0f) {
-            ESP_LOGW(TAG, "Temperature reading failed (default value: %.2f°C)", temperature);
+            trace_record(TRACE_EV_TEMP_INVALID, TRACE_CENTI(temperature), 0, 0);
             vTaskDelay(pdMS_TO_TICKS(2000));
             continue;
         }
         
-        wifi_web_set_current_temp(ctx, temperature);
-        ESP_LOGI(TAG, "Temperature: %.2f°C", temperature);
-        
-        if (relay == NULL) {
-            vTaskDelay(pdMS_TO_TICKS(2000));
-            continue;
-        }
+        wifi_web_process_sample(ctx, temperature);
         
-        if (!ctx->state.is_on) {
-            bool current_state;
-            relay_get_state(relay, &current_state);
-            if (current_state) {
-                relay_set_state(relay, false);
-                ESP_LOGI(TAG, "Power off: relay OFF");
+        if (relay != NULL) {
+            int64_t now = esp_timer_get_time();
+            if (last_step_us != 0) {
+                int64_t period = now - last_step_us;
+                if (last_period_us != 0) {
+                    metrics_observe(METRIC_CONTROL_JITTER, (uint32_t)llabs(period - last_period_us));
+                }
+                last_period_us = period;
             }
-            vTaskDelay(pdMS_TO_TICKS(2000));
-            continue;
-        }
-        
-        bool should_be_on = temperature < ctx->state.setpoint_temp;
-        bool current_state;
-        relay_get_state(relay, &current_state);
-        
-        if (should_be_on != current_state) {
-            relay_set_state(relay, should_be_on);
-            ESP_LOGI(TAG, "Auto control: relay %s (temp %.2f°C %s setpoint %.2f°C)", 
-                    should_be_on ? "ON" : "OFF", temperature, 
-                    should_be_on ? "<" : ">=", ctx->state.setpoint_temp);
+            last_step_us = now;
         }
         
         vTaskDelay(pdMS_TO_TICKS(2000));
     }
 }
 
-esp_err_t wifi_web_start_temp_sensor(wifi_web_ctx_t *ctx) {
+esp_err_t wifi_web_init_temp_sensor(wifi_web_ctx_t *ctx) {
     if (ctx == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
@@ -681,7 +2722,6 @@ esp_err_t wifi_web_start_temp_sensor(wifi_web_ctx_t *ctx) {
         return ESP_ERR_INVALID_STATE;
     }
     
-    // Initialize temperature sensor
     temp_sensor_handle_t sensor;
     esp_err_t ret = temp_sensor_init(ctx->config, TEMP_SENSOR_RESOLUTION_12BIT, &sensor);
     if (ret != ESP_OK) {
@@ -691,21 +2731,45 @@ esp_err_t wifi_web_start_temp_sensor(wifi_web_ctx_t *ctx) {
     
     ctx->temp_sensor_handle = (void *)sensor;
     ESP_LOGI(TAG, "Temperature sensor initialized");
+    return ESP_OK;
+}
+
+esp_err_t wifi_web_start_temp_sensor(wifi_web_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (ctx->temp_task_handle != NULL) {
+        ESP_LOGW(TAG, "Temperature sensor task already running");
+        return ESP_OK;
+    }
+    
+    // Enumerate here unless a separate boot stage already did
+    bool initialized_here = ctx->temp_sensor_handle == NULL;
+    if (initialized_here) {
+        esp_err_t ret = wifi_web_init_temp_sensor(ctx);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
     
     // Create task for reading temperature
-    BaseType_t task_ret = xTaskCreate(
+    ctx->temp_task_handle = xTaskCreateStatic(
         temp_sensor_task,
         "temp_sensor",
-        4096,
+        TEMP_TASK_STACK,
         ctx,
-        5,
-        (TaskHandle_t *)&ctx->temp_task_handle
+        TEMP_TASK_PRIORITY,
+        g_temp_task_stack,
+        &g_temp_task_buf
     );
     
-    if (task_ret != pdPASS) {
+    if (ctx->temp_task_handle == NULL) {
         ESP_LOGE(TAG, "Failed to create temperature sensor task");
-        temp_sensor_deinit(sensor);
-        ctx->temp_sensor_handle = NULL;
+        if (initialized_here) {
+            temp_sensor_deinit((temp_sensor_handle_t)ctx->temp_sensor_handle);
+            ctx->temp_sensor_handle = NULL;
+        }
         return ESP_ERR_NO_MEM;
     }
     
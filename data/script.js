@@ -1,7 +1,15 @@
 const API_BASE = '/api';
 const API_STATE = `${API_BASE}/state`;
-const API_POWER = `${API_BASE}/power`;
-const API_SETPOINT = `${API_BASE}/setpoint`;
+const WS_URL = `ws://${location.host}/ws`;
+const POLL_INTERVAL_MS = 2000;
+const RETRY_MAX_MS = 60000;
+const LONG_POLL_TIMEOUT_MS = 25000;
+const WS_RETRY_MS = 5000;
+const API_HISTORY = `${API_BASE}/history`;
+const HISTORY_MAGIC = 0x31545348;
+const HISTORY_HEADER_SIZE = 32;
+const HISTORY_REFRESH_MS = 10000;
+const HISTORY_MIN_SPAN = 5;
 
 const powerSwitch = document.getElementById('power-switch');
 const powerLabel = document.getElementById('power-label');
@@ -12,58 +20,257 @@ const setpointValue = document.getElementById('setpoint-value');
 const currentTempValue = document.getElementById('current-temp-value');
 const statusText = document.getElementById('status-text');
 const statusDot = document.getElementById('status-dot');
+const historyCanvas = document.getElementById('history-chart');
+const historyTierButtons = document.querySelectorAll('.history-tier');
 
-async function updateState() {
-    try {
-        const response = await fetch(API_STATE);
-        if (!response.ok) {
-            throw new Error('Failed to fetch state');
+let state = {};
+let stateVersion = null;
+let socket = null;
+let polling = false;
+let pollAbort = null;
+let pollGeneration = 0;
+let paused = false;
+let reconnectTimer = null;
+let socketRetryMs = WS_RETRY_MS;
+let history = { tier: 0, points: [], nextSlot: null };
+
+// Merge a full state or a delta pushed over the WebSocket and redraw
+function applyState(update) {
+    Object.assign(state, update);
+    renderState();
+}
+
+// Most updates change one field, so only the nodes whose content differs are written
+function setText(element, text) {
+    if (element.textContent !== text) {
+        element.textContent = text;
+    }
+}
+
+function setClass(element, className) {
+    if (element.className !== className) {
+        element.className = className;
+    }
+}
+
+function renderState() {
+    if (state.is_on !== undefined) {
+        if (powerSwitch.checked !== state.is_on) {
+            powerSwitch.checked = state.is_on;
         }
-        const state = await response.json();
-        
-        powerSwitch.checked = state.is_on;
-        powerLabel.textContent = state.is_on ? 'Включен' : 'Выключен';
-        
-        if (state.relay_state !== null && state.relay_state !== undefined) {
-            const relayOn = state.relay_state === true;
-            relayStatusText.textContent = relayOn ? 'Включено' : 'Выключено';
-            relayDot.className = 'relay-dot ' + (relayOn ? 'on' : 'off');
-        } else {
-            relayStatusText.textContent = '--';
-            relayDot.className = 'relay-dot';
+        setText(powerLabel, state.is_on ? 'Включен' : 'Выключен');
+    }
+    
+    if (state.relay_state !== null && state.relay_state !== undefined) {
+        const relayOn = state.relay_state === true;
+        setText(relayStatusText, relayOn ? 'Включено' : 'Выключено');
+        setClass(relayDot, 'relay-dot ' + (relayOn ? 'on' : 'off'));
+    } else {
+        setText(relayStatusText, '--');
+        setClass(relayDot, 'relay-dot');
+    }
+    
+    if (state.setpoint_temp !== undefined) {
+        if (parseFloat(tempSlider.value) !== state.setpoint_temp) {
+            tempSlider.value = state.setpoint_temp;
         }
-        
-        tempSlider.value = state.setpoint_temp;
-        setpointValue.textContent = state.setpoint_temp.toFixed(1);
-        
-        if (state.current_temp !== null && state.current_temp !== undefined) {
-            currentTempValue.textContent = state.current_temp.toFixed(1);
-        } else {
-            currentTempValue.textContent = '--';
+        setText(setpointValue, state.setpoint_temp.toFixed(1));
+    }
+    
+    if (state.current_temp !== null && state.current_temp !== undefined) {
+        setText(currentTempValue, state.current_temp.toFixed(1));
+    } else {
+        setText(currentTempValue, '--');
+    }
+}
+
+// index.html carries the state at the time it was sent, so the first paint needs no request.
+// A page from the service worker cache may be old, so the status waits for the device.
+function readInitialState() {
+    const element = document.getElementById('initial-state');
+    if (!element || !element.textContent) {
+        return;
+    }
+    try {
+        const initial = JSON.parse(element.textContent);
+        stateVersion = String(initial.version);
+        applyState(initial.state);
+    } catch (error) {
+        console.error('Invalid initial state:', error);
+    }
+}
+
+// The ETag of /api/state carries the state version: "v<number>"
+function rememberVersion(response) {
+    const match = /"v(\d+)"/.exec(response.headers.get('ETag') || '');
+    if (match) {
+        stateVersion = match[1];
+    }
+}
+
+// Long-poll: the device holds the request until the state moves past the version we have
+async function updateState(signal) {
+    const url = stateVersion === null
+        ? API_STATE
+        : `${API_STATE}?wait=${stateVersion}&timeout=${LONG_POLL_TIMEOUT_MS}`;
+    const response = await fetch(url, { signal });
+    if (response.status === 304) {
+        return;
+    }
+    if (!response.ok) {
+        throw new Error('Failed to fetch state');
+    }
+    rememberVersion(response);
+    applyState(await response.json());
+}
+
+function sleep(ms) {
+    return new Promise((resolve) => setTimeout(resolve, ms));
+}
+
+// While the device is unreachable, retries back off exponentially up to RETRY_MAX_MS
+function nextDelay(delay) {
+    return Math.min(delay * 2, RETRY_MAX_MS);
+}
+
+async function pollLoop(generation) {
+    let delay = POLL_INTERVAL_MS;
+    while (polling && generation === pollGeneration) {
+        const controller = new AbortController();
+        pollAbort = controller;
+        try {
+            await updateState(controller.signal);
+            updateStatus(true);
+            delay = POLL_INTERVAL_MS;
+        } catch (error) {
+            if (controller.signal.aborted) {
+                break;
+            }
+            console.error('Error updating state:', error);
+            updateStatus(false);
+            await sleep(delay);
+            delay = nextDelay(delay);
+        }
+    }
+}
+
+// A stale version is harmless: the device answers it at once with the current state.
+// Each start gets a generation, so a loop still sleeping from before a stop exits.
+function startPolling() {
+    if (!polling) {
+        polling = true;
+        pollLoop(++pollGeneration);
+    }
+}
+
+function stopPolling() {
+    if (polling) {
+        polling = false;
+        pollAbort.abort();
+    }
+}
+
+// The device pushes state changes over the socket; polling is only a fallback while it is down
+function connectSocket() {
+    if (!('WebSocket' in window)) {
+        startPolling();
+        return;
+    }
+    
+    const ws = new WebSocket(WS_URL);
+    socket = ws;
+    ws.onopen = () => {
+        socketRetryMs = WS_RETRY_MS;
+        stopPolling();
+        updateStatus(true);
+    };
+    ws.onmessage = (event) => {
+        const message = JSON.parse(event.data);
+        if (message.error) {
+            console.error('Device rejected command:', message.error);
+            return;
         }
-        
+        applyState(message);
         updateStatus(true);
-    } catch (error) {
-        console.error('Error updating state:', error);
-        updateStatus(false);
+    };
+    // A socket closed by pause() has already been replaced and must not reconnect
+    ws.onclose = () => {
+        if (socket !== ws) {
+            return;
+        }
+        socket = null;
+        startPolling();
+        reconnectTimer = setTimeout(connectSocket, socketRetryMs);
+        socketRetryMs = nextDelay(socketRetryMs);
+    };
+    ws.onerror = () => {
+        ws.close();
+    };
+}
+
+// A hidden tab gets no socket, no long-poll and no history requests
+function pause() {
+    paused = true;
+    stopPolling();
+    clearTimeout(reconnectTimer);
+    if (socket !== null) {
+        const ws = socket;
+        socket = null;
+        ws.close();
+    }
+}
+
+function resume() {
+    paused = false;
+    reconnectNow();
+    updateHistory().catch((error) => console.error('Error updating history:', error));
+}
+
+// Skips any pending backoff, used when the tab becomes visible or the network returns
+function reconnectNow() {
+    if (paused || (socket !== null && socket.readyState !== WebSocket.CLOSED)) {
+        return;
+    }
+    clearTimeout(reconnectTimer);
+    socketRetryMs = WS_RETRY_MS;
+    connectSocket();
+    startPolling();
+}
+
+function sendCommand(command) {
+    if (socket === null || socket.readyState !== WebSocket.OPEN) {
+        return false;
+    }
+    socket.send(JSON.stringify(command));
+    return true;
+}
+
+// One PATCH applies the change and returns the resulting state, no follow-up GET needed
+async function patchState(changes) {
+    if (sendCommand(changes)) {
+        return;
     }
+    
+    const response = await fetch(API_STATE, {
+        method: 'PATCH',
+        headers: {
+            'Content-Type': 'application/json',
+        },
+        body: JSON.stringify(changes)
+    });
+    
+    if (!response.ok) {
+        throw new Error('Failed to update state');
+    }
+    
+    rememberVersion(response);
+    applyState(await response.json());
+    updateStatus(true);
 }
 
 async function setPower(isOn) {
     try {
-        const response = await fetch(API_POWER, {
-            method: 'POST',
-            headers: {
-                'Content-Type': 'application/json',
-            },
-            body: JSON.stringify({ is_on: isOn })
-        });
-        
-        if (!response.ok) {
-            throw new Error('Failed to set power');
-        }
-        
-        await updateState();
+        await patchState({ is_on: isOn });
     } catch (error) {
         console.error('Error setting power:', error);
         updateStatus(false);
@@ -73,19 +280,7 @@ async function setPower(isOn) {
 
 async function setSetpoint(temp) {
     try {
-        const response = await fetch(API_SETPOINT, {
-            method: 'POST',
-            headers: {
-                'Content-Type': 'application/json',
-            },
-            body: JSON.stringify({ temperature: temp })
-        });
-        
-        if (!response.ok) {
-            throw new Error('Failed to set setpoint');
-        }
-        
-        await updateState();
+        await patchState({ setpoint_temp: temp });
     } catch (error) {
         console.error('Error setting setpoint:', error);
         updateStatus(false);
@@ -102,6 +297,197 @@ function updateStatus(isOnline) {
     }
 }
 
+// Binary dump of /api/history: history_dump_header_t followed by history_point_t entries
+function parseHistory(buffer) {
+    const view = new DataView(buffer);
+    if (buffer.byteLength < HISTORY_HEADER_SIZE || view.getUint32(0, true) !== HISTORY_MAGIC) {
+        throw new Error('Unexpected history format');
+    }
+    
+    const dump = {
+        tier: view.getUint8(4),
+        capacity: view.getUint16(6, true),
+        periodMs: view.getUint32(8, true),
+        firstSlot: view.getUint32(12, true),
+        nextSlot: view.getUint32(16, true),
+        nowMs: Number(view.getBigInt64(24, true)) / 1000,
+        points: []
+    };
+    const pointSize = view.getUint8(5);
+    for (let offset = HISTORY_HEADER_SIZE; offset + pointSize <= buffer.byteLength; offset += pointSize) {
+        dump.points.push({
+            slot: dump.firstSlot + dump.points.length,
+            avg: view.getInt16(offset, true) / 100,
+            min: view.getInt16(offset + 2, true) / 100,
+            max: view.getInt16(offset + 4, true) / 100,
+            relayPct: view.getUint8(offset + 6),
+            samples: view.getUint8(offset + 7)
+        });
+    }
+    return dump;
+}
+
+// Fetches only the points newer than the ones we already have
+async function updateHistory() {
+    const tier = history.tier;
+    const since = history.nextSlot === null ? '' : `&since=${history.nextSlot}`;
+    const response = await fetch(`${API_HISTORY}?tier=${tier}${since}`);
+    if (!response.ok) {
+        throw new Error('Failed to fetch history');
+    }
+    const dump = parseHistory(await response.arrayBuffer());
+    if (tier !== history.tier) {
+        return;
+    }
+    
+    // The device restarted or we fell behind: the dump is a full copy, not a continuation
+    if (dump.firstSlot !== history.nextSlot) {
+        history.points = [];
+    }
+    history.points = history.points.concat(dump.points).slice(-dump.capacity);
+    Object.assign(history, {
+        nextSlot: dump.nextSlot,
+        periodMs: dump.periodMs,
+        capacity: dump.capacity,
+        deviceNowMs: dump.nowMs,
+        fetchedAt: Date.now()
+    });
+    drawHistory();
+}
+
+function drawHistory() {
+    const ratio = window.devicePixelRatio || 1;
+    const width = historyCanvas.clientWidth;
+    const height = historyCanvas.clientHeight;
+    historyCanvas.width = width * ratio;
+    historyCanvas.height = height * ratio;
+    const ctx = historyCanvas.getContext('2d');
+    ctx.setTransform(ratio, 0, 0, ratio, 0, 0);
+    ctx.clearRect(0, 0, width, height);
+    
+    const points = history.points.filter((point) => point.samples > 0);
+    if (points.length === 0) {
+        ctx.fillStyle = '#999';
+        ctx.font = '14px sans-serif';
+        ctx.textAlign = 'center';
+        ctx.fillText('Нет данных', width / 2, height / 2);
+        return;
+    }
+    
+    // Slot s started s * period ms after boot; the header tells how long ago boot was
+    const slotTime = (slot) => history.fetchedAt - (history.deviceNowMs - slot * history.periodMs);
+    const end = history.fetchedAt;
+    const start = end - history.capacity * history.periodMs;
+    
+    let low = Math.min(...points.map((point) => point.min));
+    let high = Math.max(...points.map((point) => point.max));
+    if (state.setpoint_temp !== undefined) {
+        low = Math.min(low, state.setpoint_temp);
+        high = Math.max(high, state.setpoint_temp);
+    }
+    if (high - low < HISTORY_MIN_SPAN) {
+        const middle = (high + low) / 2;
+        low = middle - HISTORY_MIN_SPAN / 2;
+        high = middle + HISTORY_MIN_SPAN / 2;
+    }
+    
+    const left = 36;
+    const bottom = height - 18;
+    const x = (time) => left + (time - start) / (end - start) * (width - left);
+    const y = (temp) => bottom - (temp - low) / (high - low) * (bottom - 6);
+    
+    ctx.font = '11px sans-serif';
+    ctx.fillStyle = '#999';
+    ctx.strokeStyle = '#eee';
+    ctx.lineWidth = 1;
+    ctx.textAlign = 'right';
+    for (let i = 0; i <= 4; i++) {
+        const temp = low + (high - low) * i / 4;
+        ctx.beginPath();
+        ctx.moveTo(left, y(temp));
+        ctx.lineTo(width, y(temp));
+        ctx.stroke();
+        ctx.fillText(temp.toFixed(0), left - 4, y(temp) + 4);
+    }
+    const timeLabel = (time) => new Date(time).toLocaleTimeString([], { hour: '2-digit', minute: '2-digit' });
+    ctx.textAlign = 'left';
+    ctx.fillText(timeLabel(start), left, height - 4);
+    ctx.textAlign = 'right';
+    ctx.fillText(timeLabel(end), width, height - 4);
+    
+    // Min/max band and average line; empty slots break both
+    ctx.fillStyle = 'rgba(118, 75, 162, 0.15)';
+    ctx.strokeStyle = '#764ba2';
+    ctx.lineWidth = 2;
+    let previous = null;
+    ctx.beginPath();
+    for (const point of history.points) {
+        if (point.samples === 0) {
+            previous = null;
+            continue;
+        }
+        const x0 = x(slotTime(point.slot));
+        const x1 = x(slotTime(point.slot + 1));
+        ctx.fillRect(x0, y(point.max), Math.max(x1 - x0, 1), Math.max(y(point.min) - y(point.max), 1));
+        const px = (x0 + x1) / 2;
+        if (previous === null) {
+            ctx.moveTo(px, y(point.avg));
+        } else {
+            ctx.lineTo(px, y(point.avg));
+        }
+        previous = point;
+    }
+    ctx.stroke();
+    
+    if (state.setpoint_temp !== undefined) {
+        ctx.strokeStyle = '#f87171';
+        ctx.lineWidth = 1;
+        ctx.setLineDash([4, 4]);
+        ctx.beginPath();
+        ctx.moveTo(left, y(state.setpoint_temp));
+        ctx.lineTo(width, y(state.setpoint_temp));
+        ctx.stroke();
+        ctx.setLineDash([]);
+    }
+}
+
+async function historyLoop() {
+    let delay = HISTORY_REFRESH_MS;
+    while (true) {
+        if (!paused) {
+            try {
+                await updateHistory();
+                delay = HISTORY_REFRESH_MS;
+            } catch (error) {
+                console.error('Error updating history:', error);
+                delay = nextDelay(delay);
+            }
+        }
+        await sleep(delay);
+    }
+}
+
+historyTierButtons.forEach((button) => {
+    button.addEventListener('click', () => {
+        historyTierButtons.forEach((other) => other.classList.toggle('active', other === button));
+        history = { tier: Number(button.dataset.tier), points: [], nextSlot: null };
+        drawHistory();
+        updateHistory().catch((error) => console.error('Error updating history:', error));
+    });
+});
+
+window.addEventListener('resize', drawHistory);
+
+document.addEventListener('visibilitychange', () => {
+    if (document.hidden) {
+        pause();
+    } else {
+        resume();
+    }
+});
+
+window.addEventListener('online', reconnectNow);
+
 powerSwitch.addEventListener('change', (e) => {
     setPower(e.target.checked);
 });
@@ -120,6 +506,19 @@ tempSlider.addEventListener('input', (e) => {
     }, 300);
 });
 
-updateState();
-setInterval(updateState, 2000);
+// The initial state follows this script in index.html, so start once the page is parsed
+document.addEventListener('DOMContentLoaded', () => {
+    readInitialState();
+    connectSocket();
+    startPolling();
+    historyLoop();
+});
+
+// Service workers need a secure context; over plain HTTP the page simply loads from the device
+if ('serviceWorker' in navigator) {
+    window.addEventListener('load', () => {
+        navigator.serviceWorker.register('/sw.js')
+            .catch((error) => console.error('Service worker registration failed:', error));
+    });
+}
 
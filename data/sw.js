@@ -0,0 +1,41 @@
+// Service worker: the page shell is answered from the cache, so reopening the UI costs the
+// device no asset requests. The build replaces __ASSETS_HASH__ with a hash of the other assets,
+// so new firmware installs a new worker and a fresh cache.
+const CACHE_NAME = 'teapot-shell-__ASSETS_HASH__';
+const SHELL = ['/', '/manifest.webmanifest', '/icon.svg'];
+
+self.addEventListener('install', (event) => {
+    event.waitUntil(
+        caches.open(CACHE_NAME)
+            .then((cache) => cache.addAll(SHELL))
+            .then(() => self.skipWaiting())
+    );
+});
+
+self.addEventListener('activate', (event) => {
+    event.waitUntil(
+        caches.keys()
+            .then((names) => Promise.all(
+                names.filter((name) => name !== CACHE_NAME).map((name) => caches.delete(name))
+            ))
+            .then(() => self.clients.claim())
+    );
+});
+
+// Only the shell comes from the cache; the API, the socket and everything else go to the device.
+// The cached page carries an old initial state, which the first /api/state request replaces.
+self.addEventListener('fetch', (event) => {
+    const request = event.request;
+    const url = new URL(request.url);
+    if (request.method !== 'GET' || url.origin !== self.location.origin) {
+        return;
+    }
+    
+    const path = url.pathname === '/index.html' ? '/' : url.pathname;
+    if (!SHELL.includes(path)) {
+        return;
+    }
+    event.respondWith(
+        caches.match(path).then((cached) => cached || fetch(request))
+    );
+});
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Build the binary config image read by components/config/src/config_image.c.
+
+Used by gen_config.py at build time and standalone to re-provision a unit:
+
+    python scripts/config_image.py --wifi-ssid Kitchen --relay-gpio 2 ... -o config.bin
+    esptool.py write_flash 0x190000 config.bin
+
+On the next boot the unit notices the new image and drops the settings saved through
+/api/config. Flashing an identical image keeps them.
+"""
+from pathlib import Path
+import argparse
+import re
+import struct
+import sys
+import zlib
+
+ROOT = Path(__file__).resolve().parent.parent
+
+MAGIC = 0x47464354  # "TCFG"
+VERSION = 1
+HEADER = struct.Struct("<IHHI")
+PAYLOAD = struct.Struct("<33s65sbbhH128s64sH")
+PARTITION_LABEL = "config"
+
+
+def load_limits(root=ROOT):
+    """Read the CONFIG_* limits from config.h so the rules match config_validate()."""
+    text = (Path(root) / "components/config/include/config.h").read_text()
+    limits = {}
+    for name, value in re.findall(r"#define (CONFIG_\w+) ([\d.]+)f?\b", text):
+        limits[name] = float(value) if "." in value else int(value)
+    return limits
+
+
+def validate(cfg, limits):
+    """Mirror of config_validate(); raises ValueError with the offending field."""
+    ssid, password = cfg["wifi_ssid"], cfg["wifi_password"]
+    if not ssid or len(ssid.encode()) > limits["CONFIG_WIFI_SSID_MAX_LEN"]:
+        raise ValueError("wifi_ssid must be 1..%d bytes" % limits["CONFIG_WIFI_SSID_MAX_LEN"])
+    if len(password.encode()) > limits["CONFIG_WIFI_PASSWORD_MAX_LEN"] or \
+            0 < len(password.encode()) < limits["CONFIG_WIFI_PASSWORD_MIN_LEN"]:
+        raise ValueError("wifi_password must be empty or %d..%d bytes"
+                         % (limits["CONFIG_WIFI_PASSWORD_MIN_LEN"], limits["CONFIG_WIFI_PASSWORD_MAX_LEN"]))
+    for key in ("relay_gpio", "temp_sensor_gpio"):
+        if not limits["CONFIG_GPIO_MIN"] <= cfg[key] <= limits["CONFIG_GPIO_MAX"]:
+            raise ValueError("%s must be %d..%d" % (key, limits["CONFIG_GPIO_MIN"], limits["CONFIG_GPIO_MAX"]))
+    if cfg["relay_gpio"] == cfg["temp_sensor_gpio"]:
+        raise ValueError("relay_gpio and temp_sensor_gpio must differ")
+    if not limits["CONFIG_TEMP_MIN"] <= cfg["default_setpoint"] <= limits["CONFIG_TEMP_MAX"]:
+        raise ValueError("default_setpoint must be %g..%g" % (limits["CONFIG_TEMP_MIN"], limits["CONFIG_TEMP_MAX"]))
+    if not 0 <= cfg["coap_port"] <= 0xFFFF:
+        raise ValueError("coap_port must be 0..65535")
+    # Packed even with MQTT off, so the range is checked unconditionally
+    if not limits["CONFIG_MQTT_BATCH_WINDOW_MIN"] <= cfg["mqtt_batch_window_s"] <= limits["CONFIG_MQTT_BATCH_WINDOW_MAX"]:
+        raise ValueError("mqtt_batch_window must be %d..%d"
+                         % (limits["CONFIG_MQTT_BATCH_WINDOW_MIN"], limits["CONFIG_MQTT_BATCH_WINDOW_MAX"]))
+    if len(cfg["mqtt_uri"].encode()) > limits["CONFIG_MQTT_URI_MAX_LEN"]:
+        raise ValueError("mqtt_uri is longer than %d bytes" % limits["CONFIG_MQTT_URI_MAX_LEN"])
+    topic = cfg["mqtt_topic"]
+    if len(topic.encode()) > limits["CONFIG_MQTT_TOPIC_MAX_LEN"]:
+        raise ValueError("mqtt_topic is longer than %d bytes" % limits["CONFIG_MQTT_TOPIC_MAX_LEN"])
+    if cfg["mqtt_uri"]:
+        if not topic or topic.endswith("/") or "+" in topic or "#" in topic:
+            raise ValueError("mqtt_topic must be non-empty, without wildcards or a trailing '/'")
+
+
+def build(cfg, limits=None):
+    """Validate cfg and return the image bytes (header + payload)."""
+    validate(cfg, limits or load_limits())
+    payload = PAYLOAD.pack(
+        cfg["wifi_ssid"].encode(),
+        cfg["wifi_password"].encode(),
+        cfg["relay_gpio"],
+        cfg["temp_sensor_gpio"],
+        int(round(cfg["default_setpoint"] * 100)),
+        cfg["coap_port"],
+        cfg["mqtt_uri"].encode(),
+        cfg["mqtt_topic"].encode(),
+        cfg["mqtt_batch_window_s"],
+    )
+    # zlib.crc32 matches esp_rom_crc32_le(0, ...)
+    return HEADER.pack(MAGIC, VERSION, len(payload), zlib.crc32(payload)) + payload
+
+
+def partition_offset(partitions_csv, label=PARTITION_LABEL):
+    for line in Path(partitions_csv).read_text().splitlines():
+        fields = [f.strip() for f in line.split("#", 1)[0].split(",")]
+        if len(fields) >= 4 and fields[0] == label:
+            return int(fields[3], 0)
+    raise ValueError("no '%s' partition in %s" % (label, partitions_csv))
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--wifi-ssid", required=True)
+    parser.add_argument("--wifi-password", default="")
+    parser.add_argument("--relay-gpio", type=int, required=True)
+    parser.add_argument("--temp-sensor-gpio", type=int, required=True)
+    parser.add_argument("--default-setpoint", type=float, default=85.0)
+    parser.add_argument("--coap-port", type=int, default=5683)
+    parser.add_argument("--mqtt-uri", default="")
+    parser.add_argument("--mqtt-topic", default="teapot")
+    parser.add_argument("--mqtt-batch-window", type=int, default=60)
+    parser.add_argument("-o", "--output", default="config.bin")
+    args = parser.parse_args(argv)
+
+    cfg = {
+        "wifi_ssid": args.wifi_ssid,
+        "wifi_password": args.wifi_password,
+        "relay_gpio": args.relay_gpio,
+        "temp_sensor_gpio": args.temp_sensor_gpio,
+        "default_setpoint": args.default_setpoint,
+        "coap_port": args.coap_port,
+        "mqtt_uri": args.mqtt_uri,
+        "mqtt_topic": args.mqtt_topic,
+        "mqtt_batch_window_s": args.mqtt_batch_window,
+    }
+    try:
+        image = build(cfg)
+    except ValueError as e:
+        print("ERROR: %s" % e)
+        return 1
+    Path(args.output).write_bytes(image)
+    offset = partition_offset(ROOT / "partitions.csv")
+    print("Wrote %s (%d bytes); flash with: esptool.py write_flash 0x%x %s"
+          % (args.output, len(image), offset, args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -30,6 +30,39 @@ cfg = f"""#pragma once
 #define RELAY_GPIO {v("RELAY_GPIO")}
 #define TEMP_SENSOR_GPIO {v("TEMP_SENSOR_GPIO")}
 #define DEFAULT_SETPOINT {v("DEFAULT_SETPOINT")}f
+#define COAP_PORT {v("COAP_PORT")}
+#define MQTT_URI "{v("MQTT_URI")}"
+#define MQTT_TOPIC "{v("MQTT_TOPIC")}"
+#define MQTT_BATCH_WINDOW {v("MQTT_BATCH_WINDOW")}
 """
 
-(inc / "config_autogen.h").write_text(cfg)
\ No newline at end of file
+(inc / "config_autogen.h").write_text(cfg)
+# The same values as a CRC-checked image for the "config" partition, flashed with the
+# firmware and mapped by config_image_load() at boot
+sys.path.insert(0, str(Path(env["PROJECT_DIR"]) / "scripts"))
+import config_image
+
+image_cfg = {
+    "wifi_ssid": v("WIFI_SSID"),
+    "wifi_password": v("WIFI_PASSWORD"),
+    "relay_gpio": int(v("RELAY_GPIO")),
+    "temp_sensor_gpio": int(v("TEMP_SENSOR_GPIO")),
+    "default_setpoint": float(v("DEFAULT_SETPOINT")),
+    "coap_port": int(v("COAP_PORT")),
+    "mqtt_uri": v("MQTT_URI"),
+    "mqtt_topic": v("MQTT_TOPIC"),
+    "mqtt_batch_window_s": int(v("MQTT_BATCH_WINDOW")),
+}
+try:
+    image = config_image.build(image_cfg, config_image.load_limits(env["PROJECT_DIR"]))
+except ValueError as e:
+    print(f"ERROR: invalid config: {e}")
+    sys.exit(1)
+
+build_dir = Path(env.subst("$BUILD_DIR"))
+build_dir.mkdir(parents=True, exist_ok=True)
+image_path = build_dir / "config.bin"
+image_path.write_bytes(image)
+
+offset = config_image.partition_offset(Path(env["PROJECT_DIR"]) / "partitions.csv")
+env.Append(FLASH_EXTRA_IMAGES=[(hex(offset), str(image_path))])
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+"""Minify and gzip the files in data/ into a C source linked into the firmware.
+
+Every asset gets a content-hash ETag. Pages inline the local stylesheets and
+scripts they reference; those are then left out of the firmware. A page with an
+initial-state slot is also emitted as a template: the gzip stream up to the slot,
+flushed to a byte boundary, which the server completes with the current state.
+
+A stylesheet or script that cannot be inlined (it contains its own closing tag) is
+also published under a fingerprinted /static/ URL that pages are rewritten to
+reference, so browsers can cache it as immutable.
+
+The service worker keeps its URL, so browsers can find updates, and gets a hash of
+all other assets as its cache version instead.
+
+Usage:
+    gen_web_assets.py <data_dir> <output.c>
+"""
+import gzip
+import hashlib
+import zlib
+import re
+import sys
+from pathlib import Path
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".webmanifest": "application/manifest+json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+}
+
+
+def minify_css(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    text = re.sub(r"\s+", " ", text)
+    text = re.sub(r"\s*([{};,])\s*", r"\1", text)
+    text = re.sub(r":\s+", ":", text)
+    return text.replace(";}", "}").strip()
+
+
+def minify_lines(text, comment_prefix=None):
+    # Line-based on purpose: keeping newlines keeps JS automatic semicolon insertion intact
+    lines = []
+    for line in text.splitlines():
+        line = line.strip()
+        if not line or (comment_prefix and line.startswith(comment_prefix)):
+            continue
+        lines.append(line)
+    return "\n".join(lines)
+
+
+def minify_html(text):
+    text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    return minify_lines(text)
+
+
+FINGERPRINTED = (".css", ".js")
+SERVICE_WORKER = "sw.js"
+SERVICE_WORKER_VERSION = b"__ASSETS_HASH__"
+STATE_SLOT = '<script id="initial-state" type="application/json"></script>'
+STATE_SLOT_SPLIT = STATE_SLOT.index("</script>")
+CACHE_REVALIDATE = "no-cache"
+CACHE_IMMUTABLE = "public, max-age=31536000, immutable"
+
+MINIFIERS = {
+    ".css": minify_css,
+    ".js": lambda text: minify_lines(text, "//"),
+    ".html": minify_html,
+}
+
+
+def load_asset(path):
+    data = path.read_bytes()
+    minify = MINIFIERS.get(path.suffix)
+    if minify is not None:
+        data = minify(data.decode("utf-8")).encode("utf-8")
+    return data
+
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:16]
+
+
+def fingerprinted_path(path, digest):
+    return f"/static/{path.stem}.{digest[:8]}{path.suffix}"
+
+
+def inline_assets(html, contents_by_name, inlined):
+    """Put referenced stylesheets and scripts into the page, so it loads with one request.
+
+    Names of the inlined files are added to the set inlined."""
+    def inline(tag, match):
+        data = contents_by_name.get(match.group(1))
+        if data is None or f"</{tag}".encode() in data.lower():
+            return match.group(0)
+        inlined.add(match.group(1))
+        return f"<{tag}>{data.decode('utf-8')}</{tag}>"
+
+    html = re.sub(r'<link rel="stylesheet" href="/([^"/]+\.css)">', lambda m: inline("style", m), html)
+    return re.sub(r'<script src="/([^"/]+\.js)"></script>', lambda m: inline("script", m), html)
+
+
+def gzip_prefix(data):
+    """gzip header and deflate blocks of data, ending byte-aligned without a final block."""
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -15)
+    deflated = compressor.compress(data) + compressor.flush(zlib.Z_SYNC_FLUSH)
+    # Same header as gzip.compress(mtime=0): deflate, max compression, unknown OS
+    return b"\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\xff" + deflated
+
+
+def c_string(data):
+    return '"' + "".join(chr(b) if 32 <= b < 127 and chr(b) not in '"\\' else f'\\x{b:02x}""' for b in data) + '"'
+
+
+def c_array(name, data):
+    rows = []
+    for i in range(0, len(data), 16):
+        rows.append("    " + ", ".join(f"0x{b:02x}" for b in data[i:i + 16]) + ",")
+    return f"static const uint8_t {name}[] = {{\n" + "\n".join(rows) + "\n};\n"
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip())
+        sys.exit(1)
+
+    data_dir = Path(sys.argv[1])
+    out = Path(sys.argv[2])
+
+    paths = sorted(p for p in data_dir.iterdir() if p.is_file())
+    contents = {path: load_asset(path) for path in paths}
+
+    contents_by_name = {path.name: contents[path] for path in paths if path.suffix in FINGERPRINTED}
+    inlined = set()
+    for path in paths:
+        if path.suffix == ".html":
+            contents[path] = inline_assets(contents[path].decode("utf-8"), contents_by_name, inlined).encode("utf-8")
+    # Nothing references an inlined file any more, embedding it would only cost flash
+    paths = [path for path in paths if path.name not in inlined]
+
+    # Hash fingerprinted assets first: pages referencing them are rewritten before being hashed
+    renames = {}
+    for path in paths:
+        if path.suffix in FINGERPRINTED and path.name != SERVICE_WORKER:
+            renames[f"/{path.name}"] = fingerprinted_path(path, content_hash(contents[path]))
+    for path in paths:
+        if path.suffix == ".html":
+            text = contents[path].decode("utf-8")
+            for old, new in renames.items():
+                text = text.replace(f'"{old}"', f'"{new}"')
+            contents[path] = text.encode("utf-8")
+
+    # Any change to the shell produces a new worker, which replaces the cached shell
+    shell_hash = hashlib.sha256()
+    for path in paths:
+        if path.name != SERVICE_WORKER:
+            shell_hash.update(contents[path])
+    for path in paths:
+        if path.name == SERVICE_WORKER:
+            contents[path] = contents[path].replace(SERVICE_WORKER_VERSION, shell_hash.hexdigest()[:16].encode())
+
+    arrays = []
+    entries = []
+    templates = []
+    for index, path in enumerate(paths):
+        digest = content_hash(contents[path])
+        body = gzip.compress(contents[path], compresslevel=9, mtime=0)
+        content_type = CONTENT_TYPES.get(path.suffix, "application/octet-stream")
+        name = f"asset_{index}"
+        arrays.append(c_array(name, body))
+
+        urls = [(f"/{path.name}", CACHE_REVALIDATE)]
+        if f"/{path.name}" in renames:
+            urls.append((renames[f"/{path.name}"], CACHE_IMMUTABLE))
+        for url, cache_control in urls:
+            entries.append(f'    {{ "{url}", "/{path.name}", "{content_type}", "W/\\"{digest}\\"", '
+                           f'"{cache_control}", {name}, sizeof({name}) }},')
+        print(f"web asset {', '.join(url for url, _ in urls)}: {path.stat().st_size} -> {len(body)} bytes")
+
+        text = contents[path]
+        slot = text.find(STATE_SLOT.encode())
+        if path.suffix == ".html" and slot >= 0:
+            head = text[:slot + STATE_SLOT_SPLIT]
+            tail = text[slot + STATE_SLOT_SPLIT:]
+            # The tail travels uncompressed in the stored block, so the slot should sit near the end
+            if len(tail) > 256:
+                sys.exit(f"{path.name}: more than 256 bytes after the initial-state slot")
+            prefix = gzip_prefix(head)
+            arrays.append(c_array(f"{name}_prefix", prefix))
+            templates.append(f'    {{ "/{path.name}", {name}_prefix, sizeof({name}_prefix), '
+                             f'0x{zlib.crc32(head):08x}u, {len(head)}u, {c_string(tail)}, {len(tail)} }},')
+
+    source = (
+        "/* AUTOGENERATED by scripts/gen_web_assets.py, do not edit */\n"
+        '#include "web_assets.h"\n\n'
+        + "\n".join(arrays)
+        + "\nconst web_asset_t web_assets[] = {\n"
+        + "\n".join(entries)
+        + "\n};\n\n"
+        + f"const size_t web_assets_count = {len(entries)};\n\n"
+        + "const web_template_t web_templates[] = {\n"
+        + "\n".join(templates)
+        + "\n};\n\n"
+        + f"const size_t web_templates_count = {len(templates)};\n"
+    )
+
+    out.parent.mkdir(parents=True, exist_ok=True)
+    # Avoid touching the output (and recompiling) when nothing changed
+    if not out.exists() or out.read_text() != source:
+        out.write_text(source)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""Show GET /api/profile as a task table and map sampled PCs to functions.
+
+Usage:
+    profile_symbolize.py http://192.168.4.1/api/profile [firmware.elf]
+    profile_symbolize.py profile.json [firmware.elf]
+
+The PC histogram is only present with CONFIG_PROFILER_PC_SAMPLING. PCs are resolved
+with riscv32-esp-elf-addr2line, set $ADDR2LINE to use another one.
+"""
+import collections
+import json
+import os
+import subprocess
+import sys
+import urllib.request
+
+TOP_FUNCTIONS = 30
+
+
+def load(source):
+    if source.startswith("http://") or source.startswith("https://"):
+        with urllib.request.urlopen(source) as resp:
+            return json.load(resp)
+    with open(source) as f:
+        return json.load(f)
+
+
+def print_tasks(profile):
+    print(f"CPU window {profile['window_us'] / 1e6:.1f} s")
+    print(f"{'task':<16} {'state':<10} {'prio':>4} {'cpu %':>7} {'stack free':>10}")
+    for task in sorted(profile["tasks"], key=lambda t: -t["cpu"]):
+        print(f"{task['name']:<16} {task['state']:<10} {task['priority']:>4} "
+              f"{task['cpu']:>7.2f} {task['stack_free']:>10}")
+
+
+def symbolize(elf, pcs):
+    addr2line = os.environ.get("ADDR2LINE", "riscv32-esp-elf-addr2line")
+    result = subprocess.run([addr2line, "-f", "-C", "-e", elf],
+                            input="\n".join(f"0x{pc:08x}" for pc in pcs),
+                            capture_output=True, text=True, check=True)
+    lines = result.stdout.splitlines()
+    # Two lines per address: function, then file:line
+    return {pc: (lines[2 * i], lines[2 * i + 1]) for i, pc in enumerate(pcs)}
+
+
+def print_pcs(pc, elf):
+    samples = pc["samples"]
+    print(f"\n{samples} PC samples at {pc['hz']} Hz, {pc['isr']} in interrupts, {pc['dropped']} dropped")
+    if samples == 0:
+        return
+    bins = {addr: count for addr, count in pc["bins"]}
+    if elf is None:
+        for addr, count in sorted(bins.items(), key=lambda item: -item[1])[:TOP_FUNCTIONS]:
+            print(f"{100 * count / samples:6.2f}% 0x{addr:08x}")
+        return
+
+    symbols = symbolize(elf, sorted(bins))
+    by_function = collections.Counter()
+    where = {}
+    for addr, count in bins.items():
+        function, location = symbols[addr]
+        by_function[function] += count
+        where.setdefault(function, location)
+    for function, count in by_function.most_common(TOP_FUNCTIONS):
+        print(f"{100 * count / samples:6.2f}% {function} ({where[function]})")
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        print(__doc__.strip())
+        sys.exit(1)
+    profile = load(sys.argv[1])
+    print_tasks(profile)
+    if "pc" in profile:
+        print_pcs(profile["pc"], sys.argv[2] if len(sys.argv) == 3 else None)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Decode a binary trace dump produced by GET /api/trace.
+
+Usage:
+    trace_decode.py http://192.168.4.1/api/trace
+    trace_decode.py dump.bin
+"""
+import struct
+import sys
+import urllib.request
+
+HEADER = struct.Struct("<IHHIIq")
+EVENT = struct.Struct("<IIHHiii")
+MAGIC = 0x31435254
+
+# Must match trace_event_id_t in components/trace/include/trace.h
+EVENTS = {
+    0: ("NONE", None),
+    1: ("TEMP_SAMPLE", lambda a: f"temp={a[0] / 100:.2f}"),
+    2: ("TEMP_READ_ERROR", lambda a: f"err=0x{a[0] & 0xffffffff:x}"),
+    3: ("TEMP_INVALID", lambda a: f"temp={a[0] / 100:.2f}"),
+    4: ("RELAY_ON", lambda a: f"gpio={a[0]}"),
+    5: ("RELAY_OFF", lambda a: f"gpio={a[0]}"),
+    6: ("CONTROL_POWER_OFF", lambda a: ""),
+    7: ("CONTROL_AUTO", lambda a: f"relay={'ON' if a[0] else 'OFF'} temp={a[1] / 100:.2f} setpoint={a[2] / 100:.2f}"),
+    8: ("POWER_SET", lambda a: "ON" if a[0] else "OFF"),
+    9: ("SETPOINT_SET", lambda a: f"setpoint={a[0] / 100:.2f}"),
+}
+
+
+def load(source):
+    if source.startswith("http://") or source.startswith("https://"):
+        with urllib.request.urlopen(source) as resp:
+            return resp.read()
+    with open(source, "rb") as f:
+        return f.read()
+
+
+def decode(data):
+    if len(data) < HEADER.size:
+        raise ValueError("dump is shorter than its header")
+    magic, event_size, ring_size, next_seq, _, now_us = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError(f"bad magic 0x{magic:08x}")
+    if event_size != EVENT.size:
+        raise ValueError(f"unexpected event size {event_size}")
+
+    now_lo = now_us & 0xffffffff
+    for offset in range(HEADER.size, len(data) - EVENT.size + 1, EVENT.size):
+        seq, ts, ev_id, _, a0, a1, a2 = EVENT.unpack_from(data, offset)
+        # Timestamps hold the lower 32 bits of esp_timer_get_time(), rebuild them relative to the dump time
+        abs_us = now_us - ((now_lo - ts) & 0xffffffff)
+        name, fmt = EVENTS.get(ev_id, ("UNKNOWN", None))
+        args = fmt((a0, a1, a2)) if fmt else f"{a0} {a1} {a2}"
+        yield f"{seq - 1:8d} {abs_us / 1e6:12.6f} {name} {args}".rstrip()
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__.strip())
+        sys.exit(1)
+    for line in decode(load(sys.argv[1])):
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
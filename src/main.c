@@ -3,37 +3,154 @@
 #include "esp_log.h"
 #include "config.h"
 #include "wifi_web.h"
+#include "coap_server.h"
+#include "mqtt_telemetry.h"
+#include "sample_log.h"
+#include "state_store.h"
+#include "boot_graph.h"
+#include "profiler.h"
+#include <string.h>
 
 static const char *TAG = "MAIN";
 static wifi_web_ctx_t wifi_web_ctx;
+static teapot_config_t teapot_config;
 
-void app_main(void) {
-    ESP_LOGI(TAG, "=== Smart Teapot Project ===");
-    
-    teapot_config_t config;
-    esp_err_t ret = config_init_from_generated(&config);
+// Restart the network services whose settings changed through /api/config
+static void services_config_changed(const teapot_config_t *config, uint32_t changed, void *arg) {
+    if (changed & CONFIG_FIELD_COAP) {
+        coap_server_stop();
+        if (config->coap_port != 0) {
+            esp_err_t ret = coap_server_start(&wifi_web_ctx, config->coap_port);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Failed to restart CoAP server: %s", esp_err_to_name(ret));
+            }
+        }
+    }
+    if (changed & CONFIG_FIELD_MQTT) {
+        mqtt_telemetry_stop();
+        if (strlen(config->mqtt.uri) > 0) {
+            esp_err_t ret = mqtt_telemetry_start(&wifi_web_ctx, &config->mqtt);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Failed to restart MQTT telemetry: %s", esp_err_to_name(ret));
+            }
+        }
+    }
+}
+
+static esp_err_t stage_config(void *arg) {
+    esp_err_t ret = config_load(&teapot_config);
     if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to load from generated config, using defaults");
-        config_init_default(&config);
+        ESP_LOGW(TAG, "Failed to load config (%s), using defaults", esp_err_to_name(ret));
+        config_init_default(&teapot_config);
     }
     
     ESP_LOGI(TAG, "Configuration:");
-    ESP_LOGI(TAG, "  Temp sensor GPIO: %d", config.gpio.temp_sensor_gpio);
-    ESP_LOGI(TAG, "  Relay GPIO: %d", config.gpio.relay_gpio);
-    ESP_LOGI(TAG, "  Default setpoint: %.1f°C", config.default_setpoint);
-    ESP_LOGI(TAG, "  WiFi SSID: %s", config.wifi.ssid);
-    ESP_LOGI(TAG, "  WiFi Password: %s", strlen(config.wifi.password) > 0 ? "***" : "(empty)");
+    ESP_LOGI(TAG, "  Temp sensor GPIO: %d", teapot_config.gpio.temp_sensor_gpio);
+    ESP_LOGI(TAG, "  Relay GPIO: %d", teapot_config.gpio.relay_gpio);
+    ESP_LOGI(TAG, "  Default setpoint: %.1f°C", teapot_config.default_setpoint);
+    ESP_LOGI(TAG, "  WiFi SSID: %s", teapot_config.wifi.ssid);
+    ESP_LOGI(TAG, "  WiFi Password: %s", strlen(teapot_config.wifi.password) > 0 ? "***" : "(empty)");
+    return ESP_OK;
+}
+
+static esp_err_t stage_state(void *arg) {
+    esp_err_t ret = wifi_web_init_ctx(&wifi_web_ctx, &teapot_config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
     
-    ESP_ERROR_CHECK(wifi_web_init(&wifi_web_ctx, &config));
+    // Resume power state and setpoint from before a power loss, ahead of the control loop
+    ret = state_store_restore(&wifi_web_ctx);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to restore saved state: %s", esp_err_to_name(ret));
+    }
+    ret = state_store_start(&wifi_web_ctx);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "State will not be saved: %s", esp_err_to_name(ret));
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stage_relay(void *arg) {
+    return wifi_web_init_relay(&wifi_web_ctx);
+}
+
+static esp_err_t stage_sensor(void *arg) {
+    return wifi_web_init_temp_sensor(&wifi_web_ctx);
+}
+
+static esp_err_t stage_wifi(void *arg) {
+    // The HTTP server is started from the AP start event
+    return wifi_web_init_wifi(&teapot_config);
+}
+
+static esp_err_t stage_sample_log(void *arg) {
+    return sample_log_init();
+}
+
+static esp_err_t stage_control(void *arg) {
+    return wifi_web_start_temp_sensor(&wifi_web_ctx);
+}
+
+static esp_err_t stage_services(void *arg) {
+    if (teapot_config.coap_port != 0) {
+        esp_err_t ret = coap_server_start(&wifi_web_ctx, teapot_config.coap_port);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to start CoAP server: %s", esp_err_to_name(ret));
+        }
+    }
     
-    esp_err_t temp_ret = wifi_web_start_temp_sensor(&wifi_web_ctx);
-    if (temp_ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to start temperature sensor: %s", esp_err_to_name(temp_ret));
-    } else {
-        ESP_LOGI(TAG, "Temperature sensor started");
+    if (strlen(teapot_config.mqtt.uri) > 0) {
+        esp_err_t ret = mqtt_telemetry_start(&wifi_web_ctx, &teapot_config.mqtt);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to start MQTT telemetry: %s", esp_err_to_name(ret));
+        }
     }
     
+    return config_add_observer(CONFIG_FIELD_COAP | CONFIG_FIELD_MQTT, services_config_changed, NULL);
+}
+
+static esp_err_t stage_profiler(void *arg) {
+    return profiler_start();
+}
+
+enum {
+    STAGE_CONFIG,
+    STAGE_STATE,
+    STAGE_RELAY,
+    STAGE_SENSOR,
+    STAGE_WIFI,
+    STAGE_SAMPLE_LOG,
+    STAGE_CONTROL,
+    STAGE_SERVICES,
+    STAGE_PROFILER
+};
+
+#define DEP(stage) BOOT_GRAPH_STAGE_BIT(STAGE_##stage)
+
+// Sensor enumeration overlaps with the WiFi start, and the control loop waits only for
+// relay, sensor and restored state, so the heater is controllable before the AP is up.
+// The sample log only scans its partition and is not on that path, and the profiler starts
+// right away so its first reports cover the boot.
+static const boot_stage_t boot_stages[] = {
+    [STAGE_CONFIG]     = { .name = "config", .fn = stage_config },
+    [STAGE_STATE]      = { .name = "state", .fn = stage_state, .deps = DEP(CONFIG) },
+    [STAGE_RELAY]      = { .name = "relay", .fn = stage_relay, .deps = DEP(STATE) },
+    [STAGE_SENSOR]     = { .name = "sensor", .fn = stage_sensor, .deps = DEP(STATE), .optional = true },
+    [STAGE_WIFI]       = { .name = "wifi", .fn = stage_wifi, .deps = DEP(STATE) },
+    [STAGE_SAMPLE_LOG] = { .name = "sample_log", .fn = stage_sample_log, .optional = true },
+    [STAGE_CONTROL]    = { .name = "control", .fn = stage_control, .deps = DEP(RELAY) | DEP(SENSOR),
+                           .optional = true, .ready = true },
+    [STAGE_SERVICES]   = { .name = "services", .fn = stage_services, .deps = DEP(WIFI), .optional = true },
+    [STAGE_PROFILER]   = { .name = "profiler", .fn = stage_profiler, .optional = true },
+};
+
+void app_main(void) {
+    ESP_LOGI(TAG, "=== Smart Teapot Project ===");
+    
+    ESP_ERROR_CHECK(boot_graph_run(boot_stages, sizeof(boot_stages) / sizeof(boot_stages[0])));
+    
     ESP_LOGI(TAG, "Smart Teapot initialized successfully");
     
     vTaskSuspend(NULL);
-}
\ No newline at end of file
+}
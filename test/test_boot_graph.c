@@ -0,0 +1,82 @@
+#include <unity.h>
+#include "boot_graph.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static esp_err_t stage_sleep(void *arg) {
+    vTaskDelay(pdMS_TO_TICKS(50));
+    return ESP_OK;
+}
+
+static esp_err_t stage_fail(void *arg) {
+    return ESP_ERR_NOT_FOUND;
+}
+
+static void test_boot_graph_orders_and_overlaps(void) {
+    // a -> {b, c} -> d: b and c run side by side
+    const boot_stage_t stages[] = {
+        { .name = "a", .fn = stage_sleep },
+        { .name = "b", .fn = stage_sleep, .deps = BOOT_GRAPH_STAGE_BIT(0) },
+        { .name = "c", .fn = stage_sleep, .deps = BOOT_GRAPH_STAGE_BIT(0) },
+        { .name = "d", .fn = stage_sleep, .deps = BOOT_GRAPH_STAGE_BIT(1) | BOOT_GRAPH_STAGE_BIT(2), .ready = true },
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, boot_graph_run(stages, 4));
+
+    boot_stage_record_t r[4];
+    for (size_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, boot_graph_get_record(i, &r[i]));
+        TEST_ASSERT_EQUAL(BOOT_STAGE_DONE, r[i].status);
+    }
+    TEST_ASSERT_TRUE(r[1].start_us >= r[0].end_us);
+    TEST_ASSERT_TRUE(r[2].start_us >= r[0].end_us);
+    TEST_ASSERT_TRUE(r[3].start_us >= r[1].end_us && r[3].start_us >= r[2].end_us);
+    TEST_ASSERT_TRUE(r[1].start_us < r[2].end_us && r[2].start_us < r[1].end_us);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, boot_graph_get_record(4, &r[0]));
+
+    char json[512];
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_OK, boot_graph_render_json(json, sizeof(json), &len));
+    TEST_ASSERT_EQUAL(strlen(json), len);
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"name\":\"d\",\"status\":\"done\",\"result\":\"ESP_OK\",\"deps\":[\"b\",\"c\"]"));
+    TEST_ASSERT_NULL(strstr(json, "\"ready_us\":-1"));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, boot_graph_render_json(json, 32, &len));
+}
+
+static void test_boot_graph_skips_dependents_of_failures(void) {
+    const boot_stage_t stages[] = {
+        { .name = "sensor", .fn = stage_fail, .optional = true },
+        { .name = "control", .fn = stage_sleep, .deps = BOOT_GRAPH_STAGE_BIT(0), .optional = true },
+        { .name = "wifi", .fn = stage_sleep },
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, boot_graph_run(stages, 3));
+
+    boot_stage_record_t rec;
+    boot_graph_get_record(0, &rec);
+    TEST_ASSERT_EQUAL(BOOT_STAGE_FAILED, rec.status);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, rec.result);
+    boot_graph_get_record(1, &rec);
+    TEST_ASSERT_EQUAL(BOOT_STAGE_SKIPPED, rec.status);
+    boot_graph_get_record(2, &rec);
+    TEST_ASSERT_EQUAL(BOOT_STAGE_DONE, rec.status);
+
+    // A required stage makes the whole run fail
+    const boot_stage_t required[] = {
+        { .name = "relay", .fn = stage_fail },
+    };
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, boot_graph_run(required, 1));
+}
+
+static void test_boot_graph_rejects_forward_deps(void) {
+    const boot_stage_t stages[] = {
+        { .name = "a", .fn = stage_sleep, .deps = BOOT_GRAPH_STAGE_BIT(1) },
+        { .name = "b", .fn = stage_sleep },
+    };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, boot_graph_run(stages, 2));
+}
+
+void run_boot_graph_tests(void) {
+    RUN_TEST(test_boot_graph_orders_and_overlaps);
+    RUN_TEST(test_boot_graph_skips_dependents_of_failures);
+    RUN_TEST(test_boot_graph_rejects_forward_deps);
+}
@@ -0,0 +1,58 @@
+#include <unity.h>
+#include "cborenc.h"
+#include <string.h>
+
+// Expected encodings are the examples from RFC 8949 Appendix A
+static void test_cborenc_integers(void) {
+    uint8_t buf[32];
+    cborenc_t enc;
+    cborenc_init(&enc, buf, sizeof(buf));
+    cborenc_uint(&enc, 0);
+    cborenc_uint(&enc, 23);
+    cborenc_uint(&enc, 24);
+    cborenc_uint(&enc, 1000);
+    cborenc_uint(&enc, 1000000);
+    cborenc_int(&enc, -1);
+    cborenc_int(&enc, -1000);
+
+    const uint8_t expected[] = {
+        0x00, 0x17, 0x18, 0x18, 0x19, 0x03, 0xe8, 0x1a, 0x00, 0x0f, 0x42, 0x40, 0x20, 0x39, 0x03, 0xe7
+    };
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_OK, cborenc_finish(&enc, &len));
+    TEST_ASSERT_EQUAL(sizeof(expected), len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+static void test_cborenc_map(void) {
+    uint8_t buf[32];
+    cborenc_t enc;
+    cborenc_init(&enc, buf, sizeof(buf));
+    cborenc_map(&enc, 2);
+    cborenc_cstr(&enc, "a");
+    cborenc_bool(&enc, true);
+    cborenc_cstr(&enc, "b");
+    cborenc_float(&enc, 1.5f);
+
+    const uint8_t expected[] = { 0xa2, 0x61, 0x61, 0xf5, 0x61, 0x62, 0xfa, 0x3f, 0xc0, 0x00, 0x00 };
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_OK, cborenc_finish(&enc, &len));
+    TEST_ASSERT_EQUAL(sizeof(expected), len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+static void test_cborenc_overflow(void) {
+    uint8_t buf[4];
+    cborenc_t enc;
+    cborenc_init(&enc, buf, sizeof(buf));
+    cborenc_cstr(&enc, "teapot");
+
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, cborenc_finish(&enc, &len));
+}
+
+void run_cborenc_tests(void) {
+    RUN_TEST(test_cborenc_integers);
+    RUN_TEST(test_cborenc_map);
+    RUN_TEST(test_cborenc_overflow);
+}
@@ -0,0 +1,76 @@
+#include <unity.h>
+#include "coap_msg.h"
+#include <string.h>
+
+static void test_coap_msg_parse_request(void) {
+    // CON GET /state, token 0xAB, Observe=0, Block2 num=1 szx=2, payload "x"
+    const uint8_t datagram[] = {
+        0x41, 0x01, 0x12, 0x34, 0xAB,
+        0x60,                                   // Observe (6), empty value
+        0x55, 's', 't', 'a', 't', 'e',          // Uri-Path (11)
+        0xC1, 0x12,                             // Block2 (23)
+        0xFF, 'x'
+    };
+    coap_msg_t msg;
+    TEST_ASSERT_EQUAL(ESP_OK, coap_msg_parse(datagram, sizeof(datagram), &msg));
+    TEST_ASSERT_EQUAL(COAP_TYPE_CON, msg.type);
+    TEST_ASSERT_EQUAL(COAP_METHOD_GET, msg.code);
+    TEST_ASSERT_EQUAL(0x1234, msg.message_id);
+    TEST_ASSERT_EQUAL(1, msg.token_len);
+    TEST_ASSERT_EQUAL(0xAB, msg.token[0]);
+    TEST_ASSERT_EQUAL(3, msg.option_count);
+
+    int index = coap_msg_find_option(&msg, COAP_OPTION_URI_PATH, 0);
+    TEST_ASSERT_EQUAL(1, index);
+    TEST_ASSERT_EQUAL(5, msg.options[index].len);
+    TEST_ASSERT_EQUAL(0, coap_option_uint(&msg.options[0]));
+    TEST_ASSERT_EQUAL(0x12, coap_option_uint(&msg.options[coap_msg_find_option(&msg, COAP_OPTION_BLOCK2, 0)]));
+    TEST_ASSERT_EQUAL(1, msg.payload_len);
+    TEST_ASSERT_EQUAL('x', msg.payload[0]);
+}
+
+static void test_coap_msg_rejects_malformed(void) {
+    coap_msg_t msg;
+    const uint8_t bad_version[] = { 0x81, 0x01, 0x00, 0x01, 0x00 };
+    const uint8_t truncated_option[] = { 0x40, 0x01, 0x00, 0x01, 0xB5, 's' };
+    const uint8_t empty_payload[] = { 0x40, 0x01, 0x00, 0x01, 0xFF };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, coap_msg_parse(bad_version, sizeof(bad_version), &msg));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, coap_msg_parse(truncated_option, sizeof(truncated_option), &msg));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, coap_msg_parse(empty_payload, sizeof(empty_payload), &msg));
+}
+
+static void test_coap_writer_round_trip(void) {
+    uint8_t buf[64];
+    const uint8_t token[] = { 0x01, 0x02 };
+    coap_writer_t w;
+    coap_writer_init(&w, buf, sizeof(buf), COAP_TYPE_ACK, COAP_CODE_CONTENT, 0xBEEF, token, sizeof(token));
+    coap_writer_option_uint(&w, COAP_OPTION_OBSERVE, 300);
+    coap_writer_option_uint(&w, COAP_OPTION_CONTENT_FORMAT, COAP_FORMAT_JSON);
+    coap_writer_option_uint(&w, COAP_OPTION_SIZE2, 0);
+    coap_writer_payload(&w, "{}", 2);
+
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_OK, coap_writer_finish(&w, &len));
+
+    coap_msg_t msg;
+    TEST_ASSERT_EQUAL(ESP_OK, coap_msg_parse(buf, len, &msg));
+    TEST_ASSERT_EQUAL(COAP_TYPE_ACK, msg.type);
+    TEST_ASSERT_EQUAL(0xBEEF, msg.message_id);
+    TEST_ASSERT_EQUAL(3, msg.option_count);
+    TEST_ASSERT_EQUAL(300, coap_option_uint(&msg.options[0]));
+    TEST_ASSERT_EQUAL(COAP_OPTION_SIZE2, msg.options[2].number);
+    TEST_ASSERT_EQUAL(0, msg.options[2].len);
+    TEST_ASSERT_EQUAL(2, msg.payload_len);
+
+    // Options must be written in ascending order
+    coap_writer_init(&w, buf, sizeof(buf), COAP_TYPE_NON, COAP_CODE_CONTENT, 1, NULL, 0);
+    coap_writer_option_uint(&w, COAP_OPTION_CONTENT_FORMAT, COAP_FORMAT_JSON);
+    coap_writer_option_uint(&w, COAP_OPTION_OBSERVE, 1);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, coap_writer_finish(&w, &len));
+}
+
+void run_coap_msg_tests(void) {
+    RUN_TEST(test_coap_msg_parse_request);
+    RUN_TEST(test_coap_msg_rejects_malformed);
+    RUN_TEST(test_coap_writer_round_trip);
+}
@@ -2,6 +2,10 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "config.h"
+#include "config_image.h"
+#include "esp_rom_crc.h"
+#include "esp_partition.h"
+#include <stdbool.h>
 #include <string.h>
 
 static void test_init_default(void) {
@@ -191,6 +195,18 @@ static void test_set_default_setpoint(void) {
     TEST_ASSERT_FLOAT_WITHIN(0.1f, new_setpoint, config.default_setpoint);
 }
 
+static void test_set_coap_port(void) {
+    teapot_config_t config;
+    config_init_default(&config);
+    TEST_ASSERT_EQUAL(ESP_OK, config_set_coap_port(&config, 0));
+    TEST_ASSERT_EQUAL(0, config.coap_port);
+    TEST_ASSERT_EQUAL(ESP_OK, config_set_coap_port(&config, 65535));
+    TEST_ASSERT_EQUAL(65535, config.coap_port);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_set_coap_port(&config, -1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_set_coap_port(&config, 65536));
+    TEST_ASSERT_EQUAL(65535, config.coap_port);
+}
+
 static void test_set_default_setpoint_invalid(void) {
     teapot_config_t config;
     config_init_default(&config);
@@ -218,6 +234,224 @@ static void test_gpio_boundaries(void) {
     TEST_ASSERT_EQUAL(ESP_OK, ret);
 }
 
+static void test_validate_mqtt(void) {
+    teapot_config_t config;
+    config_init_default(&config);
+    TEST_ASSERT_EQUAL_STRING("", config.mqtt.uri);
+
+    strcpy(config.mqtt.uri, "mqtt://192.168.1.10");
+    TEST_ASSERT_EQUAL(ESP_OK, config_validate(&config));
+
+    strcpy(config.mqtt.topic, "teapot/+");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_validate(&config));
+    strcpy(config.mqtt.topic, "teapot/");
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_validate(&config));
+    strcpy(config.mqtt.topic, "home/kitchen/teapot");
+    TEST_ASSERT_EQUAL(ESP_OK, config_validate(&config));
+
+    config.mqtt.batch_window_s = 0;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_validate(&config));
+
+    // Settings of a disabled client are not checked
+    config.mqtt.uri[0] = '\0';
+    TEST_ASSERT_EQUAL(ESP_OK, config_validate(&config));
+}
+
+static void test_save_rejects_invalid(void) {
+    teapot_config_t config;
+    config_init_default(&config);
+    config.default_setpoint = CONFIG_TEMP_MAX + 1.0f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_save(&config));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_save(NULL));
+}
+
+static void test_save_flush_load_roundtrip(void) {
+    teapot_config_t config;
+    TEST_ASSERT_EQUAL(ESP_OK, config_erase_stored());
+    TEST_ASSERT_EQUAL(ESP_OK, config_load(&config));
+    teapot_config_t base = config;
+
+    // A burst of edits: only the last one reaches flash
+    TEST_ASSERT_EQUAL(ESP_OK, config_set_default_setpoint(&config, 70.0f));
+    TEST_ASSERT_EQUAL(ESP_OK, config_save(&config));
+    TEST_ASSERT_EQUAL(ESP_OK, config_set_default_setpoint(&config, 72.5f));
+    strcpy(config.mqtt.topic, "kitchen/teapot");
+    config.coap_port = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, config_save(&config));
+    TEST_ASSERT_EQUAL(ESP_OK, config_flush());
+
+    teapot_config_t loaded;
+    TEST_ASSERT_EQUAL(ESP_OK, config_load(&loaded));
+    TEST_ASSERT_EQUAL_FLOAT(72.5f, loaded.default_setpoint);
+    TEST_ASSERT_EQUAL_STRING("kitchen/teapot", loaded.mqtt.topic);
+    TEST_ASSERT_EQUAL(0, loaded.coap_port);
+    TEST_ASSERT_EQUAL_STRING(config.wifi.ssid, loaded.wifi.ssid);
+
+    // Without stored values the image or generated config applies again
+    TEST_ASSERT_EQUAL(ESP_OK, config_erase_stored());
+    TEST_ASSERT_EQUAL(ESP_OK, config_load(&loaded));
+    TEST_ASSERT_EQUAL_FLOAT(base.default_setpoint, loaded.default_setpoint);
+    TEST_ASSERT_EQUAL(base.coap_port, loaded.coap_port);
+}
+
+static void build_image(config_image_t *image) {
+    memset(image, 0, sizeof(*image));
+    strcpy(image->payload.wifi_ssid, "Kitchen");
+    strcpy(image->payload.wifi_password, "secret123");
+    image->payload.relay_gpio = 4;
+    image->payload.temp_sensor_gpio = 5;
+    image->payload.default_setpoint_centi = 7250;
+    image->payload.coap_port = 5683;
+    strcpy(image->payload.mqtt_uri, "mqtt://broker");
+    strcpy(image->payload.mqtt_topic, "kitchen/teapot");
+    image->payload.mqtt_batch_window_s = 30;
+    image->header.magic = CONFIG_IMAGE_MAGIC;
+    image->header.version = CONFIG_IMAGE_VERSION;
+    image->header.length = sizeof(image->payload);
+    image->header.crc32 = esp_rom_crc32_le(0, (const uint8_t *)&image->payload, sizeof(image->payload));
+}
+
+static void test_config_image_decode(void) {
+    config_image_t image;
+    teapot_config_t config;
+    build_image(&image);
+    TEST_ASSERT_EQUAL(ESP_OK, config_image_decode(&image, sizeof(image), &config));
+    TEST_ASSERT_EQUAL_STRING("Kitchen", config.wifi.ssid);
+    TEST_ASSERT_EQUAL(4, config.gpio.relay_gpio);
+    TEST_ASSERT_EQUAL(5, config.gpio.temp_sensor_gpio);
+    TEST_ASSERT_EQUAL_FLOAT(72.5f, config.default_setpoint);
+    TEST_ASSERT_EQUAL_STRING("kitchen/teapot", config.mqtt.topic);
+    TEST_ASSERT_EQUAL(30, config.mqtt.batch_window_s);
+    TEST_ASSERT_EQUAL(ESP_OK, config_validate(&config));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, config_image_decode(&image, sizeof(image) - 1, &config));
+    image.payload.relay_gpio = 6;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_CRC, config_image_decode(&image, sizeof(image), &config));
+
+    build_image(&image);
+    image.header.version = CONFIG_IMAGE_VERSION + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, config_image_decode(&image, sizeof(image), &config));
+
+    // Erased flash
+    memset(&image, 0xFF, sizeof(image));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, config_image_decode(&image, sizeof(image), &config));
+}
+
+static void write_config_partition(const esp_partition_t *part, const void *data, size_t size) {
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(part, 0, part->size));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_write(part, 0, data, size));
+}
+
+static void test_stored_config_dropped_with_new_image(void) {
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           CONFIG_IMAGE_PARTITION_LABEL);
+    if (part == NULL) {
+        TEST_IGNORE_MESSAGE("No config partition");
+    }
+    static config_image_t original;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_read(part, 0, &original, sizeof(original)));
+
+    config_image_t image;
+    build_image(&image);
+    write_config_partition(part, &image, sizeof(image));
+    TEST_ASSERT_EQUAL(ESP_OK, config_erase_stored());
+
+    // An edit made on the first image survives a reboot with the same image
+    teapot_config_t edited, same_image, new_image, after;
+    TEST_ASSERT_EQUAL(ESP_OK, config_load(&edited));
+    TEST_ASSERT_EQUAL(ESP_OK, config_set_default_setpoint(&edited, 60.0f));
+    TEST_ASSERT_EQUAL(ESP_OK, config_save(&edited));
+    TEST_ASSERT_EQUAL(ESP_OK, config_flush());
+    esp_err_t same_ret = config_load(&same_image);
+
+    // Re-provisioning: the new image wins over the stored edit, also on later boots
+    strcpy(image.payload.wifi_ssid, "Pantry");
+    image.header.crc32 = esp_rom_crc32_le(0, (const uint8_t *)&image.payload, sizeof(image.payload));
+    write_config_partition(part, &image, sizeof(image));
+    esp_err_t new_ret = config_load(&new_image);
+    esp_err_t after_ret = config_load(&after);
+
+    // Put the unit's own image back before anything can fail
+    write_config_partition(part, &original, sizeof(original));
+    config_erase_stored();
+
+    TEST_ASSERT_EQUAL(ESP_OK, same_ret);
+    TEST_ASSERT_EQUAL_STRING("Kitchen", same_image.wifi.ssid);
+    TEST_ASSERT_EQUAL_FLOAT(60.0f, same_image.default_setpoint);
+    TEST_ASSERT_EQUAL(ESP_OK, new_ret);
+    TEST_ASSERT_EQUAL_STRING("Pantry", new_image.wifi.ssid);
+    TEST_ASSERT_EQUAL_FLOAT(72.5f, new_image.default_setpoint);
+    TEST_ASSERT_EQUAL(ESP_OK, after_ret);
+    TEST_ASSERT_EQUAL_FLOAT(72.5f, after.default_setpoint);
+}
+
+static void test_config_diff(void) {
+    teapot_config_t a, b;
+    config_init_default(&a);
+    b = a;
+    TEST_ASSERT_EQUAL(0, config_diff(&a, &b));
+
+    b.gpio.relay_gpio = 7;
+    strcpy(b.mqtt.topic, "kitchen");
+    TEST_ASSERT_EQUAL(CONFIG_FIELD_RELAY_GPIO | CONFIG_FIELD_MQTT, config_diff(&a, &b));
+    b = a;
+    strcpy(b.wifi.password, "new-secret");
+    TEST_ASSERT_EQUAL(CONFIG_FIELD_WIFI, config_diff(&a, &b));
+}
+
+static uint32_t s_observed_changes;
+static int s_observed_relay_gpio;
+
+static void record_change(const teapot_config_t *config, uint32_t changed, void *arg) {
+    s_observed_changes |= changed;
+    s_observed_relay_gpio = config->gpio.relay_gpio;
+}
+
+static void test_config_apply_notifies_observers(void) {
+    static bool registered = false;
+    if (!registered) {
+        TEST_ASSERT_EQUAL(ESP_OK, config_add_observer(CONFIG_FIELD_RELAY_GPIO | CONFIG_FIELD_COAP,
+                                                      record_change, NULL));
+        registered = true;
+    }
+
+    teapot_config_t running, updated;
+    config_init_default(&running);
+    updated = running;
+    updated.gpio.relay_gpio = 7;
+    updated.default_setpoint = 60.0f;
+
+    s_observed_changes = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, config_apply(&running, &updated));
+    TEST_ASSERT_EQUAL(7, running.gpio.relay_gpio);
+    // Only the fields the observer subscribed to are reported
+    TEST_ASSERT_EQUAL(CONFIG_FIELD_RELAY_GPIO, s_observed_changes);
+    TEST_ASSERT_EQUAL(7, s_observed_relay_gpio);
+
+    // An invalid config is neither applied nor announced
+    s_observed_changes = 0;
+    updated.gpio.relay_gpio = updated.gpio.temp_sensor_gpio;
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, config_apply(&running, &updated));
+    TEST_ASSERT_EQUAL(7, running.gpio.relay_gpio);
+    TEST_ASSERT_EQUAL(0, s_observed_changes);
+}
+
+static void test_config_snapshot(void) {
+    teapot_config_t running, updated, copy;
+    config_init_default(&running);
+    updated = running;
+    TEST_ASSERT_EQUAL(ESP_OK, config_set_wifi_ssid(&updated, "Kitchen"));
+    TEST_ASSERT_EQUAL(ESP_OK, config_apply(&running, &updated));
+
+    memset(&copy, 0, sizeof(copy));
+    TEST_ASSERT_EQUAL(ESP_OK, config_snapshot(&running, &copy));
+    TEST_ASSERT_EQUAL_STRING("Kitchen", copy.wifi.ssid);
+    TEST_ASSERT_EQUAL(0, config_diff(&running, &copy));
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_snapshot(NULL, &copy));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, config_snapshot(&running, NULL));
+}
+
 static void test_config_module_loaded(void) {
     TEST_ASSERT_TRUE(1);
 }
@@ -247,6 +481,15 @@ void run_config_tests(void) {
     RUN_TEST(test_set_temp_sensor_gpio);
     RUN_TEST(test_set_default_setpoint);
     RUN_TEST(test_set_default_setpoint_invalid);
+    RUN_TEST(test_set_coap_port);
     RUN_TEST(test_setpoint_boundaries);
     RUN_TEST(test_gpio_boundaries);
+    RUN_TEST(test_validate_mqtt);
+    RUN_TEST(test_save_rejects_invalid);
+    RUN_TEST(test_save_flush_load_roundtrip);
+    RUN_TEST(test_config_image_decode);
+    RUN_TEST(test_stored_config_dropped_with_new_image);
+    RUN_TEST(test_config_diff);
+    RUN_TEST(test_config_apply_notifies_observers);
+    RUN_TEST(test_config_snapshot);
 }
\ No newline at end of file
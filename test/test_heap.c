@@ -0,0 +1,176 @@
+#include <unity.h>
+#include "sdkconfig.h"
+
+#if CONFIG_HEAP_TRACING_STANDALONE
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_trace.h"
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+#include "wifi_web.h"
+#include "config.h"
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define HEAP_TEST_ITERATIONS 200
+#define HEAP_TRACE_RECORDS 64
+// Covers delayed ACKs, so no segment is still waiting in a TCP queue when tracing stops
+#define HEAP_TEST_SETTLE_MS 500
+
+static heap_trace_record_t trace_records[HEAP_TRACE_RECORDS];
+static wifi_web_ctx_t ctx;
+static teapot_config_t config;
+
+static void heap_trace_begin(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_init_standalone(trace_records, HEAP_TRACE_RECORDS));
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_start(HEAP_TRACE_LEAKS));
+}
+
+// In leak mode a record is dropped when its block is freed, so whatever is left was
+// allocated during the run and is still held
+static void heap_trace_assert_flat(void) {
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_stop());
+    heap_trace_summary_t summary;
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_summary(&summary));
+    if (summary.count != 0) {
+        heap_trace_dump();
+    }
+    TEST_ASSERT_FALSE(summary.has_overflowed);
+    TEST_ASSERT_EQUAL_UINT32(0, summary.count);
+}
+
+static void test_heap_control_loop_is_flat(void) {
+    config_init_default(&config);
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_init_ctx(&ctx, &config));
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_init_relay(&ctx));
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_set_setpoint(&ctx, 50.0f));
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_set_power(&ctx, true));
+
+    // The first samples switch the relay both ways, so lazily set up state exists before tracing
+    wifi_web_process_sample(&ctx, 40.0f);
+    wifi_web_process_sample(&ctx, 60.0f);
+
+    // Failures are checked after the trace is stopped, a failed assertion would leave it running
+    esp_err_t ret = ESP_OK;
+    heap_trace_begin();
+    for (int i = 0; i < HEAP_TEST_ITERATIONS && ret == ESP_OK; i++) {
+        ret = wifi_web_process_sample(&ctx, (i & 1) ? 60.0f : 40.0f);
+    }
+    heap_trace_assert_flat();
+    TEST_ASSERT_EQUAL(ESP_OK, ret);
+
+    wifi_web_stop(&ctx);
+}
+
+// Send one request and read the whole response; returns the status code or -1
+static int http_exchange(int sock, const char *request) {
+    size_t request_len = strlen(request);
+    if (send(sock, request, request_len, 0) != (ssize_t)request_len) {
+        return -1;
+    }
+
+    char buf[512];
+    size_t len = 0;
+    char *body = NULL;
+    while (body == NULL) {
+        ssize_t ret = recv(sock, buf + len, sizeof(buf) - 1 - len, 0);
+        if (ret <= 0) {
+            return -1;
+        }
+        len += ret;
+        buf[len] = '\0';
+        body = strstr(buf, "\r\n\r\n");
+        if (body == NULL && len == sizeof(buf) - 1) {
+            return -1;
+        }
+    }
+    body += 4;
+    int status = atoi(buf + 9);
+
+    size_t content_len = 0;
+    for (char *line = strstr(buf, "\r\n"); line != NULL && line + 2 < body; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+            content_len = strtoul(line + 17, NULL, 10);
+        }
+    }
+    size_t received = len - (size_t)(body - buf);
+    while (received < content_len) {
+        ssize_t ret = recv(sock, buf, sizeof(buf), 0);
+        if (ret <= 0) {
+            return -1;
+        }
+        received += ret;
+    }
+    return status;
+}
+
+static void test_heap_http_requests_are_flat(void) {
+    static const char get_request[] =
+        "GET /api/state HTTP/1.1\r\nHost: teapot\r\n\r\n";
+    static const char patch_format[] =
+        "PATCH /api/state HTTP/1.1\r\nHost: teapot\r\nContent-Type: application/json\r\n"
+        "Content-Length: %d\r\n\r\n%s";
+
+    esp_netif_init();
+    config_init_default(&config);
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_init_ctx(&ctx, &config));
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_start(&ctx));
+    TEST_ASSERT_NOT_NULL(ctx.server);
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    TEST_ASSERT_TRUE(sock >= 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(80),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    TEST_ASSERT_EQUAL(0, connect(sock, (struct sockaddr *)&addr, sizeof(addr)));
+
+    char patch[2][160];
+    const char *bodies[2] = {"{\"setpoint_temp\":55}", "{\"setpoint_temp\":60}"};
+    for (int i = 0; i < 2; i++) {
+        snprintf(patch[i], sizeof(patch[i]), patch_format, (int)strlen(bodies[i]), bodies[i]);
+    }
+
+    // One keep-alive connection: the session and the per-route metric series are set up
+    // by the first requests, the traced ones only reuse them
+    TEST_ASSERT_EQUAL(200, http_exchange(sock, get_request));
+    TEST_ASSERT_EQUAL(200, http_exchange(sock, patch[0]));
+    vTaskDelay(pdMS_TO_TICKS(HEAP_TEST_SETTLE_MS));
+
+    int status = 200;
+    heap_trace_begin();
+    for (int i = 0; i < HEAP_TEST_ITERATIONS && status == 200; i++) {
+        status = http_exchange(sock, get_request);
+        if (status == 200) {
+            status = http_exchange(sock, patch[(i + 1) & 1]);
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(HEAP_TEST_SETTLE_MS));
+    heap_trace_assert_flat();
+    TEST_ASSERT_EQUAL(200, status);
+
+    close(sock);
+    wifi_web_stop(&ctx);
+}
+
+void run_heap_tests(void) {
+    RUN_TEST(test_heap_control_loop_is_flat);
+    RUN_TEST(test_heap_http_requests_are_flat);
+}
+
+#else
+
+static void test_heap_tracing_disabled(void) {
+    TEST_IGNORE_MESSAGE("Heap tracing is off, run pio test -e esp32c3_heap_trace");
+}
+
+void run_heap_tests(void) {
+    RUN_TEST(test_heap_tracing_disabled);
+}
+
+#endif // CONFIG_HEAP_TRACING_STANDALONE
@@ -0,0 +1,111 @@
+#include <unity.h>
+#include "history.h"
+#include <string.h>
+
+#define MS(ms) ((int64_t)(ms) * 1000)
+
+static void test_history_aggregates_slot(void) {
+    history_reset();
+    history_record(MS(1000), 20.0f, true);
+    history_record(MS(3000), 22.5f, false);
+    history_record(MS(4999), 21.0f, false);
+
+    // The slot is only stored once a sample lands in the next one
+    uint32_t first, next;
+    TEST_ASSERT_EQUAL(ESP_OK, history_range(0, &first, &next));
+    TEST_ASSERT_EQUAL(first, next);
+
+    history_record(MS(5000), 30.0f, true);
+    TEST_ASSERT_EQUAL(ESP_OK, history_range(0, &first, &next));
+    TEST_ASSERT_EQUAL(0, first);
+    TEST_ASSERT_EQUAL(1, next);
+
+    history_point_t point;
+    TEST_ASSERT_EQUAL(1, history_read(0, 0, &point, 1));
+    TEST_ASSERT_EQUAL(2116, point.avg_centi);
+    TEST_ASSERT_EQUAL(2000, point.min_centi);
+    TEST_ASSERT_EQUAL(2250, point.max_centi);
+    TEST_ASSERT_EQUAL(33, point.relay_pct);
+    TEST_ASSERT_EQUAL(3, point.samples);
+}
+
+static void test_history_fills_gaps(void) {
+    history_reset();
+    history_record(MS(5000), 20.0f, false);
+    // Sensor silent for two 5 s slots
+    history_record(MS(20000), 21.0f, false);
+    history_record(MS(25000), 22.0f, false);
+
+    uint32_t first, next;
+    history_range(0, &first, &next);
+    TEST_ASSERT_EQUAL(1, first);
+    TEST_ASSERT_EQUAL(5, next);
+
+    history_point_t points[8];
+    TEST_ASSERT_EQUAL(4, history_read(0, first, points, 8));
+    TEST_ASSERT_EQUAL(1, points[0].samples);
+    TEST_ASSERT_EQUAL(0, points[1].samples);
+    TEST_ASSERT_EQUAL(0, points[2].samples);
+    TEST_ASSERT_EQUAL(2100, points[3].avg_centi);
+}
+
+static void test_history_tiers_roll_up(void) {
+    history_reset();
+    // One sample every 2.5 s for 2 minutes, then one to close the second minute
+    for (int i = 0; i < 48; i++) {
+        history_record(MS(i * 2500), (float)i, i % 2 == 0);
+    }
+    history_record(MS(120000), 0.0f, false);
+
+    uint32_t first, next;
+    history_range(1, &first, &next);
+    TEST_ASSERT_EQUAL(0, first);
+    TEST_ASSERT_EQUAL(2, next);
+
+    history_point_t points[2];
+    TEST_ASSERT_EQUAL(2, history_read(1, 0, points, 2));
+    TEST_ASSERT_EQUAL(24, points[0].samples);
+    TEST_ASSERT_EQUAL(0, points[0].min_centi);
+    TEST_ASSERT_EQUAL(2300, points[0].max_centi);
+    TEST_ASSERT_EQUAL(1150, points[0].avg_centi);
+    TEST_ASSERT_EQUAL(50, points[0].relay_pct);
+    TEST_ASSERT_EQUAL(2400, points[1].min_centi);
+
+    // The 10 min tier has not closed a slot yet
+    history_range(2, &first, &next);
+    TEST_ASSERT_EQUAL(first, next);
+}
+
+static void test_history_ring_keeps_newest(void) {
+    history_reset();
+    uint32_t period_ms;
+    uint16_t capacity;
+    TEST_ASSERT_EQUAL(ESP_OK, history_tier_info(0, &period_ms, &capacity));
+
+    for (uint32_t slot = 0; slot <= capacity + 10u; slot++) {
+        history_record(MS((int64_t)slot * period_ms), (float)slot, false);
+    }
+
+    uint32_t first, next;
+    history_range(0, &first, &next);
+    TEST_ASSERT_EQUAL(capacity + 10u, next);
+    TEST_ASSERT_EQUAL(10, first);
+
+    // Overwritten slots read back as empty, so indexes still map to slots
+    history_point_t points[3];
+    TEST_ASSERT_EQUAL(3, history_read(0, 8, points, 3));
+    TEST_ASSERT_EQUAL(0, points[0].samples);
+    TEST_ASSERT_EQUAL(0, points[1].samples);
+    TEST_ASSERT_EQUAL(1000, points[2].avg_centi);
+
+    TEST_ASSERT_EQUAL(0, history_read(0, next, points, 3));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, history_range(HISTORY_TIER_COUNT, &first, &next));
+}
+
+void run_history_tests(void) {
+    RUN_TEST(test_history_aggregates_slot);
+    RUN_TEST(test_history_fills_gaps);
+    RUN_TEST(test_history_tiers_roll_up);
+    RUN_TEST(test_history_ring_keeps_newest);
+    history_reset();
+}
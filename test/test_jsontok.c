@@ -0,0 +1,103 @@
+#include <unity.h>
+#include "jsontok.h"
+#include <string.h>
+
+#define MAX_TOKENS 16
+
+static int parse(const char *json, jsontok_t *tokens) {
+    int count = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, jsontok_parse(json, strlen(json), tokens, MAX_TOKENS, &count));
+    return count;
+}
+
+static void test_jsontok_reads_members(void) {
+    const char *json = "{\"is_on\": true, \"temperature\": 72.5, \"count\": -3, \"name\": \"tea\\\"pot\"}";
+    jsontok_t tokens[MAX_TOKENS];
+    int count = parse(json, tokens);
+    TEST_ASSERT_EQUAL(9, count);
+    TEST_ASSERT_EQUAL(JSONTOK_OBJECT, tokens[0].type);
+    TEST_ASSERT_EQUAL(4, tokens[0].size);
+
+    bool is_on = false;
+    float temp = 0;
+    int n = 0;
+    char name[16];
+    TEST_ASSERT_EQUAL(ESP_OK, jsontok_get_bool(json, tokens, count, "is_on", &is_on));
+    TEST_ASSERT_TRUE(is_on);
+    TEST_ASSERT_EQUAL(ESP_OK, jsontok_get_float(json, tokens, count, "temperature", &temp));
+    TEST_ASSERT_EQUAL_FLOAT(72.5f, temp);
+    TEST_ASSERT_EQUAL(ESP_OK, jsontok_get_int(json, tokens, count, "count", &n));
+    TEST_ASSERT_EQUAL(-3, n);
+    TEST_ASSERT_EQUAL(ESP_OK, jsontok_get_string(json, tokens, count, "name", name, sizeof(name)));
+    TEST_ASSERT_EQUAL_STRING("tea\"pot", name);
+}
+
+static void test_jsontok_type_mismatch_and_missing(void) {
+    const char *json = "{\"is_on\":1,\"temperature\":\"hot\",\"nested\":{\"x\":true}}";
+    jsontok_t tokens[MAX_TOKENS];
+    int count = parse(json, tokens);
+
+    bool b;
+    float f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jsontok_get_bool(json, tokens, count, "is_on", &b));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jsontok_get_float(json, tokens, count, "temperature", &f));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, jsontok_get_bool(json, tokens, count, "power", &b));
+    // Only members of the root object are looked up
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, jsontok_get_bool(json, tokens, count, "x", &b));
+}
+
+static void test_jsontok_rejects_malformed(void) {
+    const char *bad[] = {
+        "", "{", "{\"a\":}", "{\"a\" 1}", "{1:2}", "{\"a\":1]", "[1,2}", "{\"a\":1} {}", "{\"a\":\"x\\q\"}", "{\"a\":\"open}",
+    };
+    jsontok_t tokens[MAX_TOKENS];
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        int count;
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, jsontok_parse(bad[i], strlen(bad[i]), tokens, MAX_TOKENS, &count), bad[i]);
+    }
+
+    // Numbers must span the whole token
+    const char *json = "{\"t\":12abc}";
+    int count = parse(json, tokens);
+    float f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jsontok_get_float(json, tokens, count, "t", &f));
+}
+
+static void test_jsontok_checks_separators(void) {
+    const char *bad[] = {
+        "{\"a\":1 \"b\":2}", "{\"a\":1,}", "[1,,2]", "{,}", "{\"a\" \"b\"}", "[,1]", "[1 2]", "{\"a\"::1}", "1,",
+    };
+    jsontok_t tokens[MAX_TOKENS];
+    int count;
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, jsontok_parse(bad[i], strlen(bad[i]), tokens, MAX_TOKENS, &count), bad[i]);
+    }
+
+    const char *good[] = {"{}", "[]", "{\"a\":[1,{\"b\":[]}],\"c\":{}}", " [ 1 , \"x\" ] "};
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, jsontok_parse(good[i], strlen(good[i]), tokens, MAX_TOKENS, &count), good[i]);
+    }
+}
+
+static void test_jsontok_rejects_nul_escape(void) {
+    const char *json = "{\"name\":\"tea\\u0000pot\"}";
+    jsontok_t tokens[MAX_TOKENS];
+    int count;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jsontok_parse(json, strlen(json), tokens, MAX_TOKENS, &count));
+}
+
+static void test_jsontok_token_limit(void) {
+    const char *json = "[1,2,3,4,5]";
+    jsontok_t tokens[4];
+    int count;
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, jsontok_parse(json, strlen(json), tokens, 4, &count));
+}
+
+void run_jsontok_tests(void) {
+    RUN_TEST(test_jsontok_reads_members);
+    RUN_TEST(test_jsontok_type_mismatch_and_missing);
+    RUN_TEST(test_jsontok_rejects_malformed);
+    RUN_TEST(test_jsontok_checks_separators);
+    RUN_TEST(test_jsontok_rejects_nul_escape);
+    RUN_TEST(test_jsontok_token_limit);
+}
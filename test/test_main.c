@@ -5,6 +5,19 @@
 
 extern void run_config_tests(void);
 extern void run_wifi_web_tests(void);
+extern void run_trace_tests(void);
+extern void run_jsontok_tests(void);
+extern void run_cborenc_tests(void);
+extern void run_coap_msg_tests(void);
+extern void run_telemetry_batch_tests(void);
+extern void run_history_tests(void);
+extern void run_sample_log_codec_tests(void);
+extern void run_state_store_tests(void);
+extern void run_boot_graph_tests(void);
+extern void run_web_storage_tests(void);
+extern void run_metrics_tests(void);
+extern void run_profiler_tests(void);
+extern void run_heap_tests(void);
 
 void setUp(void) {
     // Set httpd log level to WARN to suppress "error in listen" messages
@@ -20,6 +33,19 @@ static void run_all_tests(void) {
     
     run_config_tests();
     run_wifi_web_tests();
+    run_trace_tests();
+    run_jsontok_tests();
+    run_cborenc_tests();
+    run_coap_msg_tests();
+    run_telemetry_batch_tests();
+    run_history_tests();
+    run_sample_log_codec_tests();
+    run_state_store_tests();
+    run_boot_graph_tests();
+    run_web_storage_tests();
+    run_metrics_tests();
+    run_profiler_tests();
+    run_heap_tests();
     
     UNITY_END();
 }
@@ -0,0 +1,105 @@
+#include <unity.h>
+#include "metrics.h"
+#include <string.h>
+
+static void test_metrics_counter_and_gauge(void) {
+    uint32_t cycles = metrics_get(METRIC_RELAY_CYCLES);
+    metrics_inc(METRIC_RELAY_CYCLES);
+    metrics_inc(METRIC_RELAY_CYCLES);
+    TEST_ASSERT_EQUAL_UINT32(cycles + 2, metrics_get(METRIC_RELAY_CYCLES));
+
+    metrics_set(METRIC_HEAP_FREE, 123456);
+    TEST_ASSERT_EQUAL_UINT32(123456, metrics_get(METRIC_HEAP_FREE));
+
+    // Updates of the wrong kind are ignored
+    metrics_inc(METRIC_HEAP_FREE);
+    metrics_set(METRIC_RELAY_CYCLES, 0);
+    TEST_ASSERT_EQUAL_UINT32(123456, metrics_get(METRIC_HEAP_FREE));
+    TEST_ASSERT_EQUAL_UINT32(cycles + 2, metrics_get(METRIC_RELAY_CYCLES));
+}
+
+static void test_metrics_histogram_buckets(void) {
+    metrics_histogram_t before, after;
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_read_histogram(METRIC_ONEWIRE_TRANSACTION_DURATION, &before));
+
+    // Upper bounds are inclusive: 7500 lands in le="0.0075", 200 ms only in +Inf
+    metrics_observe(METRIC_ONEWIRE_TRANSACTION_DURATION, 7500);
+    metrics_observe(METRIC_ONEWIRE_TRANSACTION_DURATION, 7501);
+    metrics_observe(METRIC_ONEWIRE_TRANSACTION_DURATION, 200000);
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_read_histogram(METRIC_ONEWIRE_TRANSACTION_DURATION, &after));
+
+    TEST_ASSERT_EQUAL_UINT32(before.count + 3, after.count);
+    TEST_ASSERT_EQUAL_UINT32(before.buckets[2] + 1, after.buckets[2]);
+    TEST_ASSERT_EQUAL_UINT32(before.buckets[3] + 1, after.buckets[3]);
+    TEST_ASSERT_EQUAL_UINT32(before.buckets[8] + 1, after.buckets[8]);
+    TEST_ASSERT_TRUE(after.sum_us == before.sum_us + 215001);
+}
+
+static void test_metrics_register_series(void) {
+    metrics_series_t a, b, again;
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_register_series(METRIC_HTTP_REQUEST_DURATION, "uri=\"/a\"", &a));
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_register_series(METRIC_HTTP_REQUEST_DURATION, "uri=\"/b\"", &b));
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_register_series(METRIC_HTTP_REQUEST_DURATION, "uri=\"/a\"", &again));
+    TEST_ASSERT_NOT_EQUAL(a, b);
+    TEST_ASSERT_EQUAL(a, again);
+
+    metrics_histogram_t before, after;
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_read_series(b, &before));
+    metrics_observe_series(b, 3000);
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_read_series(b, &after));
+    TEST_ASSERT_EQUAL_UINT32(before.buckets[1] + 1, after.buckets[1]);
+
+    // Only labelled histograms take series, and unlabelled observations skip them
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, metrics_register_series(METRIC_CONTROL_JITTER, "x=\"1\"", &a));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, metrics_register_series(METRIC_RELAY_CYCLES, "x=\"1\"", &a));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, metrics_read_histogram(METRIC_HTTP_REQUEST_DURATION, &after));
+}
+
+static void render_all(char *out, size_t size, size_t chunk, size_t *total_out) {
+    char buf[1024];
+    metrics_cursor_t cursor = {0};
+    size_t total = 0;
+    size_t len;
+    while ((len = metrics_render(&cursor, buf, chunk)) > 0) {
+        TEST_ASSERT_TRUE(total + len < size);
+        TEST_ASSERT_EQUAL('\n', buf[len - 1]);
+        memcpy(out + total, buf, len);
+        total += len;
+    }
+    out[total] = '\0';
+    *total_out = total;
+}
+
+static void test_metrics_render(void) {
+    static char full[24576];
+    static char chunked[24576];
+    metrics_series_t series;
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_register_series(METRIC_HTTP_REQUEST_DURATION,
+                                                      "uri=\"/render\",method=\"GET\"", &series));
+    metrics_observe_series(series, 750000);
+    metrics_set(METRIC_HEAP_MIN_FREE, 4096);
+
+    size_t full_len, chunked_len;
+    render_all(full, sizeof(full), 1024, &full_len);
+    render_all(chunked, sizeof(chunked), METRICS_RENDER_MIN, &chunked_len);
+    TEST_ASSERT_EQUAL(full_len, chunked_len);
+    TEST_ASSERT_EQUAL_STRING(full, chunked);
+
+    TEST_ASSERT_NOT_NULL(strstr(full, "# TYPE teapot_relay_cycles_total counter\n"));
+    TEST_ASSERT_NOT_NULL(strstr(full, "\nteapot_heap_min_free_bytes 4096\n"));
+    TEST_ASSERT_NOT_NULL(strstr(full, "\nteapot_http_request_duration_seconds_bucket"
+                                      "{uri=\"/render\",method=\"GET\",le=\"0.5\"} 0\n"));
+    TEST_ASSERT_NOT_NULL(strstr(full, "\nteapot_http_request_duration_seconds_bucket"
+                                      "{uri=\"/render\",method=\"GET\",le=\"1\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(full, "\nteapot_http_request_duration_seconds_sum"
+                                      "{uri=\"/render\",method=\"GET\"} 0.75\n"));
+    TEST_ASSERT_NOT_NULL(strstr(full, "\nteapot_temp_conversion_duration_seconds_bucket{le=\"+Inf\"} "));
+    TEST_ASSERT_NOT_NULL(strstr(full, "\nteapot_control_period_jitter_seconds_count "));
+}
+
+void run_metrics_tests(void) {
+    RUN_TEST(test_metrics_counter_and_gauge);
+    RUN_TEST(test_metrics_histogram_buckets);
+    RUN_TEST(test_metrics_register_series);
+    RUN_TEST(test_metrics_render);
+}
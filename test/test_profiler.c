@@ -0,0 +1,96 @@
+#include <unity.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "profiler.h"
+#include <stdbool.h>
+#include <string.h>
+
+static profiler_pc_table_t table;
+
+static void test_profiler_pc_counts_per_pc(void) {
+    profiler_pc_clear(&table);
+    profiler_pc_record(&table, 0x42001000);
+    profiler_pc_record(&table, 0x42001000);
+    profiler_pc_record(&table, 0x42002002);
+    profiler_pc_record(&table, 0);
+
+    profiler_pc_bin_t bins[4];
+    size_t index = 0;
+    size_t count = profiler_pc_read(&table, &index, bins, 4);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(PROFILER_PC_BINS, index);
+    uint32_t hits_1000 = bins[0].pc == 0x42001000 ? bins[0].count : bins[1].count;
+    uint32_t hits_2002 = bins[0].pc == 0x42002002 ? bins[0].count : bins[1].count;
+    TEST_ASSERT_EQUAL_UINT32(2, hits_1000);
+    TEST_ASSERT_EQUAL_UINT32(1, hits_2002);
+
+    // The ISR sample is counted but has no bin
+    TEST_ASSERT_EQUAL_UINT32(4, table.samples);
+    TEST_ASSERT_EQUAL_UINT32(1, table.isr_samples);
+    TEST_ASSERT_EQUAL_UINT32(0, table.dropped);
+}
+
+static void test_profiler_pc_drops_when_full(void) {
+    profiler_pc_clear(&table);
+    for (uint32_t i = 0; i < PROFILER_PC_BINS + 10; i++) {
+        profiler_pc_record(&table, 0x42000000 + 4 * i);
+    }
+
+    profiler_pc_bin_t bins[16];
+    size_t index = 0;
+    size_t total = 0;
+    size_t count;
+    while ((count = profiler_pc_read(&table, &index, bins, 16)) > 0) {
+        total += count;
+    }
+    TEST_ASSERT_TRUE(total <= PROFILER_PC_BINS);
+    TEST_ASSERT_EQUAL_UINT32(PROFILER_PC_BINS + 10, total + table.dropped);
+}
+
+static void test_profiler_cpu_centi(void) {
+    TEST_ASSERT_EQUAL_UINT32(2500, profiler_cpu_centi(250, 1000));
+    TEST_ASSERT_EQUAL_UINT32(1, profiler_cpu_centi(1, 10000));
+    TEST_ASSERT_EQUAL_UINT32(10000, profiler_cpu_centi(1200, 1000));
+    TEST_ASSERT_EQUAL_UINT32(0, profiler_cpu_centi(5, 0));
+    // Deltas close to the 32-bit counter range must not overflow
+    TEST_ASSERT_EQUAL_UINT32(5000, profiler_cpu_centi(0x7fffffffu, 0xfffffffeu));
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static void test_profiler_reports_current_task(void) {
+    esp_err_t ret = profiler_start();
+    TEST_ASSERT_TRUE(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE);
+    vTaskDelay(pdMS_TO_TICKS(50));
+
+    static profiler_task_t tasks[PROFILER_MAX_TASKS];
+    size_t count;
+    uint32_t window_us;
+    TEST_ASSERT_EQUAL(ESP_OK, profiler_get_tasks(tasks, PROFILER_MAX_TASKS, &count, &window_us));
+    TEST_ASSERT_TRUE(window_us > 0);
+
+    const char *self = pcTaskGetName(NULL);
+    uint32_t cpu_sum = 0;
+    bool found = false;
+    for (size_t i = 0; i < count; i++) {
+        cpu_sum += tasks[i].cpu_centi;
+        if (strcmp(tasks[i].name, self) == 0) {
+            found = true;
+            TEST_ASSERT_EQUAL_STRING("running", profiler_task_state_name(tasks[i].state));
+            TEST_ASSERT_TRUE(tasks[i].stack_free_min > 0);
+        }
+    }
+    TEST_ASSERT_TRUE(found);
+    // Rounding down per task can only lose a little
+    TEST_ASSERT_TRUE(cpu_sum <= 10000 && cpu_sum + count >= 9900);
+}
+#endif
+
+void run_profiler_tests(void) {
+    RUN_TEST(test_profiler_pc_counts_per_pc);
+    RUN_TEST(test_profiler_pc_drops_when_full);
+    RUN_TEST(test_profiler_cpu_centi);
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    RUN_TEST(test_profiler_reports_current_task);
+#endif
+}
@@ -0,0 +1,89 @@
+#include <unity.h>
+#include "sample_log_codec.h"
+#include <string.h>
+
+static void test_sample_log_codec_round_trip(void) {
+    const sample_log_record_t records[] = {
+        { .uptime_ms = 1000, .type = SAMPLE_LOG_REC_RELAY_ON },
+        { .uptime_ms = 1000, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = 2150 },
+        { .uptime_ms = 3750, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = 2162 },
+        { .uptime_ms = 6500, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = -40 },
+        { .uptime_ms = 6500, .type = SAMPLE_LOG_REC_RELAY_OFF },
+        { .uptime_ms = 4000000000u, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = INT16_MAX },
+    };
+    const size_t count = sizeof(records) / sizeof(records[0]);
+
+    uint8_t buf[64];
+    sample_log_encoder_t enc;
+    sample_log_encoder_init(&enc, buf, sizeof(buf), 1000);
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_TRUE(sample_log_encode(&enc, &records[i]));
+    }
+
+    sample_log_decoder_t dec;
+    sample_log_decoder_init(&dec, buf, enc.len, 1000);
+    for (size_t i = 0; i < count; i++) {
+        sample_log_record_t rec;
+        TEST_ASSERT_EQUAL(ESP_OK, sample_log_decode(&dec, &rec));
+        TEST_ASSERT_EQUAL(records[i].uptime_ms, rec.uptime_ms);
+        TEST_ASSERT_EQUAL(records[i].type, rec.type);
+        TEST_ASSERT_EQUAL(records[i].temp_centi, rec.temp_centi);
+    }
+    sample_log_record_t rec;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, sample_log_decode(&dec, &rec));
+}
+
+static void test_sample_log_codec_is_compact(void) {
+    // A steady 2.75 s sample with a small temperature change costs 3 bytes
+    uint8_t buf[16];
+    sample_log_encoder_t enc;
+    sample_log_encoder_init(&enc, buf, sizeof(buf), 0);
+    sample_log_record_t first = { .uptime_ms = 0, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = 0 };
+    sample_log_record_t next = { .uptime_ms = 2750, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = 12 };
+    TEST_ASSERT_TRUE(sample_log_encode(&enc, &first));
+    size_t before = enc.len;
+    TEST_ASSERT_TRUE(sample_log_encode(&enc, &next));
+    TEST_ASSERT_EQUAL(3, enc.len - before);
+}
+
+static void test_sample_log_codec_full_page(void) {
+    uint8_t buf[4];
+    sample_log_encoder_t enc;
+    sample_log_encoder_init(&enc, buf, sizeof(buf), 0);
+    sample_log_record_t rec = { .uptime_ms = 2750, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = 5000 };
+    TEST_ASSERT_TRUE(sample_log_encode(&enc, &rec));
+    size_t len = enc.len;
+    rec.uptime_ms += 2750;
+    TEST_ASSERT_FALSE(sample_log_encode(&enc, &rec));
+    TEST_ASSERT_EQUAL(len, enc.len);
+}
+
+static void test_sample_log_codec_rejects_truncated(void) {
+    const uint8_t truncated[] = { 0x80 };
+    const uint8_t bad_type[] = { 0x03 };
+    sample_log_decoder_t dec;
+    sample_log_record_t rec;
+    sample_log_decoder_init(&dec, truncated, sizeof(truncated), 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, sample_log_decode(&dec, &rec));
+    sample_log_decoder_init(&dec, bad_type, sizeof(bad_type), 0);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, sample_log_decode(&dec, &rec));
+}
+
+static void test_sample_log_format_csv(void) {
+    char line[64];
+    sample_log_record_t sample = { .uptime_ms = 123456, .type = SAMPLE_LOG_REC_SAMPLE, .temp_centi = -105 };
+    sample_log_record_t relay = { .uptime_ms = 123456, .type = SAMPLE_LOG_REC_RELAY_ON };
+    TEST_ASSERT_EQUAL(strlen("3,123456,sample,-1.05,\n"), sample_log_format_csv(3, &sample, line, sizeof(line)));
+    TEST_ASSERT_EQUAL_STRING("3,123456,sample,-1.05,\n", line);
+    sample_log_format_csv(3, &relay, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("3,123456,relay,,1\n", line);
+    TEST_ASSERT_EQUAL(0, sample_log_format_csv(3, &relay, line, 8));
+}
+
+void run_sample_log_codec_tests(void) {
+    RUN_TEST(test_sample_log_codec_round_trip);
+    RUN_TEST(test_sample_log_codec_is_compact);
+    RUN_TEST(test_sample_log_codec_full_page);
+    RUN_TEST(test_sample_log_codec_rejects_truncated);
+    RUN_TEST(test_sample_log_format_csv);
+}
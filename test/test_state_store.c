@@ -0,0 +1,51 @@
+#include <unity.h>
+#include "state_store.h"
+#include <string.h>
+
+static void test_state_store_round_trip(void) {
+    teapot_state_t state = { .is_on = true, .setpoint_temp = 72.5f, .current_temp = 40.0f };
+    state_store_record_t record;
+    state_store_encode(&state, &record);
+    TEST_ASSERT_EQUAL(STATE_STORE_RECORD_VERSION, record.version);
+    TEST_ASSERT_EQUAL(4, sizeof(record));
+
+    teapot_state_update_t update;
+    TEST_ASSERT_EQUAL(ESP_OK, state_store_decode(&record, &update));
+    TEST_ASSERT_EQUAL(WIFI_WEB_UPDATE_IS_ON | WIFI_WEB_UPDATE_SETPOINT, update.fields);
+    TEST_ASSERT_TRUE(update.is_on);
+    TEST_ASSERT_EQUAL_FLOAT(72.5f, update.setpoint_temp);
+}
+
+static void test_state_store_ignores_temperature(void) {
+    teapot_state_t a = { .is_on = false, .setpoint_temp = 85.0f, .current_temp = 20.0f };
+    teapot_state_t b = a;
+    b.current_temp = 95.0f;
+    state_store_record_t ra, rb;
+    state_store_encode(&a, &ra);
+    state_store_encode(&b, &rb);
+    TEST_ASSERT_EQUAL_MEMORY(&ra, &rb, sizeof(ra));
+}
+
+static void test_state_store_rejects_bad_records(void) {
+    teapot_state_t state = { .is_on = false, .setpoint_temp = 85.0f };
+    state_store_record_t record;
+    teapot_state_update_t update;
+
+    state_store_encode(&state, &record);
+    record.version = STATE_STORE_RECORD_VERSION + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, state_store_decode(&record, &update));
+
+    state_store_encode(&state, &record);
+    record.setpoint_centi = (int16_t)(CONFIG_TEMP_MAX * 100) + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, state_store_decode(&record, &update));
+
+    state_store_encode(&state, &record);
+    record.flags = 0x80;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, state_store_decode(&record, &update));
+}
+
+void run_state_store_tests(void) {
+    RUN_TEST(test_state_store_round_trip);
+    RUN_TEST(test_state_store_ignores_temperature);
+    RUN_TEST(test_state_store_rejects_bad_records);
+}
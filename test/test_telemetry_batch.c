@@ -0,0 +1,86 @@
+#include <unity.h>
+#include "telemetry_batch.h"
+#include <string.h>
+
+static telemetry_queue_t queue;
+
+static telemetry_sample_t make_sample(uint32_t uptime_ms, int16_t temp_centi, uint8_t flags) {
+    telemetry_sample_t sample = { .uptime_ms = uptime_ms, .temp_centi = temp_centi, .flags = flags };
+    return sample;
+}
+
+static void test_telemetry_batch_encode(void) {
+    telemetry_sample_t samples[] = {
+        make_sample(100000, 2150, TELEMETRY_SAMPLE_IS_ON | TELEMETRY_SAMPLE_RELAY),
+        make_sample(102000, -5, 0),
+        make_sample(104000, 9907, TELEMETRY_SAMPLE_IS_ON),
+    };
+    char buf[TELEMETRY_BATCH_BUF_SIZE];
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_batch_encode(samples, 3, 2, buf, sizeof(buf), &len));
+    buf[len] = '\0';
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"t0\":100000,\"dropped\":2,\"samples\":[[0,21.50,1,1],[2000,-0.05,0,0],[4000,99.07,1,0]]}", buf);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, telemetry_batch_encode(samples, 3, 0, buf, 40, &len));
+}
+
+static void test_telemetry_batch_worst_case_fits(void) {
+    telemetry_sample_t samples[TELEMETRY_BATCH_MAX_SAMPLES];
+    for (size_t i = 0; i < TELEMETRY_BATCH_MAX_SAMPLES; i++) {
+        // Largest possible delta and temperature in every entry
+        samples[i] = make_sample(i == 0 ? 1 : 0, INT16_MIN, TELEMETRY_SAMPLE_IS_ON | TELEMETRY_SAMPLE_RELAY);
+    }
+    static char buf[TELEMETRY_BATCH_BUF_SIZE];
+    size_t len;
+    TEST_ASSERT_EQUAL(ESP_OK, telemetry_batch_encode(samples, TELEMETRY_BATCH_MAX_SAMPLES, UINT32_MAX,
+                                                     buf, sizeof(buf), &len));
+}
+
+static void test_telemetry_queue_overwrites_oldest(void) {
+    telemetry_queue_init(&queue);
+    for (uint32_t i = 0; i < TELEMETRY_QUEUE_CAPACITY + 3; i++) {
+        telemetry_sample_t sample = make_sample(i, 0, 0);
+        telemetry_queue_push(&queue, &sample);
+    }
+    TEST_ASSERT_EQUAL(TELEMETRY_QUEUE_CAPACITY, queue.count);
+    TEST_ASSERT_EQUAL(3, queue.dropped);
+
+    telemetry_sample_t out[4];
+    uint32_t first_seq;
+    TEST_ASSERT_EQUAL(4, telemetry_queue_peek(&queue, out, 4, &first_seq));
+    TEST_ASSERT_EQUAL(3, first_seq);
+    TEST_ASSERT_EQUAL(3, out[0].uptime_ms);
+    TEST_ASSERT_EQUAL(6, out[3].uptime_ms);
+}
+
+static void test_telemetry_queue_release_after_wrap(void) {
+    telemetry_queue_init(&queue);
+    for (uint32_t i = 0; i < 10; i++) {
+        telemetry_sample_t sample = make_sample(i, 0, 0);
+        telemetry_queue_push(&queue, &sample);
+    }
+
+    telemetry_sample_t out[4];
+    uint32_t first_seq;
+    size_t n = telemetry_queue_peek(&queue, out, 4, &first_seq);
+
+    // While the batch is being published the queue overflows past it
+    for (uint32_t i = 10; i < TELEMETRY_QUEUE_CAPACITY + 6; i++) {
+        telemetry_sample_t sample = make_sample(i, 0, 0);
+        telemetry_queue_push(&queue, &sample);
+    }
+    telemetry_queue_release(&queue, first_seq + (uint32_t)n);
+
+    // The overwritten batch is gone, nothing newer was released with it
+    TEST_ASSERT_EQUAL(TELEMETRY_QUEUE_CAPACITY, queue.count);
+    TEST_ASSERT_EQUAL(1, telemetry_queue_peek(&queue, out, 1, &first_seq));
+    TEST_ASSERT_EQUAL(6, out[0].uptime_ms);
+}
+
+void run_telemetry_batch_tests(void) {
+    RUN_TEST(test_telemetry_batch_encode);
+    RUN_TEST(test_telemetry_batch_worst_case_fits);
+    RUN_TEST(test_telemetry_queue_overwrites_oldest);
+    RUN_TEST(test_telemetry_queue_release_after_wrap);
+}
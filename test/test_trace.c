@@ -0,0 +1,70 @@
+#include <unity.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "trace.h"
+#include <string.h>
+
+static void test_trace_record_and_read(void) {
+    uint32_t start = trace_next_seq();
+    trace_record(TRACE_EV_TEMP_SAMPLE, 4250, 0, 0);
+    trace_record(TRACE_EV_RELAY_ON, 2, 0, 0);
+
+    trace_event_t events[4];
+    uint32_t next;
+    size_t count = trace_read(start, events, 4, &next);
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL(start + 2, next);
+    TEST_ASSERT_EQUAL(TRACE_EV_TEMP_SAMPLE, events[0].id);
+    TEST_ASSERT_EQUAL(4250, events[0].args[0]);
+    TEST_ASSERT_EQUAL(start + 1, events[0].seq);
+    TEST_ASSERT_EQUAL(TRACE_EV_RELAY_ON, events[1].id);
+    TEST_ASSERT_EQUAL(2, events[1].args[0]);
+}
+
+static void test_trace_read_nothing_new(void) {
+    trace_record(TRACE_EV_POWER_SET, 1, 0, 0);
+    uint32_t head = trace_next_seq();
+
+    trace_event_t event;
+    uint32_t next;
+    TEST_ASSERT_EQUAL(0, trace_read(head, &event, 1, &next));
+    TEST_ASSERT_EQUAL(head, next);
+}
+
+static void test_trace_overwrites_oldest(void) {
+    uint32_t start = trace_next_seq();
+    for (int i = 0; i < TRACE_RING_SIZE + 10; i++) {
+        trace_record(TRACE_EV_TEMP_SAMPLE, i, 0, 0);
+    }
+
+    trace_event_t event;
+    uint32_t next;
+    TEST_ASSERT_EQUAL(1, trace_read(start, &event, 1, &next));
+    TEST_ASSERT_EQUAL(10, event.args[0]);
+    TEST_ASSERT_EQUAL(start + 11, next);
+}
+
+static void test_trace_format_event(void) {
+    trace_event_t event = {
+        .seq = 6,
+        .timestamp_us = 1000,
+        .id = TRACE_EV_CONTROL_AUTO,
+        .args = {1, 4505, -250}
+    };
+    char line[96];
+    trace_format_event(&event, line, sizeof(line));
+    TEST_ASSERT_EQUAL_STRING("5 1000 CONTROL_AUTO relay=ON temp=45.05 setpoint=-2.50", line);
+}
+
+static void test_trace_event_name_unknown(void) {
+    TEST_ASSERT_EQUAL_STRING("UNKNOWN", trace_event_name(TRACE_EV_MAX));
+    TEST_ASSERT_EQUAL_STRING("RELAY_OFF", trace_event_name(TRACE_EV_RELAY_OFF));
+}
+
+void run_trace_tests(void) {
+    RUN_TEST(test_trace_record_and_read);
+    RUN_TEST(test_trace_read_nothing_new);
+    RUN_TEST(test_trace_overwrites_oldest);
+    RUN_TEST(test_trace_format_event);
+    RUN_TEST(test_trace_event_name_unknown);
+}
@@ -0,0 +1,159 @@
+#include <unity.h>
+#include "web_storage.h"
+#include "web_storage_cache.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+static void test_web_storage_cache_hit_and_miss(void) {
+    static web_storage_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    TEST_ASSERT_NULL(web_storage_cache_get(&cache, "/index.html"));
+
+    web_storage_cache_entry_t *entry = web_storage_cache_insert(&cache, "/index.html", 3);
+    TEST_ASSERT_NOT_NULL(entry);
+    memcpy(entry->data, "abc", 3);
+    TEST_ASSERT_EQUAL_PTR(entry, web_storage_cache_get(&cache, "/index.html"));
+    TEST_ASSERT_NULL(web_storage_cache_get(&cache, "/app.js"));
+    TEST_ASSERT_EQUAL(1, cache.hits);
+    TEST_ASSERT_EQUAL(2, cache.misses);
+    TEST_ASSERT_EQUAL(3, cache.bytes);
+
+    // Too large for the cache: streamed instead
+    TEST_ASSERT_NULL(web_storage_cache_insert(&cache, "/big.bin", WEB_STORAGE_CACHE_FILE_MAX + 1));
+
+    web_storage_cache_clear(&cache);
+    TEST_ASSERT_EQUAL(0, cache.bytes);
+    TEST_ASSERT_NULL(web_storage_cache_get(&cache, "/index.html"));
+}
+
+static void test_web_storage_cache_evicts_lru(void) {
+    static web_storage_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    char path[16];
+    for (int i = 0; i < WEB_STORAGE_CACHE_SLOTS; i++) {
+        snprintf(path, sizeof(path), "/f%d", i);
+        TEST_ASSERT_NOT_NULL(web_storage_cache_insert(&cache, path, 16));
+    }
+    // /f0 is used again, so /f1 is the least recently used
+    TEST_ASSERT_NOT_NULL(web_storage_cache_get(&cache, "/f0"));
+    TEST_ASSERT_NOT_NULL(web_storage_cache_insert(&cache, "/new", 16));
+    TEST_ASSERT_NULL(web_storage_cache_get(&cache, "/f1"));
+    TEST_ASSERT_NOT_NULL(web_storage_cache_get(&cache, "/f0"));
+
+    // The byte budget evicts as well, but never a referenced entry
+    web_storage_cache_entry_t *pinned = web_storage_cache_get(&cache, "/f2");
+    pinned->refs++;
+    web_storage_cache_entry_t *large = web_storage_cache_insert(&cache, "/large", WEB_STORAGE_CACHE_FILE_MAX);
+    TEST_ASSERT_NOT_NULL(large);
+    TEST_ASSERT_EQUAL_PTR(pinned, web_storage_cache_get(&cache, "/f2"));
+    TEST_ASSERT_TRUE(cache.bytes <= WEB_STORAGE_CACHE_BYTES_MAX);
+
+    pinned->refs--;
+    web_storage_cache_clear(&cache);
+}
+
+static void test_web_storage_cache_full_of_referenced(void) {
+    static web_storage_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    char path[16];
+    for (int i = 0; i < WEB_STORAGE_CACHE_SLOTS; i++) {
+        snprintf(path, sizeof(path), "/f%d", i);
+        web_storage_cache_entry_t *entry = web_storage_cache_insert(&cache, path, 1);
+        TEST_ASSERT_NOT_NULL(entry);
+        entry->refs = 1;
+    }
+    TEST_ASSERT_NULL(web_storage_cache_insert(&cache, "/other", 1));
+    for (int i = 0; i < WEB_STORAGE_CACHE_SLOTS; i++) {
+        cache.entries[i].refs = 0;
+    }
+    web_storage_cache_clear(&cache);
+}
+
+static void test_web_storage_cache_reuses_arena_gaps(void) {
+    static web_storage_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    const size_t third = WEB_STORAGE_CACHE_BYTES_MAX / 3;
+    web_storage_cache_entry_t *a = web_storage_cache_insert(&cache, "/a", third);
+    web_storage_cache_entry_t *b = web_storage_cache_insert(&cache, "/b", third);
+    web_storage_cache_entry_t *c = web_storage_cache_insert(&cache, "/c", third);
+    TEST_ASSERT_NOT_NULL(c);
+    TEST_ASSERT_EQUAL_PTR(cache.arena, a->data);
+    TEST_ASSERT_EQUAL_PTR(cache.arena + third, b->data);
+
+    // /b is evicted and the new file takes the front of its range
+    web_storage_cache_get(&cache, "/a");
+    web_storage_cache_get(&cache, "/c");
+    web_storage_cache_entry_t *d = web_storage_cache_insert(&cache, "/d", third / 2);
+    TEST_ASSERT_NOT_NULL(d);
+    TEST_ASSERT_EQUAL_PTR(cache.arena + third, d->data);
+    TEST_ASSERT_NULL(web_storage_cache_get(&cache, "/b"));
+
+    // Enough bytes are free in total but not in one piece, so /a goes as well
+    web_storage_cache_entry_t *e = web_storage_cache_insert(&cache, "/e", third);
+    TEST_ASSERT_NOT_NULL(e);
+    TEST_ASSERT_EQUAL_PTR(cache.arena, e->data);
+    TEST_ASSERT_NULL(web_storage_cache_get(&cache, "/a"));
+    TEST_ASSERT_NOT_NULL(web_storage_cache_get(&cache, "/d"));
+
+    web_storage_cache_clear(&cache);
+    TEST_ASSERT_EQUAL(0, cache.bytes);
+}
+
+// Time from request to the first byte of /index.html
+static int64_t first_byte_us(void) {
+    int64_t start = esp_timer_get_time();
+    web_storage_file_t file;
+    TEST_ASSERT_EQUAL(ESP_OK, web_storage_open("/index.html", &file));
+    char byte;
+    TEST_ASSERT_EQUAL(1, web_storage_read(&file, &byte, 1));
+    int64_t elapsed = esp_timer_get_time() - start;
+    web_storage_close(&file);
+    return elapsed;
+}
+
+// Mount and first-byte latency of the file system chosen in menuconfig. Only that backend
+// is measured: comparing LittleFS with SPIFFS needs a second build environment with the
+// other CONFIG_WEB_STORAGE_* choice and a partition image built for it.
+// The timings are printed for reading, not asserted: a single sample on a busy bus is too
+// noisy to gate on, so the test only checks that the second open hit the cache.
+static void test_web_storage_benchmark(void) {
+    web_storage_unmount();
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = web_storage_mount();
+    int64_t mount_us = esp_timer_get_time() - start;
+    if (ret == ESP_ERR_NOT_FOUND) {
+        TEST_IGNORE_MESSAGE("web_storage partition not found in test environment");
+        return;
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, ret);
+
+    web_storage_file_t file;
+    if (web_storage_open("/index.html", &file) != ESP_OK) {
+        TEST_IGNORE_MESSAGE("Web storage image not flashed, skipping benchmark");
+        return;
+    }
+    web_storage_close(&file);
+    // Remount so the first open below goes to flash
+    TEST_ASSERT_EQUAL(ESP_OK, web_storage_mount());
+
+    int64_t uncached_us = first_byte_us();
+    int64_t cached_us = first_byte_us();
+    uint32_t hits, misses;
+    web_storage_get_cache_stats(&hits, &misses);
+    TEST_ASSERT_EQUAL(1, hits);
+    TEST_ASSERT_EQUAL(1, misses);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s: mount %lld us, first byte %lld us uncached, %lld us cached",
+             web_storage_backend_name(), (long long)mount_us, (long long)uncached_us, (long long)cached_us);
+    TEST_MESSAGE(msg);
+}
+
+void run_web_storage_tests(void) {
+    RUN_TEST(test_web_storage_cache_hit_and_miss);
+    RUN_TEST(test_web_storage_cache_evicts_lru);
+    RUN_TEST(test_web_storage_cache_full_of_referenced);
+    RUN_TEST(test_web_storage_cache_reuses_arena_gaps);
+    RUN_TEST(test_web_storage_benchmark);
+}
@@ -2,6 +2,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "wifi_web.h"
+#include "web_storage.h"
 #include "config.h"
 #include <string.h>
 #include <stdio.h>
@@ -212,39 +213,84 @@ static void test_wifi_web_power_toggle(void) {
     TEST_ASSERT_TRUE(ctx.state.is_on);
 }
 
+static void test_wifi_web_state_version_bumps_on_change(void) {
+    init_test_config();
+    wifi_web_init_ctx(&ctx, &config);
+    TEST_ASSERT_EQUAL(0, ctx.state_version);
+    
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_set_power(&ctx, true));
+    TEST_ASSERT_EQUAL(1, ctx.state_version);
+    
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_set_setpoint(&ctx, 60.0f));
+    TEST_ASSERT_EQUAL(2, ctx.state_version);
+    
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_set_current_temp(&ctx, 30.0f));
+    TEST_ASSERT_EQUAL(3, ctx.state_version);
+    
+    // Same temperature again is not a change
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_set_current_temp(&ctx, 30.0f));
+    TEST_ASSERT_EQUAL(3, ctx.state_version);
+    
+    // Rejected setpoint leaves the version alone
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, wifi_web_set_setpoint(&ctx, CONFIG_TEMP_MAX + 1.0f));
+    TEST_ASSERT_EQUAL(3, ctx.state_version);
+}
+
+static void test_wifi_web_apply_update_is_all_or_nothing(void) {
+    init_test_config();
+    wifi_web_init_ctx(&ctx, &config);
+    
+    teapot_state_update_t update = {
+        .fields = WIFI_WEB_UPDATE_IS_ON | WIFI_WEB_UPDATE_SETPOINT,
+        .is_on = true,
+        .setpoint_temp = 65.0f
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, wifi_web_apply_update(&ctx, &update));
+    TEST_ASSERT_TRUE(ctx.state.is_on);
+    TEST_ASSERT_EQUAL_FLOAT(65.0f, ctx.state.setpoint_temp);
+    TEST_ASSERT_EQUAL(1, ctx.state_version);
+    
+    // An invalid setpoint rejects the whole update, power included
+    update.is_on = false;
+    update.setpoint_temp = CONFIG_TEMP_MAX + 1.0f;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, wifi_web_apply_update(&ctx, &update));
+    TEST_ASSERT_TRUE(ctx.state.is_on);
+    TEST_ASSERT_EQUAL_FLOAT(65.0f, ctx.state.setpoint_temp);
+    TEST_ASSERT_EQUAL(1, ctx.state_version);
+}
 
-static void test_wifi_web_spiffs_init(void) {
-    esp_err_t ret = wifi_web_init_spiffs();
+static void test_wifi_web_storage_init(void) {
+    esp_err_t ret = wifi_web_init_storage();
     if (ret == ESP_ERR_NOT_FOUND) {
-        TEST_IGNORE_MESSAGE("SPIFFS partition not found in test environment");
+        TEST_IGNORE_MESSAGE("web_storage partition not found in test environment");
         return;
     }
     TEST_ASSERT_EQUAL(ESP_OK, ret);
 }
 
-static void test_wifi_web_spiffs_file_exists(void) {
-    esp_err_t ret = wifi_web_init_spiffs();
+static void test_wifi_web_storage_file_exists(void) {
+    esp_err_t ret = wifi_web_init_storage();
     if (ret == ESP_ERR_NOT_FOUND) {
-        TEST_IGNORE_MESSAGE("SPIFFS partition not found in test environment");
+        TEST_IGNORE_MESSAGE("web_storage partition not found in test environment");
         return;
     }
     TEST_ASSERT_EQUAL(ESP_OK, ret);
     
-    FILE *file = fopen("/spiffs/index.html", "r");
+    FILE *file = fopen(WEB_STORAGE_BASE_PATH "/index.html", "r");
     if (file == NULL) {
-        TEST_IGNORE_MESSAGE("SPIFFS image not flashed, skipping HTML file test");
+        TEST_IGNORE_MESSAGE("Web storage image not flashed, skipping HTML file test");
         return;
     }
     fclose(file);
     TEST_PASS();
 }
 
-static void test_wifi_web_spiffs_file_content(void) {
-    esp_err_t ret = wifi_web_init_spiffs();
+static void test_wifi_web_storage_file_content(void) {
+    esp_err_t ret = wifi_web_init_storage();
     TEST_ASSERT_EQUAL(ESP_OK, ret);
     
-    FILE *file = fopen("/spiffs/index.html", "r");
-    TEST_ASSERT_NOT_NULL_MESSAGE(file, "index.html file not found in SPIFFS - SPIFFS image should be loaded from data/ folder during build");
+    FILE *file = fopen(WEB_STORAGE_BASE_PATH "/index.html", "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(file, "index.html file not found in web storage - the image should be built from data/ folder during build");
     
     char buffer[512];
     size_t read_bytes = fread(buffer, 1, sizeof(buffer) - 1, file);
@@ -280,7 +326,9 @@ void run_wifi_web_tests(void) {
     RUN_TEST(test_wifi_web_multiple_setpoint_changes);
     RUN_TEST(test_wifi_web_power_toggle);
     RUN_TEST(test_wifi_web_init_ctx_validates_config);
-    RUN_TEST(test_wifi_web_spiffs_init);
-    RUN_TEST(test_wifi_web_spiffs_file_exists);
-    RUN_TEST(test_wifi_web_spiffs_file_content);
+    RUN_TEST(test_wifi_web_state_version_bumps_on_change);
+    RUN_TEST(test_wifi_web_apply_update_is_all_or_nothing);
+    RUN_TEST(test_wifi_web_storage_init);
+    RUN_TEST(test_wifi_web_storage_file_exists);
+    RUN_TEST(test_wifi_web_storage_file_content);
 }
\ No newline at end of file